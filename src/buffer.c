@@ -0,0 +1,1483 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * buffer.c: A text buffer (the rows of a file) and the operations
+ *           on it: editing, searching, loading and saving.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "buffer.h"
+#include "parallel.h"
+#include "lineindex.h"
+#include "compress.h"
+
+
+/* Mapped buffers (linked through map_next), for the SIGBUS handler */
+static buffer_t *buffer_mapped = NULL;
+
+/* Size of a page, found when the SIGBUS handler is installed */
+static size_t buffer_page_size;
+
+
+/* buffer_handle_sigbus - SIGBUS handler
+ *
+ * Reading a mapping past the end of its file, once the file has been
+ * truncated, raises SIGBUS. If the fault is in a mapped buffer, blank
+ * memory is put in place of the mapping from the faulting page on, so
+ * the read goes on (and reads zeros), and the buffer is marked
+ * truncated. Any other fault kills us, as it would have anyway.
+ */
+static void buffer_handle_sigbus(int sig, siginfo_t *info, void *context)
+{
+    (void)context;
+    const char *addr = info->si_addr;
+    for (buffer_t *b = buffer_mapped; b; b = b->map_next)
+    {
+        if (addr < b->map || addr >= b->map + b->map_len)
+            continue;
+        uintptr_t page = (uintptr_t)addr & ~(uintptr_t)(buffer_page_size - 1);
+        size_t len = (uintptr_t)(b->map + b->map_len) - page;
+        if (mmap((void *)page, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                 -1, 0) == MAP_FAILED)
+            break;
+        b->map_truncated = 1;
+        return;
+    }
+    signal(sig, SIG_DFL);
+}
+
+
+/* buffer_catch_sigbus - Install the SIGBUS handler, if it isn't yet
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int buffer_catch_sigbus()
+{
+    if (buffer_page_size != 0)
+        return 0;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = buffer_handle_sigbus;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGBUS, &sa, NULL) == -1)
+        return -1;
+    buffer_page_size = sysconf(_SC_PAGESIZE);
+    return 0;
+}
+
+
+/* buffer_unlist_mapped - Remove a buffer from the mapped ones */
+static void buffer_unlist_mapped(buffer_t *buf)
+{
+    for (buffer_t **b = &buffer_mapped; *b; b = &(*b)->map_next)
+    {
+        if (*b == buf)
+        {
+            *b = buf->map_next;
+            break;
+        }
+    }
+}
+
+
+/* See buffer.h */
+void buffer_init(buffer_t *buf)
+{
+    buf->rows = NULL;
+    buf->pager = NULL;
+    buf->map = NULL;
+    buf->map_len = 0;
+    buf->line_offsets = NULL;
+    buf->view_next = 0;
+    buf->map_fd = -1;
+    buf->map_valid = 0;
+    buf->map_truncated = 0;
+    buf->map_next = NULL;
+    buf->readonly = 0;
+    buf->num_rows = 0;
+    buf->dirty = 0;
+    memset(&buf->stats, 0, sizeof(buf->stats));
+    buf->filename = NULL;
+    buf->compression = COMPRESS_NONE;
+    buf->syntax = NULL;
+    buf->hl_dirty_from = 0;
+    buf->hl_snapshot_end = 0;
+    buf->hl_version = 0;
+    buf->listeners = NULL;
+    undo_init(&buf->undo);
+    rowmeta_init(&buf->meta);
+}
+
+
+/* buffer_meta - Get the metadata of the rows (see rowmeta.h), laying
+ *               it out again if memory ran out before
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *
+ * Returns: The metadata, or NULL if the buffer isn't entirely in
+ *          memory, or memory could not be allocated
+ */
+static rowmeta_t *buffer_meta(buffer_t *buf)
+{
+    if (buf->pager || buf->line_offsets)
+        return NULL;
+    if (buf->meta.num_rows != buf->num_rows &&
+        rowmeta_build(&buf->meta, buf->rows, buf->num_rows) == -1)
+        return NULL;
+    return &buf->meta;
+}
+
+
+/* buffer_update_meta - Keep the metadata of the rows in step with a
+ *                      change (see buffer_notify)
+ *
+ * Returns: Nothing
+ */
+static void buffer_update_meta(buffer_t *buf, buffer_change_t change, int at, int n)
+{
+    if (buf->pager || buf->line_offsets)
+    {
+        rowmeta_free(&buf->meta);
+        return;
+    }
+
+    switch (change)
+    {
+    case BUFFER_ROW_CHANGED:
+        rowmeta_set(&buf->meta, at, &buf->rows[at]);
+        break;
+
+    case BUFFER_ROWS_INSERTED:
+        rowmeta_insert(&buf->meta, at, &buf->rows[at], n);
+        break;
+
+    case BUFFER_ROWS_DELETED:
+        rowmeta_delete(&buf->meta, at, n);
+        break;
+
+    case BUFFER_RESET:
+        rowmeta_build(&buf->meta, buf->rows, buf->num_rows);
+        break;
+    }
+}
+
+
+/* buffer_notify - Tell the listeners about a change
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - change: Kind of change
+ *  - at: First row affected
+ *  - n: Number of rows affected
+ *
+ * Returns: Nothing
+ */
+static void buffer_notify(buffer_t *buf, buffer_change_t change, int at, int n)
+{
+    buffer_update_meta(buf, change, at, n);
+    for (buffer_listener_t *l = buf->listeners; l; l = l->next)
+        l->changed(l, buf, change, at, n);
+}
+
+
+/* See buffer.h */
+void buffer_add_listener(buffer_t *buf, buffer_listener_t *l)
+{
+    l->next = buf->listeners;
+    buf->listeners = l;
+}
+
+
+/* See buffer.h */
+void buffer_remove_listener(buffer_t *buf, buffer_listener_t *l)
+{
+    for (buffer_listener_t **p = &buf->listeners; *p; p = &(*p)->next)
+    {
+        if (*p == l)
+        {
+            *p = l->next;
+            return;
+        }
+    }
+}
+
+
+/* See buffer.h */
+void buffer_free(buffer_t *buf)
+{
+    if (buf->pager)
+    {
+        pager_close(buf->pager);
+    }
+    else if (buf->line_offsets)
+    {
+        buffer_unlist_mapped(buf);
+        if (buf->map)
+            munmap((void *)buf->map, buf->map_len);
+        if (buf->map_fd != -1)
+            close(buf->map_fd);
+        free(buf->line_offsets);
+    }
+    else
+    {
+        for (int j = 0; j < buf->num_rows; j++)
+            editor_row_free(&buf->rows[j]);
+        free(buf->rows);
+    }
+    free(buf->filename);
+    undo_free(&buf->undo);
+    rowmeta_free(&buf->meta);
+
+    buffer_listener_t *listeners = buf->listeners;
+    buffer_init(buf);
+    buf->listeners = listeners;
+    buffer_notify(buf, BUFFER_RESET, 0, 0);
+}
+
+
+/* See buffer.h */
+erow_t *buffer_row(buffer_t *buf, int at)
+{
+    if (buf->pager)
+    {
+        erow_t *row = pager_row(buf->pager, at);
+        if (buf->pager->error)
+            buf->readonly = 1;
+        return row;
+    }
+
+    if (buf->line_offsets)
+    {
+        if (buf->map_truncated)
+            buffer_check_mapped(buf);
+
+        /* Lines (or the parts of them) past the end of a truncated
+         * file are empty */
+        erow_t *row = &buf->view_rows[buf->view_next++ % BUFFER_VIEW_ROWS];
+        size_t start = buf->line_offsets[at];
+        size_t len = buf->line_offsets[at + 1] - start - 1;
+        if (start + len > buf->map_valid)
+            len = start < buf->map_valid ? buf->map_valid - start : 0;
+        if (len > 0 && buf->map[start + len - 1] == '\r')
+            len--;
+        row->size = len;
+        row->text.chars = (char *)buf->map + start;
+        row->draw.render = NULL;
+        row->hl = NULL;
+        row->flags = ROW_VIEW;
+        return row;
+    }
+
+    return &buf->rows[at];
+}
+
+
+/* buffer_count_span - Add the counts of part of a row to some counts,
+ *                     or take them away
+ *
+ * Parameters:
+ *  - s: Counts
+ *  - row: The row
+ *  - from, to: Range of bytes of the row
+ *  - sign: 1 to add the counts, -1 to take them away
+ *
+ * Returns: Nothing
+ */
+static void buffer_count_span(stats_t *s, erow_t *row, int from, int to, int sign)
+{
+    stats_t span = {0, 0, 0};
+    int in_word = 0;
+    stats_count(&span, editor_row_chars(row) + from, to - from, &in_word);
+    s->bytes += sign * span.bytes;
+    s->words += sign * span.words;
+    s->chars += sign * span.chars;
+}
+
+
+/* buffer_count_row - Add a row (and its line break) to the counts of
+ *                    the buffer, or take it away
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - row: The row
+ *  - sign: 1 to add the row, -1 to take it away
+ *
+ * Returns: Nothing
+ */
+static void buffer_count_row(buffer_t *buf, erow_t *row, int sign)
+{
+    buffer_count_span(&buf->stats, row, 0, row->size, sign);
+    buf->stats.bytes += sign;
+}
+
+
+/* Part of a row taken out of the counts before it is edited: the
+ * range of bytes, and the size of the row */
+typedef struct buffer_span
+{
+    int from, to;
+    int size;
+} buffer_span_t;
+
+
+/* buffer_uncount - Take the part of a row an edit can change out of
+ *                  some counts, before the edit (see stats_widen)
+ *
+ * Parameters:
+ *  - s: Counts
+ *  - row: The row
+ *  - from, to: Range of bytes to be edited
+ *  - span: Output parameter to return the part taken out (to be put
+ *    back by buffer_recount after the edit)
+ *
+ * Returns: Nothing
+ */
+static void buffer_uncount(stats_t *s, erow_t *row, int from, int to, buffer_span_t *span)
+{
+    span->from = from;
+    span->to = to;
+    span->size = row->size;
+    stats_widen(editor_row_chars(row), row->size, &span->from, &span->to);
+    buffer_count_span(s, row, span->from, span->to, -1);
+}
+
+
+/* buffer_recount - Put the part of a row taken out by buffer_uncount
+ *                  back into the counts, after the edit
+ *
+ * Parameters:
+ *  - s: Counts
+ *  - row: The row
+ *  - span: The part taken out
+ *
+ * Returns: Nothing
+ */
+static void buffer_recount(stats_t *s, erow_t *row, const buffer_span_t *span)
+{
+    buffer_count_span(s, row, span->from, span->to + row->size - span->size, 1);
+}
+
+
+/* buffer_invalidate_highlight - Record that highlighting must be
+ *                               checked again from a given row down
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index
+ *
+ * Returns: Nothing
+ */
+static void buffer_invalidate_highlight(buffer_t *buf, int at)
+{
+    if (at < buf->hl_dirty_from)
+        buf->hl_dirty_from = at;
+    if (at < buf->hl_snapshot_end)
+        buf->hl_version++;
+}
+
+
+/* buffer_row_changed - Record that the contents of a row changed
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index
+ *
+ * Returns: Nothing
+ */
+static void buffer_row_changed(buffer_t *buf, int at)
+{
+    if (buf->pager)
+        pager_row_changed(buf->pager, at);
+    buffer_invalidate_highlight(buf, at);
+    buf->dirty++;
+    buffer_notify(buf, BUFFER_ROW_CHANGED, at, 1);
+}
+
+
+/* buffer_record_row - Record the contents of a row in the undo log,
+ *                     before the row is changed or deleted
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - kind: UNDO_ROW_CHANGED or UNDO_ROW_DELETED
+ *  - row: Row index
+ *  - at: Row index to record (where the row must be put back)
+ *
+ * Returns: Nothing
+ */
+static void buffer_record_row(buffer_t *buf, undo_kind_t kind, int row, int at)
+{
+    if (!buf->undo.open)
+        return;
+
+    /* A row changed several times in a row only needs to be recorded
+     * before the first change */
+    undo_step_t *last = undo_last_step(&buf->undo);
+    if (kind == UNDO_ROW_CHANGED && last && last->kind == UNDO_ROW_CHANGED && last->at == at)
+        return;
+
+    undo_step_t *step = undo_add_step(&buf->undo);
+    if (step == NULL)
+        return;
+    erow_t *r = buffer_row(buf, row);
+    step->kind = kind;
+    step->at = at;
+    step->text = malloc(r->size + 1);
+    if (step->text == NULL)
+    {
+        buf->undo.failed = 1;
+        return;
+    }
+    memcpy(step->text, editor_row_chars(r), r->size);
+    step->len = r->size;
+}
+
+
+/* buffer_record_insert - Record inserted rows in the undo log
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Index of the first row inserted
+ *  - n: Number of rows inserted
+ *
+ * Returns: Nothing
+ */
+static void buffer_record_insert(buffer_t *buf, int at, int n)
+{
+    undo_step_t *step = undo_add_step(&buf->undo);
+    if (step == NULL)
+        return;
+    step->kind = UNDO_ROWS_INSERTED;
+    step->at = at;
+    step->n = n;
+}
+
+
+/* See buffer.h */
+void buffer_insert_row(buffer_t *buf, int at, const char *s, size_t len)
+{
+    if (buf->readonly || at < 0 || at > buf->num_rows)
+        return;
+
+    erow_t row;
+    if (editor_row_init(&row, s, len) == -1)
+        return;
+
+    if (buf->pager)
+    {
+        if (pager_insert_row(buf->pager, at, &row) == -1)
+        {
+            editor_row_free(&row);
+            return;
+        }
+    }
+    else
+    {
+        buf->rows = realloc(buf->rows, sizeof(erow_t) * (buf->num_rows + 1));
+        memmove(&buf->rows[at + 1], &buf->rows[at], sizeof(erow_t) * (buf->num_rows - at));
+        buf->rows[at] = row;
+    }
+    buffer_count_row(buf, &row, 1);
+
+    buf->num_rows++;
+    buffer_record_insert(buf, at, 1);
+    buffer_invalidate_highlight(buf, at);
+    buf->dirty++;
+    buffer_notify(buf, BUFFER_ROWS_INSERTED, at, 1);
+}
+
+
+/* buffer_next_line - Find the next row in text given to
+ *                     buffer_insert_text
+ *
+ * Parameters:
+ *  - t: Start of the row, moved past it
+ *  - end: End of the text
+ *  - counted: Is the text in the format of buffer_insert_counted?
+ *  - len: Set to the length of the row
+ *
+ * Returns: Contents of the row
+ */
+static const char *buffer_next_line(const char **t, const char *end, int counted, size_t *len)
+{
+    const char *s = *t;
+    if (counted)
+    {
+        uint32_t len32;
+        memcpy(&len32, s, 4);
+        *len = len32;
+        *t = s + 4 + len32;
+        return s + 4;
+    }
+
+    const char *eol = memchr(s, '\n', end - s);
+    *len = eol ? (size_t)(eol - s) : (size_t)(end - s);
+    if (*len > 0 && s[*len - 1] == '\r')
+        (*len)--;
+    *t = eol ? eol + 1 : end;
+    return s;
+}
+
+
+/* buffer_insert_text - Insert rows for buffer_insert_lines or
+ *                      buffer_insert_counted
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index to insert the new rows at
+ *  - text: Text to insert
+ *  - len: Length of text
+ *  - n: Number of rows in text
+ *  - counted: Is the text in the format of buffer_insert_counted?
+ *
+ * Returns: Number of rows inserted
+ */
+static int buffer_insert_text(buffer_t *buf, int at, const char *text, size_t len,
+                              int n, int counted)
+{
+    if (!buf->pager)
+    {
+        buf->rows = realloc(buf->rows, sizeof(erow_t) * (buf->num_rows + n));
+        memmove(&buf->rows[at + n], &buf->rows[at], sizeof(erow_t) * (buf->num_rows - at));
+    }
+
+    const char *t = text, *end = text + len;
+    for (int j = 0; j < n; j++)
+    {
+        size_t linelen;
+        const char *line = buffer_next_line(&t, end, counted, &linelen);
+
+        erow_t row;
+        if (editor_row_init(&row, line, linelen) == -1 ||
+            (buf->pager && pager_insert_row(buf->pager, at + j, &row) == -1))
+        {
+            editor_row_free(&row);
+            if (!buf->pager)
+                memmove(&buf->rows[at + j], &buf->rows[at + n], sizeof(erow_t) * (buf->num_rows - at));
+            n = j;
+            break;
+        }
+        if (!buf->pager)
+            buf->rows[at + j] = row;
+        buffer_count_row(buf, &row, 1);
+    }
+    if (n == 0)
+        return 0;
+
+    buf->num_rows += n;
+    buffer_record_insert(buf, at, n);
+    buffer_invalidate_highlight(buf, at);
+    buf->dirty++;
+    buffer_notify(buf, BUFFER_ROWS_INSERTED, at, n);
+    return n;
+}
+
+
+/* See buffer.h */
+int buffer_insert_lines(buffer_t *buf, int at, const char *text, size_t len)
+{
+    if (buf->readonly || at < 0 || at > buf->num_rows || len == 0)
+        return 0;
+
+    int n = 0;
+    for (const char *t = text; (t = memchr(t, '\n', text + len - t)) != NULL; t++)
+        n++;
+    if (text[len - 1] != '\n')
+        n++;
+    return buffer_insert_text(buf, at, text, len, n, 0);
+}
+
+
+/* See buffer.h */
+int buffer_insert_counted(buffer_t *buf, int at, const char *text, size_t len)
+{
+    int n = 0;
+    for (size_t i = 0; i < len; n++)
+    {
+        uint32_t len32 = 0;
+        if (len - i >= 4)
+            memcpy(&len32, text + i, 4);
+        if (len - i < 4 || len32 > len - i - 4 || n == INT_MAX)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        i += 4 + len32;
+    }
+
+    if (buf->readonly || at < 0 || at > buf->num_rows || n == 0)
+        return 0;
+    return buffer_insert_text(buf, at, text, len, n, 1);
+}
+
+
+/* See buffer.h */
+void buffer_delete_row(buffer_t *buf, int at)
+{
+    buffer_delete_rows(buf, at, 1);
+}
+
+
+/* See buffer.h */
+void buffer_delete_rows(buffer_t *buf, int at, int n)
+{
+    if (buf->readonly || at < 0 || n <= 0 || at + n > buf->num_rows)
+        return;
+
+    /* Each row is recorded as deleted at at, so undoing the steps
+     * backwards puts them back in order */
+    for (int i = 0; i < n && buf->undo.open; i++)
+        buffer_record_row(buf, UNDO_ROW_DELETED, at + i, at);
+    for (int i = 0; i < n; i++)
+        buffer_count_row(buf, buffer_row(buf, at + i), -1);
+
+    if (buf->pager)
+    {
+        /* Rows whose block can't be faulted in stay (and saving fails,
+         * see pager_t.error) */
+        int deleted = 0;
+        while (deleted < n && pager_delete_row(buf->pager, at) == 0)
+            deleted++;
+        n = deleted;
+        if (n == 0)
+            return;
+    }
+    else
+    {
+        for (int i = at; i < at + n; i++)
+            editor_row_free(&buf->rows[i]);
+        memmove(&buf->rows[at], &buf->rows[at + n], sizeof(erow_t) * (buf->num_rows - at - n));
+    }
+    buf->num_rows -= n;
+    buffer_invalidate_highlight(buf, at);
+    buf->dirty++;
+    buffer_notify(buf, BUFFER_ROWS_DELETED, at, n);
+}
+
+
+/* buffer_move_rows - Put consecutive rows in a new order
+ *
+ * Parameters:
+ *  - buf: Buffer (not paged)
+ *  - at: Index of the first row
+ *  - n: Number of rows
+ *  - order: The permutation (see buffer_permute_rows)
+ *  - inverse: Undo the permutation instead (moving the row at each
+ *    position back to where order says it came from)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int buffer_move_rows(buffer_t *buf, int at, int n, const int *order, int inverse)
+{
+    erow_t *moved = malloc(sizeof(erow_t) * (n > 0 ? n : 1));
+    if (moved == NULL)
+        return -1;
+    for (int i = 0; i < n; i++)
+    {
+        if (inverse)
+            moved[order[i]] = buf->rows[at + i];
+        else
+            moved[i] = buf->rows[at + order[i]];
+    }
+    memcpy(&buf->rows[at], moved, sizeof(erow_t) * n);
+    free(moved);
+
+    /* To the listeners, the rows are deleted and inserted again (the
+     * rows aren't read when they are deleted) */
+    buffer_invalidate_highlight(buf, at);
+    buf->dirty++;
+    buf->num_rows -= n;
+    buffer_notify(buf, BUFFER_ROWS_DELETED, at, n);
+    buf->num_rows += n;
+    buffer_notify(buf, BUFFER_ROWS_INSERTED, at, n);
+    return 0;
+}
+
+
+/* See buffer.h */
+int buffer_permute_rows(buffer_t *buf, int at, int n, const int *order)
+{
+    if (buf->readonly || buf->pager)
+    {
+        errno = buf->readonly ? EROFS : EINVAL;
+        return -1;
+    }
+    if (at < 0 || n < 0 || at + n > buf->num_rows)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n == 0)
+        return 0;
+
+    int *copy = NULL;
+    if (buf->undo.open)
+    {
+        copy = malloc(sizeof(int) * n);
+        if (copy == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        memcpy(copy, order, sizeof(int) * n);
+    }
+    if (buffer_move_rows(buf, at, n, order, 0) == -1)
+    {
+        free(copy);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (copy)
+    {
+        undo_step_t *step = undo_add_step(&buf->undo);
+        if (step == NULL)
+        {
+            free(copy);
+            return 0;
+        }
+        step->kind = UNDO_ROWS_MOVED;
+        step->at = at;
+        step->n = n;
+        step->text = (char *)copy;
+        step->len = sizeof(int) * n;
+    }
+    return 0;
+}
+
+
+/* buffer_edit_row - Get a row that is about to be changed
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index
+ *
+ * Returns: The row, or NULL if the buffer is read-only (which a paged
+ *          buffer becomes if loading the row fails, see buffer_row)
+ */
+static erow_t *buffer_edit_row(buffer_t *buf, int at)
+{
+    if (buf->readonly)
+        return NULL;
+    erow_t *row = buffer_row(buf, at);
+    return buf->readonly ? NULL : row;
+}
+
+
+/* See buffer.h */
+void buffer_row_insert_char(buffer_t *buf, int row, int at, int c)
+{
+    erow_t *r = buffer_edit_row(buf, row);
+    if (r == NULL)
+        return;
+    buffer_record_row(buf, UNDO_ROW_CHANGED, row, row);
+    if (at < 0 || at > r->size)
+        at = r->size;
+    buffer_span_t span;
+    buffer_uncount(&buf->stats, r, at, at, &span);
+    editor_row_insert_char(r, at, c);
+    buffer_recount(&buf->stats, r, &span);
+    buffer_row_changed(buf, row);
+}
+
+
+/* See buffer.h */
+void buffer_row_delete_char(buffer_t *buf, int row, int at)
+{
+    erow_t *r = buffer_edit_row(buf, row);
+    if (r == NULL)
+        return;
+    buffer_record_row(buf, UNDO_ROW_CHANGED, row, row);
+    buffer_span_t span;
+    buffer_uncount(&buf->stats, r, at, at + 1, &span);
+    editor_row_delete_char(r, at);
+    buffer_recount(&buf->stats, r, &span);
+    buffer_row_changed(buf, row);
+}
+
+
+/* See buffer.h */
+void buffer_row_append_string(buffer_t *buf, int row, const char *s, size_t len)
+{
+    erow_t *r = buffer_edit_row(buf, row);
+    if (r == NULL)
+        return;
+    buffer_record_row(buf, UNDO_ROW_CHANGED, row, row);
+    buffer_span_t span;
+    buffer_uncount(&buf->stats, r, r->size, r->size, &span);
+    editor_row_append_string(r, s, len);
+    buffer_recount(&buf->stats, r, &span);
+    buffer_row_changed(buf, row);
+}
+
+
+/* See buffer.h */
+void buffer_row_truncate(buffer_t *buf, int row, int len)
+{
+    erow_t *r = buffer_edit_row(buf, row);
+    if (r == NULL || len < 0 || len > r->size)
+        return;
+    buffer_record_row(buf, UNDO_ROW_CHANGED, row, row);
+    buffer_span_t span;
+    buffer_uncount(&buf->stats, r, len, r->size, &span);
+    editor_row_truncate(r, len);
+    buffer_recount(&buf->stats, r, &span);
+    buffer_row_changed(buf, row);
+}
+
+
+/* See buffer.h */
+void buffer_row_splice(buffer_t *buf, int row, const erow_edit_t *edits, int n,
+                       const char *s, int len)
+{
+    erow_t *r = n > 0 ? buffer_edit_row(buf, row) : NULL;
+    if (r == NULL)
+        return;
+    buffer_record_row(buf, UNDO_ROW_CHANGED, row, row);
+    buffer_span_t span;
+    buffer_uncount(&buf->stats, r, edits[0].at, edits[n - 1].at + edits[n - 1].len, &span);
+    editor_row_splice(r, edits, n, s, len);
+    buffer_recount(&buf->stats, r, &span);
+    buffer_row_changed(buf, row);
+}
+
+
+/* A row changed by buffer_replace_all: its number of matches (-1 if
+ * memory ran out, leaving it unchanged), its contents from before
+ * (if they are to be recorded for undo), and how its counts changed */
+typedef struct buffer_replaced
+{
+    char *text;
+    int len;
+    int matches;
+    stats_t counts;
+} buffer_replaced_t;
+
+/* Work shared by the threads of buffer_replace_all */
+typedef struct buffer_replace_job
+{
+    buffer_t *buf;
+    const char *query;
+    int qlen;
+    const char *with;
+    int wlen;
+    int record;
+    buffer_replaced_t *rows;
+} buffer_replace_job_t;
+
+
+/* buffer_replace_row - Replace every match in a row
+ *
+ * Parameters:
+ *  - job: Replacement to make
+ *  - row: Row
+ *  - out: Output parameter to return what changed
+ *  - edits, capacity: Room for the matches, grown as needed
+ *
+ * Returns: Nothing
+ */
+static void buffer_replace_row(buffer_replace_job_t *job, erow_t *row, buffer_replaced_t *out,
+                               erow_edit_t **edits, int *capacity)
+{
+    out->text = NULL;
+    out->len = 0;
+    out->matches = 0;
+    memset(&out->counts, 0, sizeof(out->counts));
+
+    int n = 0;
+    const char *chars = editor_row_chars(row);
+    const char *p = chars, *end = chars + row->size, *m;
+    while (end - p >= job->qlen && (m = memmem(p, end - p, job->query, job->qlen)) != NULL)
+    {
+        if (n == *capacity)
+        {
+            int grown = *capacity ? *capacity * 2 : 16;
+            erow_edit_t *e = realloc(*edits, sizeof(erow_edit_t) * grown);
+            if (e == NULL)
+            {
+                out->matches = -1;
+                return;
+            }
+            *edits = e;
+            *capacity = grown;
+        }
+        (*edits)[n].at = m - chars;
+        (*edits)[n].len = job->qlen;
+        n++;
+        p = m + job->qlen;
+    }
+    if (n == 0)
+        return;
+
+    if (job->record)
+    {
+        out->text = malloc(row->size + 1);
+        if (out->text == NULL)
+        {
+            out->matches = -1;
+            return;
+        }
+        memcpy(out->text, chars, row->size);
+        out->len = row->size;
+    }
+
+    /* The row is left as it was if memory runs out */
+    buffer_span_t span;
+    buffer_uncount(&out->counts, row, (*edits)[0].at, (*edits)[n - 1].at + job->qlen, &span);
+    int spliced = editor_row_splice(row, *edits, n, job->with, job->wlen);
+    buffer_recount(&out->counts, row, &span);
+    if (spliced == -1)
+    {
+        free(out->text);
+        out->text = NULL;
+        out->matches = -1;
+        return;
+    }
+    out->matches = n;
+}
+
+
+/* buffer_replace_chunk - Replace every match in a chunk of rows
+ *                        (see parallel_for) */
+static void buffer_replace_chunk(void *arg, int start, int end)
+{
+    buffer_replace_job_t *job = arg;
+    erow_edit_t *edits = NULL;
+    int capacity = 0;
+    for (int i = start; i < end; i++)
+        buffer_replace_row(job, &job->buf->rows[i], &job->rows[i], &edits, &capacity);
+    free(edits);
+}
+
+
+/* buffer_replaced - Record a row changed by buffer_replace_all
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index
+ *  - r: What changed in the row (its old contents now belong to the
+ *    undo log)
+ *
+ * Returns: Nothing
+ */
+static void buffer_replaced(buffer_t *buf, int at, buffer_replaced_t *r)
+{
+    if (r->matches <= 0)
+        return;
+    buf->stats.bytes += r->counts.bytes;
+    buf->stats.words += r->counts.words;
+    buf->stats.chars += r->counts.chars;
+    if (r->text)
+    {
+        undo_step_t *step = undo_add_step(&buf->undo);
+        if (step)
+        {
+            step->kind = UNDO_ROW_CHANGED;
+            step->at = at;
+            step->text = r->text;
+            step->len = r->len;
+        }
+        else
+        {
+            free(r->text);
+        }
+    }
+    buffer_row_changed(buf, at);
+}
+
+
+/* See buffer.h */
+long buffer_replace_all(buffer_t *buf, const char *query, const char *with)
+{
+    if (buf->readonly || query[0] == '\0')
+        return 0;
+
+    buffer_replace_job_t job = {buf, query, strlen(query), with, strlen(with), buf->undo.open, NULL};
+    long total = 0;
+    int failed = 0;
+
+    if (buf->pager)
+    {
+        /* Rows can come and go from memory, so one at a time, and each
+         * changed row is reported before the next one is loaded */
+        erow_edit_t *edits = NULL;
+        int capacity = 0;
+        for (int i = 0; i < buf->num_rows; i++)
+        {
+            erow_t *row = buffer_edit_row(buf, i);
+            if (row == NULL)
+                break;
+            buffer_replaced_t r;
+            buffer_replace_row(&job, row, &r, &edits, &capacity);
+            buffer_replaced(buf, i, &r);
+            total += r.matches > 0 ? r.matches : 0;
+            failed |= r.matches < 0;
+        }
+        free(edits);
+    }
+    else
+    {
+        /* The rows are rebuilt in parallel, then reported in order */
+        job.rows = malloc(sizeof(buffer_replaced_t) * (buf->num_rows > 0 ? buf->num_rows : 1));
+        if (job.rows == NULL)
+            return -1;
+        parallel_for(buf->num_rows, BUFFER_REPLACE_CHUNK_ROWS, buffer_replace_chunk, &job);
+        for (int i = 0; i < buf->num_rows; i++)
+        {
+            buffer_replaced(buf, i, &job.rows[i]);
+            total += job.rows[i].matches > 0 ? job.rows[i].matches : 0;
+            failed |= job.rows[i].matches < 0;
+        }
+        free(job.rows);
+    }
+
+    if (failed)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    return total;
+}
+
+
+/* buffer_restore_rows - Put back rows that were deleted, all at once
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index to put them back at
+ *  - steps: UNDO_ROW_DELETED steps, in the order the rows go in
+ *  - n: Number of steps
+ *
+ * Returns: Nothing
+ */
+static void buffer_restore_rows(buffer_t *buf, int at, const undo_step_t *steps, int n)
+{
+    if (!buf->pager)
+    {
+        buf->rows = realloc(buf->rows, sizeof(erow_t) * (buf->num_rows + n));
+        memmove(&buf->rows[at + n], &buf->rows[at], sizeof(erow_t) * (buf->num_rows - at));
+    }
+    for (int j = 0; j < n; j++)
+    {
+        erow_t row;
+        if (editor_row_init(&row, steps[j].text ? steps[j].text : "", steps[j].len) == -1 ||
+            (buf->pager && pager_insert_row(buf->pager, at + j, &row) == -1))
+        {
+            editor_row_free(&row);
+            if (!buf->pager)
+                memmove(&buf->rows[at + j], &buf->rows[at + n], sizeof(erow_t) * (buf->num_rows - at));
+            n = j;
+            break;
+        }
+        if (!buf->pager)
+            buf->rows[at + j] = row;
+        buffer_count_row(buf, &row, 1);
+    }
+    if (n == 0)
+        return;
+
+    buf->num_rows += n;
+    buffer_invalidate_highlight(buf, at);
+    buf->dirty++;
+    buffer_notify(buf, BUFFER_ROWS_INSERTED, at, n);
+}
+
+
+/* See buffer.h */
+int buffer_undo(buffer_t *buf, int *cx, int *cy)
+{
+    undo_group_t g;
+    if (buf->readonly || !undo_pop(&buf->undo, &g))
+        return 0;
+
+    for (int i = g.num_steps - 1; i >= 0; i--)
+    {
+        undo_step_t *step = &g.steps[i];
+        switch (step->kind)
+        {
+        case UNDO_ROW_CHANGED:
+        {
+            erow_t *row = buffer_edit_row(buf, step->at);
+            if (row == NULL)
+                break;
+            erow_edit_t all = {0, row->size};
+            buffer_count_row(buf, row, -1);
+            editor_row_splice(row, &all, 1, step->text ? step->text : "", step->len);
+            buffer_count_row(buf, row, 1);
+            buffer_row_changed(buf, step->at);
+            break;
+        }
+
+        case UNDO_ROWS_INSERTED:
+            buffer_delete_rows(buf, step->at, step->n);
+            break;
+
+        case UNDO_ROW_DELETED:
+        {
+            /* Rows deleted together go back together */
+            int first = i;
+            while (first > 0 && g.steps[first - 1].kind == UNDO_ROW_DELETED &&
+                   g.steps[first - 1].at == step->at)
+                first--;
+            buffer_restore_rows(buf, step->at, &g.steps[first], i - first + 1);
+            i = first;
+            break;
+        }
+
+        case UNDO_ROWS_MOVED:
+            /* If memory runs out, the rows stay in their new order */
+            buffer_move_rows(buf, step->at, step->n, (const int *)step->text, 1);
+            break;
+        }
+    }
+
+    *cx = g.cx;
+    *cy = g.cy;
+    undo_group_free(&g);
+    return 1;
+}
+
+
+/* See buffer.h */
+uint32_t buffer_row_hash(buffer_t *buf, int at)
+{
+    rowmeta_t *meta = buffer_meta(buf);
+    if (meta)
+        return rowmeta_hash(meta, at, &buf->rows[at]);
+    return rowmeta_hash_row(buffer_row(buf, at));
+}
+
+
+/* See buffer.h */
+char *buffer_to_string(buffer_t *buf, int *buflen)
+{
+    int totlen = 0;
+    int j;
+    rowmeta_t *meta = buffer_meta(buf);
+    if (meta)
+    {
+        totlen = rowmeta_total(meta) + buf->num_rows;
+    }
+    else
+    {
+        for (j = 0; j < buf->num_rows; j++)
+            totlen += buffer_row(buf, j)->size + 1;
+    }
+    *buflen = totlen;
+    char *s = malloc(totlen + 1);
+    if (s == NULL)
+        return NULL;
+    char *p = s;
+    for (j = 0; j < buf->num_rows; j++)
+    {
+        erow_t *row = buffer_row(buf, j);
+        memcpy(p, editor_row_chars(row), row->size);
+        p += row->size;
+        *p = '\n';
+        p++;
+    }
+    *p = '\0';
+    return s;
+}
+
+
+/* See buffer.h */
+int buffer_open_file(buffer_t *buf, const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+        return -1;
+
+    size_t cap = BUFFER_LOAD_BYTES, len = 0;
+    char *block = malloc(cap);
+    if (block == NULL)
+    {
+        fclose(fp);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    buffer_free(buf);
+    buf->filename = strdup(filename);
+
+    /* The whole lines read so far go in together, cut the same way as
+     * the blocks of a file loaded in the background (see
+     * compress_update), so line breaks are always treated alike */
+    size_t n;
+    while ((n = fread(block + len, 1, cap - len, fp)) > 0)
+    {
+        len += n;
+        char *eol = memrchr(block, '\n', len);
+        if (eol != NULL)
+        {
+            size_t cut = eol - block + 1;
+            buffer_insert_lines(buf, buf->num_rows, block, cut);
+            memmove(block, block + cut, len - cut);
+            len -= cut;
+        }
+        else if (len == cap)
+        {
+            char *bigger = realloc(block, cap * 2);
+            if (bigger == NULL)
+                break;
+            block = bigger;
+            cap *= 2;
+        }
+    }
+    int error = ferror(fp) ? EIO : len == cap ? ENOMEM : 0;
+    if (!error)
+        buffer_insert_lines(buf, buf->num_rows, block, len);
+    free(block);
+    fclose(fp);
+    buf->dirty = 0;
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+
+/* See buffer.h */
+int buffer_open_paged(buffer_t *buf, const char *filename, size_t cache_bytes)
+{
+    pager_t *pager = pager_open(filename, cache_bytes);
+    if (pager == NULL)
+        return -1;
+
+    buffer_free(buf);
+    buf->filename = strdup(filename);
+    buf->pager = pager;
+    buf->num_rows = pager->num_rows;
+    buf->stats = pager->stats;
+    buffer_notify(buf, BUFFER_RESET, 0, 0);
+    return 0;
+}
+
+
+/* See buffer.h */
+int buffer_check_mapped(buffer_t *buf)
+{
+    if (buf->map_fd == -1)
+        return 0;
+    buf->map_truncated = 0;
+    struct stat st;
+    if (fstat(buf->map_fd, &st) == -1 || (size_t)st.st_size >= buf->map_valid)
+        return 0;
+    buf->map_valid = st.st_size;
+    return 1;
+}
+
+
+/* See buffer.h */
+int buffer_open_mapped(buffer_t *buf, const char *filename)
+{
+    if (buffer_catch_sigbus() == -1)
+        return -1;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    /* Find the start of every line (see lineindex.h), plus one past
+     * the end of the last one */
+    lineindex_t idx;
+    if (lineindex_open(&idx, fd, filename, 1) == -1)
+    {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    size_t n = idx.count;
+    stats_t stats = idx.stats;
+    size_t *offsets = realloc(idx.starts, sizeof(size_t) * (n + 1));
+    if (offsets == NULL)
+    {
+        lineindex_free(&idx);
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    offsets[n++] = idx.terminated ? idx.size : idx.size + 1;
+
+    const char *map = NULL;
+    size_t len = idx.size;
+    if (len > 0)
+    {
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            int saved_errno = errno;
+            free(offsets);
+            close(fd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+
+    buffer_free(buf);
+    buf->filename = strdup(filename);
+    buf->map = map;
+    buf->map_len = len;
+    buf->map_fd = fd;
+    buf->map_valid = len;
+    buf->map_next = buffer_mapped;
+    buffer_mapped = buf;
+    buf->line_offsets = offsets;
+    buf->num_rows = n - 1;
+    buf->stats = stats;
+    buf->readonly = 1;
+    buffer_notify(buf, BUFFER_RESET, 0, 0);
+    return 0;
+}
+
+
+/* See buffer.h */
+ssize_t buffer_save_file(buffer_t *buf)
+{
+    if (buf->filename == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (buf->readonly)
+    {
+        errno = EROFS;
+        return -1;
+    }
+
+    if (buf->pager)
+    {
+        ssize_t len = pager_save(buf->pager, buf->filename);
+        if (len != -1)
+            buf->dirty = 0;
+        return len;
+    }
+
+    if (buf->compression != COMPRESS_NONE)
+    {
+        ssize_t len = compress_save(buf, buf->compression);
+        if (len != -1)
+            buf->dirty = 0;
+        return len;
+    }
+
+    int len;
+    char *s = buffer_to_string(buf, &len);
+    if (s == NULL)
+        return -1;
+
+    int fd = open(buf->filename, O_RDWR | O_CREAT, 0644);
+    if (fd != -1)
+    {
+        if (ftruncate(fd, len) != -1)
+        {
+            if (write(fd, s, len) == len)
+            {
+                close(fd);
+                free(s);
+                buf->dirty = 0;
+                return len;
+            }
+        }
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    }
+    free(s);
+    return -1;
+}
+
+
+/* See buffer.h */
+int buffer_find(buffer_t *buf, const char *query, int from, int direction, int *col)
+{
+    size_t qlen = strlen(query);
+    int current = from;
+    rowmeta_t *meta = buffer_meta(buf);
+
+    for (int i = 0; i < buf->num_rows; i++)
+    {
+        current += direction;
+        if (current == -1)
+            current = buf->num_rows - 1;
+        else if (current == buf->num_rows)
+            current = 0;
+
+        /* Rows too short for a match are skipped without reading them */
+        if (meta && meta->sizes[current] < (int)qlen)
+            continue;
+
+        erow_t *row = buffer_row(buf, current);
+        char *chars = editor_row_chars(row);
+        char *match = memmem(chars, row->size, query, qlen);
+        if (match)
+        {
+            *col = match - chars;
+            return current;
+        }
+    }
+    return -1;
+}
+
+
+/* See buffer.h */
+int buffer_find_next(buffer_t *buf, const char *query, int row, int col, int *match)
+{
+    size_t qlen = strlen(query);
+    if (buf->num_rows == 0 || qlen == 0)
+        return -1;
+    if (row < 0 || row >= buf->num_rows)
+    {
+        row = 0;
+        col = -1;
+    }
+
+    rowmeta_t *meta = buffer_meta(buf);
+
+    /* The row we start from is searched twice: after the position,
+     * and then (once we've wrapped around) up to it */
+    for (int i = 0; i <= buf->num_rows; i++)
+    {
+        int current = (row + i) % buf->num_rows;
+        if (meta && meta->sizes[current] < (int)qlen)
+            continue;
+        erow_t *r = buffer_row(buf, current);
+        int start = i == 0 ? col + 1 : 0;
+        int end = i == buf->num_rows ? col + (int)qlen : r->size;
+        if (end > r->size)
+            end = r->size;
+        if (start < 0)
+            start = 0;
+        if (end - start < (int)qlen)
+            continue;
+
+        char *chars = editor_row_chars(r);
+        char *found = memmem(&chars[start], end - start, query, qlen);
+        if (found)
+        {
+            *match = found - chars;
+            return current;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,551 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * buffer.h: A text buffer (the rows of a file) and the operations
+ *           on it: editing, searching, loading and saving.
+ *
+ * This module (together with row.c) makes up the libmicro library.
+ * It never touches the terminal and never exits the process: errors
+ * are reported through return values and errno, so the buffer can be
+ * embedded in other tools.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include "row.h"
+#include "rowmeta.h"
+#include "stats.h"
+#include "pager.h"
+#include "undo.h"
+
+struct syntax;
+struct buffer;
+
+/* Kinds of changes reported to buffer listeners */
+typedef enum
+{
+    /* The contents of row at changed */
+    BUFFER_ROW_CHANGED,
+
+    /* n rows were inserted at at */
+    BUFFER_ROWS_INSERTED,
+
+    /* n rows were deleted starting at at */
+    BUFFER_ROWS_DELETED,
+
+    /* The buffer was emptied, or its contents replaced wholesale */
+    BUFFER_RESET
+} buffer_change_t;
+
+/* Something that keeps track of changes to a buffer (e.g., an index
+ * over its rows) */
+typedef struct buffer_listener
+{
+    /* Called after every change */
+    void (*changed)(struct buffer_listener *l, struct buffer *buf,
+                    buffer_change_t change, int at, int n);
+
+    /* Passed through for the listener's own use */
+    void *arg;
+
+    struct buffer_listener *next;
+} buffer_listener_t;
+
+/* Number of row views handed out by buffer_row() in read-only mode
+ * before the oldest one is reused */
+#define BUFFER_VIEW_ROWS (4)
+
+/* buffer_replace_all() only spreads the work over several threads
+ * for at least this many rows per thread */
+#define BUFFER_REPLACE_CHUNK_ROWS (16384)
+
+/* Size of the chunks buffer_open_file() reads a file in (a chunk may
+ * grow to hold a single long line) */
+#define BUFFER_LOAD_BYTES (1 << 16)
+
+/* A text buffer */
+typedef struct buffer
+{
+    /* Buffer rows (unused in paged mode; use buffer_row() to access rows) */
+    erow_t *rows;
+
+    /* Paged row storage, for files opened with buffer_open_paged()
+     * (NULL if the whole file is in memory) */
+    pager_t *pager;
+
+    /* For files opened with buffer_open_mapped(): the memory-mapped
+     * file, and the offset of the start of each line in it (plus one
+     * past the end of the last line). Rows are views into the mapping,
+     * built on demand in view_rows. */
+    const char *map;
+    size_t map_len;
+    size_t *line_offsets;
+    erow_t view_rows[BUFFER_VIEW_ROWS];
+    unsigned int view_next;
+
+    /* The mapped file, and how much of the mapping it still backs:
+     * map_len, until the file is truncated while it is mapped (which
+     * sets map_truncated; see buffer_row). Mapped buffers are listed
+     * through map_next, for the SIGBUS handler. */
+    int map_fd;
+    size_t map_valid;
+    volatile sig_atomic_t map_truncated;
+    struct buffer *map_next;
+
+    /* Is the buffer read-only? (All editing operations are ignored) */
+    int readonly;
+
+    /* Number of rows */
+    int num_rows;
+
+    /* Has the buffer been modified since its last save? */
+    int dirty;
+
+    /* Number of bytes (counting a line break after every row), words
+     * and characters in the buffer (see stats.h). Counted as the rows
+     * are loaded (or when the file is indexed, for paged and read-only
+     * buffers), then kept up to date by counting the part of a row
+     * around each edit again */
+    stats_t stats;
+
+    /* File (if any) backing the buffer */
+    char *filename;
+
+    /* Format the file is compressed in (a compress_format_t, see
+     * compress.h; 0 if it isn't) */
+    int compression;
+
+    /* Syntax highlighting rules (NULL if the buffer is not highlighted),
+     * and the first row whose highlighting may be out of date because
+     * it or a row above it has changed (see highlight.h) */
+    const struct syntax *syntax;
+    int hl_dirty_from;
+
+    /* Rows above hl_snapshot_end have been copied for the background
+     * highlighter; editing any of them increments hl_version, so the
+     * highlighter knows its results are out of date */
+    int hl_snapshot_end;
+    unsigned int hl_version;
+
+    /* Listeners to notify of changes */
+    buffer_listener_t *listeners;
+
+    /* Changes made so far, to be undone (see buffer_undo). Recorded
+     * while a group is open (see undo_begin) */
+    undo_t undo;
+
+    /* Sizes and hashes of the rows, kept in arrays of their own for
+     * scans over every row (see rowmeta.h). Only kept in step for
+     * buffers that are entirely in memory */
+    rowmeta_t meta;
+} buffer_t;
+
+
+/* buffer_init - Initializes an empty buffer
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *
+ * Returns: Nothing
+ */
+void buffer_init(buffer_t *buf);
+
+
+/* buffer_free - Frees the contents of a buffer
+ *
+ * The buffer is left empty, as if buffer_init had been called on it
+ * (except that its listeners stay registered).
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *
+ * Returns: Nothing
+ */
+void buffer_free(buffer_t *buf);
+
+
+/* buffer_add_listener - Start notifying a listener of changes
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - l: Listener (must stay valid until it is removed)
+ *
+ * Returns: Nothing
+ */
+void buffer_add_listener(buffer_t *buf, buffer_listener_t *l);
+
+
+/* buffer_remove_listener - Stop notifying a listener of changes
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - l: Listener
+ *
+ * Returns: Nothing
+ */
+void buffer_remove_listener(buffer_t *buf, buffer_listener_t *l);
+
+
+/* buffer_row - Get a row of the buffer
+ *
+ * In paged mode, this may have to load the row from the file. The
+ * returned pointer is only valid until the buffer is modified or
+ * (in paged mode) rows from two other blocks are accessed or
+ * (in read-only mode) two other rows are accessed.
+ *
+ * A paged buffer is made read-only once paging it fails (see
+ * pager_t.error): rows that can't be loaded are shown empty, and the
+ * buffer couldn't be saved anyway.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index (must be less than buf->num_rows)
+ *
+ * Returns: The row (not to be changed if the buffer is read-only)
+ */
+erow_t *buffer_row(buffer_t *buf, int at);
+
+
+/* buffer_insert_row - Insert a new row
+ *
+ * Copy the given string as a new row, and insert it at the
+ * specified index.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index to insert the new row at
+ *  - s: String contents of new row
+ *  - len: Length of string
+ *
+ * Returns: nothing
+ */
+void buffer_insert_row(buffer_t *buf, int at, const char *s, size_t len);
+
+
+/* buffer_insert_lines - Insert several new rows at once
+ *
+ * Splits text into lines and inserts them as new rows, making room
+ * for all of them at once (this is much faster than inserting the
+ * rows one by one). Line breaks may be "\n" or "\r\n", and text
+ * that is not terminated by a line break becomes a row of its own.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index to insert the new rows at
+ *  - text: Text to insert
+ *  - len: Length of text
+ *
+ * Returns: Number of rows inserted
+ */
+int buffer_insert_lines(buffer_t *buf, int at, const char *text, size_t len);
+
+
+/* buffer_insert_counted - Insert several new rows at once, exactly as
+ *                         given
+ *
+ * Like buffer_insert_lines, but each row in text is its length (as a
+ * native uint32_t) followed by its contents, which are kept as they
+ * are, even if they end in '\r'.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index to insert the new rows at
+ *  - text: Rows to insert
+ *  - len: Length of text
+ *
+ * Returns: Number of rows inserted, or -1 (with errno set to EINVAL)
+ *          if text is not made of whole rows
+ */
+int buffer_insert_counted(buffer_t *buf, int at, const char *text, size_t len);
+
+
+/* buffer_permute_rows - Reorder consecutive rows
+ *
+ * The rows are moved as they are, without copying their contents. The
+ * new order is recorded in the undo log (if a group is being
+ * recorded) by itself, so it takes an int per row whatever the rows
+ * hold. Listeners are told the rows were deleted and inserted again.
+ *
+ * Parameters:
+ *  - buf: Buffer (entirely in memory: not paged)
+ *  - at: Index of the first row
+ *  - n: Number of rows
+ *  - order: For each new position (from at), the position (from at)
+ *    of the row to put there; a permutation of 0..n-1
+ *
+ * Returns: 0 on success, -1 on error (with errno set: EROFS if the
+ *          buffer is read-only, EINVAL if it is paged, ENOMEM)
+ */
+int buffer_permute_rows(buffer_t *buf, int at, int n, const int *order);
+
+
+/* buffer_delete_row - Delete a row
+ *
+ * Deletes a row, and shifts all subsequent rows up one row.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Index of row to delete
+ *
+ * Returns: nothing
+ */
+void buffer_delete_row(buffer_t *buf, int at);
+
+
+/* buffer_delete_rows - Delete several consecutive rows at once
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Index of the first row to delete
+ *  - n: Number of rows to delete
+ *
+ * Returns: nothing
+ */
+void buffer_delete_rows(buffer_t *buf, int at, int n);
+
+
+/* buffer_row_insert_char - Inserts a character in a row
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - row: Row index
+ *  - at: Position in the row
+ *  - c: Character to insert
+ *
+ * Returns: nothing
+ */
+void buffer_row_insert_char(buffer_t *buf, int row, int at, int c);
+
+
+/* buffer_row_delete_char - Deletes a character in a row
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - row: Row index
+ *  - at: Position in the row
+ *
+ * Returns: nothing
+ */
+void buffer_row_delete_char(buffer_t *buf, int row, int at);
+
+
+/* buffer_row_append_string - Append a string at the end of a row
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - row: Row index
+ *  - s: String to append
+ *  - len: Length of the string to append
+ *
+ * Returns: nothing
+ */
+void buffer_row_append_string(buffer_t *buf, int row, const char *s, size_t len);
+
+
+/* buffer_row_truncate - Truncate a row
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - row: Row index
+ *  - len: New length of the row (must not exceed the current length)
+ *
+ * Returns: nothing
+ */
+void buffer_row_truncate(buffer_t *buf, int row, int len);
+
+
+/* buffer_row_splice - Replace several ranges of a row with a string
+ *
+ * See editor_row_splice. Listeners are told about the row once.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - row: Row index
+ *  - edits: Ranges to replace, sorted by position and not overlapping
+ *  - n: Number of ranges
+ *  - s: String to put in place of each range
+ *  - len: Length of the string
+ *
+ * Returns: nothing
+ */
+void buffer_row_splice(buffer_t *buf, int row, const erow_edit_t *edits, int n,
+                       const char *s, int len);
+
+
+/* buffer_replace_all - Replace every match of a string
+ *
+ * Matches don't overlap; each row is searched from left to right.
+ * Every row with a match is rebuilt (and rendered, and reported to the
+ * listeners) once, however many matches it has. Rows are searched and
+ * rebuilt on several threads at once, unless the buffer is paged.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - query: String to search for (not empty)
+ *  - with: String to put in its place
+ *
+ * Returns: Number of matches replaced, or -1 if memory ran out (some
+ *          rows may have been changed, as recorded in the undo log)
+ */
+long buffer_replace_all(buffer_t *buf, const char *query, const char *with);
+
+
+/* buffer_undo - Undo the last group of changes
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - cx, cy: Output parameters to return the cursor position from
+ *    before the changes
+ *
+ * Returns: 1 if changes were undone, 0 if there was nothing to undo
+ */
+int buffer_undo(buffer_t *buf, int *cx, int *cy);
+
+
+/* buffer_row_hash - Hash the contents of a row
+ *
+ * Rows with the same contents have the same hash. The hashes of rows
+ * of a buffer that is entirely in memory are kept until they change.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Row index
+ *
+ * Returns: Hash of the row (never 0)
+ */
+uint32_t buffer_row_hash(buffer_t *buf, int at);
+
+
+/* buffer_to_string - Convert the buffer rows to a single string
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - buflen: Output parameter to return the length of the string
+ *
+ * Returns: Buffer rows as a single string (must be freed by the caller),
+ *          or NULL if memory could not be allocated
+ */
+char *buffer_to_string(buffer_t *buf, int *buflen);
+
+
+/* buffer_open_file - Loads a file into the buffer
+ *
+ * Any previous contents of the buffer are discarded. Lines are split as
+ * buffer_insert_lines() splits them (one '\r' before each line break is
+ * dropped).
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - filename: File to open
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+int buffer_open_file(buffer_t *buf, const char *filename);
+
+
+/* buffer_open_paged - Opens a file in paged mode
+ *
+ * Instead of loading the whole file, rows are loaded from the file
+ * in blocks as they are accessed, keeping roughly cache_bytes of
+ * them in memory (see pager.h). Any previous contents of the
+ * buffer are discarded.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - filename: File to open
+ *  - cache_bytes: Approximate amount of memory to use for rows
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+int buffer_open_paged(buffer_t *buf, const char *filename, size_t cache_bytes);
+
+
+/* buffer_open_mapped - Opens a file read-only, without copying it
+ *
+ * The file is memory-mapped, and rows are views into the mapping
+ * (see ROW_VIEW), so the only memory used per line is its offset.
+ * The buffer is read-only. Any previous contents of the buffer are
+ * discarded. If the file is truncated while it is open, reading past
+ * its new end doesn't raise SIGBUS (it is handled), and the lines
+ * past it are shown empty (see buffer_check_mapped).
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - filename: File to open
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+int buffer_open_mapped(buffer_t *buf, const char *filename);
+
+
+/* buffer_check_mapped - Check whether the file of a mapped buffer has
+ *                       been truncated
+ *
+ * Lines past the new end of the file are shown empty from then on.
+ * Reading them before is safe (see buffer_open_mapped), but reads
+ * zeros where the file was cut.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *
+ * Returns: 1 if the file turned out to be shorter than before, 0 if
+ *          not (or if the buffer isn't mapped)
+ */
+int buffer_check_mapped(buffer_t *buf);
+
+
+/* buffer_save_file - Writes the buffer to its file
+ *
+ * If the buffer was loaded from a compressed file, the file is written
+ * compressed in the same format (see compress.h).
+ *
+ * Parameters:
+ *  - buf: Buffer (its filename must be set)
+ *
+ * Returns: Number of bytes written, or -1 on error (with errno set)
+ */
+ssize_t buffer_save_file(buffer_t *buf);
+
+
+/* buffer_find - Search for a string in the buffer
+ *
+ * Searches row by row, starting at the row after (or before,
+ * if searching backwards) the given row, and wrapping around
+ * the end (or start) of the buffer.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - query: String to search for
+ *  - from: Row to start searching from (-1 to start at the first row)
+ *  - direction: 1 to search forwards, -1 to search backwards
+ *  - col: Output parameter to return the position of the match in its row
+ *
+ * Returns: Index of the row with the match, or -1 if there is no match
+ */
+int buffer_find(buffer_t *buf, const char *query, int from, int direction, int *col);
+
+
+/* buffer_find_next - Search for a string after a position
+ *
+ * Finds the first match that starts after the given position, wrapping
+ * around the end of the buffer (so the match at the position itself is
+ * found last).
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - query: String to search for
+ *  - row, col: Position to search from
+ *  - match: Output parameter to return the position of the match in its row
+ *
+ * Returns: Index of the row with the match, or -1 if there is no match
+ */
+int buffer_find_next(buffer_t *buf, const char *query, int row, int col, int *match);
+
+#endif /* BUFFER_H */
@@ -12,6 +12,10 @@
 #define MICRO_VERSION "0.220.2021"
 #define MICRO_TAB_STOP (4)
 #define MICRO_QUIT_TIMES (3)
+#define MICRO_PAGE_CACHE_MB (256)
+#define MICRO_FOLLOW_POLL_MS (1000)
+#define MICRO_LOAD_POLL_MS (20)
+#define MICRO_LONG_ROW_BYTES (256 << 10)
 
 #define CTRL_KEY(k) ((k)&0x1f)
 
@@ -0,0 +1,730 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * compress.c: Loading files in the background (decompressing them, if
+ * they are compressed), and saving compressed files (gzip, and zstd if
+ * compiled in).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#ifdef MICRO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MICRO_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+
+/* Size of the chunks of compressed data read or written at a time */
+#define COMPRESS_CHUNK (256 << 10)
+
+/* A compressor or decompressor, in whichever format */
+typedef struct compress_codec
+{
+    compress_format_t format;
+
+    /* Has the decompressor reached the end of a compressed stream (a
+     * gzip member or a zstd frame), with nothing of it left over? */
+    int complete;
+
+#ifdef MICRO_HAVE_ZLIB
+    z_stream z;
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    ZSTD_DStream *zd;
+    ZSTD_CStream *zc;
+#endif
+} compress_codec_t;
+
+
+/* compress_decoder_init - Set up a decompressor (which only copies
+ *                         files that aren't compressed)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int compress_decoder_init(compress_codec_t *c, compress_format_t format)
+{
+    memset(c, 0, sizeof(*c));
+    c->format = format;
+    switch (format)
+    {
+    case COMPRESS_NONE:
+        c->complete = 1;
+        return 0;
+#ifdef MICRO_HAVE_ZLIB
+    case COMPRESS_GZIP:
+        /* 16 + MAX_WBITS: a gzip header and trailer, not zlib's */
+        if (inflateInit2(&c->z, 16 + MAX_WBITS) != Z_OK)
+            return -1;
+        return 0;
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    case COMPRESS_ZSTD:
+        c->zd = ZSTD_createDStream();
+        return c->zd ? 0 : -1;
+#endif
+    default:
+        return -1;
+    }
+}
+
+
+/* compress_decode - Decompress as much as fits
+ *
+ * Parameters:
+ *  - c: Decompressor
+ *  - in, in_len: Compressed data (advanced past what was used)
+ *  - out, out_cap: Where to put the decompressed data
+ *  - produced: Output parameter to return the number of bytes put in
+ *    out (if it's out_cap, there may be more to come without any more
+ *    input)
+ *
+ * Returns: 0 on success, -1 if the data is corrupt
+ */
+static int compress_decode(compress_codec_t *c, const char **in, size_t *in_len,
+                           char *out, size_t out_cap, size_t *produced)
+{
+    *produced = 0;
+    switch (c->format)
+    {
+    case COMPRESS_NONE:
+    {
+        size_t n = *in_len < out_cap ? *in_len : out_cap;
+        memcpy(out, *in, n);
+        *in += n;
+        *in_len -= n;
+        *produced = n;
+        return 0;
+    }
+#ifdef MICRO_HAVE_ZLIB
+    case COMPRESS_GZIP:
+    {
+        /* A file can hold several gzip members, one after the other */
+        if (c->complete && *in_len > 0)
+        {
+            inflateReset(&c->z);
+            c->complete = 0;
+        }
+        if (c->complete)
+            return 0;
+
+        c->z.next_in = (Bytef *)*in;
+        c->z.avail_in = *in_len;
+        c->z.next_out = (Bytef *)out;
+        c->z.avail_out = out_cap;
+        int rc = inflate(&c->z, Z_NO_FLUSH);
+        *in += *in_len - c->z.avail_in;
+        *in_len = c->z.avail_in;
+        *produced = out_cap - c->z.avail_out;
+        if (rc == Z_STREAM_END)
+            c->complete = 1;
+        else if (rc != Z_OK && rc != Z_BUF_ERROR)
+            return -1;
+        return 0;
+    }
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    case COMPRESS_ZSTD:
+    {
+        ZSTD_inBuffer input = {*in, *in_len, 0};
+        ZSTD_outBuffer output = {out, out_cap, 0};
+        size_t rc = ZSTD_decompressStream(c->zd, &output, &input);
+        if (ZSTD_isError(rc))
+            return -1;
+        *in += input.pos;
+        *in_len -= input.pos;
+        *produced = output.pos;
+
+        /* 0 means a frame was finished and flushed; a file can hold
+         * several frames, one after the other */
+        c->complete = rc == 0;
+        return 0;
+    }
+#endif
+    default:
+        return -1;
+    }
+}
+
+
+/* compress_decoder_free - Free a decompressor
+ *
+ * Returns: Nothing
+ */
+static void compress_decoder_free(compress_codec_t *c)
+{
+#ifdef MICRO_HAVE_ZLIB
+    if (c->format == COMPRESS_GZIP)
+        inflateEnd(&c->z);
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    if (c->format == COMPRESS_ZSTD)
+        ZSTD_freeDStream(c->zd);
+#endif
+}
+
+
+/* compress_encoder_init - Set up a compressor
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int compress_encoder_init(compress_codec_t *c, compress_format_t format)
+{
+    memset(c, 0, sizeof(*c));
+    c->format = format;
+    switch (format)
+    {
+#ifdef MICRO_HAVE_ZLIB
+    case COMPRESS_GZIP:
+        if (deflateInit2(&c->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return -1;
+        return 0;
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    case COMPRESS_ZSTD:
+        c->zc = ZSTD_createCStream();
+        if (c->zc == NULL)
+            return -1;
+        ZSTD_initCStream(c->zc, ZSTD_CLEVEL_DEFAULT);
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+
+/* compress_encoder_free - Free a compressor
+ *
+ * Returns: Nothing
+ */
+static void compress_encoder_free(compress_codec_t *c)
+{
+#ifdef MICRO_HAVE_ZLIB
+    if (c->format == COMPRESS_GZIP)
+        deflateEnd(&c->z);
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    if (c->format == COMPRESS_ZSTD)
+        ZSTD_freeCStream(c->zc);
+#endif
+}
+
+
+/* compress_write_all - Write all of some bytes to a file
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int compress_write_all(int fd, const char *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/* compress_encode - Compress some data and write it out
+ *
+ * Parameters:
+ *  - c: Compressor
+ *  - fd: File to write to
+ *  - in, len: Data to compress
+ *  - finish: Is this the end of the data?
+ *  - out: Scratch space of COMPRESS_CHUNK bytes
+ *  - written: Number of bytes written so far (updated)
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int compress_encode(compress_codec_t *c, int fd, const char *in, size_t len,
+                           int finish, char *out, ssize_t *written)
+{
+    switch (c->format)
+    {
+#ifdef MICRO_HAVE_ZLIB
+    case COMPRESS_GZIP:
+    {
+        c->z.next_in = (Bytef *)in;
+        c->z.avail_in = len;
+        int rc;
+        do
+        {
+            c->z.next_out = (Bytef *)out;
+            c->z.avail_out = COMPRESS_CHUNK;
+            rc = deflate(&c->z, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (rc == Z_STREAM_ERROR)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            size_t n = COMPRESS_CHUNK - c->z.avail_out;
+            if (compress_write_all(fd, out, n) == -1)
+                return -1;
+            *written += n;
+        } while (c->z.avail_out == 0 || (finish && rc != Z_STREAM_END));
+        return 0;
+    }
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    case COMPRESS_ZSTD:
+    {
+        ZSTD_inBuffer input = {in, len, 0};
+        size_t rc;
+        do
+        {
+            ZSTD_outBuffer output = {out, COMPRESS_CHUNK, 0};
+            rc = ZSTD_compressStream2(c->zc, &output, &input,
+                                      finish ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(rc))
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            if (compress_write_all(fd, out, output.pos) == -1)
+                return -1;
+            *written += output.pos;
+        } while (input.pos < input.size || (finish && rc != 0));
+        return 0;
+    }
+#endif
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+
+/* compress_push - Hand the complete lines of the block being filled
+ *                 over to the editor
+ *
+ * The rest of the block (a line that isn't complete yet) is moved to a
+ * new block. If there is no complete line and the block is full, it is
+ * made larger instead.
+ *
+ * Parameters:
+ *  - r: File being loaded
+ *  - block, len, cap: Block being filled (updated)
+ *  - final: Is this the end of the file? (Then the whole block is
+ *    handed over)
+ *
+ * Returns: 0 on success, -1 if the thread should stop (with errno set:
+ *          ECANCELED if it was asked to, ENOMEM if memory could not be
+ *          allocated)
+ */
+static int compress_push(compress_reader_t *r, char **block, size_t *len, size_t *cap,
+                         int final)
+{
+    char *eol = memrchr(*block, '\n', *len);
+    size_t cut = final ? *len : eol ? (size_t)(eol - *block) + 1 : 0;
+    if (cut == 0)
+    {
+        if (final || *len < *cap)
+            return 0;
+        char *bigger = realloc(*block, *cap * 2);
+        if (bigger == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        *block = bigger;
+        *cap *= 2;
+        return 0;
+    }
+
+    size_t rest = *len - cut;
+    size_t next_cap = rest < COMPRESS_BLOCK_BYTES ? COMPRESS_BLOCK_BYTES : *cap;
+    char *next = malloc(next_cap);
+    if (next == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(next, *block + cut, rest);
+
+    pthread_mutex_lock(&r->lock);
+    while (r->count == COMPRESS_QUEUE_BLOCKS && !r->quit)
+        pthread_cond_wait(&r->cond, &r->lock);
+    if (r->quit)
+    {
+        pthread_mutex_unlock(&r->lock);
+        free(next);
+        errno = ECANCELED;
+        return -1;
+    }
+    compress_block_t *b = &r->queue[(r->head + r->count) % COMPRESS_QUEUE_BLOCKS];
+    b->text = *block;
+    b->len = cut;
+    r->count++;
+    uint64_t one = 1;
+    ssize_t rc = write(r->event_fd, &one, sizeof(one));
+    (void)rc; /* Can only fail if the counter overflows */
+    pthread_mutex_unlock(&r->lock);
+
+    *block = next;
+    *len = rest;
+    *cap = next_cap;
+    return 0;
+}
+
+
+/* compress_reader_main - Main function of the loading thread */
+static void *compress_reader_main(void *arg)
+{
+    compress_reader_t *r = arg;
+    compress_codec_t c;
+    size_t cap = COMPRESS_BLOCK_BYTES, len = 0;
+    char *block = malloc(cap);
+    char *in = malloc(COMPRESS_CHUNK);
+    int decoding = compress_decoder_init(&c, r->format) == 0;
+    int error = decoding && block && in ? 0 : ENOMEM;
+
+    off_t offset = 0;
+    while (!error)
+    {
+        ssize_t n = pread(r->fd, in, COMPRESS_CHUNK, offset);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+        {
+            error = errno;
+            break;
+        }
+        if (n == 0)
+        {
+            /* A file cut short is as good as corrupt */
+            if (!c.complete)
+                error = EILSEQ;
+            else if (compress_push(r, &block, &len, &cap, 1) == -1)
+                error = errno;
+            break;
+        }
+        offset += n;
+
+        const char *p = in;
+        size_t left = n;
+        int full;
+        do
+        {
+            /* If the decompressed data filled the block, there may be
+             * more to come even with no input left */
+            size_t produced, space = cap - len;
+            if (compress_decode(&c, &p, &left, block + len, space, &produced) == -1)
+            {
+                error = EILSEQ;
+                break;
+            }
+            len += produced;
+            full = produced == space;
+            if (full && compress_push(r, &block, &len, &cap, 0) == -1)
+            {
+                error = errno;
+                break;
+            }
+        } while (left > 0 || full);
+
+        pthread_mutex_lock(&r->lock);
+        r->consumed = offset;
+        pthread_mutex_unlock(&r->lock);
+    }
+    if (decoding)
+        compress_decoder_free(&c);
+    free(in);
+    free(block);
+
+    pthread_mutex_lock(&r->lock);
+    r->done = 1;
+    r->error = error;
+    uint64_t one = 1;
+    ssize_t rc = write(r->event_fd, &one, sizeof(one));
+    (void)rc;
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+
+/* See compress.h */
+compress_format_t compress_detect(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return COMPRESS_NONE;
+    unsigned char magic[4];
+    ssize_t n = read(fd, magic, sizeof(magic));
+    close(fd);
+
+#ifdef MICRO_HAVE_ZLIB
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return COMPRESS_GZIP;
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return COMPRESS_ZSTD;
+#endif
+    (void)n;
+    (void)magic;
+    return COMPRESS_NONE;
+}
+
+
+/* See compress.h */
+compress_format_t compress_guess(const char *filename)
+{
+    const char *ext = strrchr(filename, '.');
+    if (ext == NULL)
+        return COMPRESS_NONE;
+#ifdef MICRO_HAVE_ZLIB
+    if (strcmp(ext, ".gz") == 0)
+        return COMPRESS_GZIP;
+#endif
+#ifdef MICRO_HAVE_ZSTD
+    if (strcmp(ext, ".zst") == 0)
+        return COMPRESS_ZSTD;
+#endif
+    return COMPRESS_NONE;
+}
+
+
+/* See compress.h */
+compress_reader_t *compress_open(buffer_t *buf, const char *filename, compress_format_t format)
+{
+    compress_reader_t *r = calloc(1, sizeof(compress_reader_t));
+    if (r == NULL)
+        return NULL;
+    r->format = format;
+    r->path = strdup(filename);
+    r->fd = open(filename, O_RDONLY | O_CLOEXEC);
+    r->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct stat st;
+    if (r->path == NULL || r->fd == -1 || r->event_fd == -1 || fstat(r->fd, &st) == -1)
+        goto fail;
+    r->size = st.st_size;
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    int rc = pthread_create(&r->thread, NULL, compress_reader_main, r);
+    if (rc != 0)
+    {
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        errno = rc;
+        goto fail;
+    }
+
+    buffer_free(buf);
+    buf->filename = strdup(filename);
+    buf->compression = format;
+    r->pending = 1;
+    return r;
+
+fail:;
+    int saved_errno = errno;
+    if (r->fd != -1)
+        close(r->fd);
+    if (r->event_fd != -1)
+        close(r->event_fd);
+    free(r->path);
+    free(r);
+    errno = saved_errno;
+    return NULL;
+}
+
+
+/* See compress.h */
+void compress_close(compress_reader_t *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->quit = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+
+    for (int i = 0; i < r->count; i++)
+        free(r->queue[(r->head + i) % COMPRESS_QUEUE_BLOCKS].text);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    close(r->event_fd);
+    close(r->fd);
+    free(r->path);
+    free(r);
+}
+
+
+/* See compress.h */
+int compress_fd(compress_reader_t *r)
+{
+    return r->event_fd;
+}
+
+
+/* See compress.h */
+int compress_update(compress_reader_t *r, buffer_t *buf)
+{
+    if (r->finished)
+        return 0;
+
+    uint64_t events;
+    ssize_t rc = read(r->event_fd, &events, sizeof(events));
+    (void)rc; /* Nothing to read is fine too */
+
+    compress_block_t blocks[COMPRESS_QUEUE_BLOCKS];
+    int n = 0;
+    size_t total = 0;
+    pthread_mutex_lock(&r->lock);
+    while (r->count > 0 && total < COMPRESS_MAX_BATCH)
+    {
+        blocks[n] = r->queue[r->head];
+        total += blocks[n++].len;
+        r->head = (r->head + 1) % COMPRESS_QUEUE_BLOCKS;
+        r->count--;
+    }
+    r->pending = r->count > 0;
+    int finished = r->done && r->count == 0;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+
+    /* Loading the file doesn't modify it, even in a read-only buffer */
+    int was_dirty = buf->dirty;
+    int readonly = buf->readonly;
+    buf->readonly = 0;
+    for (int i = 0; i < n; i++)
+    {
+        buffer_insert_lines(buf, buf->num_rows, blocks[i].text, blocks[i].len);
+        free(blocks[i].text);
+    }
+    buf->readonly = readonly;
+    if (!was_dirty)
+        buf->dirty = 0;
+
+    r->finished = finished;
+    return n > 0;
+}
+
+
+/* See compress.h */
+int compress_progress(compress_reader_t *r)
+{
+    pthread_mutex_lock(&r->lock);
+    off_t consumed = r->consumed;
+    pthread_mutex_unlock(&r->lock);
+    return r->size > 0 ? (int)(consumed * 100 / r->size) : 100;
+}
+
+
+/* See compress.h */
+ssize_t compress_save(buffer_t *buf, compress_format_t format)
+{
+    compress_codec_t c;
+    if (compress_encoder_init(&c, format) == -1)
+    {
+        errno = format == COMPRESS_NONE ? EINVAL : ENOMEM;
+        return -1;
+    }
+
+    /* The file is written under a temporary name next to it, and only
+     * replaces it once it has been written in full (as in pager_save) */
+    size_t namelen = strlen(buf->filename) + sizeof(".XXXXXX");
+    char *tmpname = malloc(namelen);
+    char *in = malloc(COMPRESS_CHUNK);
+    char *out = malloc(COMPRESS_CHUNK);
+    int fd = -1;
+    if (tmpname && in && out)
+    {
+        snprintf(tmpname, namelen, "%s.XXXXXX", buf->filename);
+        fd = mkostemp(tmpname, O_CLOEXEC);
+    }
+    else
+    {
+        errno = ENOMEM;
+    }
+    ssize_t written = 0;
+    int ok = fd != -1;
+
+    /* Keep the permissions of the file, or give a new one the usual
+     * ones (mkostemp makes it private to us) */
+    struct stat st;
+    if (ok)
+    {
+        mode_t mode = 0666;
+        if (stat(buf->filename, &st) == 0)
+        {
+            mode = st.st_mode & 07777;
+        }
+        else
+        {
+            mode_t mask = umask(0);
+            umask(mask);
+            mode &= ~mask;
+        }
+        fchmod(fd, mode);
+    }
+
+    /* Rows are copied into in with their line breaks, and compressed
+     * each time it fills up */
+    size_t len = 0;
+    for (int j = 0; ok && j < buf->num_rows; j++)
+    {
+        erow_t *row = buffer_row(buf, j);
+        const char *s = editor_row_chars(row);
+        size_t left = row->size + 1;
+        while (ok && left > 0)
+        {
+            size_t n = left < COMPRESS_CHUNK - len ? left : COMPRESS_CHUNK - len;
+            memcpy(in + len, s, left == n ? n - 1 : n);
+            if (left == n)
+                in[len + n - 1] = '\n';
+            s += n;
+            left -= n;
+            len += n;
+            if (len == COMPRESS_CHUNK)
+            {
+                ok = compress_encode(&c, fd, in, len, 0, out, &written) == 0;
+                len = 0;
+            }
+        }
+    }
+    if (ok)
+        ok = compress_encode(&c, fd, in, len, 1, out, &written) == 0;
+
+    int saved_errno = errno;
+    compress_encoder_free(&c);
+    free(in);
+    free(out);
+    if (fd != -1 && close(fd) == -1 && ok)
+    {
+        saved_errno = errno;
+        ok = 0;
+    }
+    if (ok && rename(tmpname, buf->filename) == -1)
+    {
+        saved_errno = errno;
+        ok = 0;
+    }
+    if (!ok && fd != -1)
+        unlink(tmpname);
+    free(tmpname);
+    errno = saved_errno;
+    return ok ? written : -1;
+}
@@ -0,0 +1,207 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * compress.h: Loading files in the background (decompressing them, if
+ * they are compressed), and saving compressed files (gzip, and zstd if
+ * compiled in).
+ *
+ * The file is read (and decompressed) by a background thread, which
+ * cuts the text into blocks of whole lines and puts them in a queue of
+ * at most COMPRESS_QUEUE_BLOCKS blocks. The editor appends the blocks
+ * in the queue to the buffer whenever it gets around to it (see
+ * compress_update), so the start of the file can be shown, browsed and
+ * searched while the rest is still being loaded, and the thread never
+ * gets more than a few blocks ahead of the editor. Nothing is written
+ * to disk.
+ *
+ * Saving compresses the buffer again, in the format it was opened in.
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include "buffer.h"
+
+/* Size of the blocks of (decompressed) text handed to the editor (a
+ * block may be larger if it holds a single long line) */
+#define COMPRESS_BLOCK_BYTES (1 << 20)
+
+/* Number of blocks the loading thread can get ahead by */
+#define COMPRESS_QUEUE_BLOCKS (8)
+
+/* Maximum number of bytes added to the buffer by a single call to
+ * compress_update(), so a large file can't keep the editor from
+ * redrawing */
+#define COMPRESS_MAX_BATCH (2 << 20)
+
+/* Compression formats */
+typedef enum
+{
+    /* Not compressed (compress_open() reads such files as they are) */
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD,
+} compress_format_t;
+
+/* A block of (decompressed) text */
+typedef struct compress_block
+{
+    char *text;
+    size_t len;
+} compress_block_t;
+
+/* State of a file being loaded */
+typedef struct compress_reader
+{
+    /* The file, its format and (compressed) size */
+    char *path;
+    int fd;
+    compress_format_t format;
+    off_t size;
+
+    /* Set by compress_update when there were more blocks waiting than
+     * fitted in the last batch, and once every block has been added to
+     * the buffer or loading failed (error can then be read without
+     * the lock) */
+    int pending;
+    int finished;
+
+    /* Loading thread, and the lock and condition variable that
+     * go with it. Everything below is protected by the lock */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* eventfd signalled whenever a block is added to the queue, or the
+     * thread is done */
+    int event_fd;
+
+    /* Blocks waiting to be added to the buffer (a ring buffer) */
+    compress_block_t queue[COMPRESS_QUEUE_BLOCKS];
+    int head, count;
+
+    /* Number of bytes of the file read so far */
+    off_t consumed;
+
+    /* Set when the whole file has been read (or reading or
+     * decompressing it failed) */
+    int done;
+
+    /* errno of a failed read, or EILSEQ if the file is corrupt (0 if
+     * nothing failed) */
+    int error;
+
+    /* Set to ask the thread to exit */
+    int quit;
+
+} compress_reader_t;
+
+
+/* compress_detect - Find the compression format of a file
+ *
+ * Only formats that were compiled in are recognized; other files are
+ * opened as they are.
+ *
+ * Parameters:
+ *  - filename: File
+ *
+ * Returns: The format of the file, from its first bytes (COMPRESS_NONE
+ *          if it isn't compressed, or can't be read)
+ */
+compress_format_t compress_detect(const char *filename);
+
+
+/* compress_guess - Choose a compression format for a new file
+ *
+ * Parameters:
+ *  - filename: Name of the file
+ *
+ * Returns: The format its extension (".gz" or ".zst") calls for, if
+ *          compiled in, or COMPRESS_NONE
+ */
+compress_format_t compress_guess(const char *filename);
+
+
+/* compress_open - Start loading a file into a buffer in the background
+ *
+ * The buffer is emptied; its contents are then loaded by
+ * compress_update(). The buffer is set to be saved in the same format.
+ *
+ * Parameters:
+ *  - buf: Buffer to load the file into
+ *  - filename: File to load
+ *  - format: Its format (see compress_detect)
+ *
+ * Returns: A new compress_reader_t, or NULL on error (with errno set)
+ */
+compress_reader_t *compress_open(buffer_t *buf, const char *filename, compress_format_t format);
+
+
+/* compress_close - Stop loading a file
+ *
+ * Parameters:
+ *  - r: File being loaded
+ *
+ * Returns: Nothing
+ */
+void compress_close(compress_reader_t *r);
+
+
+/* compress_fd - File descriptor that becomes readable when there are
+ *               blocks waiting to be added to the buffer (suitable
+ *               for poll())
+ *
+ * Parameters:
+ *  - r: File being loaded
+ *
+ * Returns: A file descriptor
+ */
+int compress_fd(compress_reader_t *r);
+
+
+/* compress_update - Add the blocks loaded so far to the buffer
+ *
+ * Adds at most COMPRESS_MAX_BATCH bytes; r->pending is set if there is
+ * more left to add, and r->finished once there is nothing more to come.
+ * Never waits for the loading thread. The blocks go after the last row
+ * of the buffer, so the buffer may be edited meanwhile, but no rows
+ * may be added after the last one.
+ *
+ * Parameters:
+ *  - r: File being loaded
+ *  - buf: Buffer the file is being loaded into
+ *
+ * Returns: 1 if the buffer changed, 0 if it didn't
+ */
+int compress_update(compress_reader_t *r, buffer_t *buf);
+
+
+/* compress_progress - Find how much of a file has been loaded
+ *
+ * Parameters:
+ *  - r: File being loaded
+ *
+ * Returns: Percentage of the file read so far
+ */
+int compress_progress(compress_reader_t *r);
+
+
+/* compress_save - Write a buffer to its file, compressed
+ *
+ * The buffer is written to a temporary file which then replaces the
+ * file, so the file is left as it was if anything goes wrong.
+ *
+ * Parameters:
+ *  - buf: Buffer (with its filename set)
+ *  - format: Compression format
+ *
+ * Returns: Number of (compressed) bytes written, or -1 on error (with
+ *          errno set)
+ */
+ssize_t compress_save(buffer_t *buf, compress_format_t format);
+
+#endif /* COMPRESS_H */
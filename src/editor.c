@@ -12,172 +12,1509 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stddef.h>
-#include <unistd.h>
+#include <limits.h>
 #include <string.h>
-#include <fcntl.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "editor.h"
+#include "filter.h"
+#include "highlight.h"
 #include "input.h"
 #include "screen.h"
+#include "sort.h"
 #include "terminal.h"
 
 
+/* editor_drop_offsets - Stop keeping track of the byte offsets of a
+ *                       buffer's rows
+ *
+ * Parameters:
+ *  - eb: Buffer
+ *
+ * Returns: Nothing
+ */
+static void editor_drop_offsets(editor_buffer_t *eb)
+{
+    if (eb->offsets)
+    {
+        offsets_free(eb->offsets);
+        free(eb->offsets);
+        eb->offsets = NULL;
+    }
+}
+
+
+/* editor_index_offsets - Start keeping track of the byte offsets of a
+ *                        buffer's rows (again, after it was loaded)
+ *
+ * Parameters:
+ *  - eb: Buffer
+ *
+ * Returns: Nothing
+ */
+static void editor_index_offsets(editor_buffer_t *eb)
+{
+    editor_drop_offsets(eb);
+    if (eb->buf.pager)
+        return;
+
+    eb->offsets = malloc(sizeof(offsets_t));
+    if (eb->offsets == NULL || offsets_init(eb->offsets, &eb->buf) == -1)
+    {
+        if (eb->offsets)
+            offsets_free(eb->offsets);
+        free(eb->offsets);
+        eb->offsets = NULL;
+    }
+}
+
+
+/* editor_start_journal - Start journaling the changes to a buffer
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - eb: Buffer (loaded from its file, or saved to it)
+ *  - resume: Keep the journal the buffer was just recovered from
+ *
+ * Returns: Nothing
+ */
+static void editor_start_journal(editor_ctx_t *ctx, editor_buffer_t *eb, int resume)
+{
+    eb->journal = malloc(sizeof(journal_t));
+    if (eb->journal == NULL || journal_init(eb->journal, &eb->buf, resume) == -1)
+    {
+        if (errno == EWOULDBLOCK)
+            screen_set_status_message(ctx, "%s is open elsewhere, so it isn't journaled",
+                                      eb->buf.filename);
+        else
+            screen_set_status_message(ctx, "Can't journal changes to %s: %s",
+                                      eb->buf.filename, strerror(errno));
+        free(eb->journal);
+        eb->journal = NULL;
+    }
+}
+
+
+/* editor_add_buffer - Add an empty buffer at the end of the buffer list
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Index of the new buffer
+ */
+static int editor_add_buffer(editor_ctx_t *ctx)
+{
+    editor_buffer_t **buffers = realloc(ctx->buffers, sizeof(editor_buffer_t *) * (ctx->num_buffers + 1));
+    editor_buffer_t *eb = calloc(1, sizeof(editor_buffer_t));
+    if (buffers == NULL || eb == NULL)
+        terminal_die("malloc");
+
+    buffer_init(&eb->buf);
+    editor_index_offsets(eb);
+    buffers[ctx->num_buffers] = eb;
+    ctx->buffers = buffers;
+    return ctx->num_buffers++;
+}
+
+
+/* editor_add_pane - Add a pane to the list of panes
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - at: Position of the new pane in the list
+ *  - index: Buffer to show in the pane
+ *
+ * Returns: The new pane
+ */
+static pane_t *editor_add_pane(editor_ctx_t *ctx, int at, int index)
+{
+    pane_t **panes = realloc(ctx->panes, sizeof(pane_t *) * (ctx->num_panes + 1));
+    pane_t *pane = malloc(sizeof(pane_t));
+    if (panes == NULL || pane == NULL)
+        terminal_die("malloc");
+
+    pane_init(pane, &ctx->buffers[index]->buf, index);
+    memmove(&panes[at + 1], &panes[at], sizeof(pane_t *) * (ctx->num_panes - at));
+    panes[at] = pane;
+    ctx->panes = panes;
+    ctx->num_panes++;
+    return pane;
+}
+
+
+/* editor_wrap_index - Get a buffer's wrap index, if soft wrap is on
+ *
+ * The index is created the first time it's needed at a given width.
+ * Panes of the same width share it.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - eb: Buffer
+ *  - cols: Width of the pane
+ *
+ * Returns: The wrap index, or NULL if soft wrap is off or the buffer
+ *          can't be wrapped (with errno set, if it should have been)
+ */
+static wrap_t *editor_wrap_index(editor_ctx_t *ctx, editor_buffer_t *eb, int cols)
+{
+    /* Wrapping every row would mean loading the whole file */
+    if (!ctx->soft_wrap || eb->buf.pager)
+        return NULL;
+
+    for (int i = 0; i < eb->num_wraps; i++)
+        if (eb->wraps[i]->cols == cols)
+            return eb->wraps[i];
+
+    wrap_t **wraps = realloc(eb->wraps, sizeof(wrap_t *) * (eb->num_wraps + 1));
+    if (wraps == NULL)
+        return NULL;
+    eb->wraps = wraps;
+
+    wrap_t *wrap = malloc(sizeof(wrap_t));
+    if (wrap == NULL)
+        return NULL;
+    if (wrap_init(wrap, &eb->buf, cols) == -1)
+    {
+        wrap_free(wrap);
+        free(wrap);
+        return NULL;
+    }
+    eb->wraps[eb->num_wraps++] = wrap;
+    return wrap;
+}
+
+
+/* editor_wrap_width - Is there a pane of a given width? */
+static int editor_wrap_width(editor_ctx_t *ctx, int cols)
+{
+    for (int k = 0; k < ctx->num_panes; k++)
+        if (ctx->panes[k]->cols == cols)
+            return 1;
+    return 0;
+}
+
+
+/* editor_sweep_wraps - Free the wrap indexes that can't be used any more
+ *
+ * An index is kept as long as there is a pane of its width, even if
+ * the pane shows another buffer, so switching back to the buffer
+ * doesn't have to wrap it all over again. An index whose width is
+ * gone is moved to the width of a pane showing its buffer that has no
+ * index yet (e.g., after the terminal is resized), which only wraps
+ * its rows again as they are needed.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_sweep_wraps(editor_ctx_t *ctx)
+{
+    for (int i = 0; i < ctx->num_buffers; i++)
+    {
+        editor_buffer_t *eb = ctx->buffers[i];
+        int wrapped = ctx->soft_wrap && !eb->buf.pager;
+        int kept = 0;
+        for (int j = 0; j < eb->num_wraps; j++)
+        {
+            wrap_t *wrap = eb->wraps[j];
+            if (wrapped && editor_wrap_width(ctx, wrap->cols))
+            {
+                eb->wraps[kept++] = wrap;
+                continue;
+            }
+
+            /* A width of a pane showing the buffer, with no index (the
+             * indexes kept so far, and those still to come that have a
+             * pane's width) */
+            int cols = -1;
+            for (int k = 0; k < ctx->num_panes && wrapped && cols == -1; k++)
+            {
+                if (ctx->panes[k]->buffer != i)
+                    continue;
+                cols = ctx->panes[k]->cols;
+                for (int m = 0; m < eb->num_wraps; m++)
+                    if ((m < kept || m > j) && eb->wraps[m]->cols == cols)
+                        cols = -1;
+            }
+
+            if (cols != -1)
+            {
+                wrap_set_cols(wrap, cols);
+                eb->wraps[kept++] = wrap;
+            }
+            else
+            {
+                wrap_free(wrap);
+                free(wrap);
+            }
+        }
+        eb->num_wraps = kept;
+    }
+}
+
+
+/* editor_damage_panes - Make sure the panes showing a buffer are drawn
+ *                       again, for changes their listeners don't see
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - buf: Buffer (NULL for all of the panes)
+ *
+ * Returns: Nothing
+ */
+static void editor_damage_panes(editor_ctx_t *ctx, buffer_t *buf)
+{
+    for (int i = 0; i < ctx->num_panes; i++)
+        if (buf == NULL || ctx->panes[i]->buf == buf)
+            ctx->panes[i]->damaged = 1;
+}
+
+
+/* editor_place_panes - Lay out the panes on the screen again
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_place_panes(editor_ctx_t *ctx)
+{
+    /* Make room for the status message */
+    pane_layout_place(ctx->layout, 0, 0, ctx->window_rows - 1, ctx->window_cols);
+    ctx->repaint = 1;
+}
+
+
+/* editor_store_view - Save the cursor position and offsets in the
+ *                     focused pane
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_store_view(editor_ctx_t *ctx)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    pane->cx = ctx->cx;
+    pane->cy = ctx->cy;
+    pane->rowoff = ctx->rowoff;
+    pane->coloff = ctx->coloff;
+    pane->segoff = ctx->segoff;
+}
+
+
+/* editor_clamp_cursor - Bring the cursor back into the buffer, and to
+ *                       the start of a character
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_clamp_cursor(editor_ctx_t *ctx)
+{
+    if (ctx->cy > ctx->buf->num_rows)
+        ctx->cy = ctx->buf->num_rows;
+    erow_t *row = ctx->cy < ctx->buf->num_rows ? buffer_row(ctx->buf, ctx->cy) : NULL;
+    int rowlen = row ? row->size : 0;
+    if (ctx->cx > rowlen)
+        ctx->cx = rowlen;
+    if (row && ctx->cx > 0 && ctx->cx < rowlen)
+        ctx->cx = editor_row_prev_char(row, ctx->cx + 1);
+}
+
+
+/* editor_load_view - Make the focused pane's buffer the one being
+ *                    edited, with the pane's cursor position and offsets
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_load_view(editor_ctx_t *ctx)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    ctx->buf = pane->buf;
+    ctx->current = pane->buffer;
+    ctx->screen_rows = pane->rows;
+    ctx->screen_cols = pane->cols;
+    ctx->wrap = editor_wrap_index(ctx, ctx->buffers[pane->buffer], pane->cols);
+    ctx->cx = pane->cx;
+    ctx->cy = pane->cy;
+    ctx->rowoff = pane->rowoff;
+    ctx->coloff = pane->coloff;
+    ctx->segoff = pane->segoff;
+
+    /* The buffer may have been edited in another pane, or reloaded
+     * in follow mode, since */
+    editor_clamp_cursor(ctx);
+}
+
+
+/* editor_keep_view - Save a pane's cursor position and offsets in its
+ *                    buffer, for when the buffer is shown again
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - pane: Pane (with its view saved, see editor_store_view)
+ *
+ * Returns: Nothing
+ */
+static void editor_keep_view(editor_ctx_t *ctx, pane_t *pane)
+{
+    editor_buffer_t *eb = ctx->buffers[pane->buffer];
+    eb->cx = pane->cx;
+    eb->cy = pane->cy;
+    eb->rowoff = pane->rowoff;
+    eb->coloff = pane->coloff;
+    eb->segoff = pane->segoff;
+}
+
+
+/* See editor.h */
+void init_editor(editor_ctx_t *ctx)
+{
+    if (terminal_get_window_size(&ctx->window_rows, &ctx->window_cols) == -1)
+        terminal_die("terminal_get_window_size");
+
+    ctx->rx = 0;
+    ctx->soft_wrap = 0;
+    ctx->screen_cy = 0;
+    ctx->screen_cx = 0;
+
+    ctx->buffers = NULL;
+    ctx->num_buffers = 0;
+    editor_add_buffer(ctx);
+
+    ctx->panes = NULL;
+    ctx->num_panes = 0;
+    ctx->pane = 0;
+    editor_add_pane(ctx, 0, 0);
+    ctx->layout = pane_layout_new(ctx->panes[0]);
+    if (ctx->layout == NULL)
+        terminal_die("malloc");
+    editor_place_panes(ctx);
+    editor_load_view(ctx);
+
+    ctx->follow = 0;
+    ctx->highlighter = highlight_worker_start();
+
+    ctx->paged = 0;
+    ctx->page_cache = (size_t)MICRO_PAGE_CACHE_MB << 20;
+    ctx->readonly = 0;
+
+    ctx->search = NULL;
+    ctx->failed = 0;
+    ctx->macro = NULL;
+    ctx->macro_len = 0;
+    ctx->macro_capacity = 0;
+    ctx->recording = 0;
+    ctx->replay = -1;
+    ctx->replay_buf = NULL;
+    ctx->statusmsg[0] = '\0';
+    ctx->statusmsg_time = 0;
+}
+
+
+/* editor_remember_views - Save where each file with a cached line
+ *                         index was viewed (see lineindex.h)
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_remember_views(editor_ctx_t *ctx)
+{
+    editor_store_view(ctx);
+    for (int i = 0; i < ctx->num_panes; i++)
+        editor_keep_view(ctx, ctx->panes[i]);
+
+    for (int i = 0; i < ctx->num_buffers; i++)
+    {
+        editor_buffer_t *eb = ctx->buffers[i];
+        if (eb->buf.filename == NULL || !(eb->buf.pager || eb->buf.line_offsets))
+            continue;
+        lineindex_view_t view = {eb->cx, eb->cy, eb->rowoff, eb->coloff};
+        lineindex_save_view(eb->buf.filename, eb->buf.pager ? PAGER_BLOCK_ROWS : 1, &view);
+    }
+}
+
+
+/* See editor.h */
+void editor_free(editor_ctx_t *ctx)
+{
+    if (ctx->num_panes > 0)
+        editor_remember_views(ctx);
+
+    if (ctx->highlighter)
+        highlight_worker_stop(ctx->highlighter);
+    ctx->highlighter = NULL;
+
+    for (int i = 0; i < ctx->num_panes; i++)
+    {
+        pane_free(ctx->panes[i]);
+        free(ctx->panes[i]);
+    }
+    free(ctx->panes);
+    pane_layout_free(ctx->layout);
+    ctx->panes = NULL;
+    ctx->num_panes = 0;
+    ctx->layout = NULL;
+
+    for (int i = 0; i < ctx->num_buffers; i++)
+    {
+        editor_buffer_t *eb = ctx->buffers[i];
+        if (eb->follow)
+            follow_close(eb->follow);
+        if (eb->reader)
+            compress_close(eb->reader);
+        for (int j = 0; j < eb->num_wraps; j++)
+        {
+            wrap_free(eb->wraps[j]);
+            free(eb->wraps[j]);
+        }
+        free(eb->wraps);
+        if (eb->offsets)
+        {
+            offsets_free(eb->offsets);
+            free(eb->offsets);
+        }
+        if (eb->journal)
+        {
+            journal_free(eb->journal);
+            free(eb->journal);
+        }
+        buffer_free(&eb->buf);
+        free(eb);
+    }
+    free(ctx->buffers);
+    ctx->buffers = NULL;
+    ctx->num_buffers = 0;
+
+    free(ctx->search);
+    ctx->search = NULL;
+    free(ctx->macro);
+    ctx->macro = NULL;
+    ctx->macro_len = ctx->macro_capacity = 0;
+}
+
+
+/* editor_check_writable - Check that the buffer can be modified
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: 1 if the buffer can be modified, 0 (after telling
+ *          the user) if it's read-only
+ */
+static int editor_check_writable(editor_ctx_t *ctx)
+{
+    if (ctx->buf->readonly)
+    {
+        screen_set_status_message(ctx, "Buffer is read-only");
+        return 0;
+    }
+    return 1;
+}
+
+
+/* editor_check_loaded_end - Check that no line would be added past the
+ *                           end of a file that is still loading
+ *
+ * The rest of the file is added after the rows loaded so far, so a
+ * line added past them (from the row after the last one) would end up
+ * in the middle of the file.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: 1 if the cursors can add lines, 0 (after telling the user)
+ *          if one of them is past the end of a file that is loading
+ */
+static int editor_check_loaded_end(editor_ctx_t *ctx)
+{
+    if (ctx->buffers[ctx->current]->reader == NULL)
+        return 1;
+
+    pane_t *pane = ctx->panes[ctx->pane];
+    int past_end = ctx->cy >= ctx->buf->num_rows;
+    for (int i = 0; i < pane->num_cursors; i++)
+        past_end |= pane->cursors[i].cy >= ctx->buf->num_rows;
+    if (past_end)
+    {
+        screen_set_status_message(ctx, "Can't add lines at the end until the file has finished loading");
+        return 0;
+    }
+    return 1;
+}
+
+
+/* editor_compare_cursors - qsort comparison of cursors by position */
+static int editor_compare_cursors(const void *a, const void *b)
+{
+    const pane_cursor_t *x = a, *y = b;
+    if (x->cy != y->cy)
+        return x->cy < y->cy ? -1 : 1;
+    return (x->cx > y->cx) - (x->cx < y->cx);
+}
+
+
+/* editor_sort_cursors - Sort a list of cursors and merge duplicates
+ *
+ * Parameters:
+ *  - cursors: Cursors
+ *  - n: Number of cursors
+ *  - cx, cy: Position of the main cursor (which must be in the list)
+ *  - main: Output parameter to return the index of the main cursor
+ *
+ * Returns: Number of cursors left
+ */
+static int editor_sort_cursors(pane_cursor_t *cursors, int n, int cx, int cy, int *main)
+{
+    qsort(cursors, n, sizeof(pane_cursor_t), editor_compare_cursors);
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (count > 0 && editor_compare_cursors(&cursors[count - 1], &cursors[i]) == 0)
+            continue;
+        cursors[count] = cursors[i];
+        if (cursors[count].cx == cx && cursors[count].cy == cy)
+            *main = count;
+        count++;
+    }
+    return count;
+}
+
+
+/* editor_gather_cursors - Take all the cursors of the focused pane
+ *
+ * Cursors left outside the buffer or inside a character (by edits made
+ * in another pane) are brought back in first, so the list holds the
+ * main cursor and the extra ones in order, with no duplicates. The
+ * pane has no extra cursors until they are handed back with
+ * editor_scatter_cursors.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - n: Output parameter to return the number of cursors
+ *  - main: Output parameter to return the index of the main cursor
+ *
+ * Returns: The list of cursors
+ */
+static pane_cursor_t *editor_gather_cursors(editor_ctx_t *ctx, int *n, int *main)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    int count = pane->num_cursors + 1;
+    pane_cursor_t *cursors = realloc(pane->cursors, sizeof(pane_cursor_t) * count);
+    if (cursors == NULL)
+        terminal_die("realloc");
+    pane->cursors = NULL;
+    pane->num_cursors = 0;
+    cursors[count - 1] = (pane_cursor_t){ctx->cx, ctx->cy};
+
+    for (int i = 0; i < count; i++)
+    {
+        pane_cursor_t *c = &cursors[i];
+        if (c->cy > ctx->buf->num_rows)
+            c->cy = ctx->buf->num_rows;
+        erow_t *row = c->cy < ctx->buf->num_rows ? buffer_row(ctx->buf, c->cy) : NULL;
+        int rowlen = row ? row->size : 0;
+        if (c->cx > rowlen)
+            c->cx = rowlen;
+        if (row && c->cx > 0 && c->cx < rowlen)
+            c->cx = editor_row_prev_char(row, c->cx + 1);
+    }
+
+    *n = editor_sort_cursors(cursors, count, cursors[count - 1].cx, cursors[count - 1].cy, main);
+    return cursors;
+}
+
+
+/* editor_scatter_cursors - Give the focused pane back its cursors
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - cursors: Cursors, in order (see editor_gather_cursors)
+ *  - n: Number of cursors
+ *  - main: Index of the main cursor
+ *
+ * Returns: Nothing
+ */
+static void editor_scatter_cursors(editor_ctx_t *ctx, pane_cursor_t *cursors, int n, int main)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    ctx->cx = cursors[main].cx;
+    ctx->cy = cursors[main].cy;
+    memmove(&cursors[main], &cursors[main + 1], sizeof(pane_cursor_t) * (n - main - 1));
+    free(pane->cursors);
+    pane->cursors = cursors;
+    pane->num_cursors = n - 1;
+    pane->damaged = 1;
+}
+
+
+/* editor_edit_cursors - Make the same edit at every cursor
+ *
+ * At each cursor, the character before it (direction -1), after it
+ * (direction 1) or nothing (direction 0) is replaced by s. The edits
+ * to a row are all made in one go, so a row with many cursors on it is
+ * only rebuilt (and rendered, and reported to the buffer's listeners)
+ * once. Cursors at the start or end of a row do not join rows.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - direction: Character to replace
+ *  - s: Text to put in its place
+ *  - len: Length of s
+ *
+ * Returns: Nothing
+ */
+static void editor_edit_cursors(editor_ctx_t *ctx, int direction, const char *s, int len)
+{
+    int n, main;
+    pane_cursor_t *cursors = editor_gather_cursors(ctx, &n, &main);
+    erow_edit_t *edits = malloc(sizeof(erow_edit_t) * n);
+    if (edits == NULL)
+        terminal_die("malloc");
+
+    /* Typing past the end of the buffer starts a new row */
+    if (len > 0 && cursors[n - 1].cy == ctx->buf->num_rows)
+        buffer_insert_row(ctx->buf, ctx->buf->num_rows, "", 0);
+
+    for (int i = 0; i < n && cursors[i].cy < ctx->buf->num_rows;)
+    {
+        int cy = cursors[i].cy;
+        erow_t *row = buffer_row(ctx->buf, cy);
+        int k = 0, changed = len > 0;
+        for (int j = i; j < n && cursors[j].cy == cy; j++, k++)
+        {
+            int start = cursors[j].cx, end = cursors[j].cx;
+            if (direction < 0 && start > 0)
+                start = editor_row_prev_char(row, start);
+            else if (direction > 0 && end < row->size)
+                end = editor_row_next_char(row, end);
+            edits[k].at = start;
+            edits[k].len = end - start;
+            changed |= end > start;
+        }
+        if (changed)
+            buffer_row_splice(ctx->buf, cy, edits, k, s, len);
+
+        /* Each cursor ends up just after its own edit */
+        int shift = 0;
+        for (int e = 0; e < k; e++, i++)
+        {
+            cursors[i].cx = edits[e].at + shift + len;
+            shift += len - edits[e].len;
+        }
+    }
+
+    free(edits);
+    editor_scatter_cursors(ctx, cursors, n, main);
+}
+
+
+/* editor_break_row - Break a row in two at a given position
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - cy: Row (or the number of rows, to add an empty row at the end)
+ *  - cx: Position in the row
+ *
+ * Returns: Nothing
+ */
+static void editor_break_row(buffer_t *buf, int cy, int cx)
+{
+    if (cx == 0)
+    {
+        buffer_insert_row(buf, cy, "", 0);
+    }
+    else
+    {
+        erow_t *row = buffer_row(buf, cy);
+        buffer_insert_row(buf, cy + 1, &editor_row_chars(row)[cx], row->size - cx);
+        buffer_row_truncate(buf, cy, cx);
+    }
+}
+
+
+/* editor_begin_change - Start a command that changes the buffer
+ *
+ * Everything the command changes is undone together (see undo_begin).
+ * While a macro is replayed, everything it changes in the buffer it
+ * was started in is undone together instead.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - typing: Is the command typing a character?
+ *
+ * Returns: Nothing
+ */
+static void editor_begin_change(editor_ctx_t *ctx, int typing)
+{
+    if (ctx->buf == ctx->replay_buf)
+        return;
+    undo_begin(&ctx->buf->undo, ctx->cx, ctx->cy, typing);
+}
+
+
+/* editor_end_change - Finish a command that changes the buffer
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_end_change(editor_ctx_t *ctx)
+{
+    if (ctx->buf == ctx->replay_buf)
+        return;
+    undo_end(&ctx->buf->undo, ctx->cx, ctx->cy);
+}
+
+
+/* See editor.h */
+void editor_insert_char(editor_ctx_t *ctx, int c)
+{
+    char ch = c;
+    editor_insert_text(ctx, &ch, 1);
+}
+
+
+/* See editor.h */
+void editor_insert_text(editor_ctx_t *ctx, const char *s, int len)
+{
+    if (len == 0 || !editor_check_writable(ctx) || !editor_check_loaded_end(ctx))
+        return;
+    editor_begin_change(ctx, 1);
+    if (ctx->panes[ctx->pane]->num_cursors > 0)
+    {
+        editor_edit_cursors(ctx, 0, s, len);
+    }
+    else
+    {
+        if (ctx->cy == ctx->buf->num_rows)
+        {
+            buffer_insert_row(ctx->buf, ctx->buf->num_rows, "", 0);
+        }
+        erow_edit_t edit = {ctx->cx, 0};
+        buffer_row_splice(ctx->buf, ctx->cy, &edit, 1, s, len);
+        ctx->cx += len;
+    }
+    editor_end_change(ctx);
+}
+
+
+/* See editor.h */
+void editor_insert_newline(editor_ctx_t *ctx)
+{
+    if (!editor_check_writable(ctx) || !editor_check_loaded_end(ctx))
+        return;
+    editor_begin_change(ctx, 0);
+    if (ctx->panes[ctx->pane]->num_cursors > 0)
+    {
+        int n, main;
+        pane_cursor_t *cursors = editor_gather_cursors(ctx, &n, &main);
+
+        /* From the bottom up, so the rows still to be broken stay put.
+         * Each cursor then goes down by one row for every row broken
+         * up to and including its own */
+        for (int i = n - 1; i >= 0; i--)
+            editor_break_row(ctx->buf, cursors[i].cy, cursors[i].cx);
+        for (int i = 0; i < n; i++)
+        {
+            cursors[i].cy += i + 1;
+            cursors[i].cx = 0;
+        }
+        editor_scatter_cursors(ctx, cursors, n, main);
+    }
+    else
+    {
+        editor_break_row(ctx->buf, ctx->cy, ctx->cx);
+        ctx->cy++;
+        ctx->cx = 0;
+    }
+    editor_end_change(ctx);
+}
+
+
+/* editor_delete_prev - Delete the character before the (single) cursor,
+ *                      or join its row to the one above
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_delete_prev(editor_ctx_t *ctx)
+{
+    if (ctx->cy == ctx->buf->num_rows)
+        return;
+
+    if (ctx->cx == 0 && ctx->cy == 0)
+        return;
+
+    erow_t *row = buffer_row(ctx->buf, ctx->cy);
+    if (ctx->cx > 0)
+    {
+        /* Delete all the bytes of the character before the cursor */
+        int start = editor_row_prev_char(row, ctx->cx);
+        erow_edit_t edit = {start, ctx->cx - start};
+        buffer_row_splice(ctx->buf, ctx->cy, &edit, 1, "", 0);
+        ctx->cx = start;
+    }
+    else
+    {
+        ctx->cx = buffer_row(ctx->buf, ctx->cy - 1)->size;
+        buffer_row_append_string(ctx->buf, ctx->cy - 1, editor_row_chars(row), row->size);
+        buffer_delete_row(ctx->buf, ctx->cy);
+        ctx->cy--;
+    }
+}
+
+
+/* See editor.h */
+void editor_delete_char(editor_ctx_t *ctx)
+{
+    if (!editor_check_writable(ctx))
+        return;
+    editor_begin_change(ctx, 0);
+    if (ctx->panes[ctx->pane]->num_cursors > 0)
+        editor_edit_cursors(ctx, -1, "", 0);
+    else
+        editor_delete_prev(ctx);
+    editor_end_change(ctx);
+}
+
+
+/* editor_delete_next - Delete the character after the (single) cursor,
+ *                      or join the row below to its row
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void editor_delete_next(editor_ctx_t *ctx)
+{
+    if (ctx->cy == ctx->buf->num_rows)
+        return;
+
+    erow_t *row = buffer_row(ctx->buf, ctx->cy);
+    if (ctx->cx < row->size)
+    {
+        erow_edit_t edit = {ctx->cx, editor_row_next_char(row, ctx->cx) - ctx->cx};
+        buffer_row_splice(ctx->buf, ctx->cy, &edit, 1, "", 0);
+    }
+    else if (ctx->cy + 1 < ctx->buf->num_rows)
+    {
+        erow_t *next = buffer_row(ctx->buf, ctx->cy + 1);
+        buffer_row_append_string(ctx->buf, ctx->cy, editor_row_chars(next), next->size);
+        buffer_delete_row(ctx->buf, ctx->cy + 1);
+    }
+}
+
+
+/* See editor.h */
+void editor_delete_next_char(editor_ctx_t *ctx)
+{
+    if (!editor_check_writable(ctx))
+        return;
+    editor_begin_change(ctx, 0);
+    if (ctx->panes[ctx->pane]->num_cursors > 0)
+        editor_edit_cursors(ctx, 1, "", 0);
+    else
+        editor_delete_next(ctx);
+    editor_end_change(ctx);
+}
+
+
+/* See editor.h */
+void editor_undo(editor_ctx_t *ctx)
+{
+    if (!editor_check_writable(ctx))
+        return;
+    int cx, cy;
+    if (!buffer_undo(ctx->buf, &cx, &cy))
+    {
+        screen_set_status_message(ctx, "Nothing to undo");
+        return;
+    }
+    editor_clear_cursors(ctx);
+    ctx->cx = cx;
+    ctx->cy = cy;
+    editor_clamp_cursor(ctx);
+}
+
+
+/* editor_has_cursor - Is there a cursor of the focused pane at a
+ *                     given position? */
+static int editor_has_cursor(editor_ctx_t *ctx, int cy, int cx)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    pane_cursor_t key = {cx, cy};
+    if (ctx->cx == cx && ctx->cy == cy)
+        return 1;
+    return bsearch(&key, pane->cursors, pane->num_cursors, sizeof(pane_cursor_t),
+                   editor_compare_cursors) != NULL;
+}
+
+
+/* editor_add_cursor - Add a cursor to the focused pane, and make it
+ *                     the main one
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - cy, cx: Position of the new cursor
+ *
+ * Returns: Nothing
+ */
+static void editor_add_cursor(editor_ctx_t *ctx, int cy, int cx)
+{
+    int n, main;
+    pane_cursor_t *cursors = editor_gather_cursors(ctx, &n, &main);
+    pane_cursor_t *grown = realloc(cursors, sizeof(pane_cursor_t) * (n + 1));
+    if (grown == NULL)
+        terminal_die("realloc");
+    grown[n] = (pane_cursor_t){cx, cy};
+    n = editor_sort_cursors(grown, n + 1, cx, cy, &main);
+    editor_scatter_cursors(ctx, grown, n, main);
+}
+
+
+/* See editor.h */
+void editor_add_cursor_below(editor_ctx_t *ctx)
+{
+    if (ctx->cy + 1 >= ctx->buf->num_rows)
+    {
+        screen_set_status_message(ctx, "No row below");
+        return;
+    }
+    int rx = editor_row_cx2rx(buffer_row(ctx->buf, ctx->cy), ctx->cx);
+    int cx = editor_row_rx2cx(buffer_row(ctx->buf, ctx->cy + 1), rx);
+    editor_add_cursor(ctx, ctx->cy + 1, cx);
+}
+
+
+/* See editor.h */
+void editor_add_cursor_at_match(editor_ctx_t *ctx)
+{
+    if (ctx->search == NULL)
+    {
+        screen_set_status_message(ctx, "Search for something first (Ctrl-F)");
+        return;
+    }
+
+    /* Every match we skip has a cursor, so this ends */
+    int row = ctx->cy, col = ctx->cx;
+    for (int tries = 0; tries <= ctx->panes[ctx->pane]->num_cursors; tries++)
+    {
+        row = buffer_find_next(ctx->buf, ctx->search, row, col, &col);
+        if (row == -1)
+        {
+            screen_set_status_message(ctx, "No match for \"%.40s\"", ctx->search);
+            return;
+        }
+        if (!editor_has_cursor(ctx, row, col))
+        {
+            editor_add_cursor(ctx, row, col);
+            screen_set_status_message(ctx, "%d cursors (Esc to remove)",
+                                      ctx->panes[ctx->pane]->num_cursors + 1);
+            return;
+        }
+    }
+    screen_set_status_message(ctx, "Every match already has a cursor");
+}
+
+
+/* See editor.h */
+void editor_clear_cursors(editor_ctx_t *ctx)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    if (pane->num_cursors == 0)
+        return;
+    pane->num_cursors = 0;
+    pane->damaged = 1;
+}
+
+
+/* See editor.h */
+void editor_move_cursors(editor_ctx_t *ctx, void (*move)(editor_ctx_t *ctx, int key), int key)
+{
+    if (ctx->panes[ctx->pane]->num_cursors == 0)
+    {
+        move(ctx, key);
+        return;
+    }
+
+    int n, main;
+    pane_cursor_t *cursors = editor_gather_cursors(ctx, &n, &main);
+    for (int i = 0; i < n; i++)
+    {
+        ctx->cx = cursors[i].cx;
+        ctx->cy = cursors[i].cy;
+        move(ctx, key);
+        cursors[i] = (pane_cursor_t){ctx->cx, ctx->cy};
+    }
+    n = editor_sort_cursors(cursors, n, cursors[main].cx, cursors[main].cy, &main);
+    editor_scatter_cursors(ctx, cursors, n, main);
+}
+
+
+/* See editor.h */
+void editor_open_file(editor_ctx_t *ctx, char *filename)
+{
+    /* Use a fresh buffer, unless we haven't started using this one */
+    buffer_t *buf = ctx->buf;
+    if (buf->filename || buf->num_rows > 0 || buf->dirty || ctx->buffers[ctx->current]->follow)
+        editor_switch_buffer(ctx, editor_add_buffer(ctx));
+    editor_buffer_t *eb = ctx->buffers[ctx->current];
+
+    if (ctx->follow)
+    {
+        eb->follow = follow_open(ctx->buf, filename);
+        if (eb->follow == NULL)
+            terminal_die("follow_open");
+        highlight_select_syntax(ctx->buf);
+        editor_index_offsets(eb);
+        return;
+    }
+
+    /* Compressed files can't be paged or mapped, and the journal would
+     * be of the compressed bytes; they are always loaded in memory */
+    compress_format_t format = compress_detect(filename);
+
+    /* Files that wouldn't fit in the page cache are always paged */
+    struct stat st;
+    int paged = format == COMPRESS_NONE &&
+                (ctx->paged || (stat(filename, &st) == 0 && (size_t)st.st_size > ctx->page_cache));
+
+    /* Otherwise the offsets would be measured all over again when the
+     * buffer is reset, which means reading every row of a paged file */
+    editor_drop_offsets(eb);
+
+    /* Files are loaded in memory in the background, except that the
+     * journal left behind by a crash has the latest contents */
+    int mapped = format == COMPRESS_NONE && ctx->readonly;
+    int rc = 0, recovered = 0;
+    if (mapped)
+        rc = buffer_open_mapped(ctx->buf, filename);
+    else if (paged)
+        rc = buffer_open_paged(ctx->buf, filename, ctx->page_cache);
+    else if (format == COMPRESS_NONE)
+        recovered = journal_recover(ctx->buf, filename) == 1;
+    if (rc == -1)
+        terminal_die("fopen");
+
+    if (!mapped && !paged && !recovered)
+    {
+        eb->reader = compress_open(ctx->buf, filename, format);
+        if (eb->reader == NULL)
+            terminal_die("fopen");
+        ctx->buf->readonly = ctx->readonly;
+    }
+    highlight_select_syntax(ctx->buf);
+    editor_index_offsets(eb);
+
+    /* Journaling starts once a file has been loaded (see
+     * editor_load_update) */
+    if (recovered)
+    {
+        editor_start_journal(ctx, eb, 1);
+        if (ctx->buf->dirty)
+            screen_set_status_message(ctx, "Recovered unsaved changes to %s", filename);
+    }
+
+    /* Large files (whose line index is cached) open where they were
+     * last viewed */
+    lineindex_view_t view;
+    if ((ctx->readonly || paged) &&
+        lineindex_load_view(filename, ctx->readonly ? 1 : PAGER_BLOCK_ROWS, &view) == 0)
+    {
+        ctx->cy = view.cy < 0 ? 0 : view.cy > INT_MAX ? INT_MAX : (int)view.cy;
+        ctx->cx = view.cx < 0 ? 0 : view.cx > INT_MAX ? INT_MAX : (int)view.cx;
+        editor_clamp_cursor(ctx);
+        ctx->rowoff = view.rowoff >= 0 && view.rowoff <= ctx->cy ? (int)view.rowoff : ctx->cy;
+        ctx->coloff = view.coloff >= 0 && view.coloff <= ctx->cx ? (int)view.coloff : 0;
+    }
+
+    /* A paged buffer can't be wrapped */
+    if (ctx->buf->pager)
+    {
+        editor_sweep_wraps(ctx);
+        ctx->wrap = NULL;
+    }
+}
+
+
+/* See editor.h */
+void editor_switch_buffer(editor_ctx_t *ctx, int index)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    editor_store_view(ctx);
+    editor_keep_view(ctx, pane);
+
+    index = (index % ctx->num_buffers + ctx->num_buffers) % ctx->num_buffers;
+    editor_buffer_t *eb = ctx->buffers[index];
+    pane_show(pane, &eb->buf, index);
+    pane->cx = eb->cx;
+    pane->cy = eb->cy;
+    pane->rowoff = eb->rowoff;
+    pane->coloff = eb->coloff;
+    pane->segoff = eb->segoff;
+    editor_load_view(ctx);
+}
+
+
+/* See editor.h */
+void editor_split_pane(editor_ctx_t *ctx, int side_by_side)
+{
+    /* Each half needs a line of text and a status bar, or a column
+     * (plus the separator) */
+    pane_t *pane = ctx->panes[ctx->pane];
+    if (side_by_side ? pane->cols < 3 : pane->rows < 3)
+    {
+        screen_set_status_message(ctx, "Pane is too small to split");
+        return;
+    }
+
+    editor_store_view(ctx);
+    pane_t *new_pane = editor_add_pane(ctx, ctx->pane + 1, pane->buffer);
+    new_pane->cx = pane->cx;
+    new_pane->cy = pane->cy;
+    new_pane->rowoff = pane->rowoff;
+    new_pane->coloff = pane->coloff;
+    new_pane->segoff = pane->segoff;
+    if (pane_layout_split(ctx->layout, pane, new_pane, side_by_side) == -1)
+        terminal_die("malloc");
+
+    editor_place_panes(ctx);
+    editor_sweep_wraps(ctx);
+    ctx->pane++;
+    editor_load_view(ctx);
+}
+
+
 /* See editor.h */
-void init_editor(editor_ctx_t *ctx)
+void editor_close_pane(editor_ctx_t *ctx)
 {
-    if (terminal_get_window_size(&ctx->screen_rows, &ctx->screen_cols) == -1)
-        terminal_die("terminal_get_window_size");
+    pane_t *pane = ctx->panes[ctx->pane];
+    if (pane_layout_remove(ctx->layout, pane) == -1)
+    {
+        screen_set_status_message(ctx, "Can't close the last pane");
+        return;
+    }
 
-    /* Make room for the status bar and the status message*/
-    ctx->screen_rows -= 2;
+    editor_store_view(ctx);
+    editor_keep_view(ctx, pane);
+    pane_free(pane);
+    free(pane);
+    ctx->num_panes--;
+    memmove(&ctx->panes[ctx->pane], &ctx->panes[ctx->pane + 1],
+            sizeof(pane_t *) * (ctx->num_panes - ctx->pane));
 
-    ctx->cx = 0;
-    ctx->cy = 0;
-    ctx->rx = 0;
+    /* The focus goes to the next pane (or the previous one, if this
+     * was the last) */
+    if (ctx->pane == ctx->num_panes)
+        ctx->pane--;
+    editor_place_panes(ctx);
+    editor_sweep_wraps(ctx);
+    editor_load_view(ctx);
+}
+
+
+/* See editor.h */
+void editor_focus_pane(editor_ctx_t *ctx, int index)
+{
+    editor_store_view(ctx);
+    ctx->pane = (index % ctx->num_panes + ctx->num_panes) % ctx->num_panes;
+    editor_load_view(ctx);
+}
 
-    ctx->num_rows = 0;
-    ctx->rows = NULL;
 
-    ctx->dirty = 0;
+/* See editor.h */
+void editor_toggle_wrap(editor_ctx_t *ctx)
+{
+    if (ctx->soft_wrap)
+    {
+        ctx->soft_wrap = 0;
+        editor_sweep_wraps(ctx);
+        editor_damage_panes(ctx, NULL);
+        ctx->wrap = NULL;
+        ctx->segoff = 0;
+        screen_set_status_message(ctx, "Soft wrap off");
+        return;
+    }
 
-    ctx->rowoff = 0;
+    if (ctx->buf->pager)
+    {
+        screen_set_status_message(ctx, "Soft wrap is not available in paged mode");
+        return;
+    }
+    ctx->soft_wrap = 1;
+    ctx->wrap = editor_wrap_index(ctx, ctx->buffers[ctx->current], ctx->screen_cols);
+    if (ctx->wrap == NULL)
+    {
+        ctx->soft_wrap = 0;
+        editor_sweep_wraps(ctx);
+        screen_set_status_message(ctx, "Can't wrap: %s", strerror(errno));
+        return;
+    }
+    editor_damage_panes(ctx, NULL);
     ctx->coloff = 0;
+    ctx->segoff = 0;
+    screen_set_status_message(ctx, "Soft wrap on");
+}
 
-    ctx->filename = NULL;
 
-    ctx->statusmsg[0] = '\0';
-    ctx->statusmsg_time = 0;
+/* See editor.h */
+void editor_resize(editor_ctx_t *ctx)
+{
+    if (terminal_get_window_size(&ctx->window_rows, &ctx->window_cols) == -1)
+        terminal_die("terminal_get_window_size");
+
+    /* Indexes for the old widths move to the new ones, and the panes'
+     * rows are wrapped again as they are drawn (see editor_wrap_background
+     * for the rest) */
+    editor_store_view(ctx);
+    editor_place_panes(ctx);
+    editor_sweep_wraps(ctx);
+    editor_load_view(ctx);
 }
 
 
 /* See editor.h */
-void editor_insert_char(editor_ctx_t *ctx, int c)
+int editor_wrap_background(editor_ctx_t *ctx)
 {
-    if (ctx->cy == ctx->num_rows)
-    {
-        editor_row_insert(ctx, ctx->num_rows, "", 0);
-    }
-    editor_row_insert_char(&ctx->rows[ctx->cy], ctx->cx, c);
-    ctx->cx++;
-    ctx->dirty++;
+    for (int i = 0; i < ctx->num_buffers; i++)
+        for (int j = 0; j < ctx->buffers[i]->num_wraps; j++)
+            if (wrap_refine(ctx->buffers[i]->wraps[j]))
+                return 1;
+    return 0;
 }
 
 
 /* See editor.h */
-void editor_insert_newline(editor_ctx_t *ctx)
+int editor_highlight_background(editor_ctx_t *ctx)
 {
-    if (ctx->cx == 0)
-    {
-        editor_row_insert(ctx, ctx->cy, "", 0);
-    }
-    else
+    if (ctx->highlighter == NULL)
+        return 0;
+
+    /* Rows of the focused buffer on the screen, in any of the panes */
+    int first = ctx->rowoff;
+    int last = ctx->rowoff + ctx->screen_rows - 1;
+    for (int i = 0; i < ctx->num_panes; i++)
     {
-        erow_t *row = &ctx->rows[ctx->cy];
-        editor_row_insert(ctx, ctx->cy + 1, &row->chars[ctx->cx], row->size - ctx->cx);
-        row = &ctx->rows[ctx->cy];
-        row->size = ctx->cx;
-        row->chars[row->size] = '\0';
-        editor_row_render(row);
+        pane_t *pane = ctx->panes[i];
+        if (pane->buf != ctx->buf || i == ctx->pane)
+            continue;
+        if (pane->rowoff < first)
+            first = pane->rowoff;
+        if (pane->rowoff + pane->rows - 1 > last)
+            last = pane->rowoff + pane->rows - 1;
     }
-    ctx->cy++;
-    ctx->cx = 0;
+
+    if (!highlight_worker_poll(ctx->highlighter, ctx->buf, first, last))
+        return 0;
+    editor_damage_panes(ctx, ctx->buf);
+    return 1;
 }
 
 
-/* See editor.h */
-void editor_delete_char(editor_ctx_t *ctx)
+/* editor_follow_buffer - Load new data from a buffer's followed file
+ *
+ * Parameters:
+ *  - ctx: Editor context object (with the focused pane's view saved,
+ *    see editor_store_view)
+ *  - index: Buffer
+ *
+ * Returns: Nothing
+ */
+static void editor_follow_buffer(editor_ctx_t *ctx, int index)
 {
-    if (ctx->cy == ctx->num_rows)
-        return;
+    editor_buffer_t *eb = ctx->buffers[index];
+    int last = eb->buf.num_rows - 1;
 
-    if (ctx->cx == 0 && ctx->cy == 0)
+    int changed = follow_update(eb->follow, &eb->buf);
+    if (changed == -1)
+    {
+        screen_set_status_message(ctx, "Can't follow %.20s: %s", eb->follow->path, strerror(errno));
+        return;
+    }
+    if (eb->follow->reloaded)
+    {
+        eb->follow->reloaded = 0;
+        screen_set_status_message(ctx, "%.20s was truncated; reloaded", eb->follow->path);
+    }
+    if (!changed)
         return;
 
-    erow_t *row = &ctx->rows[ctx->cy];
-    if (ctx->cx > 0)
+    /* Cursors that were on the last row move to the new last row (the
+     * others are brought back into the buffer when they are loaded) */
+    int end = eb->buf.num_rows > 0 ? eb->buf.num_rows - 1 : 0;
+    if (eb->cy >= last)
     {
-        editor_row_delete_char(row, ctx->cx - 1);
-        ctx->cx--;
+        eb->cy = end;
+        eb->cx = 0;
     }
-    else
+    for (int i = 0; i < ctx->num_panes; i++)
     {
-        ctx->cx = ctx->rows[ctx->cy - 1].size;
-        editor_row_append_string(&ctx->rows[ctx->cy - 1], row->chars, row->size);
-        editor_row_delete(ctx, ctx->cy);
-        ctx->cy--;
+        pane_t *pane = ctx->panes[i];
+        if (pane->buffer == index && pane->cy >= last)
+        {
+            pane->cy = end;
+            pane->cx = 0;
+        }
     }
-    ctx->dirty++;
 }
 
 
 /* See editor.h */
-void editor_open_file(editor_ctx_t *ctx, char *filename)
+void editor_follow_update(editor_ctx_t *ctx)
 {
-    free(ctx->filename);
-    ctx->filename = strdup(filename);
-
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
-        terminal_die("fopen");
-    char *line = NULL;
-    size_t linecap = 0;
-    ssize_t linelen;
-    while ((linelen = getline(&line, &linecap, fp)) != -1)
-    {
-        while (linelen > 0 && (line[linelen - 1] == '\n' ||
-                               line[linelen - 1] == '\r'))
-            linelen--;
-        editor_row_insert(ctx, ctx->num_rows, line, linelen);
-    }
-    free(line);
-    fclose(fp);
-    ctx->dirty = 0;
+    editor_store_view(ctx);
+    for (int i = 0; i < ctx->num_buffers; i++)
+        if (ctx->buffers[i]->follow)
+            editor_follow_buffer(ctx, i);
+    editor_load_view(ctx);
 }
 
 
 /* See editor.h */
 void editor_save_file(editor_ctx_t *ctx)
 {
-    if (ctx->filename == NULL)
+    if (!editor_check_writable(ctx))
+        return;
+
+    editor_buffer_t *eb = ctx->buffers[ctx->current];
+    if (eb->reader)
     {
-        ctx->filename = input_prompt(ctx, "Save as: %s (ESC to cancel)", NULL);
-        if (ctx->filename == NULL)
+        screen_set_status_message(ctx, "Can't save until the file has finished loading");
+        return;
+    }
+
+    if (ctx->buf->filename == NULL)
+    {
+        ctx->buf->filename = input_prompt(ctx, "Save as: %s (ESC to cancel)", NULL);
+        if (ctx->buf->filename == NULL)
         {
             screen_set_status_message(ctx, "Save cancelled");
             return;
         }
+        ctx->buf->compression = compress_guess(ctx->buf->filename);
+        highlight_select_syntax(ctx->buf);
+        editor_damage_panes(ctx, ctx->buf);
+    }
+
+    ssize_t len = buffer_save_file(ctx->buf);
+    if (len == -1)
+    {
+        screen_set_status_message(ctx, "Can't save! I/O error: %s", strerror(errno));
+        return;
     }
+    screen_set_status_message(ctx, "%zd bytes written to disk", len);
 
-    int len;
-    char *buf = editor_rows_to_string(ctx, &len);
-    int fd = open(ctx->filename, O_RDWR | O_CREAT, 0644);
-    if (fd != -1)
+    /* The file now has every change, so the journal starts over (or,
+     * for a new file, starts) */
+    if (eb->journal)
+        journal_saved(eb->journal);
+    else if (!ctx->buf->pager && ctx->buf->compression == COMPRESS_NONE)
+        editor_start_journal(ctx, eb, 0);
+}
+
+
+/* See editor.h */
+int editor_load_update(editor_ctx_t *ctx)
+{
+    int changed = 0;
+    for (int i = 0; i < ctx->num_buffers; i++)
     {
-        if (ftruncate(fd, len) != -1)
+        editor_buffer_t *eb = ctx->buffers[i];
+        pager_t *pager = eb->buf.pager;
+        if (pager && pager->error && !eb->pager_failed)
         {
-            if (write(fd, buf, len) == len)
-            {
-                close(fd);
-                free(buf);
-                ctx->dirty = 0;
-                screen_set_status_message(ctx, "%d bytes written to disk", len);
-                return;
-            }
+            screen_set_status_message(ctx, "Paging %.20s failed: %s (read-only)",
+                                      eb->buf.filename, strerror(pager->error));
+            eb->pager_failed = 1;
+            changed = 1;
+        }
+        if (buffer_check_mapped(&eb->buf))
+            changed = 1;
+        if (eb->buf.map_valid < eb->buf.map_len && !eb->truncated)
+        {
+            screen_set_status_message(ctx, "%.20s was truncated; lines past its end are shown empty",
+                                      eb->buf.filename);
+            eb->truncated = 1;
+            changed = 1;
+        }
+
+        compress_reader_t *r = eb->reader;
+        if (r == NULL)
+            continue;
+
+        if (compress_update(r, &eb->buf))
+            changed = 1;
+        if (!r->finished)
+            continue;
+
+        if (r->error)
+        {
+            screen_set_status_message(ctx, "Can't load %s: %s (read-only)",
+                                      r->path, strerror(r->error));
+            eb->buf.readonly = 1;
+        }
+        else if (!eb->buf.readonly && eb->buf.compression == COMPRESS_NONE)
+        {
+            /* Changes made while the file was loading are only in the
+             * buffer, so the journal starts from a copy of it */
+            editor_start_journal(ctx, eb, 0);
+            if (eb->journal && eb->buf.dirty)
+                journal_checkpoint(eb->journal);
         }
-        close(fd);
+        compress_close(r);
+        eb->reader = NULL;
+        changed = 1;
     }
-    free(buf);
+    return changed;
+}
+
+
+/* See editor.h */
+void editor_journal_update(editor_ctx_t *ctx)
+{
+    for (int i = 0; i < ctx->num_buffers; i++)
+    {
+        editor_buffer_t *eb = ctx->buffers[i];
+        if (eb->journal == NULL)
+            continue;
 
-    screen_set_status_message(ctx, "Can't save! I/O error: %s", strerror(errno));
+        int error = journal_error(eb->journal);
+        if (error)
+        {
+            screen_set_status_message(ctx, "Can't write the journal of %s: %s",
+                                      eb->buf.filename, strerror(error));
+            journal_free(eb->journal);
+            free(eb->journal);
+            eb->journal = NULL;
+        }
+        else if (journal_needs_checkpoint(eb->journal))
+        {
+            journal_checkpoint(eb->journal);
+        }
+    }
 }
 
 
 /* editor_find_callback - Callback function for input_prompt()
  *
  * Searches for the provided string and moves the cursor
- * to the first occurrence of that string.
+ * to the first occurrence of that string after the cursor.
  *
  * Parameters:
  *  - ctx: Editor context object
@@ -191,12 +1528,22 @@ void editor_find_callback(editor_ctx_t *ctx, char *query, int key)
     static int last_match = -1;
     static int direction = 1;
 
+    /* Where the cursor was when the prompt came up (-1 if this is the
+     * first key typed) */
+    static int start_cy = -1, start_cx;
+
     if (key == '\r' || key == '\x1b')
     {
         last_match = -1;
         direction = 1;
+        start_cy = -1;
         return;
     }
+    if (start_cy == -1)
+    {
+        start_cy = ctx->cy;
+        start_cx = ctx->cx;
+    }
     else if (key == ARROW_RIGHT || key == ARROW_DOWN)
     {
         direction = 1;
@@ -211,28 +1558,28 @@ void editor_find_callback(editor_ctx_t *ctx, char *query, int key)
         direction = 1;
     }
 
+    /* A new search finds the first match after where the cursor was,
+     * so searching again for the same thing goes on to the next one.
+     * Coming back around to it (or before it) counts as failing */
+    int col, current;
     if (last_match == -1)
+    {
         direction = 1;
-    int current = last_match;
-
-    for (int i = 0; i < ctx->num_rows; i++)
+        current = buffer_find_next(ctx->buf, query, start_cy, start_cx, &col);
+        ctx->failed = current == -1 || start_cy >= ctx->buf->num_rows || current < start_cy ||
+                      (current == start_cy && col <= start_cx);
+    }
+    else
     {
-        current += direction;
-        if (current == -1)
-            current = ctx->num_rows - 1;
-        else if (current == ctx->num_rows)      
-            current = 0;
-
-        erow_t *row = &ctx->rows[current];
-        char *match = strstr(row->render, query);
-        if (match)
-        {
-            last_match = current;
-            ctx->cy = current;
-            ctx->cx = editor_row_rx2cx(row, match - row->render);
-            ctx->rowoff = ctx->num_rows;
-            break;
-        }
+        current = buffer_find(ctx->buf, query, last_match, direction, &col);
+        ctx->failed = current == -1;
+    }
+    if (current != -1)
+    {
+        last_match = current;
+        ctx->cy = current;
+        ctx->cx = col;
+        ctx->rowoff = ctx->buf->num_rows;
     }
 }
 
@@ -244,12 +1591,15 @@ void editor_find(editor_ctx_t *ctx)
     int saved_cy = ctx->cy;
     int saved_coloff = ctx->coloff;
     int saved_rowoff = ctx->rowoff;
+    int saved_segoff = ctx->segoff;
 
     char *query = input_prompt(ctx, "Search: %s (Use ESC/Arrows/Enter)", editor_find_callback);
 
     if (query)
     {
-        free(query);
+        free(ctx->search);
+        ctx->search = query;
+        editor_clear_cursors(ctx);
     }
     else
     {
@@ -257,5 +1607,334 @@ void editor_find(editor_ctx_t *ctx)
         ctx->cy = saved_cy;
         ctx->coloff = saved_coloff;
         ctx->rowoff = saved_rowoff;
+        ctx->segoff = saved_segoff;
+    }
+}
+
+
+/* See editor.h */
+void editor_replace(editor_ctx_t *ctx)
+{
+    if (!editor_check_writable(ctx))
+        return;
+
+    /* The search moves the cursor to the matches as the user types,
+     * but the replacement leaves it where it was */
+    int saved_cx = ctx->cx;
+    int saved_cy = ctx->cy;
+    int saved_coloff = ctx->coloff;
+    int saved_rowoff = ctx->rowoff;
+    int saved_segoff = ctx->segoff;
+
+    char *query = input_prompt(ctx, "Replace: %s (Use ESC/Arrows/Enter)", editor_find_callback);
+
+    ctx->cx = saved_cx;
+    ctx->cy = saved_cy;
+    ctx->coloff = saved_coloff;
+    ctx->rowoff = saved_rowoff;
+    ctx->segoff = saved_segoff;
+    if (query == NULL)
+        return;
+
+    /* The query is shown in the next prompt, which is a format string */
+    char prompt[80];
+    int len = snprintf(prompt, sizeof(prompt), "Replace \"");
+    for (int i = 0; query[i] && i < 20; i++)
+    {
+        if (query[i] == '%')
+            prompt[len++] = '%';
+        prompt[len++] = query[i];
+    }
+    snprintf(prompt + len, sizeof(prompt) - len, "\" with: %%s");
+
+    char *with = input_prompt(ctx, prompt, NULL);
+    if (with == NULL)
+    {
+        free(query);
+        return;
+    }
+
+    editor_begin_change(ctx, 0);
+    long n = buffer_replace_all(ctx->buf, query, with);
+    editor_end_change(ctx);
+    editor_clear_cursors(ctx);
+    editor_clamp_cursor(ctx);
+
+    if (n == -1)
+        screen_set_status_message(ctx, "Replace failed: %s (Ctrl-Z undoes what was replaced)",
+                                  strerror(errno));
+    else if (n == 0)
+        screen_set_status_message(ctx, "No match for \"%.40s\"", query);
+    else
+        screen_set_status_message(ctx, "Replaced %ld occurrence%s", n, n == 1 ? "" : "s");
+
+    free(ctx->search);
+    ctx->search = query;
+    free(with);
+}
+
+
+/* editor_line_range - Find the lines a command that works on lines
+ *                     applies to
+ *
+ * The lines are those given by a "first,last" prefix of the text the
+ * user typed, or else those from the first cursor to the last, if
+ * there are several, or else the whole buffer.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - text: What the user typed (moved past the prefix, if any)
+ *  - at: Output parameter to return the index of the first row
+ *  - n: Output parameter to return the number of rows
+ *
+ * Returns: 0 on success, -1 (after telling the user) if the prefix
+ *          isn't a range of lines of the buffer
+ */
+static int editor_line_range(editor_ctx_t *ctx, char **text, int *at, int *n)
+{
+    char *p = *text, *end;
+    if (p[0] >= '0' && p[0] <= '9')
+    {
+        long first = strtol(p, &end, 10), last = -1;
+        if (*end == ',')
+        {
+            char *q = end + 1;
+            last = strtol(q, &end, 10);
+            if (end == q)
+                last = -1;
+        }
+        if (last == -1 || (*end != ' ' && *end != '\0'))
+        {
+            /* Not a range after all, but a command that starts with a
+             * digit */
+        }
+        else if (first < 1 || last < first || last > ctx->buf->num_rows)
+        {
+            screen_set_status_message(ctx, "Not a range of lines: %ld,%ld (the file has %d)",
+                                      first, last, ctx->buf->num_rows);
+            return -1;
+        }
+        else
+        {
+            while (*end == ' ')
+                end++;
+            *text = end;
+            *at = first - 1;
+            *n = last - first + 1;
+            return 0;
+        }
+    }
+
+    pane_t *pane = ctx->panes[ctx->pane];
+    if (pane->num_cursors == 0)
+    {
+        *at = 0;
+        *n = ctx->buf->num_rows;
+        return 0;
+    }
+    int first = ctx->cy, last = ctx->cy;
+    for (int i = 0; i < pane->num_cursors; i++)
+    {
+        if (pane->cursors[i].cy < first)
+            first = pane->cursors[i].cy;
+        if (pane->cursors[i].cy > last)
+            last = pane->cursors[i].cy;
+    }
+    if (last >= ctx->buf->num_rows)
+        last = ctx->buf->num_rows - 1;
+    *at = first;
+    *n = last >= first ? last - first + 1 : 0;
+    return 0;
+}
+
+
+/* editor_filter_cancelled - Has Esc been pressed to stop the command
+ *                           being filtered through? (Other keys are
+ *                           kept until it is done) */
+static int editor_filter_cancelled(void *arg)
+{
+    (void)arg;
+    return terminal_take_key('\x1b');
+}
+
+
+/* See editor.h */
+void editor_filter(editor_ctx_t *ctx)
+{
+    if (!editor_check_writable(ctx))
+        return;
+    if (ctx->buffers[ctx->current]->reader)
+    {
+        screen_set_status_message(ctx, "Can't filter until the file has finished loading");
+        return;
+    }
+
+    char *command = input_prompt(ctx, "Filter through: %s (prefix first,last for some lines)", NULL);
+    if (command == NULL)
+        return;
+    char *p = command;
+    int at, n;
+    if (editor_line_range(ctx, &p, &at, &n) == -1 || *p == '\0')
+    {
+        if (*p == '\0')
+            screen_set_status_message(ctx, "No command to filter through");
+        free(command);
+        return;
+    }
+
+    /* The command may take a while (or never finish), so say how to
+     * stop it; a replayed macro doesn't show anything until it's done */
+    screen_set_status_message(ctx, "Running %.30s... (Esc to cancel)", p);
+    if (ctx->replay < 0)
+        screen_refresh(ctx);
+
+    filter_result_t result;
+    editor_begin_change(ctx, 0);
+    int rc = filter_rows(ctx->buf, at, n, p, editor_filter_cancelled, NULL, &result);
+    editor_end_change(ctx);
+
+    if (rc == -1 && errno == ECANCELED)
+    {
+        screen_set_status_message(ctx, "Filter cancelled");
+    }
+    else if (rc == -1 && errno == EFBIG)
+    {
+        screen_set_status_message(ctx, "%.30s wrote far more than it was given, stopped", p);
+    }
+    else if (rc == -1)
+    {
+        screen_set_status_message(ctx, "Can't filter through %.30s: %s", p, strerror(errno));
+    }
+    else if (result.status != 0)
+    {
+        screen_set_status_message(ctx, "%.30s failed (exit status %d)%s%.40s", p, result.status,
+                                  result.message[0] ? ": " : "", result.message);
+    }
+    else
+    {
+        editor_clear_cursors(ctx);
+        ctx->cy = at;
+        ctx->cx = 0;
+        editor_clamp_cursor(ctx);
+        screen_set_status_message(ctx, "%d line%s replaced with %d", n, n == 1 ? "" : "s",
+                                  result.rows);
+    }
+    free(command);
+}
+
+
+/* See editor.h */
+void editor_sort(editor_ctx_t *ctx)
+{
+    if (!editor_check_writable(ctx))
+        return;
+    if (ctx->buf->pager)
+    {
+        screen_set_status_message(ctx, "Sorting is not available in paged mode");
+        return;
+    }
+    if (ctx->buffers[ctx->current]->reader)
+    {
+        screen_set_status_message(ctx, "Can't sort until the file has finished loading");
+        return;
+    }
+
+    char *answer = input_prompt(ctx, "Lines: %s (sort, unique or reverse; prefix first,last for some)",
+                                NULL);
+    if (answer == NULL)
+        return;
+    char *p = answer;
+    int at, n;
+    if (editor_line_range(ctx, &p, &at, &n) == -1)
+    {
+        free(answer);
+        return;
+    }
+    size_t len = strlen(p);
+    int what = len == 0 ? 0 : strncmp(p, "sort", len) == 0 ? 's' : strncmp(p, "unique", len) == 0 ? 'u' :
+                                 strncmp(p, "reverse", len) == 0 ? 'r' : 0;
+    if (what == 0)
+    {
+        screen_set_status_message(ctx, "Sort, unique or reverse? (not \"%.30s\")", p);
+        free(answer);
+        return;
+    }
+    free(answer);
+
+    editor_begin_change(ctx, 0);
+    int rc = what == 's' ? sort_lines(ctx->buf, at, n) :
+             what == 'u' ? sort_unique_lines(ctx->buf, at, n) : sort_reverse_lines(ctx->buf, at, n);
+    editor_end_change(ctx);
+    if (rc == -1)
+    {
+        screen_set_status_message(ctx, "Can't reorder the lines: %s", strerror(errno));
+        return;
+    }
+
+    editor_clear_cursors(ctx);
+    ctx->cy = at;
+    ctx->cx = 0;
+    editor_clamp_cursor(ctx);
+    if (what == 'u')
+        screen_set_status_message(ctx, "%d duplicate line%s removed", rc, rc == 1 ? "" : "s");
+    else
+        screen_set_status_message(ctx, "%d line%s %s", n, n == 1 ? "" : "s",
+                                  what == 's' ? "sorted" : "reversed");
+}
+
+
+/* See editor.h */
+int editor_cursor_offset(editor_ctx_t *ctx, long long *offset, long long *total)
+{
+    offsets_t *o = ctx->buffers[ctx->current]->offsets;
+    if (o == NULL)
+        return -1;
+    *offset = offsets_row(o, ctx->cy) + (ctx->cy < ctx->buf->num_rows ? ctx->cx : 0);
+    *total = offsets_total(o);
+    return 0;
+}
+
+
+/* See editor.h */
+void editor_goto(editor_ctx_t *ctx)
+{
+    char *target = input_prompt(ctx, "Go to: %s (line, or @byte offset)", NULL);
+    if (target == NULL)
+        return;
+
+    /* Offsets can also be given in hex, as "@0x..." */
+    int is_offset = target[0] == '@';
+    char *p = target + is_offset, *end;
+    int base = is_offset && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') ? 16 : 10;
+    errno = 0;
+    long long n = strtoll(p, &end, base);
+    if (end == p || *end != '\0' || n < 0 || errno == ERANGE)
+    {
+        screen_set_status_message(ctx, "Not a line number or offset: %.40s", target);
+        free(target);
+        return;
+    }
+    free(target);
+
+    offsets_t *o = ctx->buffers[ctx->current]->offsets;
+    if (is_offset && o == NULL)
+    {
+        screen_set_status_message(ctx, "Byte offsets are not available in paged mode");
+        return;
+    }
+
+    editor_clear_cursors(ctx);
+    if (is_offset)
+    {
+        ctx->cy = offsets_find(o, n, &ctx->cx);
     }
+    else
+    {
+        ctx->cy = n > 0 ? (n - 1 < ctx->buf->num_rows ? (int)(n - 1) : ctx->buf->num_rows) : 0;
+        ctx->cx = 0;
+    }
+    editor_clamp_cursor(ctx);
+
+    /* Bring the row to the top of the screen (see editor_find_callback) */
+    ctx->rowoff = ctx->buf->num_rows;
 }
@@ -11,40 +11,152 @@
 #define EDITOR_H
 
 #include <time.h>
-#include "row.h"
+#include "buffer.h"
+#include "follow.h"
+#include "compress.h"
+#include "highlight.h"
+#include "wrap.h"
+#include "offsets.h"
+#include "journal.h"
+#include "lineindex.h"
+#include "pane.h"
+
+/* A buffer open in the editor */
+typedef struct editor_buffer
+{
+    /* Text being edited */
+    buffer_t buf;
+
+    /* Cursor position and offsets in this buffer, saved when a pane
+     * switches to another buffer (see editor_switch_buffer) */
+    int cx, cy;
+    int rowoff, coloff, segoff;
+
+    /* Soft wrap indexes of this buffer, one for each width of the
+     * panes it is shown in (see editor_wrap_index). Allocated
+     * separately, since they are registered with the buffer */
+    wrap_t **wraps;
+    int num_wraps;
+
+    /* Byte offsets of the rows (NULL in paged mode). Allocated
+     * separately, since they are registered with the buffer */
+    offsets_t *offsets;
+
+    /* Journal of the changes not saved yet (NULL if the buffer isn't
+     * journaled: it has no file, or is read-only, paged, followed or
+     * compressed) */
+    journal_t *journal;
+
+    /* File being followed (NULL if not in follow mode) */
+    follow_t *follow;
+
+    /* File still being loaded into the buffer in the background (NULL
+     * once it has been, or if it's paged, mapped or followed) */
+    compress_reader_t *reader;
+
+    /* Whether paging the file has failed, making the buffer read-only
+     * (see buffer_row), and been reported */
+    int pager_failed;
+
+    /* Whether the mapped file has been found truncated (see
+     * buffer_open_mapped), and been reported */
+    int truncated;
+} editor_buffer_t;
+
 
 /* Context object to store global information about the editor */
 typedef struct editor_ctx
 {
-    /* Number of rows in the terminal */
+    /* Number of rows and columns in the terminal */
+    int window_rows;
+    int window_cols;
+
+    /* Number of rows in the focused pane */
     int screen_rows;
 
-    /* NUmber of columns in the terminal */
+    /* NUmber of columns in the focused pane */
     int screen_cols;
 
     /* Cursor position */
     int cx, cy;
 
-    /* Editor rows */
-    erow_t *rows;
+    /* Open buffers. Buffers are allocated separately, so they stay put
+     * as the list grows */
+    editor_buffer_t **buffers;
+    int num_buffers;
+
+    /* Panes the screen is split into (in the order they are laid out),
+     * how they are laid out, and the pane that has the focus. The
+     * cursor position, offsets, buffer and wrap index in this struct
+     * are those of the focused pane, which are saved back into it when
+     * another pane gets the focus */
+    pane_t **panes;
+    int num_panes;
+    int pane;
+    pane_layout_t *layout;
 
-    /* Has the file been modified since its last save? */
-    int dirty;
+    /* Has the layout changed since the last frame? (The whole screen
+     * has to be drawn again) */
+    int repaint;
 
-    /* Number of editor rows */
-    int num_rows;
+    /* Text being edited (the focused pane's buffer, and its index) */
+    buffer_t *buf;
+    int current;
 
     /* Row and column offsets (the row/column we're currently scrolled to) */
     int rowoff;
     int coloff;
 
+    /* Soft line wrapping: long rows are continued on the next lines of
+     * the screen instead of being scrolled horizontally. In this mode,
+     * coloff is always 0, and segoff is the first segment of row rowoff
+     * that is on the screen (see editor_row_wrap_start). wrap is the
+     * focused pane's wrap index, or NULL if soft wrap is off (or the
+     * buffer can't be wrapped) */
+    int soft_wrap;
+    wrap_t *wrap;
+    int segoff;
+
+    /* Position of the cursor in the focused pane */
+    int screen_cy, screen_cx;
+
     /* Index into the rendered editor row
      * In the absence of tabs or characters that are rendered as multiple
      * characters, this field will be equal to cx */
     int rx;
 
-    /* File (if any) that is being edited */
-    char *filename;
+    /* Open files in paged mode (see pager.h), and the amount of
+     * memory to use for rows in paged mode */
+    int paged;
+    size_t page_cache;
+
+    /* Open files read-only, memory-mapped (see buffer_open_mapped) */
+    int readonly;
+
+    /* Open files in follow mode (see editor_open_file) */
+    int follow;
+
+    /* Last search term (NULL if nothing has been searched for yet) */
+    char *search;
+
+    /* Set when a command can't do what it was asked to (a search finds
+     * nothing or wraps around, or the cursor can't move any further),
+     * which stops a keyboard macro being replayed */
+    int failed;
+
+    /* Keyboard macro: the keys recorded, and whether keys are being
+     * recorded. While the macro is replayed, replay is the index of the
+     * next key to replay (-1 otherwise), and replay_buf is the buffer
+     * whose undo group is kept open for the whole replay (see input.h) */
+    int *macro;
+    int macro_len;
+    int macro_capacity;
+    int recording;
+    int replay;
+    buffer_t *replay_buf;
+
+    /* Background syntax highlighter (NULL if it couldn't be started) */
+    highlight_worker_t *highlighter;
 
     /* Status message to be displayed at the bottom of the screen */
     char statusmsg[80];
@@ -64,6 +176,17 @@ typedef struct editor_ctx
 void init_editor(editor_ctx_t *ctx);
 
 
+/* editor_free - Frees the editor's buffers and stops its
+ *               background work
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ * 
+ * Returns: Nothing
+ */
+void editor_free(editor_ctx_t *ctx);
+
+
 /* editor_insert_char - Insert character at cursor
  *
  * Inserts a character at the cursor's current position.
@@ -77,6 +200,22 @@ void init_editor(editor_ctx_t *ctx);
 void editor_insert_char(editor_ctx_t *ctx, int c);
 
 
+/* editor_insert_text - Insert text at cursor
+ *
+ * Inserts a string (with no line breaks) at the cursor's current
+ * position, as a single change to its row. Typing the same characters
+ * one at a time has the same result.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - s: Text to insert
+ *  - len: Length of the text
+ *
+ * Returns: Nothing
+ */
+void editor_insert_text(editor_ctx_t *ctx, const char *s, int len);
+
+
 /* editor_insert_newline - Insert a line break at cursor
  * 
  * Parameters:
@@ -99,7 +238,106 @@ void editor_insert_newline(editor_ctx_t *ctx);
 void editor_delete_char(editor_ctx_t *ctx);
 
 
+/* editor_delete_next_char - Delete character after cursor
+ *
+ * Deletes the character under the cursor, or joins the next row to
+ * the cursor's row if the cursor is at the end of it.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_delete_next_char(editor_ctx_t *ctx);
+
+
+/* editor_undo - Undo the last command that changed the buffer
+ *
+ * The cursor goes back to where it was before the command.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_undo(editor_ctx_t *ctx);
+
+
+/* editor_add_cursor_below - Add a cursor on the row below
+ *
+ * The new cursor goes in the same screen column, and becomes the main
+ * one; the previous one stays as an extra cursor. From then on, typing
+ * and deleting happen at every cursor.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_add_cursor_below(editor_ctx_t *ctx);
+
+
+/* editor_add_cursor_at_match - Add a cursor at the next match of the
+ *                              last search
+ *
+ * The search starts after the main cursor, wraps around the end of the
+ * buffer, and skips matches that already have a cursor. The new cursor
+ * becomes the main one.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_add_cursor_at_match(editor_ctx_t *ctx);
+
+
+/* editor_clear_cursors - Remove the extra cursors of the focused pane
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_clear_cursors(editor_ctx_t *ctx);
+
+
+/* editor_move_cursors - Move every cursor of the focused pane
+ *
+ * Cursors that end up in the same place are merged.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - move: Function that moves the main cursor (ctx->cx, ctx->cy); it
+ *    is called once for each cursor, with that cursor made the main one
+ *  - key: Key to pass to move
+ *
+ * Returns: Nothing
+ */
+void editor_move_cursors(editor_ctx_t *ctx, void (*move)(editor_ctx_t *ctx, int key), int key);
+
+
 /* editor_open_file - Opens a file in the editor
+ *
+ * The file is opened in a new buffer, which becomes the current one
+ * (unless the current buffer is still empty and unnamed, in which case
+ * the file is opened there).
+ *
+ * If ctx->follow is set, the file is followed, like `tail -f`: data
+ * appended to it is added to the buffer as it arrives (see
+ * editor_follow_update). Otherwise, files are opened read-only if
+ * ctx->readonly is set, or in paged mode if ctx->paged is set or if
+ * they are larger than the page cache, and are loaded in memory in the
+ * background otherwise: this returns right away, and the rows are added
+ * to the buffer as they are read (see editor_load_update). Compressed
+ * files (see compress.h) are always loaded in the background (and kept
+ * read-only if ctx->readonly is set).
+ *
+ * Changes to files in memory are journaled once they are loaded (see
+ * journal.h), and if the file has a journal left behind by a crash, the
+ * changes in it are recovered (right away). Read-only and paged files
+ * whose line index is cached (see lineindex.h) open where they were
+ * last viewed.
  *
  * Parameters:
  *  - ctx: Editor context object
@@ -110,11 +348,156 @@ void editor_delete_char(editor_ctx_t *ctx);
 void editor_open_file(editor_ctx_t *ctx, char *filename);
 
 
+/* editor_switch_buffer - Show another buffer in the focused pane
+ *
+ * The cursor position and offsets of the buffer we switch away from
+ * are kept, and those of the buffer we switch to are brought back.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - index: Buffer to show (wraps around at both ends of the list)
+ *
+ * Returns: Nothing
+ */
+void editor_switch_buffer(editor_ctx_t *ctx, int index);
+
+
+/* editor_split_pane - Split the focused pane in two
+ *
+ * The new pane shows the same buffer, at the same position, and gets
+ * the focus.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - side_by_side: Put the new pane to the right of the focused one,
+ *    instead of below it
+ *
+ * Returns: Nothing
+ */
+void editor_split_pane(editor_ctx_t *ctx, int side_by_side);
+
+
+/* editor_close_pane - Close the focused pane
+ *
+ * The buffer it showed stays open. The last pane can't be closed.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_close_pane(editor_ctx_t *ctx);
+
+
+/* editor_focus_pane - Give another pane the focus
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - index: Pane to focus (wraps around at both ends of the list)
+ *
+ * Returns: Nothing
+ */
+void editor_focus_pane(editor_ctx_t *ctx, int index);
+
+
+/* editor_toggle_wrap - Turn soft line wrapping on or off
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_toggle_wrap(editor_ctx_t *ctx);
+
+
+/* editor_resize - Adapt to a new terminal size
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_resize(editor_ctx_t *ctx);
+
+
+/* editor_highlight_background - Keep the background highlighter busy
+ *
+ * Collects any results from the background highlighter and hands
+ * it the next rows to work on. Never waits for it.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: 1 if the screen needs to be redrawn, 0 otherwise
+ */
+int editor_highlight_background(editor_ctx_t *ctx);
+
+
+/* editor_wrap_background - Wrap some of the rows that haven't been
+ *                          since the terminal was resized
+ *
+ * Does a bit of the work at a time (see wrap_refine), so it can be
+ * called while waiting for keys.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: 1 if there are rows left to wrap, 0 otherwise
+ */
+int editor_wrap_background(editor_ctx_t *ctx);
+
+
+/* editor_follow_update - Load new data from the followed files
+ *
+ * In each pane showing a followed file, if the cursor was on the last
+ * row, it is moved to the new last row, so the end of the file stays
+ * in view.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_follow_update(editor_ctx_t *ctx);
+
+
+/* editor_load_update - Add the parts of the files being loaded in the
+ *                      background read so far to their buffers
+ *
+ * Files that have finished loading start being journaled. Files that
+ * couldn't be read or decompressed are reported, and their buffers
+ * made read-only, so what was loaded of them can't be saved over them.
+ * So are paged files once paging them fails (see buffer_row), and
+ * mapped files once they turn out to have been truncated.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: 1 if the screen needs to be redrawn, 0 otherwise
+ */
+int editor_load_update(editor_ctx_t *ctx);
+
+
+/* editor_journal_update - Check on the journals of the open buffers
+ *
+ * Starts a checkpoint of the journals that have grown large enough,
+ * and reports journals that couldn't be written (which are then
+ * dropped).
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_journal_update(editor_ctx_t *ctx);
+
+
 /* editor_save_file - Saves the currently open file
+ *
+ * Prompts for a filename if the buffer doesn't have one yet.
  *
  * Parameters:
  *  - ctx: Editor context object
- *  - filename: File to open
  * 
  * Returns: Nothing
  */
@@ -123,8 +506,10 @@ void editor_save_file(editor_ctx_t *ctx);
 
 /* editor_find - Search in the editor
  *
- * Prompts the user for a search string, and moves the cursor
- * to the first occurrence of that string.
+ * Prompts the user for a search string, and moves the cursor to the
+ * first occurrence of that string after the cursor (which fails, see
+ * ctx->failed, if there is none before the search comes back around).
+ * The string is kept in ctx->search (see editor_add_cursor_at_match).
  *
  * Parameters:
  *  - ctx: Editor context object
@@ -133,4 +518,76 @@ void editor_save_file(editor_ctx_t *ctx);
  */
 void editor_find(editor_ctx_t *ctx);
 
-#endif /* EDITOR_H */
\ No newline at end of file
+
+/* editor_replace - Replace every match of a string
+ *
+ * Prompts the user for a search string (moving the cursor to matches
+ * as it is typed, like editor_find), then for the string to put in its
+ * place, and replaces every match in the buffer. The whole replacement
+ * is undone in one go.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_replace(editor_ctx_t *ctx);
+
+
+/* editor_filter - Pipe lines through a shell command
+ *
+ * Prompts the user for a shell command, and replaces the lines with
+ * what it prints when they are piped into it (see filter_rows). The
+ * lines are the whole buffer, or, if there are several cursors, the
+ * lines from the first cursor to the last; a command preceded by
+ * "first,last" (line numbers, counting from 1) filters those lines
+ * instead. The whole change is undone in one go.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_filter(editor_ctx_t *ctx);
+
+
+/* editor_sort - Sort lines, remove duplicate lines, or reverse them
+ *
+ * Prompts the user for what to do ("sort", "unique" or "reverse", or
+ * their first letters), and does it to the lines, which are chosen as
+ * for editor_filter (see sort.h). The whole change is undone in one go.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_sort(editor_ctx_t *ctx);
+
+
+/* editor_goto - Go to a line, or to a byte offset
+ *
+ * Prompts the user for a line number (counting from 1), or for a byte
+ * offset in the file (counting from 0, like `grep -b`) preceded by @.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+void editor_goto(editor_ctx_t *ctx);
+
+
+/* editor_cursor_offset - Find the byte offset of the cursor
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - offset: Output parameter to return the offset of the cursor
+ *  - total: Output parameter to return the size of the buffer
+ *
+ * Returns: 0 on success, -1 if the buffer doesn't keep track of byte
+ *          offsets (in paged mode)
+ */
+int editor_cursor_offset(editor_ctx_t *ctx, long long *offset, long long *total);
+
+#endif /* EDITOR_H */
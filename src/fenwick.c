@@ -0,0 +1,131 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * fenwick.c: Fenwick trees (binary indexed trees) of prefix sums.
+ */
+
+#include <stdlib.h>
+
+#include "fenwick.h"
+
+/* Lowest set bit of i */
+#define LOWBIT(i) ((i) & -(i))
+
+
+/* See fenwick.h */
+void fenwick_init(fenwick_t *f)
+{
+    f->tree = NULL;
+    f->n = 0;
+    f->capacity = 0;
+}
+
+
+/* See fenwick.h */
+void fenwick_free(fenwick_t *f)
+{
+    free(f->tree);
+    fenwick_init(f);
+}
+
+
+/* fenwick_reserve - Make room for at least n values
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int fenwick_reserve(fenwick_t *f, int n)
+{
+    if (n <= f->capacity)
+        return 0;
+    int capacity = f->capacity ? f->capacity : 64;
+    while (capacity < n)
+        capacity *= 2;
+    long long *tree = realloc(f->tree, sizeof(long long) * (capacity + 1));
+    if (tree == NULL)
+        return -1;
+    f->tree = tree;
+    f->capacity = capacity;
+    return 0;
+}
+
+
+/* See fenwick.h */
+int fenwick_build(fenwick_t *f, const int *values, int n)
+{
+    if (fenwick_reserve(f, n) == -1)
+        return -1;
+
+    f->n = n;
+    for (int i = 1; i <= n; i++)
+        f->tree[i] = values[i - 1];
+    for (int i = 1; i <= n; i++)
+    {
+        int parent = i + LOWBIT(i);
+        if (parent <= n)
+            f->tree[parent] += f->tree[i];
+    }
+    return 0;
+}
+
+
+/* See fenwick.h */
+void fenwick_add(fenwick_t *f, int i, long long delta)
+{
+    for (i++; i <= f->n; i += LOWBIT(i))
+        f->tree[i] += delta;
+}
+
+
+/* See fenwick.h */
+int fenwick_append(fenwick_t *f, long long value)
+{
+    if (fenwick_reserve(f, f->n + 1) == -1)
+        return -1;
+
+    /* The new node covers (i - lowbit(i), i]: the new value plus
+     * the values just before it that it takes over */
+    int i = ++f->n;
+    f->tree[i] = value + fenwick_prefix(f, i - 1) - fenwick_prefix(f, i - LOWBIT(i));
+    return 0;
+}
+
+
+/* See fenwick.h */
+void fenwick_truncate(fenwick_t *f, int n)
+{
+    /* No remaining node covers a dropped value */
+    if (n < f->n)
+        f->n = n;
+}
+
+
+/* See fenwick.h */
+long long fenwick_prefix(const fenwick_t *f, int i)
+{
+    long long sum = 0;
+    for (; i > 0; i -= LOWBIT(i))
+        sum += f->tree[i];
+    return sum;
+}
+
+
+/* See fenwick.h */
+int fenwick_search(const fenwick_t *f, long long target)
+{
+    int pos = 0;
+    int step = 1;
+    while (step * 2 <= f->n)
+        step *= 2;
+
+    for (; step > 0; step /= 2)
+    {
+        if (pos + step <= f->n && f->tree[pos + step] <= target)
+        {
+            pos += step;
+            target -= f->tree[pos];
+        }
+    }
+    return pos;
+}
@@ -0,0 +1,118 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * fenwick.h: Fenwick trees (binary indexed trees) of prefix sums.
+ *
+ * Stores a sequence of values so that changing one value, summing
+ * the first i values, and finding which value a running total falls
+ * in all take O(log n). Values can also be appended or dropped from
+ * the end in O(log n); inserting or deleting anywhere else means
+ * rebuilding the tree, which takes O(n).
+ */
+
+#ifndef FENWICK_H
+#define FENWICK_H
+
+/* A Fenwick tree */
+typedef struct fenwick
+{
+    /* tree[i] (1-based) is the sum of values (i - lowbit(i), i] */
+    long long *tree;
+    int n;
+    int capacity;
+} fenwick_t;
+
+
+/* fenwick_init - Initialize an empty tree
+ *
+ * Parameters:
+ *  - f: Tree
+ *
+ * Returns: Nothing
+ */
+void fenwick_init(fenwick_t *f);
+
+
+/* fenwick_free - Free a tree (leaving it empty)
+ *
+ * Parameters:
+ *  - f: Tree
+ *
+ * Returns: Nothing
+ */
+void fenwick_free(fenwick_t *f);
+
+
+/* fenwick_build - Replace the contents of a tree, in O(n)
+ *
+ * Parameters:
+ *  - f: Tree
+ *  - values: Values
+ *  - n: Number of values
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+int fenwick_build(fenwick_t *f, const int *values, int n);
+
+
+/* fenwick_add - Add to one of the values
+ *
+ * Parameters:
+ *  - f: Tree
+ *  - i: Index of the value (0-based)
+ *  - delta: Amount to add
+ *
+ * Returns: Nothing
+ */
+void fenwick_add(fenwick_t *f, int i, long long delta);
+
+
+/* fenwick_append - Add a value at the end
+ *
+ * Parameters:
+ *  - f: Tree
+ *  - value: Value
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+int fenwick_append(fenwick_t *f, long long value);
+
+
+/* fenwick_truncate - Drop values from the end
+ *
+ * Parameters:
+ *  - f: Tree
+ *  - n: Number of values to keep
+ *
+ * Returns: Nothing
+ */
+void fenwick_truncate(fenwick_t *f, int n);
+
+
+/* fenwick_prefix - Sum of the first i values
+ *
+ * Parameters:
+ *  - f: Tree
+ *  - i: Number of values to sum (0 to f->n)
+ *
+ * Returns: The sum
+ */
+long long fenwick_prefix(const fenwick_t *f, int i);
+
+
+/* fenwick_search - Find the value a running total falls in
+ *
+ * Assumes all values are non-negative.
+ *
+ * Parameters:
+ *  - f: Tree
+ *  - target: Running total (0-based)
+ *
+ * Returns: The largest i such that fenwick_prefix(f, i) <= target
+ *          (so target falls in value i, if i < f->n)
+ */
+int fenwick_search(const fenwick_t *f, long long target);
+
+#endif /* FENWICK_H */
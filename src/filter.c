@@ -0,0 +1,461 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * filter.c: Piping rows of a buffer through a shell command, and
+ * replacing them with its output.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "filter.h"
+
+extern char **environ;
+
+/* Output of a command, as read so far */
+typedef struct filter_output
+{
+    /* Blocks of whole lines read from its standard output */
+    char **blocks;
+    size_t *lens;
+    int num_blocks;
+    int capacity;
+
+    /* Block being filled */
+    char *block;
+    size_t len, cap;
+
+    /* Number of bytes read from its standard output */
+    size_t total;
+
+    /* Start of what it wrote to its standard error */
+    char message[FILTER_MESSAGE_BYTES];
+    size_t message_len;
+} filter_output_t;
+
+/* Rows being written to a command */
+typedef struct filter_input
+{
+    buffer_t *buf;
+    int at, n;
+
+    /* Index (from at) of the next row to be put in iov */
+    int next;
+
+    /* Number of bytes written so far */
+    size_t written;
+
+    /* What is left to write of the rows in iov */
+    struct iovec iov[2 * FILTER_WRITE_ROWS];
+    int first, count;
+} filter_input_t;
+
+
+/* filter_push - Add the whole lines of the block being filled to the
+ *               output, and start the next block with the rest
+ *
+ * Parameters:
+ *  - o: Output
+ *  - final: Is this the end of the output? (Then the whole block is
+ *    added)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int filter_push(filter_output_t *o, int final)
+{
+    char *eol = memrchr(o->block, '\n', o->len);
+    size_t cut = final ? o->len : eol ? (size_t)(eol - o->block) + 1 : 0;
+    if (cut == 0)
+    {
+        if (final || o->len < o->cap)
+            return 0;
+        char *bigger = realloc(o->block, o->cap * 2);
+        if (bigger == NULL)
+            return -1;
+        o->block = bigger;
+        o->cap *= 2;
+        return 0;
+    }
+
+    if (o->num_blocks == o->capacity)
+    {
+        int capacity = o->capacity ? o->capacity * 2 : 16;
+        char **blocks = realloc(o->blocks, sizeof(char *) * capacity);
+        if (blocks == NULL)
+            return -1;
+        o->blocks = blocks;
+        size_t *lens = realloc(o->lens, sizeof(size_t) * capacity);
+        if (lens == NULL)
+            return -1;
+        o->lens = lens;
+        o->capacity = capacity;
+    }
+
+    size_t rest = o->len - cut;
+    size_t next_cap = rest < FILTER_BLOCK_BYTES ? FILTER_BLOCK_BYTES : o->cap;
+    char *next = malloc(next_cap);
+    if (next == NULL)
+        return -1;
+    memcpy(next, o->block + cut, rest);
+
+    o->blocks[o->num_blocks] = o->block;
+    o->lens[o->num_blocks] = cut;
+    o->num_blocks++;
+    o->block = next;
+    o->len = rest;
+    o->cap = next_cap;
+    return 0;
+}
+
+
+/* filter_read_output - Read what is ready of the command's standard
+ *                      output
+ *
+ * Parameters:
+ *  - o: Output
+ *  - fd: The command's standard output
+ *  - limit: Most bytes of output it may write (so far)
+ *
+ * Returns: 1 if there is more to come, 0 at the end of the output, -1
+ *          on error (with errno set, to EFBIG if there is too much of it)
+ */
+static int filter_read_output(filter_output_t *o, int fd, size_t limit)
+{
+    ssize_t n = read(fd, o->block + o->len, o->cap - o->len);
+    if (n == -1)
+        return errno == EINTR || errno == EAGAIN ? 1 : -1;
+    if (n == 0)
+        return 0;
+
+    o->len += n;
+    o->total += n;
+    if (o->total > limit)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+    if (o->len == o->cap && filter_push(o, 0) == -1)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 1;
+}
+
+
+/* filter_read_message - Read what is ready of the command's standard
+ *                       error, keeping its start
+ *
+ * Returns: 1 if there is more to come, 0 at the end of it
+ */
+static int filter_read_message(filter_output_t *o, int fd)
+{
+    char scratch[4096];
+    ssize_t n = read(fd, scratch, sizeof(scratch));
+    if (n == -1 && (errno == EINTR || errno == EAGAIN))
+        return 1;
+    if (n <= 0)
+        return 0;
+
+    size_t room = sizeof(o->message) - 1 - o->message_len;
+    size_t keep = (size_t)n < room ? (size_t)n : room;
+    memcpy(o->message + o->message_len, scratch, keep);
+    o->message_len += keep;
+    return 1;
+}
+
+
+/* filter_write_rows - Write as many rows to the command as its standard
+ *                     input takes without blocking, with their line
+ *                     breaks
+ *
+ * Returns: 1 if there are rows left to write, 0 once they have all been
+ *          written (or the command stopped reading), -1 on error (with
+ *          errno set)
+ */
+static int filter_write_rows(filter_input_t *in, int fd)
+{
+    for (;;)
+    {
+        /* The row a paged buffer hands out can be evicted by reading the
+         * next one, so its rows are written one at a time */
+        if (in->count == 0)
+        {
+            int batch = in->buf->pager ? 1 : FILTER_WRITE_ROWS;
+            in->first = 0;
+            for (; in->count < 2 * batch && in->next < in->n; in->next++)
+            {
+                erow_t *row = buffer_row(in->buf, in->at + in->next);
+                in->iov[in->count].iov_base = editor_row_chars(row);
+                in->iov[in->count++].iov_len = row->size;
+                in->iov[in->count].iov_base = (char *)"\n";
+                in->iov[in->count++].iov_len = 1;
+            }
+            if (in->count == 0)
+                return 0;
+        }
+
+        ssize_t n = writev(fd, &in->iov[in->first], in->count);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return 1;
+            return errno == EPIPE ? 0 : -1;
+        }
+        in->written += n;
+
+        /* Skip what was written, which may end inside an iovec */
+        struct iovec *iov = &in->iov[in->first];
+        while (in->count > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            in->first++;
+            in->count--;
+        }
+        if (in->count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+
+/* filter_spawn - Start a shell command with its standard input, output
+ *                and error connected to pipes
+ *
+ * Parameters:
+ *  - command: Shell command
+ *  - in, out, err: Pipes (the child's ends are used, not closed)
+ *  - pid: Output parameter to return the process ID of the command
+ *
+ * Returns: 0 on success, an errno value otherwise
+ */
+static int filter_spawn(const char *command, int in[2], int out[2], int err[2], pid_t *pid)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int rc = posix_spawn_file_actions_init(&actions);
+    if (rc != 0)
+        return rc;
+    rc = posix_spawnattr_init(&attr);
+    if (rc != 0)
+    {
+        posix_spawn_file_actions_destroy(&actions);
+        return rc;
+    }
+
+    /* The command gets the usual signal handling whatever ours is, and
+     * a process group of its own, so all of a pipeline can be killed */
+    sigset_t none, pipe_set;
+    sigemptyset(&none);
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &pipe_set);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF |
+                                    POSIX_SPAWN_SETPGROUP);
+
+    posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+
+    char *argv[] = {"sh", "-c", (char *)command, NULL};
+    rc = posix_spawn(pid, "/bin/sh", &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return rc;
+}
+
+
+/* filter_close_all - Close the pipes that are open */
+static void filter_close_all(int *fds, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (fds[i] != -1)
+            close(fds[i]);
+}
+
+
+/* filter_run - Write the rows to the command and read its output, until
+ *              it has closed its output (or is to be stopped)
+ *
+ * Parameters:
+ *  - in: Rows to write
+ *  - fds: The pipes (see filter_rows; our ends are closed as we are
+ *    done with them, and set to -1)
+ *  - cancel, arg: See filter_rows
+ *  - o: Output
+ *
+ * Returns: 0 on success, an errno value otherwise
+ */
+static int filter_run(filter_input_t *in, int *fds, filter_cancel_t cancel, void *arg,
+                      filter_output_t *o)
+{
+    int *ends[3] = {&fds[1], &fds[2], &fds[4]};
+    while (fds[1] != -1 || fds[2] != -1 || fds[4] != -1)
+    {
+        struct pollfd p[3] = {
+            {fds[1], POLLOUT, 0}, {fds[2], POLLIN, 0}, {fds[4], POLLIN, 0}};
+        if (poll(p, 3, FILTER_POLL_MS) == -1 && errno != EINTR)
+            return errno;
+        if (cancel && cancel(arg))
+            return ECANCELED;
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (*ends[i] == -1 || p[i].revents == 0)
+                continue;
+            size_t limit = FILTER_SLACK_BYTES + FILTER_GROWTH * in->written;
+            int rc = i == 0 ? filter_write_rows(in, fds[1]) :
+                     i == 1 ? filter_read_output(o, fds[2], limit) :
+                              filter_read_message(o, fds[4]);
+            if (rc == -1)
+                return errno;
+            if (rc == 0)
+            {
+                close(*ends[i]);
+                *ends[i] = -1;
+            }
+        }
+    }
+    return filter_push(o, 1) == -1 ? ENOMEM : 0;
+}
+
+
+/* See filter.h */
+int filter_rows(buffer_t *buf, int at, int n, const char *command, filter_cancel_t cancel,
+                void *arg, filter_result_t *result)
+{
+    if (buf->readonly)
+    {
+        errno = EROFS;
+        return -1;
+    }
+    if (at < 0 || n < 0 || at + n > buf->num_rows)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    filter_output_t o;
+    memset(&o, 0, sizeof(o));
+    o.cap = FILTER_BLOCK_BYTES;
+    o.block = malloc(o.cap);
+    if (o.block == NULL)
+        return -1;
+
+    /* Close-on-exec, so the command can't hold its own input open; our
+     * end of its input doesn't block, so we can read while it's full */
+    int fds[6] = {-1, -1, -1, -1, -1, -1};
+    int *in = &fds[0], *out = &fds[2], *err = &fds[4];
+    if (pipe2(in, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1 ||
+        pipe2(err, O_CLOEXEC) == -1 || fcntl(in[1], F_SETFL, O_NONBLOCK) == -1)
+    {
+        int saved_errno = errno;
+        filter_close_all(fds, 6);
+        free(o.block);
+        errno = saved_errno;
+        return -1;
+    }
+
+    pid_t pid;
+    int rc = filter_spawn(command, in, out, err, &pid);
+    close(in[0]);
+    close(out[1]);
+    close(err[1]);
+    in[0] = out[1] = err[1] = -1;
+    if (rc != 0)
+    {
+        filter_close_all(fds, 6);
+        free(o.block);
+        errno = rc;
+        return -1;
+    }
+
+    /* A command that stops reading its input early (or couldn't be
+     * read from) closes the pipe, and writing to it raises SIGPIPE,
+     * which is blocked while we write and taken back afterwards */
+    sigset_t pipe_set, old;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+
+    filter_input_t input = {buf, at, n, 0, 0, {{0}}, 0, 0};
+    int error = filter_run(&input, fds, cancel, arg, &o);
+    if (error)
+        kill(-pid, SIGKILL);
+    filter_close_all(fds, 6);
+
+    /* A command can close its output and keep running, so we keep
+     * asking whether to stop it; most exit right away, so we look again
+     * soon at first */
+    int wstatus = 0;
+    for (int wait_ms = 1;;)
+    {
+        pid_t w = waitpid(pid, &wstatus, error ? 0 : WNOHANG);
+        if (w == pid || (w == -1 && errno != EINTR))
+            break;
+        if (w == 0 && cancel && cancel(arg))
+        {
+            error = ECANCELED;
+            kill(-pid, SIGKILL);
+        }
+        else if (w == 0)
+        {
+            poll(NULL, 0, wait_ms);
+            wait_ms = wait_ms * 2 < FILTER_POLL_MS ? wait_ms * 2 : FILTER_POLL_MS;
+        }
+    }
+
+    sigset_t pending;
+    sigpending(&pending);
+    if (!sigismember(&old, SIGPIPE) && sigismember(&pending, SIGPIPE))
+    {
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipe_set, NULL, &zero);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    result->status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+    result->rows = 0;
+    o.message[o.message_len] = '\0';
+    o.message[strcspn(o.message, "\n")] = '\0';
+    memcpy(result->message, o.message, sizeof(result->message));
+
+    if (!error && result->status == 0)
+    {
+        buffer_delete_rows(buf, at, n);
+        for (int i = 0; i < o.num_blocks; i++)
+            result->rows += buffer_insert_lines(buf, at + result->rows, o.blocks[i], o.lens[i]);
+    }
+
+    for (int i = 0; i < o.num_blocks; i++)
+        free(o.blocks[i]);
+    free(o.blocks);
+    free(o.lens);
+    free(o.block);
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * filter.h: Piping rows of a buffer through a shell command, and
+ * replacing them with its output.
+ *
+ * The rows are written to the command's standard input straight from
+ * the buffer, many at a time with writev(), so the text is never
+ * gathered into one string. The pipes are polled together, so while we
+ * write, the command's output is read into blocks of whole lines (and
+ * the start of what it writes to its standard error is kept), and the
+ * command never stalls on a full pipe. Once the command has exited, the
+ * rows are replaced by the blocks, unless it failed.
+ *
+ * A command that doesn't exit, or doesn't stop writing, can be stopped
+ * from the caller (see filter_cancel_t). One that writes far more than
+ * it was given (see FILTER_SLACK_BYTES) is stopped anyway, so a command
+ * like yes can't fill up memory.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "buffer.h"
+
+/* Size of the blocks of output read from the command (a block may be
+ * larger if it holds a single long line) */
+#define FILTER_BLOCK_BYTES (1 << 20)
+
+/* Most rows written to the command by a single writev() (each row
+ * takes two iovecs: its text, and a line break) */
+#define FILTER_WRITE_ROWS (512)
+
+/* Size of the start of the command's standard error that is kept */
+#define FILTER_MESSAGE_BYTES (128)
+
+/* Most output kept from a command, beyond FILTER_GROWTH times as much
+ * as has been written to it (it is stopped if it writes more) */
+#define FILTER_SLACK_BYTES ((size_t)1 << 30)
+
+/* How many times the size of its input a command's output may grow to,
+ * on top of FILTER_SLACK_BYTES (so sorting or pretty-printing a large
+ * buffer is never stopped) */
+#define FILTER_GROWTH (16)
+
+/* Longest time between two calls to the cancel function, in
+ * milliseconds */
+#define FILTER_POLL_MS (50)
+
+/* Function called while a command runs, to find whether to stop it:
+ * returns nonzero to stop it */
+typedef int (*filter_cancel_t)(void *arg);
+
+/* What became of a command */
+typedef struct filter_result
+{
+    /* Exit status of the command (128 plus the signal number, if it
+     * was killed by a signal, as the shell does) */
+    int status;
+
+    /* Number of rows its output took up */
+    int rows;
+
+    /* First line it wrote to its standard error (empty if none) */
+    char message[FILTER_MESSAGE_BYTES];
+} filter_result_t;
+
+
+/* filter_rows - Pipe rows of a buffer through a shell command, and
+ *               replace them with its output
+ *
+ * The command is run with /bin/sh -c, in a process group of its own.
+ * The rows are only replaced if it exits with status 0; it may stop
+ * reading its input early. Everything is recorded in the undo group
+ * being recorded, if any. If the command is stopped (by cancel, or for
+ * writing too much), its whole process group is killed and the rows
+ * are left alone.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Index of the first row
+ *  - n: Number of rows (0 to insert the output at at)
+ *  - command: Shell command
+ *  - cancel: Function called at least every FILTER_POLL_MS until the
+ *    command exits (NULL to always wait for it); it must not touch buf
+ *  - arg: Passed to cancel
+ *  - result: Output parameter to return what became of the command
+ *
+ * Returns: 0 if the command ran (see result->status), -1 if it couldn't
+ *          be run, its output couldn't be read, or it was stopped (with
+ *          errno set: ECANCELED if cancel stopped it, EFBIG if it wrote
+ *          more than FILTER_SLACK_BYTES plus FILTER_GROWTH times what
+ *          it was given)
+ */
+int filter_rows(buffer_t *buf, int at, int n, const char *command, filter_cancel_t cancel,
+                void *arg, filter_result_t *result);
+
+#endif /* FILTER_H */
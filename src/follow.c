@@ -0,0 +1,267 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * follow.c: Following a growing file (like `tail -f`).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "common.h"
+#include "follow.h"
+
+/* Size of each read() from the followed file */
+#define FOLLOW_CHUNK (1 << 20)
+
+/* Events on the followed file that make us look at it again */
+#define FOLLOW_FILE_EVENTS (IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB)
+
+/* Events on its directory that may mean the file was recreated */
+#define FOLLOW_DIR_EVENTS (IN_CREATE | IN_MOVED_TO)
+
+
+/* follow_open_file - Open (or reopen) the followed file
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int follow_open_file(follow_t *f)
+{
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (f->fd != -1)
+        close(f->fd);
+    f->fd = fd;
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    f->offset = 0;
+
+    if (f->file_watch != -1)
+        inotify_rm_watch(f->inotify_fd, f->file_watch);
+    f->file_watch = inotify_add_watch(f->inotify_fd, f->path, FOLLOW_FILE_EVENTS);
+    return 0;
+}
+
+
+/* follow_changed - Buffer listener callback (see buffer_listener_t)
+ *
+ * Whatever is done to the end of the buffer other than by us means new
+ * data can no longer be appended to the last row.
+ */
+static void follow_changed(buffer_listener_t *l, buffer_t *buf,
+                           buffer_change_t change, int at, int n)
+{
+    follow_t *f = l->arg;
+    if (f->appending)
+        return;
+
+    int last = buf->num_rows - 1;
+    switch (change)
+    {
+    case BUFFER_ROW_CHANGED:
+        if (at == last)
+            f->open_line = 0;
+        break;
+
+    case BUFFER_ROWS_INSERTED:
+        if (at + n - 1 == last)
+            f->open_line = 0;
+        break;
+
+    case BUFFER_ROWS_DELETED:
+        if (at > last)
+            f->open_line = 0;
+        break;
+
+    case BUFFER_RESET:
+        f->open_line = 0;
+        break;
+    }
+}
+
+
+/* See follow.h */
+follow_t *follow_open(buffer_t *buf, const char *filename)
+{
+    follow_t *f = calloc(1, sizeof(follow_t));
+    if (f == NULL)
+        return NULL;
+    f->fd = -1;
+    f->file_watch = -1;
+    f->dir_watch = -1;
+    f->path = strdup(filename);
+    f->chunk = malloc(FOLLOW_CHUNK);
+    f->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (f->path == NULL || f->chunk == NULL || f->inotify_fd == -1 ||
+        follow_open_file(f) == -1)
+    {
+        int saved_errno = errno;
+        follow_close(f);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    /* Watch the directory too, so we notice when a rotated
+     * file is replaced by a new one */
+    char *dir = strdup(filename);
+    if (dir)
+    {
+        f->dir_watch = inotify_add_watch(f->inotify_fd, dirname(dir), FOLLOW_DIR_EVENTS);
+        free(dir);
+    }
+
+    buffer_free(buf);
+    buf->filename = strdup(filename);
+    f->buf = buf;
+    f->listener.changed = follow_changed;
+    f->listener.arg = f;
+    buffer_add_listener(buf, &f->listener);
+    f->pending = 1;
+    return f;
+}
+
+
+/* See follow.h */
+void follow_close(follow_t *f)
+{
+    if (f->buf)
+        buffer_remove_listener(f->buf, &f->listener);
+    if (f->fd != -1)
+        close(f->fd);
+    if (f->inotify_fd != -1)
+        close(f->inotify_fd);
+    free(f->chunk);
+    free(f->path);
+    free(f);
+}
+
+
+/* See follow.h */
+int follow_fd(follow_t *f)
+{
+    return f->inotify_fd;
+}
+
+
+/* follow_append - Append newly read data to the buffer
+ *
+ * Parameters:
+ *  - f: Followed file
+ *  - buf: Buffer
+ *  - data: New data
+ *  - len: Length of data
+ *
+ * Returns: Nothing
+ */
+static void follow_append(follow_t *f, buffer_t *buf, const char *data, size_t len)
+{
+    f->appending = 1;
+
+    /* Complete the last line first, if it was missing its line break */
+    if (f->open_line && buf->num_rows > 0)
+    {
+        int last = buf->num_rows - 1;
+        const char *eol = memchr(data, '\n', len);
+        size_t seg = eol ? (size_t)(eol - data) : len;
+        if (seg > 0)
+            buffer_row_append_string(buf, last, data, seg);
+        if (eol == NULL)
+        {
+            f->appending = 0;
+            return;
+        }
+
+        erow_t *row = buffer_row(buf, last);
+        if (row->size > 0 && editor_row_chars(row)[row->size - 1] == '\r')
+            buffer_row_truncate(buf, last, row->size - 1);
+        f->open_line = 0;
+        data += seg + 1;
+        len -= seg + 1;
+    }
+
+    if (len > 0)
+    {
+        buffer_insert_lines(buf, buf->num_rows, data, len);
+        f->open_line = data[len - 1] != '\n';
+    }
+    f->appending = 0;
+}
+
+
+/* See follow.h */
+int follow_update(follow_t *f, buffer_t *buf)
+{
+    int was_dirty = buf->dirty;
+    int changed = 0;
+
+    /* We only use inotify to wake up; the file itself tells us what changed */
+    char events[4096];
+    while (read(f->inotify_fd, events, sizeof(events)) > 0)
+        ;
+
+    /* Has the file been replaced by a new one? */
+    struct stat st;
+    int rotated = stat(f->path, &st) == 0 &&
+                  (st.st_dev != f->dev || st.st_ino != f->ino);
+
+    /* Has it been truncated? Then start over */
+    if (fstat(f->fd, &st) == -1)
+        return -1;
+    if (st.st_size < f->offset)
+    {
+        for (int j = buf->num_rows - 1; j >= 0; j--)
+            buffer_delete_row(buf, j);
+        f->offset = 0;
+        f->open_line = 0;
+        f->reloaded = 1;
+        changed = 1;
+    }
+
+    size_t total = 0;
+    ssize_t n = 0;
+    while (total < FOLLOW_MAX_BATCH)
+    {
+        n = pread(f->fd, f->chunk, FOLLOW_CHUNK, f->offset);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        follow_append(f, buf, f->chunk, n);
+        f->offset += n;
+        total += n;
+        changed = 1;
+    }
+    if (n == -1)
+        return -1;
+    f->pending = total >= FOLLOW_MAX_BATCH;
+
+    /* Once we've read everything from a rotated file, move on to the new one */
+    if (rotated && !f->pending && follow_open_file(f) == 0)
+    {
+        f->open_line = 0;
+        f->pending = 1;
+    }
+
+    if (!was_dirty)
+        buf->dirty = 0;
+    return changed;
+}
@@ -0,0 +1,116 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * follow.h: Following a growing file (like `tail -f`).
+ *
+ * The file is watched with inotify. Whenever it grows, only the new
+ * bytes are read and appended to the buffer as rows. If the file is
+ * truncated, the buffer is reloaded; if it is rotated (renamed or
+ * deleted and then recreated under the same name), we finish reading
+ * the old file and carry on with the new one.
+ */
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <sys/types.h>
+#include "buffer.h"
+
+/* Maximum number of bytes read by a single call to follow_update(),
+ * so a fast producer can't keep the editor from redrawing */
+#define FOLLOW_MAX_BATCH (16 << 20)
+
+/* State of a followed file */
+typedef struct follow
+{
+    /* Path of the followed file, and the file currently open */
+    char *path;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+
+    /* Number of bytes of the open file added to the buffer so far */
+    off_t offset;
+
+    /* Is the last row an incomplete line (not yet terminated by
+     * a line break), which new data should be appended to? Any other
+     * change to the end of the buffer (e.g., the user editing the last
+     * row, or adding rows after it) clears it, so the rest of the line
+     * goes on a row of its own. */
+    int open_line;
+
+    /* Buffer the file is loaded into, and our listener on it (which
+     * ignores the changes we make ourselves, while appending is set) */
+    buffer_t *buf;
+    buffer_listener_t listener;
+    int appending;
+
+    /* inotify instance, and its watches on the file and its directory */
+    int inotify_fd;
+    int file_watch;
+    int dir_watch;
+
+    /* Set when the buffer had to be reloaded because the file
+     * was truncated (cleared by the caller) */
+    int reloaded;
+
+    /* Set when there's more data to read than fitted in the last batch */
+    int pending;
+
+    /* Read buffer */
+    char *chunk;
+} follow_t;
+
+
+/* follow_open - Start following a file
+ *
+ * The buffer is emptied; its contents are then loaded by follow_update().
+ *
+ * Parameters:
+ *  - buf: Buffer to load the file into
+ *  - filename: File to follow
+ *
+ * Returns: A new follow_t, or NULL on error (with errno set)
+ */
+follow_t *follow_open(buffer_t *buf, const char *filename);
+
+
+/* follow_close - Stop following a file
+ *
+ * Parameters:
+ *  - f: Followed file
+ *
+ * Returns: Nothing
+ */
+void follow_close(follow_t *f);
+
+
+/* follow_fd - File descriptor that becomes readable when the
+ *             followed file changes (suitable for poll())
+ *
+ * Parameters:
+ *  - f: Followed file
+ *
+ * Returns: A file descriptor
+ */
+int follow_fd(follow_t *f);
+
+
+/* follow_update - Add any new data in the file to the buffer
+ *
+ * Reads at most FOLLOW_MAX_BATCH bytes; f->pending is set if
+ * there is more left to read.
+ *
+ * Parameters:
+ *  - f: Followed file
+ *  - buf: Buffer the file is being loaded into (the one passed to
+ *    follow_open)
+ *
+ * Returns: 1 if the buffer changed, 0 if it didn't,
+ *          -1 on error (with errno set)
+ */
+int follow_update(follow_t *f, buffer_t *buf);
+
+#endif /* FOLLOW_H */
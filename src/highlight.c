@@ -0,0 +1,572 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * highlight.c: Incremental syntax highlighting.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+#include "highlight.h"
+
+
+/* Syntax rules for C and C++ */
+static const char *c_extensions[] = {".c", ".h", ".cpp", ".hpp", ".cc", NULL};
+static const char *c_keywords[] = {
+    "switch", "if", "while", "for", "break", "continue", "return", "else",
+    "struct", "union", "typedef", "static", "enum", "class", "case",
+    "default", "do", "goto", "sizeof", "const", "volatile", "extern",
+
+    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
+    "void|", "short|", "size_t|", "ssize_t|", NULL};
+
+/* Syntax rules for all the file types we know about */
+static const syntax_t syntax_db[] = {
+    {"c",
+     c_extensions,
+     c_keywords,
+     "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
+};
+
+#define SYNTAX_DB_ENTRIES (sizeof(syntax_db) / sizeof(syntax_db[0]))
+
+
+/* See highlight.h */
+void highlight_select_syntax(buffer_t *buf)
+{
+    buf->syntax = NULL;
+    buf->hl_dirty_from = 0;
+    if (buf->filename == NULL)
+        return;
+
+    const char *ext = strrchr(buf->filename, '.');
+    for (unsigned int j = 0; j < SYNTAX_DB_ENTRIES; j++)
+    {
+        const syntax_t *s = &syntax_db[j];
+        for (int i = 0; s->filematch[i]; i++)
+        {
+            int is_ext = (s->filematch[i][0] == '.');
+            if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
+                (!is_ext && strstr(buf->filename, s->filematch[i])))
+            {
+                buf->syntax = s;
+                return;
+            }
+        }
+    }
+}
+
+
+/* is_separator - Does a character separate keywords and numbers? */
+static int is_separator(char c)
+{
+    return isspace((unsigned char)c) || c == '\0' || strchr(",.()+-/*=~%<>[];{}", c) != NULL;
+}
+
+
+/* starts_with - Does text (of length len) contain s at position i? */
+static int starts_with(const char *text, int len, int i, const char *s, int slen)
+{
+    return i + slen <= len && !memcmp(&text[i], s, slen);
+}
+
+
+/* highlight_lex - Highlight a line of text
+ *
+ * Parameters:
+ *  - syntax: Syntax rules
+ *  - text: Text of the line
+ *  - len: Length of the line
+ *  - hl: Where to store the highlighting (len bytes)
+ *  - state: Lexer state at the start of the line
+ *
+ * Returns: Lexer state at the end of the line
+ */
+static unsigned char highlight_lex(const syntax_t *syntax, const char *text, int len,
+                                   unsigned char *hl, unsigned char state)
+{
+    memset(hl, HL_NORMAL, len);
+
+    const char **keywords = syntax->keywords;
+    const char *scs = syntax->singleline_comment_start;
+    const char *mcs = syntax->multiline_comment_start;
+    const char *mce = syntax->multiline_comment_end;
+    int scs_len = scs ? strlen(scs) : 0;
+    int mcs_len = mcs ? strlen(mcs) : 0;
+    int mce_len = mce ? strlen(mce) : 0;
+
+    int prev_sep = 1;
+    int in_string = 0;
+    int in_comment = (state == HL_STATE_COMMENT);
+
+    int i = 0;
+    while (i < len)
+    {
+        char c = text[i];
+        unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+
+        if (scs_len && !in_string && !in_comment)
+        {
+            if (starts_with(text, len, i, scs, scs_len))
+            {
+                memset(&hl[i], HL_COMMENT, len - i);
+                break;
+            }
+        }
+
+        if (mcs_len && mce_len && !in_string)
+        {
+            if (in_comment)
+            {
+                hl[i] = HL_MLCOMMENT;
+                if (starts_with(text, len, i, mce, mce_len))
+                {
+                    memset(&hl[i], HL_MLCOMMENT, mce_len);
+                    i += mce_len;
+                    in_comment = 0;
+                    prev_sep = 1;
+                }
+                else
+                {
+                    i++;
+                }
+                continue;
+            }
+            else if (starts_with(text, len, i, mcs, mcs_len))
+            {
+                memset(&hl[i], HL_MLCOMMENT, mcs_len);
+                i += mcs_len;
+                in_comment = 1;
+                continue;
+            }
+        }
+
+        if (syntax->flags & HL_HIGHLIGHT_STRINGS)
+        {
+            if (in_string)
+            {
+                hl[i] = HL_STRING;
+                if (c == '\\' && i + 1 < len)
+                {
+                    hl[i + 1] = HL_STRING;
+                    i += 2;
+                    continue;
+                }
+                if (c == in_string)
+                    in_string = 0;
+                i++;
+                prev_sep = 1;
+                continue;
+            }
+            else if (c == '"' || c == '\'')
+            {
+                in_string = c;
+                hl[i] = HL_STRING;
+                i++;
+                continue;
+            }
+        }
+
+        if (syntax->flags & HL_HIGHLIGHT_NUMBERS)
+        {
+            if ((isdigit((unsigned char)c) && (prev_sep || prev_hl == HL_NUMBER)) ||
+                (c == '.' && prev_hl == HL_NUMBER))
+            {
+                hl[i] = HL_NUMBER;
+                i++;
+                prev_sep = 0;
+                continue;
+            }
+        }
+
+        if (prev_sep)
+        {
+            int j;
+            for (j = 0; keywords[j]; j++)
+            {
+                int klen = strlen(keywords[j]);
+                int kw2 = keywords[j][klen - 1] == '|';
+                if (kw2)
+                    klen--;
+
+                if (starts_with(text, len, i, keywords[j], klen) &&
+                    is_separator(i + klen < len ? text[i + klen] : '\0'))
+                {
+                    memset(&hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+                    i += klen;
+                    break;
+                }
+            }
+            if (keywords[j] != NULL)
+            {
+                prev_sep = 0;
+                continue;
+            }
+        }
+
+        prev_sep = is_separator(c);
+        i++;
+    }
+
+    return in_comment ? HL_STATE_COMMENT : HL_STATE_NORMAL;
+}
+
+
+/* See highlight.h */
+void highlight_row(const syntax_t *syntax, erow_t *row, unsigned char state)
+{
+    /* Lexing a long row would mean going over all of it after every
+     * edit; leave it plain, as if it were all whitespace */
+    if (row->flags & ROW_LONG)
+    {
+        row->hl_start = state;
+        row->hl_state = state;
+        row->flags |= ROW_HL_VALID;
+        return;
+    }
+
+    int rsize;
+    const char *render = editor_row_rendered(row, &rsize);
+    row->hl = realloc(row->hl, rsize ? rsize : 1);
+    row->hl_start = state;
+    row->hl_state = highlight_lex(syntax, render, rsize, row->hl, state);
+    row->flags |= ROW_HL_VALID;
+}
+
+
+/* See highlight.h */
+void highlight_update(buffer_t *buf, int first, int last)
+{
+    /* Views of read-only buffers are built on the fly, so there's
+     * nowhere to keep their highlighting */
+    if (buf->syntax == NULL || buf->readonly)
+        return;
+
+    if (last >= buf->num_rows)
+        last = buf->num_rows - 1;
+
+    int start = buf->hl_dirty_from < first ? buf->hl_dirty_from : first;
+    if (first > last)
+        return;
+
+    unsigned char state;
+    int guessed = first - start > HIGHLIGHT_SYNC_ROWS;
+    if (guessed)
+    {
+        /* Too far behind to catch up now; use whatever we know about the
+         * row above the screen, and let the background worker fix it up */
+        erow_t *above = buffer_row(buf, first - 1);
+        state = (above->flags & (ROW_HL_VALID | ROW_HL_STATE)) ? above->hl_state : HL_STATE_NORMAL;
+        start = first;
+    }
+    else
+    {
+        /* Rows above start are up to date, so we can trust their end state */
+        state = start > 0 ? buffer_row(buf, start - 1)->hl_state : HL_STATE_NORMAL;
+    }
+
+    for (int i = start; i <= last; i++)
+    {
+        erow_t *row = buffer_row(buf, i);
+        if (!(row->flags & ROW_HL_VALID) || row->hl_start != state)
+            highlight_row(buf->syntax, row, state);
+        state = row->hl_state;
+    }
+
+    if (!guessed && buf->hl_dirty_from <= last)
+        buf->hl_dirty_from = last + 1;
+}
+
+
+/* highlight_worker_main - Body of the background highlighter thread
+ *
+ * Parameters:
+ *  - arg: Worker
+ *
+ * Returns: NULL
+ */
+static void *highlight_worker_main(void *arg)
+{
+    highlight_worker_t *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;)
+    {
+        while (!w->ready && !w->quit)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->quit)
+            break;
+        w->ready = 0;
+        pthread_mutex_unlock(&w->lock);
+
+        /* The chunk belongs to us until we set done */
+        unsigned char state = w->start_state;
+        const char *text = w->text;
+        for (int i = 0; i < w->num_rows; i++)
+        {
+            int len = w->lengths[i];
+            if (len < 0)
+            {
+                /* Long row (see highlight_row) */
+                w->states[i] = state;
+                continue;
+            }
+            if (w->known_start[i] == state)
+            {
+                state = w->known_end[i];
+            }
+            else
+            {
+                if (len > w->scratch_cap)
+                {
+                    w->scratch_cap = len;
+                    w->scratch = realloc(w->scratch, len);
+                }
+                state = highlight_lex(w->syntax, text, len, w->scratch, state);
+            }
+            w->states[i] = state;
+            text += len;
+        }
+
+        pthread_mutex_lock(&w->lock);
+        w->done = 1;
+        uint64_t one = 1;
+        ssize_t rc = write(w->event_fd, &one, sizeof(one));
+        (void)rc; /* Can only fail if the counter overflows */
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+
+/* See highlight.h */
+highlight_worker_t *highlight_worker_start(void)
+{
+    highlight_worker_t *w = calloc(1, sizeof(highlight_worker_t));
+    if (w == NULL)
+        return NULL;
+
+    w->event_fd = -1;
+    w->lengths = malloc(sizeof(int) * HIGHLIGHT_CHUNK_ROWS);
+    w->known_start = malloc(HIGHLIGHT_CHUNK_ROWS);
+    w->known_end = malloc(HIGHLIGHT_CHUNK_ROWS);
+    w->states = malloc(HIGHLIGHT_CHUNK_ROWS);
+    w->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->lengths == NULL || w->known_start == NULL || w->known_end == NULL ||
+        w->states == NULL || w->event_fd == -1)
+        goto fail;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    int rc = pthread_create(&w->thread, NULL, highlight_worker_main, w);
+    if (rc != 0)
+    {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        errno = rc;
+        goto fail;
+    }
+    return w;
+
+fail:;
+    int saved_errno = errno;
+    if (w->event_fd != -1)
+        close(w->event_fd);
+    free(w->lengths);
+    free(w->known_start);
+    free(w->known_end);
+    free(w->states);
+    free(w);
+    errno = saved_errno;
+    return NULL;
+}
+
+
+/* See highlight.h */
+void highlight_worker_stop(highlight_worker_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->quit = 1;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    close(w->event_fd);
+    free(w->text);
+    free(w->lengths);
+    free(w->known_start);
+    free(w->known_end);
+    free(w->states);
+    free(w->scratch);
+    free(w);
+}
+
+
+/* See highlight.h */
+int highlight_worker_fd(highlight_worker_t *w)
+{
+    return w->event_fd;
+}
+
+
+/* highlight_worker_submit - Hand the next chunk of out-of-date rows to the worker
+ *
+ * Parameters:
+ *  - w: Worker (must not be busy)
+ *  - buf: Buffer
+ *
+ * Returns: Nothing
+ */
+static void highlight_worker_submit(highlight_worker_t *w, buffer_t *buf)
+{
+    int first = buf->hl_dirty_from;
+    size_t bytes = 0;
+    int n = 0;
+    while (n < HIGHLIGHT_CHUNK_ROWS && first + n < buf->num_rows && bytes < HIGHLIGHT_CHUNK_BYTES)
+    {
+        erow_t *row = buffer_row(buf, first + n);
+        if (row->flags & ROW_LONG)
+        {
+            w->lengths[n] = -1;
+            w->known_start[n] = HL_STATE_UNKNOWN;
+            w->known_end[n] = row->hl_state;
+            n++;
+            continue;
+        }
+        if (bytes + row->size > w->text_cap)
+        {
+            size_t cap = w->text_cap ? w->text_cap : HIGHLIGHT_CHUNK_BYTES;
+            while (cap < bytes + row->size)
+                cap *= 2;
+            char *text = realloc(w->text, cap);
+            if (text == NULL)
+                break;
+            w->text = text;
+            w->text_cap = cap;
+        }
+        memcpy(w->text + bytes, editor_row_chars(row), row->size);
+        bytes += row->size;
+        w->lengths[n] = row->size;
+        w->known_start[n] = (row->flags & (ROW_HL_VALID | ROW_HL_STATE)) ? row->hl_start : HL_STATE_UNKNOWN;
+        w->known_end[n] = row->hl_state;
+        n++;
+    }
+    if (n == 0)
+        return;
+
+    w->buf = buf;
+    w->version = buf->hl_version;
+    w->syntax = buf->syntax;
+    w->first_row = first;
+    w->num_rows = n;
+    w->start_state = first > 0 ? buffer_row(buf, first - 1)->hl_state : HL_STATE_NORMAL;
+    buf->hl_snapshot_end = first + n;
+
+    pthread_mutex_lock(&w->lock);
+    w->ready = 1;
+    w->done = 0;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    w->busy = 1;
+}
+
+
+/* highlight_worker_apply - Store the states computed by the worker in the rows
+ *
+ * Parameters:
+ *  - w: Worker (with a finished chunk of buf)
+ *  - buf: Buffer
+ *
+ * Returns: Nothing
+ */
+static void highlight_worker_apply(highlight_worker_t *w, buffer_t *buf)
+{
+    unsigned char state = w->start_state;
+    for (int i = 0; i < w->num_rows; i++)
+    {
+        erow_t *row = buffer_row(buf, w->first_row + i);
+        if (!(row->flags & (ROW_HL_VALID | ROW_HL_STATE)) || row->hl_start != state)
+        {
+            /* Any highlighting the row has was based on the wrong state */
+            row->flags &= ~ROW_HL_VALID;
+            row->flags |= ROW_HL_STATE;
+            row->hl_start = state;
+            row->hl_state = w->states[i];
+        }
+        state = w->states[i];
+    }
+
+    int end = w->first_row + w->num_rows;
+    if (buf->hl_dirty_from < end)
+        buf->hl_dirty_from = end;
+}
+
+
+/* See highlight.h */
+int highlight_worker_poll(highlight_worker_t *w, buffer_t *buf, int first, int last)
+{
+    int redraw = 0;
+
+    if (w->busy)
+    {
+        pthread_mutex_lock(&w->lock);
+        int done = w->done;
+        pthread_mutex_unlock(&w->lock);
+        if (!done)
+            return 0;
+
+        uint64_t count;
+        ssize_t rc = read(w->event_fd, &count, sizeof(count));
+        (void)rc; /* Just resets the counter */
+        w->busy = 0;
+
+        /* Only use the results if nothing above the end of the chunk
+         * changed (or the buffer was reset) while the worker was busy.
+         * The chunk may come from a buffer that is no longer shown */
+        int end = w->first_row + w->num_rows;
+        if (w->version == w->buf->hl_version &&
+            w->buf->hl_snapshot_end == end && w->syntax == w->buf->syntax)
+        {
+            highlight_worker_apply(w, w->buf);
+            redraw = w->buf == buf && w->first_row <= last && end >= first;
+        }
+        w->buf->hl_snapshot_end = 0;
+    }
+
+    if (buf->syntax && !buf->readonly && !buf->pager && buf->hl_dirty_from < buf->num_rows)
+        highlight_worker_submit(w, buf);
+    return redraw;
+}
+
+
+/* See highlight.h */
+int highlight_color(int hl)
+{
+    switch (hl)
+    {
+    case HL_COMMENT:
+    case HL_MLCOMMENT:
+        return 36;
+    case HL_KEYWORD1:
+        return 33;
+    case HL_KEYWORD2:
+        return 32;
+    case HL_STRING:
+        return 35;
+    case HL_NUMBER:
+        return 31;
+    default:
+        return 37;
+    }
+}
@@ -0,0 +1,239 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * highlight.h: Incremental syntax highlighting.
+ *
+ * Each row keeps its highlighting (one HL_* value per rendered
+ * character), the lexer state it was highlighted with at the start of
+ * the line, and the lexer state at the end of the line. A row only
+ * needs to be highlighted again if it was edited, or if the state at
+ * the end of the previous row has changed. So, after an edit, we only
+ * re-lex rows from the edited row forward until the end-of-line state
+ * matches what it was before, and never past the bottom of the screen
+ * (rows further down are brought up to date when they are displayed).
+ *
+ * Jumping far down a large file would mean lexing every row above the
+ * screen before it could be drawn. Instead, a background worker thread
+ * works its way down the file in chunks, computing the end-of-line state
+ * of each row. The UI thread hands it a copy of each chunk's text
+ * together with the buffer's highlight version, so the worker never
+ * touches the buffer; results for a chunk that was edited in the
+ * meantime are simply thrown away. Until the worker catches up, rows on
+ * the screen are highlighted from a best guess of the state above them.
+ */
+
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include <pthread.h>
+#include "buffer.h"
+
+/* highlight_update() lexes at most this many rows above the screen
+ * to catch up; beyond that, it leaves them to the background worker */
+#define HIGHLIGHT_SYNC_ROWS (1000)
+
+/* Maximum size of each chunk of rows handed to the background worker */
+#define HIGHLIGHT_CHUNK_ROWS (4096)
+#define HIGHLIGHT_CHUNK_BYTES (1 << 20)
+
+/* Highlight classes */
+typedef enum
+{
+    HL_NORMAL = 0,
+    HL_COMMENT,
+    HL_MLCOMMENT,
+    HL_KEYWORD1,
+    HL_KEYWORD2,
+    HL_STRING,
+    HL_NUMBER
+} highlight_t;
+
+/* Lexer states at the end of a row */
+#define HL_STATE_NORMAL (0)
+#define HL_STATE_COMMENT (1)
+#define HL_STATE_UNKNOWN (0xff)
+
+/* Syntax flags */
+#define HL_HIGHLIGHT_NUMBERS (1 << 0)
+#define HL_HIGHLIGHT_STRINGS (1 << 1)
+
+/* Syntax rules for a file type */
+typedef struct syntax
+{
+    /* Name of the file type */
+    const char *filetype;
+
+    /* File name extensions (starting with '.') or substrings
+     * of file names, terminated by NULL */
+    const char **filematch;
+
+    /* Keywords, terminated by NULL. Secondary keywords (e.g.,
+     * types) end with '|' */
+    const char **keywords;
+
+    /* Comment delimiters */
+    const char *singleline_comment_start;
+    const char *multiline_comment_start;
+    const char *multiline_comment_end;
+
+    /* HL_HIGHLIGHT_* flags */
+    int flags;
+} syntax_t;
+
+/* Background highlighter */
+typedef struct highlight_worker
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* eventfd signalled whenever the worker finishes a chunk */
+    int event_fd;
+
+    /* Set (under lock) to ask the worker to exit */
+    int quit;
+
+    /* Has a chunk been handed to the worker and not collected yet?
+     * (Only used by the UI thread) */
+    int busy;
+
+    /* Is a chunk waiting to be lexed / has it been lexed? (Under lock) */
+    int ready;
+    int done;
+
+    /* The chunk: which buffer, and which version of its highlighting,
+     * it was copied from, and the rows it covers */
+    buffer_t *buf;
+    unsigned int version;
+    const syntax_t *syntax;
+    int first_row;
+    int num_rows;
+    unsigned char start_state;
+
+    /* Text of the rows, one after another, and their lengths (-1 for
+     * long rows, which are left out; see highlight_row) */
+    char *text;
+    size_t text_cap;
+    int *lengths;
+
+    /* Lexer states already known for each row (HL_STATE_UNKNOWN if
+     * not), so rows that haven't changed don't have to be lexed again */
+    unsigned char *known_start;
+    unsigned char *known_end;
+
+    /* Output: the state at the end of each row */
+    unsigned char *states;
+
+    /* Scratch space for highlighting a row */
+    unsigned char *scratch;
+    int scratch_cap;
+} highlight_worker_t;
+
+
+/* highlight_select_syntax - Choose syntax rules based on the file name
+ *
+ * Parameters:
+ *  - buf: Buffer (highlighting is turned off if its filename doesn't
+ *    match any known file type)
+ *
+ * Returns: Nothing
+ */
+void highlight_select_syntax(buffer_t *buf);
+
+
+/* highlight_row - Highlight a single row
+ *
+ * Parameters:
+ *  - syntax: Syntax rules
+ *  - row: Row to highlight
+ *  - state: Lexer state at the start of the row
+ *
+ * Returns: Nothing (the row's hl and hl_state are updated)
+ */
+void highlight_row(const syntax_t *syntax, erow_t *row, unsigned char state);
+
+
+/* highlight_update - Bring highlighting up to date for the screen
+ *
+ * Re-lexes the rows that need it, from the first row that might
+ * have changed since the last update, down to the last visible row.
+ * If that would mean lexing more than HIGHLIGHT_SYNC_ROWS rows above
+ * the screen, only the visible rows are highlighted, starting from
+ * the state of the row above them if it is known (see
+ * highlight_worker_poll).
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - first: First visible row
+ *  - last: Last visible row
+ *
+ * Returns: Nothing
+ */
+void highlight_update(buffer_t *buf, int first, int last);
+
+
+/* highlight_worker_start - Start the background highlighter
+ *
+ * Parameters: none
+ *
+ * Returns: A new worker, or NULL on error (with errno set)
+ */
+highlight_worker_t *highlight_worker_start(void);
+
+
+/* highlight_worker_stop - Stop the background highlighter
+ *
+ * Parameters:
+ *  - w: Worker
+ *
+ * Returns: Nothing
+ */
+void highlight_worker_stop(highlight_worker_t *w);
+
+
+/* highlight_worker_fd - File descriptor that becomes readable when
+ *                       the worker has finished a chunk (suitable
+ *                       for poll())
+ *
+ * Parameters:
+ *  - w: Worker
+ *
+ * Returns: A file descriptor
+ */
+int highlight_worker_fd(highlight_worker_t *w);
+
+
+/* highlight_worker_poll - Collect the worker's results and give it more work
+ *
+ * Never waits for the worker. If it has finished a chunk that hasn't
+ * been edited since, the states it computed are stored in the rows
+ * (the chunk may come from a buffer other than buf, which must not
+ * have been freed in the meantime). Then, if there are still rows in buf whose state is out of
+ * date, the next chunk of them is handed to the worker. Paged buffers
+ * are not highlighted in the background, since that would mean
+ * reading the whole file.
+ *
+ * Parameters:
+ *  - w: Worker
+ *  - buf: Buffer being displayed
+ *  - first: First visible row
+ *  - last: Last visible row
+ *
+ * Returns: 1 if the highlighting of the visible rows may have
+ *          changed, 0 otherwise
+ */
+int highlight_worker_poll(highlight_worker_t *w, buffer_t *buf, int first, int last);
+
+
+/* highlight_color - ANSI color for a highlight class
+ *
+ * Parameters:
+ *  - hl: HL_* value
+ *
+ * Returns: ANSI foreground color code
+ */
+int highlight_color(int hl);
+
+#endif /* HIGHLIGHT_H */
@@ -14,7 +14,9 @@
 #include "common.h"
 #include "terminal.h"
 #include "editor.h"
+#include "input.h"
 #include "screen.h"
+#include "trace.h"
 
 /* editor_move_cursor - Moves the cursor based on keypresses
  *
@@ -26,25 +28,25 @@
  */
 void editor_move_cursor(editor_ctx_t *ctx, int key)
 {
-    erow_t *row = (ctx->cy >= ctx->num_rows) ? NULL : &ctx->rows[ctx->cy];
+    erow_t *row = (ctx->cy >= ctx->buf->num_rows) ? NULL : buffer_row(ctx->buf, ctx->cy);
 
     switch (key)
     {
     case ARROW_LEFT:
         if (ctx->cx != 0)
         {
-            ctx->cx--;
+            ctx->cx = editor_row_prev_char(row, ctx->cx);
         }
         else if (ctx->cy > 0)
         {
             ctx->cy--;
-            ctx->cx = ctx->rows[ctx->cy].size;
+            ctx->cx = buffer_row(ctx->buf, ctx->cy)->size;
         }
         break;
     case ARROW_RIGHT:
         if (row && ctx->cx < row->size)
         {
-            ctx->cx++;
+            ctx->cx = editor_row_next_char(row, ctx->cx);
         }
         else if (row && ctx->cx == row->size)
         {
@@ -59,29 +61,161 @@ void editor_move_cursor(editor_ctx_t *ctx, int key)
         }
         break;
     case ARROW_DOWN:
-        if (ctx->cy < ctx->num_rows)
+        if (ctx->cy < ctx->buf->num_rows)
         {
             ctx->cy++;
         }
         break;
+    case HOME_KEY:
+        ctx->cx = 0;
+        break;
+    case END_KEY:
+        if (row)
+            ctx->cx = row->size;
+        break;
     }
 
     /* Snap cursor to end of line */
-    row = (ctx->cy >= ctx->num_rows) ? NULL : &ctx->rows[ctx->cy];
+    row = (ctx->cy >= ctx->buf->num_rows) ? NULL : buffer_row(ctx->buf, ctx->cy);
     int rowlen = row ? row->size : 0;
     if (ctx->cx > rowlen)
     {
         ctx->cx = rowlen;
     }
+
+    /* Don't leave the cursor in the middle of a character */
+    if (row && ctx->cx > 0 && ctx->cx < rowlen)
+    {
+        ctx->cx = editor_row_prev_char(row, ctx->cx + 1);
+    }
 }
 
 
-/* See input.h */
-void input_process_keypress(editor_ctx_t *ctx)
+/* input_page_wrapped - Move a page up or down in soft wrap mode
+ *
+ * Moves the cursor and the screen by a screen's worth of lines (rather
+ * than rows), keeping the cursor in the same column of its line.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - key: PAGE_UP or PAGE_DOWN
+ *
+ * Returns: Nothing
+ */
+static void input_page_wrapped(editor_ctx_t *ctx, int key)
 {
-    static int quit_times = MICRO_QUIT_TIMES;
+    int cols = ctx->screen_cols;
+    int seg = 0, start = 0, rx = 0;
+    if (ctx->cy < ctx->buf->num_rows)
+    {
+        erow_t *row = buffer_row(ctx->buf, ctx->cy);
+        rx = editor_row_cx2rx(row, ctx->cx);
+        seg = editor_row_wrap_segment(row, cols, rx, &start);
+    }
+
+    int delta = key == PAGE_UP ? -ctx->screen_rows : ctx->screen_rows;
+    /* Rows a screen's worth of lines away are wrapped at this width
+     * first (after a resize, the rest are wrapped later) */
+    wrap_measure_rows(ctx->wrap, ctx->cy - 2 * ctx->screen_rows, ctx->cy + 2 * ctx->screen_rows);
+    wrap_measure_rows(ctx->wrap, ctx->rowoff - ctx->screen_rows,
+                      ctx->rowoff + 2 * ctx->screen_rows);
+    long long total = wrap_total(ctx->wrap);
+    long long line = wrap_line(ctx->wrap, ctx->cy) + seg + delta;
+    if (line < 0)
+        line = 0;
+    if (line > total)
+        line = total;
+
+    long long top = wrap_line(ctx->wrap, ctx->rowoff) + ctx->segoff + delta;
+    if (top < 0)
+        top = 0;
+    if (top > line)
+        top = line;
+    ctx->rowoff = wrap_find(ctx->wrap, top, &ctx->segoff);
+
+    ctx->cy = wrap_find(ctx->wrap, line, &seg);
+    ctx->cx = 0;
+    if (ctx->cy >= ctx->buf->num_rows)
+        return;
+
+    /* Same column, but not past the end of the line */
+    int last = seg + 1 >= wrap_count(ctx->wrap, ctx->cy);
+    erow_t *row = buffer_row(ctx->buf, ctx->cy);
+    int target = editor_row_wrap_start(row, cols, seg) + (rx - start);
+    if (!last)
+    {
+        int next = editor_row_wrap_start(row, cols, seg + 1);
+        if (target >= next)
+            target = next - 1;
+    }
+    ctx->cx = editor_row_rx2cx(row, target);
+}
+
+
+/* input_read_key - Read the next key
+ *
+ * While a macro is replayed, the key comes from the macro (if it runs
+ * out in the middle of a prompt, the prompt gets Esc). Otherwise it is
+ * read from the terminal, and added to the macro if one is being
+ * recorded.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Integer value of keypress (see terminal_read_key)
+ */
+static int input_read_key(editor_ctx_t *ctx)
+{
+    if (ctx->replay >= 0)
+    {
+        if (ctx->replay < ctx->macro_len)
+            return ctx->macro[ctx->replay++];
+        ctx->failed = 1;
+        return '\x1b';
+    }
 
     int c = terminal_read_key();
+    if (!ctx->recording)
+        return c;
+
+    if (ctx->macro_len == ctx->macro_capacity)
+    {
+        int capacity = ctx->macro_capacity ? ctx->macro_capacity * 2 : 64;
+        int *macro = realloc(ctx->macro, sizeof(int) * capacity);
+        if (macro == NULL)
+        {
+            ctx->recording = 0;
+            screen_set_status_message(ctx, "Macro too long, recording stopped");
+            return c;
+        }
+        ctx->macro = macro;
+        ctx->macro_capacity = capacity;
+    }
+    ctx->macro[ctx->macro_len++] = c;
+    return c;
+}
+
+
+/* input_is_text - Does a key just insert itself? (See input_handle_key) */
+static int input_is_text(int c)
+{
+    /* Bytes of UTF-8 sequences are read as negative chars */
+    return c == '\t' || (c >= ' ' && c < BACKSPACE) || (c < 0 && c >= -128);
+}
+
+
+/* input_handle_key - Apply a single key to the editor
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - c: Key that was pressed
+ *
+ * Returns: 1 if the user asked to quit the editor, 0 otherwise
+ */
+static int input_handle_key(editor_ctx_t *ctx, int c)
+{
+    static int quit_times = MICRO_QUIT_TIMES;
+
     switch (c)
     {
     case '\r':
@@ -90,47 +224,112 @@ void input_process_keypress(editor_ctx_t *ctx)
 
     /* Ctrl-q: Exit  */
     case CTRL_KEY('q'):
-        if (ctx->dirty && quit_times > 0)
+    {
+        int unsaved = 0;
+        for (int i = 0; i < ctx->num_buffers; i++)
+            if (ctx->buffers[i]->buf.dirty)
+                unsaved++;
+        if (unsaved && quit_times > 0)
         {
-            screen_set_status_message(ctx, "WARNING!!! File has unsaved changes. "
-                                           "Press Ctrl-Q %d more times to quit.",
-                                      quit_times);
+            if (unsaved == 1 && ctx->buf->dirty)
+                screen_set_status_message(ctx, "WARNING!!! File has unsaved changes. "
+                                               "Press Ctrl-Q %d more times to quit.",
+                                          quit_times);
+            else
+                screen_set_status_message(ctx, "WARNING!!! %d files have unsaved changes. "
+                                               "Press Ctrl-Q %d more times to quit.",
+                                          unsaved, quit_times);
             quit_times--;
-            return;
+            return 0;
         }
+    }
         write(STDOUT_FILENO, "\x1b[2J", 4);
         write(STDOUT_FILENO, "\x1b[H", 3);
-        exit(0);
-        break;
+        return 1;
 
     case CTRL_KEY('s'):
         editor_save_file(ctx);
         break;
 
-    /* Moving the cursor */
-    case HOME_KEY:
-        ctx->cx = 0;
+    case CTRL_KEY('f'):
+        editor_find(ctx);
         break;
-    case END_KEY:
-        if (ctx->cy < ctx->num_rows)
-            ctx->cx = ctx->rows[ctx->cy].size;
+    case CTRL_KEY('r'):
+        editor_replace(ctx);
         break;
 
-    case CTRL_KEY('f'):
-        editor_find(ctx);
+    /* Ctrl-u: Pipe lines through a Unix command */
+    case CTRL_KEY('u'):
+        editor_filter(ctx);
+        break;
+
+    /* Ctrl-a: Arrange lines (sort, remove duplicates, reverse) */
+    case CTRL_KEY('a'):
+        editor_sort(ctx);
+        break;
+
+    case CTRL_KEY('z'):
+        editor_undo(ctx);
+        break;
+
+    case CTRL_KEY('g'):
+        editor_goto(ctx);
+        break;
+
+    case CTRL_KEY('w'):
+        editor_toggle_wrap(ctx);
+        break;
+
+    /* Switching buffers */
+    case CTRL_KEY('n'):
+    case CTRL_KEY('p'):
+        if (ctx->num_buffers > 1)
+        {
+            editor_switch_buffer(ctx, ctx->current + (c == CTRL_KEY('n') ? 1 : -1));
+            screen_set_status_message(ctx, "Buffer %d/%d: %.40s", ctx->current + 1, ctx->num_buffers,
+                                      ctx->buf->filename ? ctx->buf->filename : "[No Name]");
+        }
+        break;
+
+    /* Panes: split (one above the other, or side by side), go to the
+     * other pane, close */
+    case CTRL_KEY('t'):
+    case CTRL_KEY('v'):
+        editor_split_pane(ctx, c == CTRL_KEY('v'));
+        break;
+    case CTRL_KEY('o'):
+        editor_focus_pane(ctx, ctx->pane + 1);
+        break;
+    case CTRL_KEY('x'):
+        editor_close_pane(ctx);
+        break;
+
+    /* Multiple cursors: add one on the row below, or at the next match
+     * of the last search; Esc goes back to a single cursor */
+    case CTRL_KEY('e'):
+        editor_add_cursor_below(ctx);
+        break;
+    case CTRL_KEY('d'):
+        editor_add_cursor_at_match(ctx);
         break;
 
     case BACKSPACE:
     case CTRL_KEY('h'):
-    case DEL_KEY:
-        if (c == DEL_KEY)
-            editor_move_cursor(ctx, ARROW_RIGHT);
         editor_delete_char(ctx);
         break;
+    case DEL_KEY:
+        editor_delete_next_char(ctx);
+        break;
 
     case PAGE_UP:
     case PAGE_DOWN:
     {
+        editor_clear_cursors(ctx);
+        if (ctx->wrap)
+        {
+            input_page_wrapped(ctx, c);
+            break;
+        }
         if (c == PAGE_UP)
         {
             ctx->cy = ctx->rowoff;
@@ -138,8 +337,8 @@ void input_process_keypress(editor_ctx_t *ctx)
         else if (c == PAGE_DOWN)
         {
             ctx->cy = ctx->rowoff + ctx->screen_rows - 1;
-            if (ctx->cy > ctx->num_rows)
-                ctx->cy = ctx->num_rows;
+            if (ctx->cy > ctx->buf->num_rows)
+                ctx->cy = ctx->buf->num_rows;
         }
 
         int times = ctx->screen_rows;
@@ -148,15 +347,27 @@ void input_process_keypress(editor_ctx_t *ctx)
     }
     break;
 
+    /* Moving the cursor (every cursor, if there are several) */
     case ARROW_UP:
     case ARROW_DOWN:
     case ARROW_LEFT:
     case ARROW_RIGHT:
-        editor_move_cursor(ctx, c);
-        break;
+    case HOME_KEY:
+    case END_KEY:
+    {
+        int cx = ctx->cx, cy = ctx->cy;
+        editor_move_cursors(ctx, editor_move_cursor, c);
+        /* An arrow that can't move past the start or end of the buffer
+         * fails (which stops a macro being replayed) */
+        if (c != HOME_KEY && c != END_KEY && ctx->cx == cx && ctx->cy == cy)
+            ctx->failed = 1;
+    }
+    break;
 
-    case CTRL_KEY('l'):
     case '\x1b':
+        editor_clear_cursors(ctx);
+        break;
+    case CTRL_KEY('l'):
         break;
 
     default:
@@ -165,6 +376,152 @@ void input_process_keypress(editor_ctx_t *ctx)
     }
 
     quit_times = MICRO_QUIT_TIMES;
+    return 0;
+}
+
+
+/* input_toggle_recording - Start recording a macro, or stop
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void input_toggle_recording(editor_ctx_t *ctx)
+{
+    if (!ctx->recording)
+    {
+        ctx->recording = 1;
+        ctx->macro_len = 0;
+        screen_set_status_message(ctx, "Recording macro (Ctrl-K to stop)");
+        return;
+    }
+
+    /* The Ctrl-K that stopped the recording isn't part of it */
+    ctx->recording = 0;
+    ctx->macro_len--;
+    screen_set_status_message(ctx, "Macro recorded (%d key%s), Ctrl-Y replays it",
+                              ctx->macro_len, ctx->macro_len == 1 ? "" : "s");
+}
+
+
+/* input_replay_macro - Replay the macro, a number of times or until a
+ *                      command in it fails
+ *
+ * The keys are handled as if they were typed (including those typed
+ * into prompts), except that runs of characters that just insert
+ * themselves are inserted into their row in one go, and that the
+ * screen isn't drawn until the replay is over. Keys that would quit
+ * or undo stop the replay instead, as does a keypress.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *
+ * Returns: Nothing
+ */
+static void input_replay_macro(editor_ctx_t *ctx)
+{
+    if (ctx->recording)
+    {
+        /* Nor is the Ctrl-Y */
+        ctx->macro_len--;
+        screen_set_status_message(ctx, "Can't replay a macro while recording it");
+        return;
+    }
+    if (ctx->macro_len == 0)
+    {
+        screen_set_status_message(ctx, "No macro recorded (Ctrl-K starts recording)");
+        return;
+    }
+
+    char *answer = input_prompt(ctx, "Replay macro: %s times (0 = until it fails)", NULL);
+    if (answer == NULL)
+        return;
+    char *end;
+    long times = strtol(answer, &end, 10);
+    int valid = end != answer && *end == '\0' && times >= 0;
+    free(answer);
+    if (!valid)
+    {
+        screen_set_status_message(ctx, "Not a number of times");
+        return;
+    }
+
+    ctx->replay_buf = ctx->buf;
+    undo_begin(&ctx->buf->undo, ctx->cx, ctx->cy, 0);
+
+    long done = 0;
+    int interrupted = 0;
+    ctx->failed = 0;
+    while ((times == 0 || done < times) && !ctx->failed)
+    {
+        ctx->replay = 0;
+        while (ctx->replay < ctx->macro_len && !ctx->failed)
+        {
+            int c = ctx->macro[ctx->replay];
+            if (input_is_text(c))
+            {
+                char text[256];
+                int len = 0;
+                while (ctx->replay < ctx->macro_len && len < (int)sizeof(text) &&
+                       input_is_text(ctx->macro[ctx->replay]))
+                    text[len++] = ctx->macro[ctx->replay++];
+                editor_insert_text(ctx, text, len);
+                continue;
+            }
+            if (c == CTRL_KEY('q') || c == CTRL_KEY('z'))
+            {
+                ctx->failed = 1;
+                break;
+            }
+            ctx->replay++;
+            input_handle_key(ctx, c);
+        }
+        if (ctx->failed)
+            break;
+        done++;
+
+        /* Any key stops the replay (and is otherwise ignored) */
+        if (terminal_wait(NULL, 0, 0))
+        {
+            terminal_read_key();
+            interrupted = 1;
+            break;
+        }
+    }
+    ctx->replay = -1;
+
+    undo_end(&ctx->replay_buf->undo, ctx->cx, ctx->cy);
+    ctx->replay_buf = NULL;
+
+    if (interrupted)
+        screen_set_status_message(ctx, "Macro interrupted after %ld time%s", done, done == 1 ? "" : "s");
+    else if (ctx->failed)
+        screen_set_status_message(ctx, "Macro stopped after %ld time%s: a command in it failed",
+                                  done, done == 1 ? "" : "s");
+    else
+        screen_set_status_message(ctx, "Macro replayed %ld time%s", done, done == 1 ? "" : "s");
+}
+
+
+/* See input.h */
+int input_process_keypress(editor_ctx_t *ctx)
+{
+    int c = input_read_key(ctx);
+
+    TRACE_BEGIN(TRACE_EDIT);
+    int quit = 0;
+    /* Keyboard macros: start or stop recording, replay (these keys
+     * can't be part of a macro) */
+    if (c == CTRL_KEY('k'))
+        input_toggle_recording(ctx);
+    else if (c == CTRL_KEY('y'))
+        input_replay_macro(ctx);
+    else
+        quit = input_handle_key(ctx, c);
+    TRACE_END(TRACE_EDIT);
+
+    return quit;
 }
 
 
@@ -178,9 +535,10 @@ char *input_prompt(editor_ctx_t *ctx, char *prompt, void (*callback)(editor_ctx_
     while (1)
     {
         screen_set_status_message(ctx, prompt, buf);
-        screen_refresh(ctx);
+        if (ctx->replay < 0)
+            screen_refresh(ctx);
 
-        int c = terminal_read_key();
+        int c = input_read_key(ctx);
         if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE)
         {
             if (buflen != 0)
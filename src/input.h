@@ -4,6 +4,14 @@
  * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/ 
  * 
  * input.c: Functions for getting input from the user.
+ *
+ * The keys typed can be recorded as a keyboard macro (Ctrl-K starts and
+ * stops recording), which can then be replayed a number of times, or
+ * until a command in it fails (Ctrl-Y). A replay feeds the recorded
+ * keys to the same code as typed keys (prompts included), but without
+ * drawing the screen until it is done. Runs of typed characters are
+ * inserted into their row in one go, and everything the replay changes
+ * is undone together.
  */
 
 #ifndef INPUT_H
@@ -14,9 +22,9 @@
  * Parameters:
  *  - ctx: Editor context object
  * 
- * Returns: Nothing
+ * Returns: 1 if the user asked to quit the editor, 0 otherwise
  */
-void input_process_keypress(editor_ctx_t *ctx);
+int input_process_keypress(editor_ctx_t *ctx);
 
 
 /* input_prompt - Prompt the user for a value
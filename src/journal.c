@@ -0,0 +1,857 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * journal.c: A crash-safe journal of the unsaved changes to a buffer.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <libgen.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+/* Kinds of records */
+#define JOURNAL_ROW_CHANGED 'C'
+#define JOURNAL_ROWS_INSERTED 'I'
+#define JOURNAL_ROWS_DELETED 'D'
+
+/* A record is its kind (one byte), the row it applies to, a number of
+ * rows and the length of its payload (four bytes each), the payload,
+ * and a checksum of all of that (four bytes) */
+#define JOURNAL_RECORD_HEADER (13)
+#define JOURNAL_RECORD_CHECK (4)
+
+
+/* See journal.h */
+char *journal_path(const char *filename)
+{
+    char *dir_copy = strdup(filename);
+    char *base_copy = strdup(filename);
+    char *path = NULL;
+    if (dir_copy && base_copy)
+    {
+        const char *dir = dirname(dir_copy);
+        const char *base = basename(base_copy);
+        size_t len = strlen(dir) + strlen(base) + 32;
+        path = malloc(len);
+        if (path)
+            snprintf(path, len, "%s/.%s.micro-journal", dir, base);
+    }
+    free(dir_copy);
+    free(base_copy);
+    return path;
+}
+
+
+/* journal_checksum - Checksum (FNV-1a) of some bytes
+ *
+ * Parameters:
+ *  - p: Bytes
+ *  - len: Number of bytes
+ *
+ * Returns: Checksum
+ */
+static uint32_t journal_checksum(const char *p, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+/* journal_identify - Fill in a header for the current version of a file
+ *
+ * Parameters:
+ *  - h: Header
+ *  - filename: File
+ *
+ * Returns: 0 on success, -1 if the file can't be found (with errno set)
+ */
+static int journal_identify(journal_header_t *h, const char *filename)
+{
+    struct stat st;
+    if (stat(filename, &st) == -1)
+        return -1;
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, JOURNAL_MAGIC, sizeof(h->magic));
+    h->file_size = st.st_size;
+    h->file_mtime_sec = st.st_mtim.tv_sec;
+    h->file_mtime_nsec = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+
+/* journal_write_all - Write all of some bytes to a file
+ *
+ * Parameters:
+ *  - fd: File descriptor
+ *  - p: Bytes
+ *  - len: Number of bytes
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int journal_write_all(int fd, const char *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/* journal_create - Replace a journal file with a new one
+ *
+ * The new journal is written to a temporary file, synced, and renamed
+ * over the old one, so a crash leaves either the old journal or the
+ * new one.
+ *
+ * Parameters:
+ *  - path: Journal file
+ *  - h: Header of the new journal
+ *  - snapshot: Snapshot to follow the header (h->snapshot_len bytes,
+ *    if h->has_snapshot is set)
+ *
+ * Returns: Descriptor of the new journal, open for appending and
+ *          locked, or -1 on error (with errno set)
+ */
+static int journal_create(const char *path, const journal_header_t *h, const char *snapshot)
+{
+    size_t len = strlen(path) + 5;
+    char *tmp = malloc(len);
+    if (tmp == NULL)
+        return -1;
+    snprintf(tmp, len, "%s.tmp", path);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        free(tmp);
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1 ||
+        journal_write_all(fd, (const char *)h, sizeof(*h)) == -1 ||
+        journal_write_all(fd, snapshot, h->snapshot_len) == -1 ||
+        fdatasync(fd) == -1 ||
+        rename(tmp, path) == -1)
+    {
+        int saved_errno = errno;
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        errno = saved_errno;
+        return -1;
+    }
+    free(tmp);
+    return fd;
+}
+
+
+/* journal_grow - Make room for more bytes in pending (under lock)
+ *
+ * Parameters:
+ *  - j: Journal
+ *  - extra: Number of bytes to make room for
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (and
+ *          j->error is set)
+ */
+static int journal_grow(journal_t *j, size_t extra)
+{
+    if (j->len + extra <= j->cap)
+        return 0;
+    size_t cap = j->cap ? j->cap : 4096;
+    while (cap < j->len + extra)
+        cap *= 2;
+    char *pending = realloc(j->pending, cap);
+    if (pending == NULL)
+    {
+        j->error = ENOMEM;
+        return -1;
+    }
+    j->pending = pending;
+    j->cap = cap;
+    return 0;
+}
+
+
+/* journal_begin_record - Start a record in pending (under lock)
+ *
+ * Parameters:
+ *  - j: Journal
+ *  - kind: Kind of record
+ *  - at: Row it applies to
+ *  - n: Number of rows
+ *
+ * Returns: Offset of the record in pending, or -1 if memory could not
+ *          be allocated
+ */
+static long journal_begin_record(journal_t *j, char kind, int at, int n)
+{
+    if (journal_grow(j, JOURNAL_RECORD_HEADER) == -1)
+        return -1;
+    size_t start = j->len;
+    uint32_t at32 = at, n32 = n;
+    j->pending[start] = kind;
+    memcpy(&j->pending[start + 1], &at32, 4);
+    memcpy(&j->pending[start + 5], &n32, 4);
+    j->len += JOURNAL_RECORD_HEADER;
+    return start;
+}
+
+
+/* journal_end_record - Finish the record started at an offset in
+ *                      pending (under lock)
+ *
+ * Parameters:
+ *  - j: Journal
+ *  - start: Offset of the record
+ *
+ * Returns: Nothing
+ */
+static void journal_end_record(journal_t *j, size_t start)
+{
+    if (journal_grow(j, JOURNAL_RECORD_CHECK) == -1)
+        return;
+    uint32_t len = j->len - start - JOURNAL_RECORD_HEADER;
+    memcpy(&j->pending[start + 9], &len, 4);
+    uint32_t check = journal_checksum(&j->pending[start], j->len - start);
+    memcpy(&j->pending[j->len], &check, 4);
+    j->len += JOURNAL_RECORD_CHECK;
+    j->tail += j->len - start;
+}
+
+
+/* journal_append - Append bytes to the record being built (under lock)
+ *
+ * Parameters:
+ *  - j: Journal
+ *  - p: Bytes
+ *  - len: Number of bytes
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int journal_append(journal_t *j, const char *p, size_t len)
+{
+    if (journal_grow(j, len) == -1)
+        return -1;
+    memcpy(&j->pending[j->len], p, len);
+    j->len += len;
+    return 0;
+}
+
+
+/* journal_add_rows - Record the contents of some rows (under lock)
+ *
+ * Parameters:
+ *  - j: Journal
+ *  - kind: JOURNAL_ROW_CHANGED (for a single row) or
+ *    JOURNAL_ROWS_INSERTED
+ *  - at: First row
+ *  - n: Number of rows
+ *
+ * Returns: Nothing
+ */
+static void journal_add_rows(journal_t *j, char kind, int at, int n)
+{
+    if (kind == JOURNAL_ROW_CHANGED)
+    {
+        /* Only the last contents of a row matter, so a record of an
+         * earlier change to it that hasn't been written out yet can go */
+        if (j->last_row == at)
+        {
+            j->tail -= j->len - j->last_at;
+            j->len = j->last_at;
+        }
+        long start = journal_begin_record(j, kind, at, 1);
+        if (start == -1)
+            return;
+        erow_t *row = buffer_row(j->buf, at);
+        if (journal_append(j, editor_row_chars(row), row->size) == -1)
+            return;
+        journal_end_record(j, start);
+        j->last_row = at;
+        j->last_at = start;
+        return;
+    }
+
+    /* Inserted rows are recorded as their lengths and contents, in
+     * records of up to JOURNAL_RECORD_BYTES */
+    j->last_row = -1;
+    int i = 0;
+    while (i < n)
+    {
+        long start = journal_begin_record(j, kind, at + i, 0);
+        if (start == -1)
+            return;
+        int first = i;
+        size_t bytes = 0;
+        do
+        {
+            erow_t *row = buffer_row(j->buf, at + i);
+            uint32_t size = row->size;
+            if (journal_append(j, (const char *)&size, 4) == -1 ||
+                journal_append(j, editor_row_chars(row), row->size) == -1)
+                return;
+            bytes += 4 + row->size;
+            i++;
+        } while (i < n && bytes < JOURNAL_RECORD_BYTES);
+
+        uint32_t count = i - first;
+        memcpy(&j->pending[start + 5], &count, 4);
+        journal_end_record(j, start);
+    }
+}
+
+
+/* journal_changed - Buffer listener callback (see buffer_listener_t) */
+static void journal_changed(buffer_listener_t *l, buffer_t *buf,
+                            buffer_change_t change, int at, int n)
+{
+    journal_t *j = l->arg;
+    (void)buf;
+
+    if (change == BUFFER_RESET)
+    {
+        journal_checkpoint(j);
+        return;
+    }
+
+    pthread_mutex_lock(&j->lock);
+    if (j->error)
+    {
+        pthread_mutex_unlock(&j->lock);
+        return;
+    }
+
+    size_t before = j->len;
+    switch (change)
+    {
+    case BUFFER_ROW_CHANGED:
+        journal_add_rows(j, JOURNAL_ROW_CHANGED, at, 1);
+        break;
+
+    case BUFFER_ROWS_INSERTED:
+        journal_add_rows(j, JOURNAL_ROWS_INSERTED, at, n);
+        break;
+
+    case BUFFER_ROWS_DELETED:
+    {
+        j->last_row = -1;
+        long start = journal_begin_record(j, JOURNAL_ROWS_DELETED, at, n);
+        if (start != -1)
+            journal_end_record(j, start);
+        break;
+    }
+
+    case BUFFER_RESET:
+        break;
+    }
+
+    /* Wake the writer when the first record of a batch comes in (it
+     * then waits for more), and when the batch is full */
+    if (before == 0 || (before < JOURNAL_BATCH_BYTES && j->len >= JOURNAL_BATCH_BYTES))
+        pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+}
+
+
+/* journal_main - Body of the writer thread
+ *
+ * Parameters:
+ *  - arg: Journal
+ *
+ * Returns: NULL
+ */
+static void *journal_main(void *arg)
+{
+    journal_t *j = arg;
+
+    pthread_mutex_lock(&j->lock);
+    while (!j->quit && !j->error)
+    {
+        if (j->len == 0 && !j->restart)
+        {
+            pthread_cond_wait(&j->wake, &j->lock);
+            continue;
+        }
+
+        /* Give the batch time to fill up */
+        if (!j->restart && j->len < JOURNAL_BATCH_BYTES)
+        {
+            struct timespec t;
+            clock_gettime(CLOCK_REALTIME, &t);
+            t.tv_nsec += JOURNAL_FLUSH_MS * 1000000L;
+            t.tv_sec += t.tv_nsec / 1000000000L;
+            t.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&j->wake, &j->lock, &t);
+            if (j->quit)
+                break;
+        }
+
+        /* Take the batch (and the new journal to start, if any), and
+         * leave the spare buffer to fill up in the meantime */
+        char *batch = j->pending;
+        size_t len = j->len, cap = j->cap;
+        j->pending = j->spare;
+        j->cap = j->spare_cap;
+        j->len = 0;
+        j->last_row = -1;
+
+        int restart = j->restart;
+        size_t split = restart ? j->restart_at : len;
+        journal_header_t header = j->next_header;
+        char *snapshot = j->next_snapshot;
+        j->restart = 0;
+        j->next_snapshot = NULL;
+        int fd = j->fd;
+        pthread_mutex_unlock(&j->lock);
+
+        int rc = 0;
+        if (split > 0)
+            rc = journal_write_all(fd, batch, split);
+        if (rc == 0 && restart)
+        {
+            int new_fd = journal_create(j->path, &header, snapshot);
+            if (new_fd == -1)
+            {
+                rc = -1;
+            }
+            else
+            {
+                close(fd);
+                fd = new_fd;
+            }
+        }
+        if (rc == 0 && len > split)
+            rc = journal_write_all(fd, batch + split, len - split);
+        if (rc == 0)
+            rc = fdatasync(fd);
+        int saved_errno = errno;
+        free(snapshot);
+
+        pthread_mutex_lock(&j->lock);
+        j->fd = fd;
+        if (rc == -1)
+        {
+            j->error = saved_errno;
+            break;
+        }
+        if (!j->restart)
+            j->checkpointing = 0;
+
+        /* Keep the batch's memory for the next one, unless it grew
+         * much larger than a batch */
+        if (cap > 4 * JOURNAL_BATCH_BYTES)
+        {
+            free(batch);
+            batch = NULL;
+            cap = 0;
+        }
+        j->spare = batch;
+        j->spare_cap = cap;
+    }
+    pthread_mutex_unlock(&j->lock);
+    return NULL;
+}
+
+
+/* journal_replay - Apply the records of a journal to a buffer
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - p: Records
+ *  - len: Length of the records
+ *
+ * Returns: Length of the records that were applied (the rest are
+ *          incomplete or damaged)
+ */
+static size_t journal_replay(buffer_t *buf, const char *p, size_t len)
+{
+    size_t done = 0;
+    while (len - done >= JOURNAL_RECORD_HEADER + JOURNAL_RECORD_CHECK)
+    {
+        const char *r = p + done;
+        uint32_t at, n, size, check;
+        memcpy(&at, r + 1, 4);
+        memcpy(&n, r + 5, 4);
+        memcpy(&size, r + 9, 4);
+        if (size > len - done - JOURNAL_RECORD_HEADER - JOURNAL_RECORD_CHECK)
+            break;
+        memcpy(&check, r + JOURNAL_RECORD_HEADER + size, 4);
+        if (check != journal_checksum(r, JOURNAL_RECORD_HEADER + size))
+            break;
+
+        const char *payload = r + JOURNAL_RECORD_HEADER;
+        switch (r[0])
+        {
+        case JOURNAL_ROW_CHANGED:
+        {
+            if (at >= (uint32_t)buf->num_rows)
+                return done;
+            erow_edit_t all = {0, buffer_row(buf, at)->size};
+            buffer_row_splice(buf, at, &all, 1, payload, size);
+            break;
+        }
+
+        case JOURNAL_ROWS_INSERTED:
+        {
+            if (at > (uint32_t)buf->num_rows || n == 0 ||
+                buffer_insert_counted(buf, at, payload, size) != (int)n)
+                return done;
+            break;
+        }
+
+        case JOURNAL_ROWS_DELETED:
+            if (at > (uint32_t)buf->num_rows || n > buf->num_rows - at)
+                return done;
+            buffer_delete_rows(buf, at, n);
+            break;
+
+        default:
+            return done;
+        }
+        done += JOURNAL_RECORD_HEADER + size + JOURNAL_RECORD_CHECK;
+    }
+    return done;
+}
+
+
+/* See journal.h */
+int journal_recover(buffer_t *buf, const char *filename)
+{
+    char *path = journal_path(filename);
+    if (path == NULL)
+        return -1;
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    free(path);
+    if (fd == -1)
+        return errno == ENOENT ? 0 : -1;
+
+    /* A journal someone else is writing is theirs to recover */
+    struct stat st;
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1 || fstat(fd, &st) == -1 ||
+        (size_t)st.st_size < sizeof(journal_header_t))
+    {
+        close(fd);
+        return 0;
+    }
+
+    size_t size = st.st_size;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    /* Without a snapshot, the records only apply to the version of
+     * the file they were recorded against, and if there are none
+     * there's nothing to recover */
+    journal_header_t h, current;
+    memcpy(&h, map, sizeof(h));
+    size_t start = sizeof(h) + h.snapshot_len;
+    int usable = memcmp(h.magic, JOURNAL_MAGIC, sizeof(h.magic)) == 0 &&
+                 h.snapshot_len <= size - sizeof(h);
+    if (usable && !h.has_snapshot)
+    {
+        usable = start < size && journal_identify(&current, filename) == 0 &&
+                 current.file_size == h.file_size &&
+                 current.file_mtime_sec == h.file_mtime_sec &&
+                 current.file_mtime_nsec == h.file_mtime_nsec;
+    }
+    if (!usable)
+    {
+        munmap((void *)map, size);
+        close(fd);
+        return 0;
+    }
+
+    int rc = 0;
+    if (h.has_snapshot)
+    {
+        buffer_free(buf);
+        buf->filename = strdup(filename);
+        if (buffer_insert_counted(buf, 0, map + sizeof(h), h.snapshot_len) == -1)
+            rc = -1;
+    }
+    else
+    {
+        rc = buffer_open_file(buf, filename);
+    }
+
+    if (rc == 0)
+    {
+        buf->dirty = 0;
+        size_t done = journal_replay(buf, map + start, size - start);
+        if (h.has_snapshot || done > 0)
+            buf->dirty = 1;
+
+        /* Drop what couldn't be replayed, so records appended from now
+         * on follow the last good one */
+        if (start + done < size)
+            rc = ftruncate(fd, start + done);
+    }
+
+    int saved_errno = errno;
+    munmap((void *)map, size);
+    close(fd);
+    errno = saved_errno;
+    return rc == 0 ? 1 : -1;
+}
+
+
+/* See journal.h */
+int journal_init(journal_t *j, buffer_t *buf, int resume)
+{
+    j->buf = buf;
+    j->path = journal_path(buf->filename);
+    if (j->path == NULL)
+        return -1;
+
+    journal_header_t h;
+    if (journal_identify(&h, buf->filename) == -1)
+        goto fail;
+    j->base = h.file_size;
+
+    if (resume)
+    {
+        j->fd = open(j->path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (j->fd != -1 && flock(j->fd, LOCK_EX | LOCK_NB) == -1)
+        {
+            close(j->fd);
+            j->fd = -1;
+        }
+        if (j->fd == -1)
+            goto fail;
+        struct stat st;
+        journal_header_t old;
+        if (fstat(j->fd, &st) == 0 && pread(j->fd, &old, sizeof(old), 0) == sizeof(old) &&
+            old.has_snapshot)
+            j->base = old.snapshot_len;
+    }
+    else
+    {
+        /* Don't replace a journal someone else is writing */
+        int old = open(j->path, O_RDONLY | O_CLOEXEC);
+        if (old != -1)
+        {
+            int busy = flock(old, LOCK_EX | LOCK_NB) == -1;
+            close(old);
+            if (busy)
+            {
+                errno = EWOULDBLOCK;
+                goto fail;
+            }
+        }
+        j->fd = journal_create(j->path, &h, NULL);
+        if (j->fd == -1)
+            goto fail;
+    }
+
+    j->pending = j->spare = NULL;
+    j->len = j->cap = j->spare_cap = 0;
+    j->last_row = -1;
+    j->last_at = 0;
+    j->restart = 0;
+    j->restart_at = 0;
+    j->next_snapshot = NULL;
+    j->checkpointing = 0;
+    j->tail = 0;
+    j->quit = 0;
+    j->error = 0;
+
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->wake, NULL);
+    int rc = pthread_create(&j->thread, NULL, journal_main, j);
+    if (rc != 0)
+    {
+        pthread_cond_destroy(&j->wake);
+        pthread_mutex_destroy(&j->lock);
+        close(j->fd);
+        unlink(j->path);
+        errno = rc;
+        goto fail;
+    }
+
+    j->listener.changed = journal_changed;
+    j->listener.arg = j;
+    buffer_add_listener(buf, &j->listener);
+    return 0;
+
+fail:;
+    int saved_errno = errno;
+    free(j->path);
+    j->path = NULL;
+    errno = saved_errno;
+    return -1;
+}
+
+
+/* See journal.h */
+void journal_free(journal_t *j)
+{
+    buffer_remove_listener(j->buf, &j->listener);
+
+    pthread_mutex_lock(&j->lock);
+    j->quit = 1;
+    pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+    pthread_join(j->thread, NULL);
+
+    pthread_cond_destroy(&j->wake);
+    pthread_mutex_destroy(&j->lock);
+    unlink(j->path);
+    close(j->fd);
+    free(j->path);
+    free(j->pending);
+    free(j->spare);
+    free(j->next_snapshot);
+}
+
+
+/* journal_restart - Ask the writer thread to start a new journal
+ *                   (under lock)
+ *
+ * Parameters:
+ *  - j: Journal
+ *  - h: Header of the new journal
+ *  - snapshot: Its snapshot (h->snapshot_len bytes; NULL if none)
+ *  - at: Records in pending to write to the old journal first
+ *
+ * Returns: Nothing
+ */
+static void journal_restart(journal_t *j, const journal_header_t *h, char *snapshot, size_t at)
+{
+    free(j->next_snapshot);
+    j->next_header = *h;
+    j->next_snapshot = snapshot;
+    j->restart = 1;
+    j->restart_at = at;
+    j->checkpointing = 1;
+    j->last_row = -1;
+    j->tail = 0;
+    j->base = h->has_snapshot ? (long long)h->snapshot_len : (long long)h->file_size;
+    pthread_cond_signal(&j->wake);
+}
+
+
+/* See journal.h */
+int journal_saved(journal_t *j)
+{
+    journal_header_t h;
+    if (journal_identify(&h, j->buf->filename) == -1)
+        return -1;
+
+    /* The file has everything the records waiting to be written have */
+    pthread_mutex_lock(&j->lock);
+    j->len = 0;
+    journal_restart(j, &h, NULL, 0);
+    pthread_mutex_unlock(&j->lock);
+    return 0;
+}
+
+
+/* See journal.h */
+int journal_needs_checkpoint(journal_t *j)
+{
+    pthread_mutex_lock(&j->lock);
+    int needed = !j->checkpointing && !j->error &&
+                 j->tail >= JOURNAL_CHECKPOINT_MIN &&
+                 j->tail >= j->base / JOURNAL_CHECKPOINT_RATIO;
+    pthread_mutex_unlock(&j->lock);
+    return needed;
+}
+
+
+/* journal_snapshot - Copy the rows of a buffer in the format of
+ *                    buffer_insert_counted
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - len: Set to the length of the copy
+ *
+ * Returns: The copy, or NULL if memory could not be allocated
+ */
+static char *journal_snapshot(buffer_t *buf, size_t *len)
+{
+    size_t total = 0;
+    for (int i = 0; i < buf->num_rows; i++)
+        total += 4 + buffer_row(buf, i)->size;
+
+    char *s = malloc(total + 1);
+    if (s == NULL)
+        return NULL;
+    char *p = s;
+    for (int i = 0; i < buf->num_rows; i++)
+    {
+        erow_t *row = buffer_row(buf, i);
+        uint32_t size = row->size;
+        memcpy(p, &size, 4);
+        memcpy(p + 4, editor_row_chars(row), row->size);
+        p += 4 + row->size;
+    }
+    *len = total;
+    return s;
+}
+
+
+/* See journal.h */
+int journal_checkpoint(journal_t *j)
+{
+    size_t len;
+    char *snapshot = journal_snapshot(j->buf, &len);
+    if (snapshot == NULL)
+        return -1;
+
+    /* The snapshot doesn't depend on the file, which may even be gone */
+    journal_header_t h;
+    if (journal_identify(&h, j->buf->filename) == -1)
+    {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, JOURNAL_MAGIC, sizeof(h.magic));
+    }
+    h.has_snapshot = 1;
+    h.snapshot_len = len;
+
+    pthread_mutex_lock(&j->lock);
+    journal_restart(j, &h, snapshot, j->len);
+    pthread_mutex_unlock(&j->lock);
+    return 0;
+}
+
+
+/* See journal.h */
+int journal_error(journal_t *j)
+{
+    pthread_mutex_lock(&j->lock);
+    int error = j->error;
+    pthread_mutex_unlock(&j->lock);
+    return error;
+}
@@ -0,0 +1,235 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * journal.h: A crash-safe journal of the unsaved changes to a buffer.
+ *
+ * The journal of foo.c is the hidden file .foo.c.micro-journal next to
+ * it. It starts with a header identifying the version of foo.c it
+ * applies to, optionally followed by a snapshot of the whole buffer (a
+ * checkpoint), and then has a record appended for every change to the
+ * buffer's rows: the new contents of a changed row, the contents of
+ * inserted rows, or the range of deleted rows. Rows are stored as their
+ * length followed by their contents (see buffer_insert_counted), so
+ * they come back exactly as they were, even if they end in '\r'. Each
+ * record carries a checksum, so a record cut short by a crash is
+ * recognized and dropped.
+ *
+ * Records are only copied into memory as the buffer changes. A
+ * background thread writes them out in batches (every JOURNAL_FLUSH_MS
+ * at most) and syncs them to disk, so keystrokes never wait for the
+ * disk, and a crash loses at most the last batch. Several changes to
+ * the same row within a batch are written as one record.
+ *
+ * When the records written since the last checkpoint grow large
+ * compared to the buffer, the buffer is copied, and the thread replaces
+ * the journal with one that starts with that copy as its snapshot, so
+ * the journal stays bounded and recovery only has to load the snapshot
+ * and replay the records after it. Saving the buffer replaces the
+ * journal with an empty one.
+ *
+ * The journal is locked while in use, so two editors don't write to
+ * the journal of the same file.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "buffer.h"
+
+/* Longest time records wait in memory before being written out */
+#define JOURNAL_FLUSH_MS (200)
+
+/* Records are written out as soon as this many bytes are waiting */
+#define JOURNAL_BATCH_BYTES (256 << 10)
+
+/* Largest amount of inserted text in a single record (inserting more
+ * rows than this at once takes several records) */
+#define JOURNAL_RECORD_BYTES (1 << 20)
+
+/* A checkpoint is made once the records since the last one take up at
+ * least JOURNAL_CHECKPOINT_MIN bytes, and at least 1/JOURNAL_CHECKPOINT_RATIO
+ * of the size of the file or snapshot they apply to */
+#define JOURNAL_CHECKPOINT_MIN (4 << 20)
+#define JOURNAL_CHECKPOINT_RATIO (4)
+
+/* Start of a journal file */
+typedef struct journal_header
+{
+    /* JOURNAL_MAGIC */
+    char magic[8];
+
+    /* Size and modification time of the file the journal applies to
+     * (only checked if there is no snapshot) */
+    uint64_t file_size;
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+
+    /* Is there a snapshot after the header, and how long is it? */
+    uint64_t has_snapshot;
+    uint64_t snapshot_len;
+} journal_header_t;
+
+#define JOURNAL_MAGIC "MJOURNL2"
+
+/* Journal of a buffer */
+typedef struct journal
+{
+    buffer_t *buf;
+
+    /* Journal file, and the descriptor it is open (and locked) on.
+     * The descriptor is only used by the writer thread */
+    char *path;
+    int fd;
+
+    /* Writer thread, and the lock and condition variable that go with
+     * it. Everything below is protected by the lock */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    /* Records waiting to be written out, and a second buffer for the
+     * writer thread to swap in while it writes them */
+    char *pending;
+    size_t len, cap;
+    char *spare;
+    size_t spare_cap;
+
+    /* Row changed by the last record in pending, and where that record
+     * starts (last_row is -1 if the last record is of another kind) */
+    int last_row;
+    size_t last_at;
+
+    /* Journal to start over with, once the records in pending before
+     * restart_at have been written: its header, and its snapshot
+     * (NULL if it has none). Set by journal_checkpoint and
+     * journal_saved */
+    int restart;
+    size_t restart_at;
+    journal_header_t next_header;
+    char *next_snapshot;
+
+    /* Is a checkpoint waiting or being written? */
+    int checkpointing;
+
+    /* Size of the file or snapshot the journal applies to, and of the
+     * records since (see journal_needs_checkpoint) */
+    long long base;
+    long long tail;
+
+    /* Set to ask the writer thread to exit */
+    int quit;
+
+    /* errno of a failed write (0 if there was none). Once set, no more
+     * records are kept */
+    int error;
+
+    /* Registered with the buffer */
+    buffer_listener_t listener;
+} journal_t;
+
+
+/* journal_path - Find the journal file of a file
+ *
+ * Parameters:
+ *  - filename: File
+ *
+ * Returns: Path of the journal (must be freed by the caller), or NULL
+ *          if memory could not be allocated
+ */
+char *journal_path(const char *filename);
+
+
+/* journal_recover - Load a file together with its unsaved changes
+ *
+ * If the file has a journal that applies to it, and no other editor is
+ * using the journal, the buffer is loaded from the file (or from the
+ * journal's snapshot), and the changes recorded since are replayed. A
+ * record cut short by a crash, and anything after it, is dropped from
+ * the journal, so it can be resumed (see journal_init).
+ *
+ * Parameters:
+ *  - buf: Buffer (any previous contents are discarded, if the journal
+ *    is used)
+ *  - filename: File to load
+ *
+ * Returns: 1 if the buffer was loaded (buf->dirty is set if there were
+ *          changes to recover), 0 if there is no journal to recover
+ *          from (the buffer is left alone), -1 on error (with errno set)
+ */
+int journal_recover(buffer_t *buf, const char *filename);
+
+
+/* journal_init - Start journaling the changes to a buffer
+ *
+ * Parameters:
+ *  - j: Journal
+ *  - buf: Buffer (in memory, with its filename set, and just loaded
+ *    from its file or by journal_recover; must stay at the same
+ *    address until journal_free)
+ *  - resume: Keep appending to the journal journal_recover just loaded
+ *    the buffer from, instead of starting a new one
+ *
+ * Returns: 0 on success, -1 on error (with errno set; EWOULDBLOCK if
+ *          another editor is using the journal)
+ */
+int journal_init(journal_t *j, buffer_t *buf, int resume);
+
+
+/* journal_free - Stop journaling, and delete the journal
+ *
+ * Parameters:
+ *  - j: Journal
+ *
+ * Returns: Nothing
+ */
+void journal_free(journal_t *j);
+
+
+/* journal_saved - Start over after the buffer was saved
+ *
+ * Parameters:
+ *  - j: Journal
+ *
+ * Returns: 0 on success, -1 if the file can't be found (with errno set)
+ */
+int journal_saved(journal_t *j);
+
+
+/* journal_needs_checkpoint - Is it time for a checkpoint?
+ *
+ * Parameters:
+ *  - j: Journal
+ *
+ * Returns: 1 if journal_checkpoint should be called, 0 otherwise
+ */
+int journal_needs_checkpoint(journal_t *j);
+
+
+/* journal_checkpoint - Start the journal over from a snapshot
+ *
+ * The buffer is copied right away; the new journal is written in the
+ * background.
+ *
+ * Parameters:
+ *  - j: Journal
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+int journal_checkpoint(journal_t *j);
+
+
+/* journal_error - Check whether writing the journal failed
+ *
+ * Parameters:
+ *  - j: Journal
+ *
+ * Returns: errno of the failed write, or 0 if nothing failed
+ */
+int journal_error(journal_t *j);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,517 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * lineindex.c: Where the lines of a file start, remembered across runs.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "lineindex.h"
+
+/* Size of the chunks files are scanned in, and of the chunks of
+ * offsets read from and written to the cache */
+#define LINEINDEX_IO_CHUNK (1 << 20)
+#define LINEINDEX_IO_ENTRIES (LINEINDEX_IO_CHUNK / sizeof(uint64_t))
+
+
+/* lineindex_hash - Hash (FNV-1a) some bytes
+ *
+ * Parameters:
+ *  - p: Bytes
+ *  - len: Number of bytes
+ *
+ * Returns: Hash
+ */
+static uint64_t lineindex_hash(const char *p, size_t len)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+/* lineindex_cache_dir - Find (and create) the cache directory
+ *
+ * Parameters:
+ *  - create: Create the directory if it doesn't exist
+ *
+ * Returns: Path of the directory (must be freed by the caller), or
+ *          NULL if there is no home directory or memory could not be
+ *          allocated
+ */
+static char *lineindex_cache_dir(int create)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    const char *suffix = "";
+    if (base == NULL || base[0] == '\0')
+    {
+        if (home == NULL || home[0] == '\0')
+            return NULL;
+        base = home;
+        suffix = "/.cache";
+    }
+
+    size_t len = strlen(base) + strlen(suffix) + 32;
+    char *dir = malloc(len);
+    if (dir == NULL)
+        return NULL;
+
+    /* Each level of the path, in turn */
+    const char *levels[] = {"", "/micro", "/micro/lines"};
+    for (int i = 0; i < 3; i++)
+    {
+        snprintf(dir, len, "%s%s%s", base, suffix, levels[i]);
+        if (create)
+            mkdir(dir, 0700);
+    }
+    return dir;
+}
+
+
+/* See lineindex.h */
+char *lineindex_cache_path(const char *filename, int stride)
+{
+    char *real = realpath(filename, NULL);
+    if (real == NULL)
+        return NULL;
+    char *dir = lineindex_cache_dir(0);
+    size_t len = dir ? strlen(dir) + 48 : 0;
+    char *path = dir ? malloc(len) : NULL;
+    if (path)
+        snprintf(path, len, "%s/%016llx.%d", dir,
+                 (unsigned long long)lineindex_hash(real, strlen(real)), stride);
+    free(dir);
+    free(real);
+    return path;
+}
+
+
+/* lineindex_tail_check - Checksum the end of the first part of a file
+ *
+ * Parameters:
+ *  - fd: File
+ *  - size: Size of the part
+ *  - check: Output parameter to return the checksum
+ *
+ * Returns: 0 on success, -1 if the part can't be read
+ */
+static int lineindex_tail_check(int fd, size_t size, uint64_t *check)
+{
+    char tail[LINEINDEX_CHECK_BYTES];
+    size_t len = size < sizeof(tail) ? size : sizeof(tail);
+    if (pread(fd, tail, len, size - len) != (ssize_t)len)
+        return -1;
+    *check = lineindex_hash(tail, len);
+    return 0;
+}
+
+
+/* lineindex_add - Add the offset of a line to an index
+ *
+ * Parameters:
+ *  - idx: Index
+ *  - capacity: Room in idx->starts, grown as needed
+ *  - offset: Offset of the line
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int lineindex_add(lineindex_t *idx, size_t *capacity, size_t offset)
+{
+    if (idx->count == *capacity)
+    {
+        size_t grown = *capacity ? *capacity * 2 : 1024;
+        size_t *starts = realloc(idx->starts, sizeof(size_t) * grown);
+        if (starts == NULL)
+            return -1;
+        idx->starts = starts;
+        *capacity = grown;
+    }
+    idx->starts[idx->count++] = offset;
+    return 0;
+}
+
+
+/* lineindex_scan - Index the lines of a file from a given line on
+ *
+ * The lines before it must already be indexed, up to (and not
+ * including) the entry for the line we start from, if it has one, and
+ * idx->stats must hold the counts of the text before it.
+ *
+ * Parameters:
+ *  - idx: Index
+ *  - fd: File
+ *  - pos: Offset of the line to start from
+ *  - lines: Number of that line
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int lineindex_scan(lineindex_t *idx, int fd, size_t pos, long long lines)
+{
+    char *chunk = malloc(LINEINDEX_IO_CHUNK);
+    if (chunk == NULL)
+        return -1;
+
+    size_t capacity = idx->count;
+    size_t line_start = pos;
+
+    /* The text is counted up to every indexed line, so the counts
+     * before the last one are known; before_last is the same for the
+     * line indexed before it */
+    stats_t before_last = idx->last_stats;
+    if (lines % idx->stride == 0)
+    {
+        if (lineindex_add(idx, &capacity, pos) == -1)
+            goto fail;
+        before_last = idx->last_stats;
+        idx->last_stats = idx->stats;
+    }
+    int in_word = 0, cr = 0;
+
+    ssize_t n;
+    while ((n = pread(fd, chunk, LINEINDEX_IO_CHUNK, pos)) != 0)
+    {
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            goto fail;
+        }
+        char *c = chunk, *end = chunk + n, *counted = chunk;
+        while ((c = memchr(c, '\n', end - c)) != NULL)
+        {
+            /* The '\r' of a "\r\n" doesn't make it into a buffer */
+            if (c > chunk ? c[-1] == '\r' : cr)
+            {
+                idx->stats.bytes--;
+                idx->stats.chars--;
+            }
+            c++;
+            line_start = pos + (c - chunk);
+            if (++lines % idx->stride == 0)
+            {
+                stats_count(&idx->stats, counted, c - counted, &in_word);
+                counted = c;
+                if (lineindex_add(idx, &capacity, line_start) == -1)
+                    goto fail;
+                before_last = idx->last_stats;
+                idx->last_stats = idx->stats;
+            }
+        }
+        stats_count(&idx->stats, counted, end - counted, &in_word);
+        cr = end[-1] == '\r';
+        pos += n;
+    }
+    free(chunk);
+
+    /* A line only counts if it has something in it or a line break,
+     * so the line "started" at the very end of the file doesn't */
+    idx->size = pos;
+    idx->terminated = line_start == pos;
+    idx->num_lines = lines + !idx->terminated;
+    idx->stats.bytes += !idx->terminated;
+    if (idx->count > 0 && idx->starts[idx->count - 1] == pos && idx->terminated)
+    {
+        idx->count--;
+        idx->last_stats = before_last;
+    }
+    return 0;
+
+fail:;
+    int saved_errno = errno;
+    free(chunk);
+    errno = saved_errno;
+    return -1;
+}
+
+
+/* lineindex_load - Load an index from the cache
+ *
+ * Parameters:
+ *  - idx: Index (with its stride set)
+ *  - path: Cache file
+ *  - st: The file the index must be for
+ *  - h: Output parameter to return the header of the cache file
+ *
+ * Returns: 0 on success, -1 if there's no cache file for this file
+ *          and stride (or it can't be read)
+ */
+static int lineindex_load(lineindex_t *idx, const char *path, const struct stat *st,
+                          lineindex_header_t *h)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    if (read(fd, h, sizeof(*h)) != sizeof(*h) ||
+        memcmp(h->magic, LINEINDEX_MAGIC, sizeof(h->magic)) != 0 ||
+        h->dev != (uint64_t)st->st_dev || h->ino != (uint64_t)st->st_ino ||
+        h->stride != (uint64_t)idx->stride || h->count > SIZE_MAX / sizeof(size_t))
+        goto fail;
+
+    idx->starts = malloc(sizeof(size_t) * (h->count ? h->count : 1));
+    uint64_t *chunk = malloc(LINEINDEX_IO_CHUNK);
+    if (idx->starts == NULL || chunk == NULL)
+    {
+        free(chunk);
+        goto fail;
+    }
+    for (size_t i = 0; i < h->count;)
+    {
+        size_t n = h->count - i < LINEINDEX_IO_ENTRIES ? h->count - i : LINEINDEX_IO_ENTRIES;
+        if (read(fd, chunk, n * sizeof(uint64_t)) != (ssize_t)(n * sizeof(uint64_t)))
+        {
+            free(chunk);
+            goto fail;
+        }
+        for (size_t k = 0; k < n; k++)
+            idx->starts[i + k] = chunk[k];
+        i += n;
+    }
+    free(chunk);
+    close(fd);
+
+    idx->count = h->count;
+    idx->num_lines = h->num_lines;
+    idx->size = h->size;
+    idx->terminated = h->terminated;
+    idx->stats = h->stats;
+    idx->last_stats = h->last_stats;
+    return 0;
+
+fail:
+    close(fd);
+    free(idx->starts);
+    idx->starts = NULL;
+    return -1;
+}
+
+
+/* lineindex_save - Save an index to the cache
+ *
+ * The cache file is written under a temporary name, then renamed.
+ *
+ * Parameters:
+ *  - idx: Index
+ *  - path: Cache file
+ *  - h: Header to save with it (its identification of the file and
+ *    view; the rest is filled in from the index)
+ *
+ * Returns: 0 on success, -1 on error
+ */
+static int lineindex_save(lineindex_t *idx, const char *path, lineindex_header_t *h)
+{
+    memcpy(h->magic, LINEINDEX_MAGIC, sizeof(h->magic));
+    h->stride = idx->stride;
+    h->count = idx->count;
+    h->num_lines = idx->num_lines;
+    h->terminated = idx->terminated;
+    h->stats = idx->stats;
+    h->last_stats = idx->last_stats;
+
+    free(lineindex_cache_dir(1));
+    size_t len = strlen(path) + 32;
+    char *tmp = malloc(len);
+    uint64_t *chunk = malloc(LINEINDEX_IO_CHUNK);
+    int fd = -1;
+    if (tmp == NULL || chunk == NULL)
+        goto fail;
+    snprintf(tmp, len, "%s.%ld", path, (long)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1 || write(fd, h, sizeof(*h)) != sizeof(*h))
+        goto fail;
+    for (size_t i = 0; i < idx->count;)
+    {
+        size_t n = idx->count - i < LINEINDEX_IO_ENTRIES ? idx->count - i : LINEINDEX_IO_ENTRIES;
+        for (size_t k = 0; k < n; k++)
+            chunk[k] = idx->starts[i + k];
+        if (write(fd, chunk, n * sizeof(uint64_t)) != (ssize_t)(n * sizeof(uint64_t)))
+            goto fail;
+        i += n;
+    }
+    if (close(fd) == -1)
+    {
+        fd = -1;
+        goto fail;
+    }
+    fd = -1;
+    if (rename(tmp, path) == -1)
+        goto fail;
+    free(tmp);
+    free(chunk);
+    return 0;
+
+fail:
+    if (fd != -1)
+        close(fd);
+    if (tmp)
+        unlink(tmp);
+    free(tmp);
+    free(chunk);
+    return -1;
+}
+
+
+/* See lineindex.h */
+int lineindex_open(lineindex_t *idx, int fd, const char *filename, int stride)
+{
+    idx->starts = NULL;
+    idx->count = 0;
+    idx->stride = stride > 0 ? stride : 1;
+    idx->num_lines = 0;
+    idx->size = 0;
+    idx->terminated = 1;
+    memset(&idx->stats, 0, sizeof(idx->stats));
+    memset(&idx->last_stats, 0, sizeof(idx->last_stats));
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return -1;
+
+    char *path = lineindex_cache_path(filename, idx->stride);
+    lineindex_header_t h;
+    if (path && lineindex_load(idx, path, &st, &h) == 0)
+    {
+        /* Up to date */
+        if (h.size == (uint64_t)st.st_size && h.mtime_sec == st.st_mtim.tv_sec &&
+            h.mtime_nsec == st.st_mtim.tv_nsec)
+        {
+            free(path);
+            return 0;
+        }
+
+        /* Grown: index from the last indexed line on (it may have been
+         * extended too) */
+        uint64_t check;
+        if (h.size < (uint64_t)st.st_size && idx->count > 0 &&
+            lineindex_tail_check(fd, h.size, &check) == 0 && check == h.tail_check)
+        {
+            idx->count--;
+            idx->stats = idx->last_stats;
+            if (lineindex_scan(idx, fd, idx->starts[idx->count],
+                               (long long)idx->count * idx->stride) == -1)
+                goto fail;
+            goto save;
+        }
+
+        /* Anything else: start over (keeping the view) */
+        free(idx->starts);
+        idx->starts = NULL;
+        idx->count = 0;
+        memset(&idx->stats, 0, sizeof(idx->stats));
+        memset(&idx->last_stats, 0, sizeof(idx->last_stats));
+    }
+    else
+    {
+        memset(&h, 0, sizeof(h));
+    }
+    if (lineindex_scan(idx, fd, 0, 0) == -1)
+        goto fail;
+
+save:
+    /* Only worth it if the index is much smaller than the file */
+    if (path && idx->size >= LINEINDEX_MIN_BYTES &&
+        idx->count * sizeof(uint64_t) < idx->size / 4 &&
+        lineindex_tail_check(fd, idx->size, &h.tail_check) == 0)
+    {
+        h.dev = st.st_dev;
+        h.ino = st.st_ino;
+        h.size = idx->size;
+        h.mtime_sec = st.st_mtim.tv_sec;
+        h.mtime_nsec = st.st_mtim.tv_nsec;
+        lineindex_save(idx, path, &h);
+    }
+    free(path);
+    return 0;
+
+fail:;
+    int saved_errno = errno;
+    free(path);
+    lineindex_free(idx);
+    errno = saved_errno;
+    return -1;
+}
+
+
+/* See lineindex.h */
+void lineindex_free(lineindex_t *idx)
+{
+    free(idx->starts);
+    idx->starts = NULL;
+    idx->count = 0;
+}
+
+
+/* lineindex_open_cache - Open the cache file of a file
+ *
+ * Parameters:
+ *  - filename: File
+ *  - stride: Stride of the index
+ *  - flags: Flags for open()
+ *  - h: Output parameter to return the header of the cache file
+ *
+ * Returns: Descriptor of the cache file, or -1 if it doesn't exist or
+ *          is for another file by the same name
+ */
+static int lineindex_open_cache(const char *filename, int stride, int flags,
+                                lineindex_header_t *h)
+{
+    struct stat st;
+    char *path = lineindex_cache_path(filename, stride);
+    if (path == NULL || stat(filename, &st) == -1)
+    {
+        free(path);
+        return -1;
+    }
+    int fd = open(path, flags | O_CLOEXEC);
+    free(path);
+    if (fd == -1)
+        return -1;
+    if (read(fd, h, sizeof(*h)) != sizeof(*h) ||
+        memcmp(h->magic, LINEINDEX_MAGIC, sizeof(h->magic)) != 0 ||
+        h->dev != (uint64_t)st.st_dev || h->ino != (uint64_t)st.st_ino)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/* See lineindex.h */
+int lineindex_load_view(const char *filename, int stride, lineindex_view_t *view)
+{
+    lineindex_header_t h;
+    int fd = lineindex_open_cache(filename, stride, O_RDONLY, &h);
+    if (fd == -1)
+        return -1;
+    close(fd);
+    *view = h.view;
+    return 0;
+}
+
+
+/* See lineindex.h */
+int lineindex_save_view(const char *filename, int stride, const lineindex_view_t *view)
+{
+    lineindex_header_t h;
+    int fd = lineindex_open_cache(filename, stride, O_RDWR, &h);
+    if (fd == -1)
+        return -1;
+    ssize_t n = pwrite(fd, view, sizeof(*view), offsetof(lineindex_header_t, view));
+    close(fd);
+    return n == sizeof(*view) ? 0 : -1;
+}
@@ -0,0 +1,166 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * lineindex.h: Where the lines of a file start, remembered across runs.
+ *
+ * Opening a file in paged or read-only mode means finding its line
+ * breaks, which takes a full read of the file. For files of at least
+ * LINEINDEX_MIN_BYTES, the result is saved to a cache file (under
+ * $XDG_CACHE_HOME/micro/lines, or ~/.cache/micro/lines), named after a
+ * hash of the file's path and the stride of the index, along with the
+ * device, inode, size and modification time of the file it was made
+ * from, the counts of its bytes, words and characters (see stats.h), and
+ * the place the file was last viewed at. (Unless the lines are so short
+ * that reading the index would take about as long as reading the
+ * file.)
+ *
+ * Opening the file again only takes reading the cache. If the file has
+ * grown since (a log, say), and the last LINEINDEX_CHECK_BYTES of the
+ * part that was indexed haven't changed, only the part after the last
+ * indexed line is read.
+ */
+
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stats.h"
+
+/* Smallest file whose index is cached */
+#define LINEINDEX_MIN_BYTES (16 << 20)
+
+/* Number of bytes at the end of the indexed part of a file that must
+ * be unchanged for the index to be extended (rather than rebuilt)
+ * when the file grows */
+#define LINEINDEX_CHECK_BYTES (4096)
+
+/* Where a file was last viewed */
+typedef struct lineindex_view
+{
+    int64_t cx, cy;
+    int64_t rowoff, coloff;
+} lineindex_view_t;
+
+/* Start of a cache file (followed by the offsets of the lines) */
+typedef struct lineindex_header
+{
+    /* LINEINDEX_MAGIC */
+    char magic[8];
+
+    /* The file the index was made from */
+    uint64_t dev, ino;
+    uint64_t size;
+    int64_t mtime_sec, mtime_nsec;
+
+    /* Checksum of the LINEINDEX_CHECK_BYTES bytes (or fewer) before
+     * the end of the file */
+    uint64_t tail_check;
+
+    /* See lineindex_t */
+    uint64_t stride;
+    uint64_t count;
+    uint64_t num_lines;
+    uint64_t terminated;
+    stats_t stats, last_stats;
+
+    lineindex_view_t view;
+} lineindex_header_t;
+
+#define LINEINDEX_MAGIC "MLINES02"
+
+/* Index of the lines of a file */
+typedef struct lineindex
+{
+    /* Offset of the start of every stride-th line (lines 0, stride,
+     * 2 * stride, ...) */
+    size_t *starts;
+    size_t count;
+    int stride;
+
+    /* Number of lines (including a last line with no line break),
+     * size of the file, and whether it ends with a line break (or is
+     * empty) */
+    long long num_lines;
+    size_t size;
+    int terminated;
+
+    /* Counts of the text of the file, as a buffer holding it would
+     * count them (a "\r\n" is a single line break, and the last line
+     * counts a line break even if it has none), and of the text before
+     * the last indexed line (to carry on from when the file grows) */
+    stats_t stats;
+    stats_t last_stats;
+} lineindex_t;
+
+
+/* lineindex_cache_path - Find the cache file of a file's index
+ *
+ * Parameters:
+ *  - filename: File
+ *  - stride: Stride of the index (see lineindex_t)
+ *
+ * Returns: Path of the cache file (must be freed by the caller), or
+ *          NULL if there's no cache directory, the file can't be
+ *          found, or memory could not be allocated
+ */
+char *lineindex_cache_path(const char *filename, int stride);
+
+
+/* lineindex_open - Index the lines of a file
+ *
+ * The index is loaded from the cache if it is up to date, extended if
+ * the file only grew, and built from scratch otherwise (and then saved
+ * to the cache, if the file is large enough).
+ *
+ * Parameters:
+ *  - idx: Index
+ *  - fd: The file, open for reading
+ *  - filename: Its name
+ *  - stride: Number of lines between indexed lines
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+int lineindex_open(lineindex_t *idx, int fd, const char *filename, int stride);
+
+
+/* lineindex_free - Free an index
+ *
+ * Parameters:
+ *  - idx: Index
+ *
+ * Returns: Nothing
+ */
+void lineindex_free(lineindex_t *idx);
+
+
+/* lineindex_load_view - Find where a file was last viewed
+ *
+ * Parameters:
+ *  - filename: File
+ *  - stride: Stride of its index
+ *  - view: Output parameter to return the view
+ *
+ * Returns: 0 on success, -1 if the file has no cached index (or it's
+ *          for another file by the same name)
+ */
+int lineindex_load_view(const char *filename, int stride, lineindex_view_t *view);
+
+
+/* lineindex_save_view - Remember where a file was last viewed
+ *
+ * Nothing is saved for files with no cached index.
+ *
+ * Parameters:
+ *  - filename: File
+ *  - stride: Stride of its index
+ *  - view: View
+ *
+ * Returns: 0 on success, -1 if the file has no cached index (or it's
+ *          for another file by the same name), or it can't be written
+ */
+int lineindex_save_view(const char *filename, int stride, const lineindex_view_t *view);
+
+#endif /* LINEINDEX_H */
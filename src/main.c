@@ -1,27 +1,136 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "common.h"
 #include "terminal.h"
 #include "editor.h"
 #include "screen.h"
 #include "input.h"
+#include "trace.h"
 
 int main(int argc, char *argv[])
 {
     editor_ctx_t ctx;
+    int paged = 0;
+    int follow = 0;
+    int readonly = 0;
+    int soft_wrap = 0;
+    long cache_mb = MICRO_PAGE_CACHE_MB;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "Pc:fRw")) != -1)
+    {
+        switch (opt)
+        {
+        case 'P':
+            paged = 1;
+            break;
+        case 'f':
+            follow = 1;
+            break;
+        case 'R':
+            readonly = 1;
+            break;
+        case 'w':
+            soft_wrap = 1;
+            break;
+        case 'c':
+            cache_mb = strtol(optarg, NULL, 10);
+            if (cache_mb > 0)
+                break;
+            /* fall through */
+        default:
+            fprintf(stderr, "Usage: %s [-P] [-c cache_mb] [-f] [-R] [-w] [file...]\n", argv[0]);
+            return 1;
+        }
+    }
 
     terminal_enable_raw_mode();
     init_editor(&ctx);
+    terminal_watch_resize();
+    ctx.paged = paged;
+    ctx.page_cache = (size_t)cache_mb << 20;
+    ctx.readonly = readonly;
+    ctx.follow = follow;
+
+    /* Opening a file may leave a more important message */
+    screen_set_status_message(&ctx, "HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | Ctrl-W = wrap");
+    for (int i = optind; i < argc; i++)
+        editor_open_file(&ctx, argv[i]);
+    if (ctx.num_buffers > 1)
+        editor_switch_buffer(&ctx, 0);
+    if (soft_wrap)
+        editor_toggle_wrap(&ctx);
 
-    if (argc >= 2)
+    int quit = 0;
+    int redraw = 1;
+    while (!quit)
     {
-        editor_open_file(&ctx, argv[1]);
-    }
+        if (editor_highlight_background(&ctx))
+            redraw = 1;
+        if (redraw)
+            screen_refresh(&ctx);
+        redraw = 1;
+        editor_journal_update(&ctx);
 
-    screen_set_status_message(&ctx, "HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
+        /* Besides keys, we wake up when the background highlighter has
+         * finished some work, when more of a compressed file has been
+         * decompressed and, in follow mode, when a file changes (files
+         * we can't wait on are checked every MICRO_FOLLOW_POLL_MS, or
+         * MICRO_LOAD_POLL_MS while loading). While rows are left to wrap
+         * after a resize, we only check for keys between batches */
+        int fds[TERMINAL_WAIT_MAX_FDS];
+        int nfds = 0;
+        int timeout = editor_wrap_background(&ctx) ? 0 : -1;
+        if (ctx.highlighter)
+            fds[nfds++] = highlight_worker_fd(ctx.highlighter);
+        for (int i = 0; i < ctx.num_buffers; i++)
+        {
+            follow_t *f = ctx.buffers[i]->follow;
+            if (f == NULL)
+                continue;
+            if (nfds < TERMINAL_WAIT_MAX_FDS)
+                fds[nfds++] = follow_fd(f);
+            if (timeout != 0)
+                timeout = f->pending ? 0 : MICRO_FOLLOW_POLL_MS;
+        }
+        for (int i = 0; i < ctx.num_buffers; i++)
+        {
+            compress_reader_t *r = ctx.buffers[i]->reader;
+            if (r == NULL)
+                continue;
+            if (nfds < TERMINAL_WAIT_MAX_FDS)
+                fds[nfds++] = compress_fd(r);
+            else if (timeout == -1 || timeout > MICRO_LOAD_POLL_MS)
+                timeout = MICRO_LOAD_POLL_MS;
+            if (r->pending)
+                timeout = 0;
+        }
 
-    while (1)
-    {
-        screen_refresh(&ctx);
-        input_process_keypress(&ctx);
+        int key_ready = terminal_wait(fds, nfds, timeout);
+        int resized = terminal_resized();
+        if (resized)
+            editor_resize(&ctx);
+        int loaded = editor_load_update(&ctx);
+        if (ctx.follow)
+            editor_follow_update(&ctx);
+        else if (!key_ready && !resized && !loaded)
+            redraw = 0;
+
+        if (key_ready)
+            quit = input_process_keypress(&ctx);
     }
 
+    editor_free(&ctx);
+
+#ifdef MICRO_TRACE
+    const char *trace_file = getenv("MICRO_TRACE_FILE");
+    trace_export_chrome(trace_file ? trace_file : "micro-trace.json");
+#endif
+
+
     return 0;
 }
\ No newline at end of file
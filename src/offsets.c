@@ -0,0 +1,99 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * offsets.c: Byte offsets of the rows of a buffer.
+ */
+
+#include "offsets.h"
+
+
+/* offsets_measure - Number of bytes a row takes up in the file (see
+ *                   rowsum_measure_t) */
+static int offsets_measure(rowsum_t *s, erow_t *row)
+{
+    (void)s;
+    return row->size + 1;
+}
+
+
+/* See offsets.h */
+int offsets_init(offsets_t *o, buffer_t *buf)
+{
+    o->buf = buf;
+    o->summed = 0;
+    if (buf->pager)
+        return -1;
+    if (buf->line_offsets)
+        return 0;
+    o->summed = 1;
+    return rowsum_init(&o->bytes, buf, offsets_measure, o);
+}
+
+
+/* See offsets.h */
+void offsets_free(offsets_t *o)
+{
+    if (o->summed)
+        rowsum_free(&o->bytes);
+    o->summed = 0;
+}
+
+
+/* See offsets.h */
+long long offsets_row(offsets_t *o, int row)
+{
+    if (row < 0)
+        row = 0;
+    if (row > o->buf->num_rows)
+        row = o->buf->num_rows;
+    if (!o->summed)
+        return o->buf->line_offsets[row];
+    return rowsum_prefix(&o->bytes, row);
+}
+
+
+/* See offsets.h */
+int offsets_find(offsets_t *o, long long offset, int *col)
+{
+    int row;
+    long long rest;
+    if (!o->summed)
+    {
+        /* The last line that starts at or before the offset */
+        int lo = 0, hi = o->buf->num_rows;
+        while (lo < hi)
+        {
+            int mid = lo + (hi - lo + 1) / 2;
+            if ((long long)o->buf->line_offsets[mid] <= offset)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        row = lo;
+        rest = offset - (long long)o->buf->line_offsets[row];
+    }
+    else
+    {
+        row = rowsum_find(&o->bytes, offset, &rest);
+    }
+
+    if (row >= o->buf->num_rows)
+    {
+        *col = 0;
+        return o->buf->num_rows;
+    }
+    if (rest < 0)
+        rest = 0;
+    int size = buffer_row(o->buf, row)->size;
+    *col = rest > size ? size : (int)rest;
+    return row;
+}
+
+
+/* See offsets.h */
+long long offsets_total(offsets_t *o)
+{
+    return offsets_row(o, o->buf->num_rows);
+}
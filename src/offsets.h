@@ -0,0 +1,98 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * offsets.h: Byte offsets of the rows of a buffer.
+ *
+ * The offset of a row is the number of bytes before it in the file
+ * the buffer would be saved as (each row followed by a newline). We
+ * keep running totals of the length of every row (see rowsum.h), so
+ * going from a row to its offset, or from an offset to its row, takes
+ * O(log n), and stays up to date as rows are edited.
+ *
+ * Read-only buffers already know where each line starts in the file
+ * (see buffer_open_mapped), so their offsets are looked up there,
+ * with nothing to keep up to date. Paged buffers have no offsets,
+ * since measuring every row would load the whole file.
+ */
+
+#ifndef OFFSETS_H
+#define OFFSETS_H
+
+#include "buffer.h"
+#include "rowsum.h"
+
+/* Byte offset index of a buffer */
+typedef struct offsets
+{
+    buffer_t *buf;
+
+    /* Length of each row (plus its newline), and their running totals
+     * (only kept, and summed set, for buffers in memory) */
+    rowsum_t bytes;
+    int summed;
+} offsets_t;
+
+
+/* offsets_init - Start keeping track of the offsets of a buffer's rows
+ *
+ * The buffer must not be paged, and must stay in the same mode (paged,
+ * read-only or in memory) until offsets_free is called.
+ *
+ * Parameters:
+ *  - o: Offset index
+ *  - buf: Buffer (must stay at the same address until offsets_free)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated or the
+ *          buffer is paged
+ */
+int offsets_init(offsets_t *o, buffer_t *buf);
+
+
+/* offsets_free - Stop keeping track of the offsets of a buffer's rows
+ *
+ * Parameters:
+ *  - o: Offset index
+ *
+ * Returns: Nothing
+ */
+void offsets_free(offsets_t *o);
+
+
+/* offsets_row - Find the offset a row starts at
+ *
+ * Parameters:
+ *  - o: Offset index
+ *  - row: Row index (up to the number of rows, for the size of the
+ *    whole buffer)
+ *
+ * Returns: Byte offset
+ */
+long long offsets_row(offsets_t *o, int row);
+
+
+/* offsets_find - Find the row a byte offset is in
+ *
+ * Parameters:
+ *  - o: Offset index
+ *  - offset: Byte offset
+ *  - col: Output parameter to return the position of the byte in its
+ *    row (the length of the row, if the byte is its newline)
+ *
+ * Returns: Row index (the number of rows for offsets past the end,
+ *          with col set to 0)
+ */
+int offsets_find(offsets_t *o, long long offset, int *col);
+
+
+/* offsets_total - Size of the buffer in bytes
+ *
+ * Parameters:
+ *  - o: Offset index
+ *
+ * Returns: Number of bytes
+ */
+long long offsets_total(offsets_t *o);
+
+#endif /* OFFSETS_H */
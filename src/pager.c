@@ -0,0 +1,650 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * pager.c: Paged storage of rows, for files too large to fit in memory.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "pager.h"
+#include "lineindex.h"
+
+/* Size of the chunks used to copy files */
+#define PAGER_IO_CHUNK (1 << 20)
+
+
+/* pager_read_all - pread() exactly len bytes
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int pager_read_all(int fd, char *buf, size_t len, off_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            if (n == 0)
+                errno = EIO;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+
+/* pager_write_all - write() exactly len bytes
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int pager_write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/* pager_add_block - Append a (non-resident) block to the block list
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int pager_add_block(pager_t *p, int *capacity, off_t offset, size_t length, int num_rows)
+{
+    if (p->num_blocks == *capacity)
+    {
+        int newcap = *capacity ? *capacity * 2 : 64;
+        pager_block_t **blocks = realloc(p->blocks, sizeof(pager_block_t *) * newcap);
+        if (blocks == NULL)
+            return -1;
+        p->blocks = blocks;
+        *capacity = newcap;
+    }
+
+    pager_block_t *b = calloc(1, sizeof(pager_block_t));
+    if (b == NULL)
+        return -1;
+    b->source = PAGER_SOURCE_FILE;
+    b->offset = offset;
+    b->length = length;
+    b->num_rows = num_rows;
+    b->first_row = p->num_rows;
+
+    p->blocks[p->num_blocks++] = b;
+    p->num_rows += num_rows;
+    return 0;
+}
+
+
+/* See pager.h */
+pager_t *pager_open(const char *filename, size_t cache_bytes)
+{
+    pager_t *p = calloc(1, sizeof(pager_t));
+    if (p == NULL)
+        goto fail;
+
+    p->fd = -1;
+    p->spill_fd = -1;
+    editor_row_init(&p->missing, "", 0);
+    p->fd = open(filename, O_RDONLY);
+    if (p->fd == -1)
+        goto fail;
+
+    /* Cut a block every PAGER_BLOCK_ROWS lines (see lineindex.h) */
+    lineindex_t idx;
+    if (lineindex_open(&idx, p->fd, filename, PAGER_BLOCK_ROWS) == -1)
+        goto fail;
+    int capacity = 0;
+    off_t pos = idx.size;
+    for (size_t i = 0; i < idx.count; i++)
+    {
+        size_t end = i + 1 < idx.count ? idx.starts[i + 1] : idx.size;
+        long long first = (long long)i * PAGER_BLOCK_ROWS;
+        int lines = idx.num_lines - first < PAGER_BLOCK_ROWS ? idx.num_lines - first : PAGER_BLOCK_ROWS;
+        if (pager_add_block(p, &capacity, idx.starts[i], end - idx.starts[i], lines) == -1)
+        {
+            lineindex_free(&idx);
+            goto fail;
+        }
+    }
+    p->stats = idx.stats;
+    lineindex_free(&idx);
+
+    /* A resident block takes up its text at most twice (the row
+     * contents, and the rendering of rows that need one), plus the row
+     * structures */
+    size_t block_bytes = 2 * (pos / (p->num_blocks ? p->num_blocks : 1)) +
+                         PAGER_BLOCK_ROWS * (sizeof(erow_t) + 2);
+    p->max_resident = cache_bytes / block_bytes;
+    if (p->max_resident < PAGER_MIN_RESIDENT)
+        p->max_resident = PAGER_MIN_RESIDENT;
+
+    return p;
+
+fail:
+    if (p != NULL)
+    {
+        int saved_errno = errno;
+        pager_close(p);
+        errno = saved_errno;
+    }
+    return NULL;
+}
+
+
+/* pager_free_rows - Free the resident rows of a block */
+static void pager_free_rows(pager_block_t *b)
+{
+    for (int j = 0; j < b->num_rows; j++)
+        editor_row_free(&b->rows[j]);
+    free(b->rows);
+    b->rows = NULL;
+    b->capacity = 0;
+}
+
+
+/* See pager.h */
+void pager_close(pager_t *p)
+{
+    for (int i = 0; i < p->num_blocks; i++)
+    {
+        if (p->blocks[i]->rows)
+            pager_free_rows(p->blocks[i]);
+        free(p->blocks[i]);
+    }
+    free(p->blocks);
+    if (p->fd != -1)
+        close(p->fd);
+    if (p->spill_fd != -1)
+        close(p->spill_fd);
+    editor_row_free(&p->missing);
+    free(p);
+}
+
+
+/* pager_lru_unlink - Remove a block from the LRU list */
+static void pager_lru_unlink(pager_t *p, pager_block_t *b)
+{
+    if (b->lru_prev)
+        b->lru_prev->lru_next = b->lru_next;
+    else
+        p->lru_head = b->lru_next;
+    if (b->lru_next)
+        b->lru_next->lru_prev = b->lru_prev;
+    else
+        p->lru_tail = b->lru_prev;
+    b->lru_prev = b->lru_next = NULL;
+}
+
+
+/* pager_lru_push - Make a block the most recently used one */
+static void pager_lru_push(pager_t *p, pager_block_t *b)
+{
+    b->lru_prev = NULL;
+    b->lru_next = p->lru_head;
+    if (p->lru_head)
+        p->lru_head->lru_prev = b;
+    p->lru_head = b;
+    if (p->lru_tail == NULL)
+        p->lru_tail = b;
+}
+
+
+/* pager_serialize - Join the resident rows of a block into one string
+ *
+ * Every row (including the last one) is terminated by a line break.
+ *
+ * Returns: The block's text (must be freed by the caller), or NULL
+ *          if memory could not be allocated
+ */
+static char *pager_serialize(pager_block_t *b, size_t *len)
+{
+    size_t total = 0;
+    for (int j = 0; j < b->num_rows; j++)
+        total += b->rows[j].size + 1;
+
+    char *text = malloc(total ? total : 1);
+    if (text == NULL)
+        return NULL;
+    char *t = text;
+    for (int j = 0; j < b->num_rows; j++)
+    {
+        memcpy(t, editor_row_chars(&b->rows[j]), b->rows[j].size);
+        t += b->rows[j].size;
+        *t++ = '\n';
+    }
+    *len = total;
+    return text;
+}
+
+
+/* pager_spill - Write a dirty block to the spill file
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+static int pager_spill(pager_t *p, pager_block_t *b)
+{
+    if (p->spill_fd == -1)
+    {
+        FILE *fp = tmpfile();
+        if (fp == NULL)
+            return -1;
+        p->spill_fd = dup(fileno(fp));
+        fclose(fp);
+        if (p->spill_fd == -1)
+            return -1;
+    }
+
+    size_t len;
+    char *text = pager_serialize(b, &len);
+    if (text == NULL)
+        return -1;
+
+    /* Reuse the block's previous spill space if the text still fits */
+    int reuse = b->source == PAGER_SOURCE_SPILL && len <= b->length;
+    off_t offset = reuse ? b->offset : p->spill_end;
+
+    int rc = -1;
+    if (lseek(p->spill_fd, offset, SEEK_SET) != -1 &&
+        pager_write_all(p->spill_fd, text, len) == 0)
+    {
+        b->source = PAGER_SOURCE_SPILL;
+        b->offset = offset;
+        b->length = len;
+        if (!reuse)
+            p->spill_end += len;
+        rc = 0;
+    }
+    free(text);
+    return rc;
+}
+
+
+/* pager_evict - Evict least recently used blocks until within the limit */
+static void pager_evict(pager_t *p)
+{
+    while (p->resident > p->max_resident)
+    {
+        pager_block_t *victim = p->lru_tail;
+        if (victim->dirty)
+        {
+            if (pager_spill(p, victim) == -1)
+            {
+                /* Keep the block in memory rather than lose edits */
+                if (!p->error)
+                    p->error = errno;
+                return;
+            }
+            victim->dirty = 0;
+        }
+        pager_lru_unlink(p, victim);
+        pager_free_rows(victim);
+        p->resident--;
+    }
+}
+
+
+/* pager_fault - Make a block resident and most recently used
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (the
+ *          block is left non-resident, and errno and p->error are set)
+ */
+static int pager_fault(pager_t *p, pager_block_t *b)
+{
+    if (b->rows)
+    {
+        if (p->lru_head != b)
+        {
+            pager_lru_unlink(p, b);
+            pager_lru_push(p, b);
+        }
+        return 0;
+    }
+
+    int capacity = b->num_rows ? b->num_rows : 1;
+    erow_t *rows = malloc(sizeof(erow_t) * capacity);
+    char *text = malloc(b->length ? b->length : 1);
+    if (rows == NULL || text == NULL)
+    {
+        free(rows);
+        free(text);
+        if (!p->error)
+            p->error = ENOMEM;
+        errno = ENOMEM;
+        return -1;
+    }
+    b->rows = rows;
+    b->capacity = capacity;
+
+    int fd = b->source == PAGER_SOURCE_FILE ? p->fd : p->spill_fd;
+    int ok = pager_read_all(fd, text, b->length, b->offset) == 0;
+    if (!ok && !p->error)
+        p->error = errno;
+
+    char *t = text, *end = text + (ok ? b->length : 0);
+    for (int j = 0; j < b->num_rows; j++)
+    {
+        char *eol = t < end ? memchr(t, '\n', end - t) : NULL;
+        size_t len = eol ? (size_t)(eol - t) : (size_t)(end - t);
+        if (len > 0 && t[len - 1] == '\r')
+            len--;
+        editor_row_init(&b->rows[j], t, len);
+        t = eol ? eol + 1 : end;
+    }
+    free(text);
+
+    b->dirty = 0;
+    pager_lru_push(p, b);
+    p->resident++;
+    pager_evict(p);
+    return 0;
+}
+
+
+/* pager_find_block - Find the index of the block containing a row
+ *
+ * A row index equal to the number of rows maps to the last block
+ * (that's where rows appended at the end go).
+ */
+static int pager_find_block(pager_t *p, int at)
+{
+    if (at >= p->num_rows)
+        return p->num_blocks - 1;
+
+    pager_block_t *last = p->blocks[p->last_block];
+    if (at >= last->first_row && at < last->first_row + last->num_rows)
+        return p->last_block;
+
+    int lo = 0, hi = p->num_blocks - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (p->blocks[mid]->first_row <= at)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    p->last_block = lo;
+    return lo;
+}
+
+
+/* See pager.h */
+erow_t *pager_row(pager_t *p, int at)
+{
+    pager_block_t *b = p->blocks[pager_find_block(p, at)];
+    if (pager_fault(p, b) == -1)
+        return &p->missing;
+    return &b->rows[at - b->first_row];
+}
+
+
+/* See pager.h */
+void pager_row_changed(pager_t *p, int at)
+{
+    pager_block_t *b = p->blocks[pager_find_block(p, at)];
+    if (pager_fault(p, b) == 0)
+        b->dirty = 1;
+}
+
+
+/* pager_split_block - Split an oversized block in two */
+static void pager_split_block(pager_t *p, int idx)
+{
+    pager_block_t *b = p->blocks[idx];
+    int half = b->num_rows / 2;
+    pager_block_t *nb = calloc(1, sizeof(pager_block_t));
+    erow_t *rows = malloc(sizeof(erow_t) * (b->num_rows - half));
+    pager_block_t **blocks = realloc(p->blocks, sizeof(pager_block_t *) * (p->num_blocks + 1));
+    if (blocks)
+        p->blocks = blocks;
+    if (nb == NULL || rows == NULL || blocks == NULL)
+    {
+        /* Not fatal (nothing is lost): the block just stays large */
+        free(nb);
+        free(rows);
+        return;
+    }
+
+    nb->num_rows = b->num_rows - half;
+    nb->first_row = b->first_row + half;
+    nb->capacity = nb->num_rows;
+    nb->rows = rows;
+    memcpy(nb->rows, &b->rows[half], sizeof(erow_t) * nb->num_rows);
+    nb->dirty = 1;
+    b->num_rows = half;
+
+    memmove(&p->blocks[idx + 2], &p->blocks[idx + 1],
+            sizeof(pager_block_t *) * (p->num_blocks - idx - 1));
+    p->blocks[idx + 1] = nb;
+    p->num_blocks++;
+
+    pager_lru_push(p, nb);
+    p->resident++;
+    pager_evict(p);
+}
+
+
+/* See pager.h */
+int pager_insert_row(pager_t *p, int at, const erow_t *row)
+{
+    if (p->num_blocks == 0)
+    {
+        int capacity = 0;
+        if (pager_add_block(p, &capacity, 0, 0, 0) == -1)
+            goto fail;
+    }
+
+    int idx = pager_find_block(p, at);
+    pager_block_t *b = p->blocks[idx];
+    if (pager_fault(p, b) == -1)
+        return -1;
+
+    if (b->num_rows == b->capacity)
+    {
+        erow_t *rows = realloc(b->rows, sizeof(erow_t) * b->capacity * 2);
+        if (rows == NULL)
+            goto fail;
+        b->rows = rows;
+        b->capacity *= 2;
+    }
+    int local = at - b->first_row;
+    memmove(&b->rows[local + 1], &b->rows[local], sizeof(erow_t) * (b->num_rows - local));
+    b->rows[local] = *row;
+    b->num_rows++;
+    b->dirty = 1;
+
+    for (int i = idx + 1; i < p->num_blocks; i++)
+        p->blocks[i]->first_row++;
+    p->num_rows++;
+
+    if (b->num_rows > 2 * PAGER_BLOCK_ROWS)
+        pager_split_block(p, idx);
+    return 0;
+
+fail:
+    if (!p->error)
+        p->error = ENOMEM;
+    errno = ENOMEM;
+    return -1;
+}
+
+
+/* See pager.h */
+int pager_delete_row(pager_t *p, int at)
+{
+    int idx = pager_find_block(p, at);
+    pager_block_t *b = p->blocks[idx];
+    if (pager_fault(p, b) == -1)
+        return -1;
+
+    int local = at - b->first_row;
+    editor_row_free(&b->rows[local]);
+    memmove(&b->rows[local], &b->rows[local + 1], sizeof(erow_t) * (b->num_rows - local - 1));
+    b->num_rows--;
+    b->dirty = 1;
+
+    for (int i = idx + 1; i < p->num_blocks; i++)
+        p->blocks[i]->first_row--;
+    p->num_rows--;
+
+    /* Drop empty blocks (but always keep one block around) */
+    if (b->num_rows == 0 && p->num_blocks > 1)
+    {
+        pager_lru_unlink(p, b);
+        p->resident--;
+        pager_free_rows(b);
+        free(b);
+        memmove(&p->blocks[idx], &p->blocks[idx + 1],
+                sizeof(pager_block_t *) * (p->num_blocks - idx - 1));
+        p->num_blocks--;
+        p->last_block = 0;
+    }
+    return 0;
+}
+
+
+/* pager_copy_block - Copy the text of a non-resident block to a file
+ *
+ * Returns: Number of bytes written, or -1 on error (with errno set)
+ */
+static ssize_t pager_copy_block(pager_t *p, pager_block_t *b, int out, char *chunk)
+{
+    int fd = b->source == PAGER_SOURCE_FILE ? p->fd : p->spill_fd;
+    size_t done = 0;
+    while (done < b->length)
+    {
+        size_t len = b->length - done;
+        if (len > PAGER_IO_CHUNK)
+            len = PAGER_IO_CHUNK;
+        if (pager_read_all(fd, chunk, len, b->offset + done) == -1 ||
+            pager_write_all(out, chunk, len) == -1)
+            return -1;
+        done += len;
+    }
+
+    /* Only the last line of the original file can lack a line break,
+     * but rows may have been added after it since */
+    if (done > 0 && chunk[(done - 1) % PAGER_IO_CHUNK] != '\n')
+    {
+        if (pager_write_all(out, "\n", 1) == -1)
+            return -1;
+        done++;
+    }
+    return done;
+}
+
+
+/* See pager.h */
+ssize_t pager_save(pager_t *p, const char *filename)
+{
+    if (p->error)
+    {
+        /* Some rows could not be read, so we can't write them back */
+        errno = p->error;
+        return -1;
+    }
+
+    size_t namelen = strlen(filename) + sizeof(".XXXXXX");
+    char *tmpname = malloc(namelen);
+    off_t *offsets = malloc(sizeof(off_t) * (p->num_blocks + 1));
+    char *chunk = malloc(PAGER_IO_CHUNK);
+    int out = -1;
+    if (tmpname == NULL || offsets == NULL || chunk == NULL)
+        goto fail;
+
+    snprintf(tmpname, namelen, "%s.XXXXXX", filename);
+    out = mkstemp(tmpname);
+    if (out == -1)
+        goto fail;
+
+    struct stat st;
+    if (fstat(p->fd, &st) == 0)
+        fchmod(out, st.st_mode & 0777);
+
+    off_t total = 0;
+    for (int i = 0; i < p->num_blocks; i++)
+    {
+        pager_block_t *b = p->blocks[i];
+        offsets[i] = total;
+        if (b->rows)
+        {
+            size_t len;
+            char *text = pager_serialize(b, &len);
+            if (text == NULL)
+                goto fail_unlink;
+            int rc = pager_write_all(out, text, len);
+            free(text);
+            if (rc == -1)
+                goto fail_unlink;
+            total += len;
+        }
+        else
+        {
+            ssize_t len = pager_copy_block(p, b, out, chunk);
+            if (len == -1)
+                goto fail_unlink;
+            total += len;
+        }
+    }
+    offsets[p->num_blocks] = total;
+
+    if (rename(tmpname, filename) == -1)
+        goto fail_unlink;
+
+    /* Page from the new file from now on; the spill file is no longer needed */
+    for (int i = 0; i < p->num_blocks; i++)
+    {
+        pager_block_t *b = p->blocks[i];
+        b->source = PAGER_SOURCE_FILE;
+        b->offset = offsets[i];
+        b->length = offsets[i + 1] - offsets[i];
+        b->dirty = 0;
+    }
+    close(p->fd);
+    p->fd = out;
+    if (p->spill_fd != -1 && ftruncate(p->spill_fd, 0) == 0)
+        p->spill_end = 0;
+
+    free(tmpname);
+    free(offsets);
+    free(chunk);
+    return total;
+
+fail_unlink:
+{
+    int saved_errno = errno;
+    close(out);
+    unlink(tmpname);
+    errno = saved_errno;
+}
+fail:
+    free(tmpname);
+    free(offsets);
+    free(chunk);
+    return -1;
+}
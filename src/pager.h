@@ -0,0 +1,196 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * pager.h: Paged storage of rows, for files too large to fit in memory.
+ *
+ * The file is split into blocks of (initially) PAGER_BLOCK_ROWS lines.
+ * Only the byte range of each block is kept in memory; its rows are
+ * read from the file when they are first accessed ("faulted in"), and
+ * at most a fixed number of blocks are resident at any time, with the
+ * least recently used block evicted to make room for a new one.
+ *
+ * Blocks that have been edited are never simply dropped: when they are
+ * evicted, their text is spilled to an anonymous temporary file and
+ * faulted back in from there, until the buffer is saved.
+ */
+
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <sys/types.h>
+#include "row.h"
+#include "stats.h"
+
+/* Number of lines in each block when a file is opened */
+#define PAGER_BLOCK_ROWS (1024)
+
+/* Minimum number of resident blocks. Callers may hold on to the rows
+ * of the two most recently accessed blocks (e.g., when joining two
+ * lines), so we must never evict those. */
+#define PAGER_MIN_RESIDENT (2)
+
+/* Where the text of a non-resident block lives */
+typedef enum
+{
+    PAGER_SOURCE_FILE,
+    PAGER_SOURCE_SPILL
+} pager_source_t;
+
+/* A block of consecutive rows */
+typedef struct pager_block
+{
+    /* Location of the block's text in its source (file or spill file) */
+    pager_source_t source;
+    off_t offset;
+    size_t length;
+
+    /* Number of rows in the block, and index of its first row */
+    int num_rows;
+    int first_row;
+
+    /* Resident rows (NULL if the block is not in memory) */
+    erow_t *rows;
+    int capacity;
+
+    /* Have the resident rows been modified since they were faulted in? */
+    int dirty;
+
+    /* Neighbours in the LRU list of resident blocks */
+    struct pager_block *lru_prev, *lru_next;
+} pager_block_t;
+
+/* Paged row storage */
+typedef struct pager
+{
+    /* The file being paged, and the spill file (-1 until needed) */
+    int fd;
+    int spill_fd;
+    off_t spill_end;
+
+    /* Blocks, in row order */
+    pager_block_t **blocks;
+    int num_blocks;
+
+    /* Total number of rows */
+    int num_rows;
+
+    /* Counts of the text of the file when it was opened (see
+     * lineindex_t) */
+    stats_t stats;
+
+    /* Resident blocks, from most (head) to least (tail) recently used */
+    pager_block_t *lru_head, *lru_tail;
+    int resident;
+    int max_resident;
+
+    /* Index of the most recently looked up block */
+    int last_block;
+
+    /* errno of the first I/O error that could not be reported
+     * to a caller (rows that fail to load appear empty, and the
+     * buffer is made read-only, see buffer_row) */
+    int error;
+
+    /* The empty row handed out for rows whose block could not be
+     * faulted in (it must not be changed) */
+    erow_t missing;
+} pager_t;
+
+
+/* pager_open - Open a file in paged mode
+ *
+ * Scans the file once to find the block boundaries; no rows
+ * are loaded until they are accessed.
+ *
+ * Parameters:
+ *  - filename: File to open
+ *  - cache_bytes: Approximate amount of memory to use for resident
+ *    blocks (the number of resident blocks is derived from this and
+ *    the average size of a block)
+ *
+ * Returns: A new pager, or NULL on error (with errno set)
+ */
+pager_t *pager_open(const char *filename, size_t cache_bytes);
+
+
+/* pager_close - Close a pager and free all its rows
+ *
+ * Parameters:
+ *  - p: Pager
+ *
+ * Returns: Nothing
+ */
+void pager_close(pager_t *p);
+
+
+/* pager_row - Get a row, faulting in its block if necessary
+ *
+ * The returned pointer remains valid until rows are inserted into or
+ * deleted from its block, or the block is evicted (which can only
+ * happen once PAGER_MIN_RESIDENT other blocks have been accessed).
+ *
+ * Parameters:
+ *  - p: Pager
+ *  - at: Row index
+ *
+ * Returns: The row (an empty row, not in the pager and not to be
+ *          changed, if its block could not be faulted in; see
+ *          pager_t.error)
+ */
+erow_t *pager_row(pager_t *p, int at);
+
+
+/* pager_row_changed - Mark a row as modified
+ *
+ * Parameters:
+ *  - p: Pager
+ *  - at: Row index
+ *
+ * Returns: Nothing
+ */
+void pager_row_changed(pager_t *p, int at);
+
+
+/* pager_insert_row - Insert a row
+ *
+ * Parameters:
+ *  - p: Pager
+ *  - at: Row index to insert the row at
+ *  - row: Row to insert (the pager takes ownership of its contents,
+ *    unless the row could not be inserted)
+ *
+ * Returns: 0 on success, -1 if the row's block could not be faulted in
+ *          or grown (with errno and pager_t.error set)
+ */
+int pager_insert_row(pager_t *p, int at, const erow_t *row);
+
+
+/* pager_delete_row - Delete (and free) a row
+ *
+ * Parameters:
+ *  - p: Pager
+ *  - at: Row index
+ *
+ * Returns: 0 on success, -1 if the row's block could not be faulted in
+ *          (with errno and pager_t.error set)
+ */
+int pager_delete_row(pager_t *p, int at);
+
+
+/* pager_save - Write all rows to a file
+ *
+ * The file is written to a temporary file which then replaces
+ * filename, and the pager continues paging from the new file.
+ * Blocks that are not resident are copied without being parsed.
+ *
+ * Parameters:
+ *  - p: Pager
+ *  - filename: File to write
+ *
+ * Returns: Number of bytes written, or -1 on error (with errno set)
+ */
+ssize_t pager_save(pager_t *p, const char *filename);
+
+#endif /* PAGER_H */
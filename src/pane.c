@@ -0,0 +1,220 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * pane.c: Panes (viewports onto buffers) and how they split the screen.
+ */
+
+#include <stdlib.h>
+
+#include "pane.h"
+
+
+/* pane_changed - Buffer listener callback (see buffer_listener_t) */
+static void pane_changed(buffer_listener_t *l, buffer_t *buf,
+                         buffer_change_t change, int at, int n)
+{
+    pane_t *pane = l->arg;
+    (void)buf;
+    (void)n;
+
+    /* Every row takes up at least one line, so rows below the last one
+     * on the screen can't be on it. A change to a row above it can
+     * still recolor the rows that are (e.g., opening a comment) */
+    if (change != BUFFER_RESET && at >= pane->drawn_rowoff + pane->rows)
+        return;
+    pane->damaged = 1;
+}
+
+
+/* See pane.h */
+void pane_init(pane_t *pane, buffer_t *buf, int index)
+{
+    pane->buf = NULL;
+    pane->cursors = NULL;
+    pane->num_cursors = 0;
+    pane->top = pane->left = 0;
+    pane->rows = pane->cols = 1;
+    pane->drawn = NULL;
+    pane->drawn_rowoff = pane->drawn_coloff = pane->drawn_segoff = 0;
+    pane->listener.changed = pane_changed;
+    pane->listener.arg = pane;
+    pane_show(pane, buf, index);
+}
+
+
+/* See pane.h */
+void pane_free(pane_t *pane)
+{
+    if (pane->buf)
+        buffer_remove_listener(pane->buf, &pane->listener);
+    pane->buf = NULL;
+    free(pane->cursors);
+    pane->cursors = NULL;
+    pane->num_cursors = 0;
+    pane_invalidate(pane);
+}
+
+
+/* See pane.h */
+void pane_show(pane_t *pane, buffer_t *buf, int index)
+{
+    if (pane->buf)
+        buffer_remove_listener(pane->buf, &pane->listener);
+    pane->buf = buf;
+    pane->buffer = index;
+    buffer_add_listener(buf, &pane->listener);
+
+    pane->cx = pane->cy = 0;
+    pane->num_cursors = 0;
+    pane->rowoff = pane->coloff = pane->segoff = 0;
+    pane->damaged = 1;
+}
+
+
+/* See pane.h */
+void pane_invalidate(pane_t *pane)
+{
+    if (pane->drawn)
+    {
+        for (int i = 0; i <= pane->rows; i++)
+            free(pane->drawn[i].text);
+        free(pane->drawn);
+    }
+    pane->drawn = NULL;
+    pane->damaged = 1;
+}
+
+
+/* See pane.h */
+pane_layout_t *pane_layout_new(pane_t *pane)
+{
+    pane_layout_t *layout = calloc(1, sizeof(pane_layout_t));
+    if (layout == NULL)
+        return NULL;
+    layout->pane = pane;
+    return layout;
+}
+
+
+/* See pane.h */
+void pane_layout_free(pane_layout_t *layout)
+{
+    if (layout == NULL)
+        return;
+    pane_layout_free(layout->first);
+    pane_layout_free(layout->second);
+    free(layout);
+}
+
+
+/* pane_layout_find - Find the leaf of a pane
+ *
+ * Parameters:
+ *  - layout: Root of the (sub)tree to search
+ *  - pane: Pane
+ *  - parent: Output parameter to return the leaf's parent (NULL
+ *    for the root)
+ *
+ * Returns: The leaf, or NULL if the pane is not in the tree
+ */
+static pane_layout_t *pane_layout_find(pane_layout_t *layout, pane_t *pane,
+                                       pane_layout_t **parent)
+{
+    if (layout->pane)
+        return layout->pane == pane ? layout : NULL;
+
+    pane_layout_t *halves[2] = {layout->first, layout->second};
+    for (int i = 0; i < 2; i++)
+    {
+        pane_layout_t *found = pane_layout_find(halves[i], pane, parent);
+        if (found)
+        {
+            if (found == halves[i])
+                *parent = layout;
+            return found;
+        }
+    }
+    return NULL;
+}
+
+
+/* See pane.h */
+int pane_layout_split(pane_layout_t *layout, pane_t *pane, pane_t *new_pane, int side_by_side)
+{
+    pane_layout_t *parent = NULL;
+    pane_layout_t *leaf = pane_layout_find(layout, pane, &parent);
+    if (leaf == NULL)
+        return -1;
+
+    pane_layout_t *first = pane_layout_new(pane);
+    pane_layout_t *second = pane_layout_new(new_pane);
+    if (first == NULL || second == NULL)
+    {
+        free(first);
+        free(second);
+        return -1;
+    }
+
+    /* The leaf becomes the split, so its parent needn't change */
+    leaf->pane = NULL;
+    leaf->side_by_side = side_by_side;
+    leaf->first = first;
+    leaf->second = second;
+    return 0;
+}
+
+
+/* See pane.h */
+int pane_layout_remove(pane_layout_t *layout, pane_t *pane)
+{
+    pane_layout_t *parent = NULL;
+    pane_layout_t *leaf = pane_layout_find(layout, pane, &parent);
+    if (leaf == NULL || parent == NULL)
+        return -1;
+
+    /* The other half takes the place of the split */
+    pane_layout_t *other = parent->first == leaf ? parent->second : parent->first;
+    *parent = *other;
+    free(other);
+    free(leaf);
+    return 0;
+}
+
+
+/* See pane.h */
+void pane_layout_place(pane_layout_t *layout, int top, int left, int rows, int cols)
+{
+    layout->top = top;
+    layout->left = left;
+    layout->rows = rows;
+    layout->cols = cols;
+
+    if (layout->pane)
+    {
+        pane_t *pane = layout->pane;
+        if (pane->top != top || pane->left != left ||
+            pane->rows != rows - 1 || pane->cols != cols)
+            pane_invalidate(pane);
+        pane->top = top;
+        pane->left = left;
+        pane->rows = rows > 1 ? rows - 1 : 1;
+        pane->cols = cols > 0 ? cols : 1;
+        return;
+    }
+
+    if (layout->side_by_side)
+    {
+        int width = cols - 1;
+        int first = width - width / 2;
+        pane_layout_place(layout->first, top, left, rows, first);
+        pane_layout_place(layout->second, top, left + first + 1, rows, width - first);
+    }
+    else
+    {
+        int first = rows - rows / 2;
+        pane_layout_place(layout->first, top, left, first, cols);
+        pane_layout_place(layout->second, top + first, left, rows - first, cols);
+    }
+}
@@ -0,0 +1,208 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * pane.h: Panes (viewports onto buffers) and how they split the screen.
+ *
+ * The screen is divided into panes by a tree of splits: every split
+ * cuts a rectangle in two, either one half above the other or side by
+ * side, and every leaf is a pane. Several panes can show the same
+ * buffer, each with its own cursor and offsets.
+ *
+ * Each pane remembers what it last put on the screen, and listens to
+ * its buffer, so a frame only has to draw the panes whose buffer or
+ * offsets changed, and only the lines of those panes that differ from
+ * what is already on the screen.
+ */
+
+#ifndef PANE_H
+#define PANE_H
+
+#include "buffer.h"
+
+/* A line of a pane as it was last drawn (including escape sequences) */
+typedef struct pane_line
+{
+    char *text;
+    int len;
+} pane_line_t;
+
+/* A cursor in a pane (see pane_t) */
+typedef struct pane_cursor
+{
+    int cx, cy;
+} pane_cursor_t;
+
+/* A pane */
+typedef struct pane
+{
+    /* Buffer shown in the pane (the buffer itself, and its index in
+     * the editor's list of buffers) */
+    buffer_t *buf;
+    int buffer;
+
+    /* Cursor position and offsets in the buffer (see editor_ctx_t) */
+    int cx, cy;
+    int rowoff, coloff, segoff;
+
+    /* Extra cursors, besides the one at cx, cy (see editor_add_cursor).
+     * Sorted by position */
+    pane_cursor_t *cursors;
+    int num_cursors;
+
+    /* Top left corner and size of the pane's text on the screen. The
+     * pane's status bar is on the line just below its text */
+    int top, left;
+    int rows, cols;
+
+    /* The lines of text and the status bar last drawn (NULL if the
+     * pane has to be drawn from scratch), the offsets they were drawn
+     * at, and whether a change to the buffer may have made them out of
+     * date since */
+    pane_line_t *drawn;
+    int drawn_rowoff, drawn_coloff, drawn_segoff;
+    int damaged;
+
+    /* Registered with the buffer */
+    buffer_listener_t listener;
+} pane_t;
+
+/* A node of the tree of splits */
+typedef struct pane_layout
+{
+    /* Pane, if this is a leaf (NULL for a split) */
+    pane_t *pane;
+
+    /* Split: whether the halves are side by side (rather than one
+     * above the other), and the halves themselves */
+    int side_by_side;
+    struct pane_layout *first, *second;
+
+    /* Rectangle of the screen taken up by this node, including the
+     * status bars of its panes and the separators between them (see
+     * pane_layout_place) */
+    int top, left;
+    int rows, cols;
+} pane_layout_t;
+
+
+/* pane_init - Initialize a pane
+ *
+ * Parameters:
+ *  - pane: Pane
+ *  - buf: Buffer to show
+ *  - index: Index of the buffer in the editor's list of buffers
+ *
+ * Returns: Nothing
+ */
+void pane_init(pane_t *pane, buffer_t *buf, int index);
+
+
+/* pane_free - Free a pane's resources (but not the pane itself)
+ *
+ * Parameters:
+ *  - pane: Pane
+ *
+ * Returns: Nothing
+ */
+void pane_free(pane_t *pane);
+
+
+/* pane_show - Show another buffer in a pane
+ *
+ * The pane is moved to the top of the buffer, and loses its extra
+ * cursors. Its cursor and offsets can be set afterwards.
+ *
+ * Parameters:
+ *  - pane: Pane
+ *  - buf: Buffer to show
+ *  - index: Index of the buffer in the editor's list of buffers
+ *
+ * Returns: Nothing
+ */
+void pane_show(pane_t *pane, buffer_t *buf, int index);
+
+
+/* pane_invalidate - Forget what a pane last drew
+ *
+ * Used when the screen has been cleared, or the pane has moved, so it
+ * is drawn from scratch.
+ *
+ * Parameters:
+ *  - pane: Pane
+ *
+ * Returns: Nothing
+ */
+void pane_invalidate(pane_t *pane);
+
+
+/* pane_layout_new - Create a layout with a single pane
+ *
+ * Parameters:
+ *  - pane: Pane
+ *
+ * Returns: Root of the layout, or NULL if memory could not be allocated
+ */
+pane_layout_t *pane_layout_new(pane_t *pane);
+
+
+/* pane_layout_free - Free a layout (but not its panes)
+ *
+ * Parameters:
+ *  - layout: Root of the layout
+ *
+ * Returns: Nothing
+ */
+void pane_layout_free(pane_layout_t *layout);
+
+
+/* pane_layout_split - Split a pane in two
+ *
+ * The new pane takes the bottom or right half of the space of the
+ * pane being split. The layout must be placed again afterwards.
+ *
+ * Parameters:
+ *  - layout: Root of the layout
+ *  - pane: Pane to split
+ *  - new_pane: Pane for the other half
+ *  - side_by_side: Put the halves side by side instead of one above
+ *    the other
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated or the
+ *          pane is not in the layout
+ */
+int pane_layout_split(pane_layout_t *layout, pane_t *pane, pane_t *new_pane, int side_by_side);
+
+
+/* pane_layout_remove - Remove a pane from the layout
+ *
+ * The other half of the split the pane was in takes up its space. The
+ * layout must be placed again afterwards.
+ *
+ * Parameters:
+ *  - layout: Root of the layout
+ *  - pane: Pane to remove
+ *
+ * Returns: 0 on success, -1 if the pane is the only one in the
+ *          layout, or is not in it
+ */
+int pane_layout_remove(pane_layout_t *layout, pane_t *pane);
+
+
+/* pane_layout_place - Work out where every pane goes on the screen
+ *
+ * Each split gives half of its rectangle to each side (side by side
+ * halves are separated by a column). Each pane gets all of its
+ * rectangle but the last line, which is its status bar.
+ *
+ * Parameters:
+ *  - layout: Root of the layout
+ *  - top, left: Top left corner of the rectangle to divide
+ *  - rows, cols: Size of the rectangle
+ *
+ * Returns: Nothing
+ */
+void pane_layout_place(pane_layout_t *layout, int top, int left, int rows, int cols);
+
+#endif /* PANE_H */
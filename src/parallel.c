@@ -0,0 +1,75 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * parallel.c: Running a loop over a large range in parallel.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+/* A chunk of the range, and the thread doing it */
+typedef struct parallel_chunk
+{
+    void (*fn)(void *arg, int start, int end);
+    void *arg;
+    int start, end;
+    pthread_t thread;
+    int started;
+} parallel_chunk_t;
+
+
+/* parallel_main - Entry point of the threads */
+static void *parallel_main(void *arg)
+{
+    parallel_chunk_t *c = arg;
+    c->fn(c->arg, c->start, c->end);
+    return NULL;
+}
+
+
+/* See parallel.h */
+int parallel_for(int n, int min_chunk, void (*fn)(void *arg, int start, int end), void *arg)
+{
+    if (n <= 0)
+        return 0;
+    if (min_chunk < 1)
+        min_chunk = 1;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int chunks = cpus > 1 ? (int)cpus : 1;
+    if (chunks > PARALLEL_MAX_THREADS)
+        chunks = PARALLEL_MAX_THREADS;
+    if (chunks > n / min_chunk)
+        chunks = n / min_chunk > 0 ? n / min_chunk : 1;
+    if (chunks == 1)
+    {
+        fn(arg, 0, n);
+        return 1;
+    }
+
+    parallel_chunk_t c[PARALLEL_MAX_THREADS];
+    for (int i = 0; i < chunks; i++)
+    {
+        c[i].fn = fn;
+        c[i].arg = arg;
+        c[i].start = (int)((long long)n * i / chunks);
+        c[i].end = (int)((long long)n * (i + 1) / chunks);
+        c[i].started = i > 0 && pthread_create(&c[i].thread, NULL, parallel_main, &c[i]) == 0;
+    }
+
+    fn(arg, c[0].start, c[0].end);
+    for (int i = 1; i < chunks; i++)
+    {
+        if (c[i].started)
+            pthread_join(c[i].thread, NULL);
+        else
+            fn(arg, c[i].start, c[i].end);
+    }
+    return chunks;
+}
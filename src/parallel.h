@@ -0,0 +1,38 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * parallel.h: Running a loop over a large range in parallel.
+ *
+ * The range is cut into one chunk per processor (but no smaller than a
+ * given size), and each chunk is handed to a thread of its own. The
+ * calling thread does the first chunk itself, and returns once every
+ * chunk is done. If threads can't be started, the chunks they would
+ * have done are done by the calling thread, so the loop always runs to
+ * completion.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/* Most threads a loop is spread over */
+#define PARALLEL_MAX_THREADS (16)
+
+
+/* parallel_for - Call a function on every chunk of a range
+ *
+ * The function is called concurrently on disjoint chunks, so it must
+ * only touch what belongs to its own chunk.
+ *
+ * Parameters:
+ *  - n: Size of the range [0, n)
+ *  - min_chunk: Smallest chunk worth a thread of its own
+ *  - fn: Function to call on the chunk [start, end), with arg
+ *  - arg: Passed through to fn
+ *
+ * Returns: Number of chunks the range was cut into (0 if it's empty)
+ */
+int parallel_for(int n, int min_chunk, void (*fn)(void *arg, int start, int end), void *arg);
+
+#endif /* PARALLEL_H */
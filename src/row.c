@@ -12,20 +12,524 @@
 
 #include "common.h"
 #include "row.h"
-#include "editor.h"
+#include "utf8.h"
+
+
+/* The rendered version of a row that doesn't render as it is (see
+ * erow_t) */
+typedef struct erow_render
+{
+    /* Length of the render, in bytes */
+    int size;
+
+    /* For rows that aren't pure ASCII: the screen column at which the
+     * character containing each byte of the render starts (size + 1
+     * entries, the last one being the width of the whole row). NULL
+     * for ASCII rows, where every byte of the render is one column. */
+    int *rcol;
+
+    /* The render itself (NUL-terminated) */
+    char chars[];
+} erow_render_t;
+
+
+/* See row.h */
+char *editor_row_chars(const erow_t *row)
+{
+    return (row->flags & ROW_INLINE) ? (char *)row->text.local : row->text.chars;
+}
+
+
+/* See row.h */
+const char *editor_row_rendered(const erow_t *row, int *len)
+{
+    erow_render_t *r = row->draw.render;
+    if (len)
+        *len = r ? r->size : row->size;
+    return r ? r->chars : editor_row_chars(row);
+}
+
+
+/* editor_row_reserve - Make room for a number of bytes in a row's text
+ *
+ * A row whose text is stored in the row itself is given memory of its
+ * own once the text no longer fits.
+ *
+ * Parameters:
+ *  - row: Editor row
+ *  - size: Number of bytes (not counting the NUL)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (the row
+ *          is left as it was)
+ */
+static int editor_row_reserve(erow_t *row, size_t size)
+{
+    char *chars;
+    if (row->flags & ROW_INLINE)
+    {
+        if (size < ROW_INLINE_BYTES)
+            return 0;
+        chars = malloc(size + 1);
+        if (chars == NULL)
+            return -1;
+        memcpy(chars, row->text.local, row->size + 1);
+        row->flags &= ~ROW_INLINE;
+    }
+    else
+    {
+        chars = realloc(row->text.chars, size + 1);
+        if (chars == NULL)
+            return -1;
+    }
+    row->text.chars = chars;
+    return 0;
+}
+
+
+/* editor_row_free_draw - Free what a row is drawn with (its render,
+ *                        or its segments) */
+static void editor_row_free_draw(erow_t *row)
+{
+    if (row->flags & ROW_LONG)
+    {
+        free(row->draw.segs);
+    }
+    else if (row->draw.render)
+    {
+        free(row->draw.render->rcol);
+        free(row->draw.render);
+    }
+    row->draw.render = NULL;
+}
+
+
+/* editor_row_char - Decode the character at a position in a row
+ *
+ * A byte that isn't valid UTF-8 is a character of its own, so a
+ * one-byte character that isn't ASCII is always an invalid byte.
+ *
+ * Parameters:
+ *  - row: Editor row
+ *  - at: Byte offset (less than row->size)
+ *  - col: Screen column the character starts at (for tabs)
+ *  - width: Output parameter to return the width of the character
+ *
+ * Returns: Number of bytes in the character
+ */
+static int editor_row_char(erow_t *row, int at, int col, int *width)
+{
+    const char *chars = editor_row_chars(row);
+    unsigned char c = chars[at];
+    if (c == '\t')
+    {
+        *width = MICRO_TAB_STOP - (col % MICRO_TAB_STOP);
+        return 1;
+    }
+    if (c < 0x80)
+    {
+        *width = 1;
+        return 1;
+    }
+    int cp;
+    int n = utf8_decode(&chars[at], row->size - at, &cp);
+    *width = utf8_width(cp);
+    return n;
+}
+
+
+/* Long rows (see ROW_LONG) are split into segments of about this many
+ * bytes; a segment that grows to twice this size is split again */
+#define ROW_SEGMENT_BYTES (16 << 10)
+
+/* Summary of a segment of a long row */
+typedef struct erow_segment
+{
+    /* Byte offset of the first character of the segment */
+    int offset;
+
+    /* Screen column the segment starts at */
+    int col;
+
+    /* Number of columns the segment takes up, if it starts at a column
+     * equal to i modulo MICRO_TAB_STOP (tabs make this depend on where
+     * the segment starts) */
+    int width[MICRO_TAB_STOP];
+} erow_segment_t;
+
+/* Segments of a long row */
+typedef struct erow_segments
+{
+    int num;
+    int capacity;
+    erow_segment_t seg[];
+} erow_segments_t;
+
+
+/* editor_row_walk - Add up the widths of a run of characters
+ *
+ * Parameters:
+ *  - row: Editor row
+ *  - from: Byte offset of the first character
+ *  - to: Byte offset to stop at
+ *  - col: Screen column of the first character
+ *  - end_col: Output parameter to return the column after the last
+ *    character
+ *
+ * Returns: Byte offset after the last character (past to, if a
+ *          character starts before to and ends after it)
+ */
+static int editor_row_walk(erow_t *row, int from, int to, int col, int *end_col)
+{
+    int j = from;
+    while (j < to)
+    {
+        int width;
+        j += editor_row_char(row, j, col, &width);
+        col += width;
+    }
+    *end_col = col;
+    return j;
+}
+
+
+/* editor_row_segment_end - Byte offset where a segment ends */
+static int editor_row_segment_end(erow_t *row, int k)
+{
+    return k + 1 < row->draw.segs->num ? row->draw.segs->seg[k + 1].offset : row->size;
+}
+
+
+/* editor_row_segment_width - Number of columns a segment takes up */
+static int editor_row_segment_width(erow_segment_t *seg)
+{
+    return seg->width[seg->col % MICRO_TAB_STOP];
+}
+
+
+/* editor_row_find_offset - Find the segment containing a byte offset */
+static int editor_row_find_offset(erow_t *row, int at)
+{
+    int lo = 0, hi = row->draw.segs->num - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (row->draw.segs->seg[mid].offset <= at)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+
+/* editor_row_find_col - Find the segment containing a screen column */
+static int editor_row_find_col(erow_t *row, int col)
+{
+    int lo = 0, hi = row->draw.segs->num - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (row->draw.segs->seg[mid].col <= col)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+
+/* editor_row_seek - Find where to start decoding a row to reach a column
+ *
+ * Parameters:
+ *  - row: Editor row
+ *  - rx: Screen column
+ *  - at: Output parameter to return a byte offset at or before rx
+ *  - col: Output parameter to return the screen column of at
+ *
+ * Returns: Nothing
+ */
+static void editor_row_seek(erow_t *row, int rx, int *at, int *col)
+{
+    *at = 0;
+    *col = 0;
+    if (row->flags & ROW_LONG)
+    {
+        erow_segment_t *seg = &row->draw.segs->seg[editor_row_find_col(row, rx)];
+        *at = seg->offset;
+        *col = seg->col;
+    }
+}
+
+
+/* editor_row_remove_segments - Remove segments k to k + n - 1 */
+static void editor_row_remove_segments(erow_t *row, int k, int n)
+{
+    erow_segments_t *s = row->draw.segs;
+    memmove(&s->seg[k], &s->seg[k + n], sizeof(erow_segment_t) * (s->num - k - n));
+    s->num -= n;
+}
+
+
+/* editor_row_add_segments - Insert n segments before segment k
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int editor_row_add_segments(erow_t *row, int k, int n)
+{
+    erow_segments_t *s = row->draw.segs;
+    if (s == NULL || s->num + n > s->capacity)
+    {
+        int capacity = s && s->capacity ? s->capacity : 16;
+        while (capacity < (s ? s->num : 0) + n)
+            capacity *= 2;
+        s = realloc(s, sizeof(erow_segments_t) + sizeof(erow_segment_t) * capacity);
+        if (s == NULL)
+            return -1;
+        if (row->draw.segs == NULL)
+            s->num = 0;
+        s->capacity = capacity;
+        row->draw.segs = s;
+    }
+    memmove(&s->seg[k + n], &s->seg[k], sizeof(erow_segment_t) * (s->num - k));
+    s->num += n;
+    return 0;
+}
+
+
+/* editor_row_measure - Find the widths of a segment
+ *
+ * If the last character of the segment turns out to run into the next
+ * segment (e.g., because an edit completed a UTF-8 sequence), the next
+ * segment is moved up to start after it.
+ *
+ * Parameters:
+ *  - row: Long editor row
+ *  - k: Segment
+ *
+ * Returns: 1 if the next segment was moved (and must be measured
+ *          again), 0 otherwise
+ */
+static int editor_row_measure(erow_t *row, int k)
+{
+    erow_segment_t *seg = &row->draw.segs->seg[k];
+    int end = editor_row_segment_end(row, k);
+    int len = end - seg->offset;
+    const char *p = &editor_row_chars(row)[seg->offset];
+    int j = end;
+
+    if (memchr(p, '\t', len) == NULL)
+    {
+        int width = len;
+        if (!utf8_is_ascii(p, len))
+            j = editor_row_walk(row, seg->offset, end, 0, &width);
+        for (int i = 0; i < MICRO_TAB_STOP; i++)
+            seg->width[i] = width;
+    }
+    else
+    {
+        for (int i = 0; i < MICRO_TAB_STOP; i++)
+        {
+            j = editor_row_walk(row, seg->offset, end, i, &seg->width[i]);
+            seg->width[i] -= i;
+        }
+    }
+
+    if (j == end)
+        return 0;
+
+    /* Take over the start of the next segment (or all of it, if
+     * it was that short) */
+    while (k + 1 < row->draw.segs->num && editor_row_segment_end(row, k + 1) <= j)
+        editor_row_remove_segments(row, k + 1, 1);
+    if (k + 1 == row->draw.segs->num)
+        return 0;
+    row->draw.segs->seg[k + 1].offset = j;
+    return 1;
+}
+
+
+/* editor_row_layout - Find the starting columns of segments
+ *
+ * Parameters:
+ *  - row: Long editor row
+ *  - k: First segment whose width may have changed
+ *
+ * Returns: Nothing
+ */
+static void editor_row_layout(erow_t *row, int k)
+{
+    erow_segments_t *s = row->draw.segs;
+    if (k == 0)
+        s->seg[0].col = 0;
+    for (; k + 1 < s->num; k++)
+        s->seg[k + 1].col = s->seg[k].col + editor_row_segment_width(&s->seg[k]);
+}
+
+
+/* editor_row_split - Split an oversized segment into segments of
+ *                    about ROW_SEGMENT_BYTES, and measure them
+ *
+ * Parameters:
+ *  - row: Long editor row
+ *  - k: Segment
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (the
+ *          segment is measured, but left whole)
+ */
+static int editor_row_split(erow_t *row, int k)
+{
+    int start = row->draw.segs->seg[k].offset;
+    int end = editor_row_segment_end(row, k);
+    int pieces = (end - start) / ROW_SEGMENT_BYTES;
+
+    if (pieces < 2 || editor_row_add_segments(row, k + 1, pieces - 1) == -1)
+    {
+        editor_row_measure(row, k);
+        return pieces < 2 ? 0 : -1;
+    }
+
+    /* Start each piece at the next byte that isn't in the middle of
+     * a character (measuring fixes up any that are) */
+    for (int i = 1; i < pieces; i++)
+    {
+        int at = start + i * ROW_SEGMENT_BYTES;
+        for (int n = 1; n < UTF8_MAX_BYTES && utf8_is_continuation(editor_row_chars(row)[at]); n++)
+            at++;
+        row->draw.segs->seg[k + i].offset = at;
+    }
+
+    int last = k + pieces - 1;
+    for (int i = k; i <= last && i < row->draw.segs->num; i++)
+        if (editor_row_measure(row, i) && i == last)
+            last++;
+    return 0;
+}
+
+
+/* editor_row_segment - Split a row into segments
+ *
+ * Parameters:
+ *  - row: Editor row (with no render)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (the row
+ *          is then left without segments, and not long)
+ */
+static int editor_row_segment(erow_t *row)
+{
+    row->draw.segs = NULL;
+    if (editor_row_add_segments(row, 0, 1) == -1)
+        return -1;
+    row->draw.segs->seg[0].offset = 0;
+    editor_row_split(row, 0);
+    editor_row_layout(row, 0);
+    row->flags |= ROW_LONG;
+    return 0;
+}
+
+
+/* editor_row_resegment - Update the segments of a long row after an edit
+ *
+ * Parameters:
+ *  - row: Long editor row
+ *  - at: Byte offset of the edit
+ *  - delta: Number of bytes inserted (negative for deleted) at at
+ *
+ * Returns: Nothing
+ */
+static void editor_row_resegment(erow_t *row, int at, int delta)
+{
+    erow_segments_t *s = row->draw.segs;
+    int k = editor_row_find_offset(row, at);
+
+    /* Move the segments after the edit, dropping any that were deleted
+     * (a segment that starts where the next one does is empty) */
+    int n = k + 1;
+    for (int i = k + 1; i < s->num; i++)
+    {
+        int offset = s->seg[i].offset + delta;
+        s->seg[i].offset = offset > at ? offset : at;
+        if (s->seg[n - 1].offset == s->seg[i].offset)
+            n--;
+        s->seg[n++] = s->seg[i];
+    }
+    s->num = n;
+    if (s->num > 1 && s->seg[s->num - 1].offset == row->size)
+        s->num--;
+    if (k >= s->num)
+        k = s->num - 1;
+
+    /* A character at the end of the previous segment may have been
+     * completed (or cut short) at the start of this one */
+    int first = k;
+    if (k > 0 && at <= s->seg[k].offset)
+    {
+        first = k - 1;
+        editor_row_measure(row, first);
+        if (k >= s->num)
+            k = s->num - 1;
+    }
+
+    if (editor_row_segment_end(row, k) - s->seg[k].offset >= 2 * ROW_SEGMENT_BYTES)
+        editor_row_split(row, k);
+    else
+        for (int i = k; i < row->draw.segs->num && editor_row_measure(row, i); i++)
+            ;
+    editor_row_layout(row, first);
+}
+
+
+/* editor_row_edited - Update a row after an edit
+ *
+ * Long rows only have the segments around the edit measured again;
+ * other rows are rendered again. Rows become long once they reach
+ * MICRO_LONG_ROW_BYTES, and stop being long when they shrink below half
+ * of that, so editing around the limit doesn't keep switching between
+ * the two.
+ *
+ * Parameters:
+ *  - row: Editor row
+ *  - at: Byte offset of the edit
+ *  - delta: Number of bytes inserted (negative for deleted) at at
+ *
+ * Returns: Nothing
+ */
+static void editor_row_edited(erow_t *row, int at, int delta)
+{
+    if ((row->flags & ROW_LONG) && row->size >= MICRO_LONG_ROW_BYTES / 2)
+        editor_row_resegment(row, at, delta);
+    else
+        editor_row_render(row);
+}
+
+
+/* See row.h */
+int editor_row_width(erow_t *row)
+{
+    if (row->flags & ROW_LONG)
+    {
+        erow_segment_t *last = &row->draw.segs->seg[row->draw.segs->num - 1];
+        return last->col + editor_row_segment_width(last);
+    }
+    if (row->flags & ROW_VIEW)
+        return editor_row_cx2rx(row, row->size);
+    erow_render_t *r = row->draw.render;
+    if (r == NULL)
+        return row->size;
+    return r->rcol ? r->rcol[r->size] : r->size;
+}
 
 
 /* See row.h */
 int editor_row_cx2rx(erow_t *row, int cx)
 {
-    int rx = 0;
-    int j;
-    for (j = 0; j < cx; j++)
+    int from = 0, rx = 0;
+    if (row->flags & ROW_LONG)
     {
-        if (row->chars[j] == '\t')
-            rx += (MICRO_TAB_STOP - 1) - (rx % MICRO_TAB_STOP);
-        rx++;
+        erow_segment_t *seg = &row->draw.segs->seg[editor_row_find_offset(row, cx)];
+        from = seg->offset;
+        rx = seg->col;
     }
+    editor_row_walk(row, from, cx, rx, &rx);
     return rx;
 }
 
@@ -33,114 +537,395 @@ int editor_row_cx2rx(erow_t *row, int cx)
 /* See row.h */
 int editor_row_rx2cx(erow_t *row, int rx)
 {
-    int cur_rx = 0;
-    int cx;
-    for (cx = 0; cx < row->size; cx++)
+    int cur_rx, cx;
+    editor_row_seek(row, rx, &cx, &cur_rx);
+    while (cx < row->size)
     {
-        if (row->chars[cx] == '\t')
-            cur_rx += (MICRO_TAB_STOP - 1) - (cur_rx % MICRO_TAB_STOP);
-        cur_rx++;
+        int width;
+        int n = editor_row_char(row, cx, cur_rx, &width);
+        cur_rx += width;
         if (cur_rx > rx)
             return cx;
+        cx += n;
     }
     return cx;
 }
 
 
 /* See row.h */
-void editor_row_render(erow_t *row)
+int editor_row_render(erow_t *row)
 {
+    editor_row_free_draw(row);
+    row->flags &= ~(ROW_HL_VALID | ROW_HL_STATE | ROW_LONG);
+
+    if (row->size >= MICRO_LONG_ROW_BYTES)
+    {
+        free(row->hl);
+        row->hl = NULL;
+        return editor_row_segment(row);
+    }
+
+    const char *chars = editor_row_chars(row);
     int tabs = 0;
     int j;
     for (j = 0; j < row->size; j++)
-        if (row->chars[j] == '\t')
+        if (chars[j] == '\t')
             tabs++;
-    free(row->render);
-    row->render = malloc(row->size + tabs * (MICRO_TAB_STOP - 1) + 1);
+    int ascii = utf8_is_ascii(chars, row->size);
+
+    /* Most rows render as they are, and don't need a copy */
+    if (ascii && tabs == 0)
+        return 0;
+
+    int maxsize = row->size + tabs * (MICRO_TAB_STOP - 1);
+    erow_render_t *r = malloc(sizeof(erow_render_t) + maxsize + 1);
+    if (r == NULL)
+        return -1;
+    r->rcol = NULL;
     int idx = 0;
-    for (j = 0; j < row->size; j++)
+
+    if (ascii)
+    {
+        for (j = 0; j < row->size; j++)
+        {
+            if (chars[j] == '\t')
+            {
+                r->chars[idx++] = ' ';
+                while (idx % MICRO_TAB_STOP != 0)
+                    r->chars[idx++] = ' ';
+            }
+            else
+            {
+                r->chars[idx++] = chars[j];
+            }
+        }
+    }
+    else
+    {
+        /* Invalid bytes become a single '?', so render can't grow
+         * any more than it does for tabs */
+        r->rcol = malloc(sizeof(int) * (maxsize + 1));
+        if (r->rcol == NULL)
+        {
+            free(r);
+            return -1;
+        }
+        int col = 0;
+        for (j = 0; j < row->size;)
+        {
+            int width;
+            int n = editor_row_char(row, j, col, &width);
+            if (chars[j] == '\t')
+            {
+                for (int k = 0; k < width; k++)
+                {
+                    r->rcol[idx] = col + k;
+                    r->chars[idx++] = ' ';
+                }
+            }
+            else
+            {
+                /* Zero-width characters belong to the character before them */
+                int start = (width == 0 && idx > 0) ? r->rcol[idx - 1] : col;
+                if (n == 1 && (unsigned char)chars[j] >= 0x80)
+                {
+                    r->rcol[idx] = start;
+                    r->chars[idx++] = '?';
+                }
+                else
+                {
+                    for (int k = 0; k < n; k++)
+                    {
+                        r->rcol[idx] = start;
+                        r->chars[idx++] = chars[j + k];
+                    }
+                }
+            }
+            col += width;
+            j += n;
+        }
+        r->rcol[idx] = col;
+    }
+
+    r->chars[idx] = '\0';
+    r->size = idx;
+    row->draw.render = r;
+    return 0;
+}
+
+
+/* See row.h */
+int editor_row_render_slice(erow_t *row, int rx, int len, char *dest)
+{
+    const char *chars = editor_row_chars(row);
+    int j, cur_rx;
+    editor_row_seek(row, rx, &j, &cur_rx);
+    int n = 0;
+    while (j < row->size && cur_rx < rx + len)
     {
-        if (row->chars[j] == '\t')
+        int width;
+        int clen = editor_row_char(row, j, cur_rx, &width);
+        if (chars[j] == '\t')
+        {
+            for (int k = 0; k < width; k++)
+                if (cur_rx + k >= rx && cur_rx + k < rx + len)
+                    dest[n++] = ' ';
+        }
+        else if (cur_rx >= rx && cur_rx + width <= rx + len)
         {
-            row->render[idx++] = ' ';
-            while (idx % MICRO_TAB_STOP != 0)
-                row->render[idx++] = ' ';
+            if (clen == 1 && (unsigned char)chars[j] >= 0x80)
+                dest[n++] = '?';
+            else if (n + clen <= len * UTF8_MAX_BYTES)
+            {
+                memcpy(&dest[n], &chars[j], clen);
+                n += clen;
+            }
         }
+        else if (cur_rx < rx && cur_rx + width > rx)
+        {
+            /* Wide character cut off by the left edge */
+            for (int k = rx; k < cur_rx + width && k < rx + len; k++)
+                dest[n++] = ' ';
+        }
+        cur_rx += width;
+        j += clen;
+    }
+    return n;
+}
+
+
+/* editor_row_col2byte - Find the first byte of a render at or after a column */
+static int editor_row_col2byte(erow_render_t *r, int col)
+{
+    int lo = 0, hi = r->size;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (r->rcol[mid] < col)
+            lo = mid + 1;
         else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+/* See row.h */
+int editor_row_visible(erow_t *row, int col, int cols, int *start, int *end)
+{
+    erow_render_t *r = row->draw.render;
+    if (r == NULL || r->rcol == NULL)
+    {
+        int rsize = r ? r->size : row->size;
+        *start = col < rsize ? col : rsize;
+        *end = col + cols < rsize ? col + cols : rsize;
+        return 0;
+    }
+
+    int limit = col + cols;
+    int b0 = editor_row_col2byte(r, col);
+    int b1 = editor_row_col2byte(r, limit);
+
+    /* The last character we'd draw ends where the next one starts;
+     * if that's past the edge, leave it out */
+    if (b1 > b0 && r->rcol[b1] > limit)
+        b1 = editor_row_col2byte(r, r->rcol[b1 - 1]);
+
+    *start = b0;
+    *end = b1;
+    int pad = r->rcol[b0] - col;
+    return pad < cols ? pad : cols;
+}
+
+
+/* editor_row_wrap - Walk the wrapped segments of a row
+ *
+ * Stops at segment seg, or at the segment containing column rx,
+ * or at the last segment, whichever comes first.
+ *
+ * Parameters:
+ *  - row: Editor row
+ *  - cols: Number of columns on the screen
+ *  - seg: Segment to stop at (-1 for none)
+ *  - rx: Column to stop at (-1 for none)
+ *  - start: Output parameter to return the column at which the
+ *    segment we stopped at starts
+ *
+ * Returns: The segment we stopped at
+ */
+static int editor_row_wrap(erow_t *row, int cols, int seg, int rx, int *start)
+{
+    if (cols < 1)
+        cols = 1;
+
+    /* Rendered ASCII rows are one column per byte, so they simply
+     * break every cols columns. So do long rows, rather than decoding
+     * the whole row (a wide character on a break is shown as blanks). */
+    if ((row->flags & ROW_LONG) ||
+        (!(row->flags & ROW_VIEW) && (row->draw.render == NULL || row->draw.render->rcol == NULL)))
+    {
+        int last = editor_row_width(row) / cols;
+        int k = seg >= 0 ? seg : rx >= 0 ? rx / cols : last;
+        if (k > last)
+            k = last;
+        *start = k * cols;
+        return k;
+    }
+
+    const char *chars = editor_row_chars(row);
+    int c = 0; /* Column where the current segment starts */
+    int k = 0;
+    int col = 0;
+    for (int j = 0; j <= row->size;)
+    {
+        /* Tabs can be split across segments, like the spaces they
+         * render as; the end of the row takes up one column */
+        int tab = j < row->size && chars[j] == '\t';
+        int width, n;
+        if (j == row->size || tab)
+            width = n = 1;
+        else
+            n = editor_row_char(row, j, col, &width);
+        if (col + width > c + cols && col > c)
         {
-            row->render[idx++] = row->chars[j];
+            if (k == seg || (rx >= 0 && rx < col))
+                break;
+            c = col;
+            k++;
         }
+
+        col += width;
+        if (tab && col % MICRO_TAB_STOP != 0)
+            continue;
+        j += n;
     }
-    row->render[idx] = '\0';
-    row->rsize = idx;
+    *start = c;
+    return k;
 }
 
 
 /* See row.h */
-void editor_row_insert(editor_ctx_t *ctx, int at, char *s, size_t len)
+int editor_row_wrap_count(erow_t *row, int cols)
 {
-    if (at < 0 || at > ctx->num_rows)
-        return;
+    int start;
+    return editor_row_wrap(row, cols, -1, -1, &start) + 1;
+}
 
-    ctx->rows = realloc(ctx->rows, sizeof(erow_t) * (ctx->num_rows + 1));
-    memmove(&ctx->rows[at + 1], &ctx->rows[at], sizeof(erow_t) * (ctx->num_rows - at));
 
-    ctx->rows[at].size = len;
-    ctx->rows[at].chars = malloc(len + 1);
-    memcpy(ctx->rows[at].chars, s, len);
-    ctx->rows[at].chars[len] = '\0';
+/* See row.h */
+int editor_row_wrap_start(erow_t *row, int cols, int seg)
+{
+    int start;
+    editor_row_wrap(row, cols, seg, -1, &start);
+    return start;
+}
 
-    ctx->rows[at].rsize = 0;
-    ctx->rows[at].render = NULL;
-    editor_row_render(&ctx->rows[at]);
 
-    ctx->num_rows++;
-    ctx->dirty++;
+/* See row.h */
+int editor_row_wrap_segment(erow_t *row, int cols, int rx, int *start)
+{
+    return editor_row_wrap(row, cols, -1, rx, start);
 }
 
 
 /* See row.h */
-void editor_row_free(erow_t *row)
+int editor_row_next_char(erow_t *row, int cx)
 {
-    free(row->render);
-    free(row->chars);
+    const char *chars = editor_row_chars(row);
+    int cp;
+    if ((unsigned char)chars[cx] < 0x80)
+        return cx + 1;
+    return cx + utf8_decode(&chars[cx], row->size - cx, &cp);
 }
 
 
 /* See row.h */
-void editor_row_delete(editor_ctx_t *ctx, int row_idx)
+int editor_row_prev_char(erow_t *row, int cx)
 {
-    if (row_idx < 0 || row_idx >= ctx->num_rows)
-        return;
-    editor_row_free(&ctx->rows[row_idx]);
-    memmove(&ctx->rows[row_idx], &ctx->rows[row_idx + 1], sizeof(erow_t) * (ctx->num_rows - row_idx - 1));
-    ctx->num_rows--;
-    ctx->dirty++;
+    /* The byte before cx is part of a character that starts further
+     * back only if the lead byte there decodes to a sequence reaching
+     * it; otherwise it is a character of its own (shown as an invalid
+     * byte), as editor_row_char finds going forwards */
+    const char *chars = editor_row_chars(row);
+    int start = cx - 1;
+    while (start > 0 && start > cx - UTF8_MAX_BYTES && utf8_is_continuation(chars[start]))
+        start--;
+    if (start == cx - 1 || utf8_is_continuation(chars[start]))
+        return cx - 1;
+
+    int cp;
+    int n = utf8_decode(&chars[start], row->size - start, &cp);
+    return cp != -1 && start + n >= cx ? start : cx - 1;
+}
+
+
+/* See row.h */
+int editor_row_init(erow_t *row, const char *s, size_t len)
+{
+    row->size = 0;
+    row->text.local[0] = '\0';
+    row->draw.render = NULL;
+    row->hl = NULL;
+    row->hl_start = 0;
+    row->hl_state = 0;
+    row->flags = ROW_INLINE;
+
+    if (len >= ROW_INLINE_BYTES)
+    {
+        char *chars = malloc(len + 1);
+        if (chars == NULL)
+            return -1;
+        row->text.chars = chars;
+        row->flags = 0;
+    }
+    char *chars = editor_row_chars(row);
+    memcpy(chars, s, len);
+    chars[len] = '\0';
+    row->size = len;
+    editor_row_render(row);
+    return 0;
+}
+
+
+/* See row.h */
+void editor_row_free(erow_t *row)
+{
+    editor_row_free_draw(row);
+    free(row->hl);
+    if (!(row->flags & ROW_INLINE))
+        free(row->text.chars);
 }
 
 
 /* See row.h */
-void editor_row_insert_char(erow_t *row, int at, int c)
+int editor_row_insert_char(erow_t *row, int at, int c)
 {
     if (at < 0 || at > row->size)
         at = row->size;
-    row->chars = realloc(row->chars, row->size + 2);
-    memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+    if (editor_row_reserve(row, row->size + 1) == -1)
+        return -1;
+    char *chars = editor_row_chars(row);
+    memmove(&chars[at + 1], &chars[at], row->size - at + 1);
     row->size++;
-    row->chars[at] = c;
-    editor_row_render(row);
+    chars[at] = c;
+    editor_row_edited(row, at, 1);
+    return 0;
 }
 
 
 /* See row.h */
-void editor_row_append_string(erow_t *row, char *s, size_t len)
+int editor_row_append_string(erow_t *row, const char *s, size_t len)
 {
     /* Reallocate memory so appended string fits in row */
-    row->chars = realloc(row->chars, row->size + 1);
-    memcpy(&row->chars[row->size], s, len);
+    int at = row->size;
+    if (editor_row_reserve(row, row->size + len) == -1)
+        return -1;
+    char *chars = editor_row_chars(row);
+    memcpy(&chars[row->size], s, len);
     row->size += len;
-    row->chars[row->size] = '\0';
-    editor_row_render(row);
+    chars[row->size] = '\0';
+    editor_row_edited(row, at, len);
+    return 0;
 }
 
 
@@ -149,28 +934,76 @@ void editor_row_delete_char(erow_t *row, int at)
 {
     if (at < 0 || at >= row->size)
         return;
-    memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
+    char *chars = editor_row_chars(row);
+    memmove(&chars[at], &chars[at + 1], row->size - at);
     row->size--;
-    editor_row_render(row);
+    editor_row_edited(row, at, -1);
 }
 
 
 /* See row.h */
-char *editor_rows_to_string(editor_ctx_t *ctx, int *buflen)
+int editor_row_splice(erow_t *row, const erow_edit_t *edits, int n, const char *s, int len)
 {
-    int totlen = 0;
-    int j;
-    for (j = 0; j < ctx->num_rows; j++)
-        totlen += ctx->rows[j].size + 1;
-    *buflen = totlen;
-    char *buf;
-    char *p = buf;
-    for (j = 0; j < ctx->num_rows; j++)
-    {
-        memcpy(p, ctx->rows[j].chars, ctx->rows[j].size);
-        p += ctx->rows[j].size;
-        *p = '\n';
-        p++;
-    }
-    return buf;
+    if (n == 0)
+        return 0;
+
+    /* A short result is built on the stack, as it will go in the row
+     * itself (where the old text may still be) */
+    long long size = row->size;
+    for (int i = 0; i < n; i++)
+        size += len - edits[i].len;
+    char local[ROW_INLINE_BYTES];
+    char *chars = size < ROW_INLINE_BYTES ? local : malloc(size + 1);
+    if (chars == NULL)
+        return -1;
+
+    /* Copy what's between the ranges, with the string in each range */
+    const char *old = editor_row_chars(row);
+    char *p = chars;
+    int from = 0;
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(p, &old[from], edits[i].at - from);
+        p += edits[i].at - from;
+        memcpy(p, s, len);
+        p += len;
+        from = edits[i].at + edits[i].len;
+    }
+    memcpy(p, &old[from], row->size - from);
+    chars[size] = '\0';
+
+    if (!(row->flags & ROW_INLINE))
+        free(row->text.chars);
+    if (chars == local)
+    {
+        memcpy(row->text.local, local, size + 1);
+        row->flags |= ROW_INLINE;
+    }
+    else
+    {
+        row->text.chars = chars;
+        row->flags &= ~ROW_INLINE;
+    }
+    int delta = (int)(size - row->size);
+    row->size = (int)size;
+
+    /* A long row can only be patched up around a single insertion or
+     * deletion */
+    if (n == 1 && (len == 0 || edits[0].len == 0))
+        editor_row_edited(row, edits[0].at, delta);
+    else
+        editor_row_render(row);
+    return 0;
+}
+
+
+/* See row.h */
+void editor_row_truncate(erow_t *row, int len)
+{
+    if (len < 0 || len > row->size)
+        return;
+    int delta = len - row->size;
+    row->size = len;
+    editor_row_chars(row)[len] = '\0';
+    editor_row_edited(row, len, delta);
 }
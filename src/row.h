@@ -10,101 +10,298 @@
 #ifndef ROW_H
 #define ROW_H
 
-#include <time.h>
+#include <stddef.h>
 
-/* Forward declaration of editor context */
-typedef struct editor_ctx editor_ctx_t;
+/* Row flags */
 
-/* An "editor row" (a line of text) */
+/* The row is a view of text owned by someone else (e.g., a memory-mapped
+ * file): its text is not NUL-terminated and must not be modified or freed,
+ * and there is no render (use editor_row_render_slice instead) */
+#define ROW_VIEW (1 << 0)
+
+/* The row's highlighting (hl, hl_start and hl_state) is up to date
+ * with its contents (see highlight.h) */
+#define ROW_HL_VALID (1 << 1)
+
+/* The row's hl_start and hl_state are up to date, but it has not been
+ * highlighted (set by the background highlighter) */
+#define ROW_HL_STATE (1 << 2)
+
+/* The row is too long to render in one piece (see MICRO_LONG_ROW_BYTES):
+ * there is no render or hl, and segments summarize the row instead.
+ * Long rows are not syntax highlighted. */
+#define ROW_LONG (1 << 3)
+
+/* The row's text is stored in the row itself (see ROW_INLINE_BYTES),
+ * rather than in memory of its own */
+#define ROW_INLINE (1 << 4)
+
+/* Rows shorter than this many bytes (counting the NUL) keep their text
+ * in the row itself, in place of a pointer to it (see ROW_INLINE) */
+#define ROW_INLINE_BYTES (16)
+
+/* An "editor row" (a line of text)
+ *
+ * There is one per line of the file, so the row packs into as little
+ * space as it can: lengths are 32-bit, the flags share a word with the
+ * lexer state, short lines are stored in the row itself, and what is
+ * only needed to draw some rows is kept out of it. Use editor_row_chars
+ * and editor_row_rendered to get at the text. */
 typedef struct erow
 {
-    /* The actual line of text */
+    /* The actual line of text (see editor_row_chars) */
+    union
+    {
+        char *chars;
+        char local[ROW_INLINE_BYTES];
+    } text;
+
+    /* Highlighting of the rendered row (one HL_* value per character) */
+    unsigned char *hl;
+
+    /* How the row is drawn. For long rows (see ROW_LONG): the row split
+     * into segments of about ROW_SEGMENT_BYTES, with the width of each,
+     * so only the segments around a column or an edit need to be
+     * decoded. For other rows: the rendered version of the row, or NULL
+     * if the row renders as it is (ASCII with no tabs, which most rows
+     * are), so its text is its render. NULL for views. */
+    union
+    {
+        struct erow_render *render;
+        struct erow_segments *segs;
+    } draw;
+
+    /* Length of the line, in bytes */
     int size;
-    char *chars;
 
-    /* The rendered version of that line */
-    int rsize;
-    char *render;
+    /* Lexer state at the start and at the end of the row */
+    unsigned char hl_start;
+    unsigned char hl_state;
+
+    /* ROW_* flags */
+    unsigned short flags;
 } erow_t;
 
+/* A range of bytes of a row to be replaced (see editor_row_splice) */
+typedef struct erow_edit
+{
+    int at;
+    int len;
+} erow_edit_t;
+
+/* editor_row_chars - Get the text of a row
+ *
+ * The text may be stored in the row itself, so the pointer is only
+ * valid until the row is changed or moved (e.g., by rows being
+ * inserted before it).
+ *
+ * Parameters:
+ *  - row: Editor row
+ *
+ * Returns: The row's text (row->size bytes, followed by a NUL unless
+ *          the row is a view)
+ */
+char *editor_row_chars(const erow_t *row);
+
+
+/* editor_row_rendered - Get the rendered version of a row
+ *
+ * Like the text, the render is only valid until the row is changed
+ * or moved.
+ *
+ * Parameters:
+ *  - row: Editor row (not a view, nor a long row)
+ *  - len: Output parameter to return the length of the render (may
+ *    be NULL)
+ *
+ * Returns: The rendered row
+ */
+const char *editor_row_rendered(const erow_t *row, int *len);
+
+
 /* editor_row_cx2rx 
  * 
- * Concerts the cursor position to a position into
- * the rendered row
+ * Concerts the cursor position (a byte offset in the row) to a
+ * screen column in the rendered row
  * 
  * Parameters:
  *  - row: Editor row
  *  - cx: Cursor position to convert
  * 
- * Returns: An index into the rendered row
+ * Returns: A column of the rendered row
  */
 int editor_row_cx2rx(erow_t *row, int cx);
 
 
 /* editor_row_rx2cx 
  * 
- * Concerts a position in the rendered row into a
+ * Concerts a column of the rendered row into a
  * cursor position
  * 
  * Parameters:
  *  - row: Editor row
- *  - rx: Rendered row position
+ *  - rx: Rendered row column
  * 
  * Returns: A cursor position in the row
  */
 int editor_row_rx2cx(erow_t *row, int rx);
 
+/* editor_row_width - Width of a row on the screen
+ * 
+ * Parameters:
+ *  - row: Editor row
+ * 
+ * Returns: Number of columns the whole row takes up
+ */
+int editor_row_width(erow_t *row);
+
+
 /* editor_row_render - Render an editor row
  * 
  * Take the raw content of an editor row and produce the rendered
- * version (currently replaces tabs with 4 spaces)
+ * version (currently replaces tabs with 4 spaces, and bytes that
+ * aren't valid UTF-8 with '?'). Long rows are split into segments
+ * instead (see ROW_LONG).
  * 
  * Parameters:
  *  - row: Editor row to render
  * 
- * Returns: nothing
+ * Returns: 0 on success, -1 if memory could not be allocated (the row
+ *          is then drawn as it is, until it is rendered again)
  */
-void editor_row_render(erow_t *row);
+int editor_row_render(erow_t *row);
 
 
-/* editor_row_insert - Insert a new editor row
+/* editor_row_render_slice - Render part of an editor row
  * 
- * Allocate space for a new editor row, and copy the given
- * string as a new editor row, and insert it at the specified
- * index.
+ * Renders the columns [rx, rx + len) of the row into dest, without
+ * keeping a rendered copy of the row. This is how views and long
+ * rows are drawn.
  * 
  * Parameters:
- *  - ctx: Editor context
- *  - at: Row index to insert the new row at
- *  - s: String contents of new row
- *  - len: Length of string
+ *  - row: Editor row
+ *  - rx: First column to render
+ *  - len: Maximum number of columns to render
+ *  - dest: Where to write the rendered text (at least
+ *    len * UTF8_MAX_BYTES bytes)
  * 
- * Returns: nothing
+ * Returns: Number of bytes written to dest
  */
-void editor_row_insert(editor_ctx_t *ctx, int at, char *s, size_t len);
+int editor_row_render_slice(erow_t *row, int rx, int len, char *dest);
 
 
-/* editor_row_free - Free a row
+/* editor_row_visible - Find the part of a rendered row that fits on the screen
+ * 
+ * Characters that don't fit entirely in the columns [col, col + cols)
+ * (i.e., wide characters cut off at either edge) are left out.
  * 
  * Parameters:
  *  - row: Editor row
+ *  - col: First column on the screen
+ *  - cols: Number of columns on the screen
+ *  - start, end: Output parameters to return the range of bytes
+ *    of render to draw
  * 
- * Returns: nothing
+ * Returns: Number of blank columns to draw before the bytes
+ *          (where a wide character was cut off)
  */
-void editor_row_free(erow_t *row);
+int editor_row_visible(erow_t *row, int col, int cols, int *start, int *end);
 
 
-/* editor_row_delete - Delete a row
- *
- * Deletes a row, and shifts all subsequent rows up one row.
+/* editor_row_wrap_count - Number of screen lines a row takes up when wrapped
+ * 
+ * Rows are wrapped at cols columns, breaking before the first character
+ * that doesn't fit (so wide characters are never split). The end of
+ * the row takes up a column too, so there's always room for the
+ * cursor after the last character.
+ * 
+ * Parameters:
+ *  - row: Editor row
+ *  - cols: Number of columns on the screen
+ * 
+ * Returns: Number of wrapped segments (at least 1)
+ */
+int editor_row_wrap_count(erow_t *row, int cols);
+
+
+/* editor_row_wrap_start - Find where a wrapped segment starts
  * 
  * Parameters:
- *  - ctx: Editor context
- *  - row_idx: Index of row to delete
+ *  - row: Editor row
+ *  - cols: Number of columns on the screen
+ *  - seg: Segment (0 for the first screen line of the row)
+ * 
+ * Returns: Column of the rendered row at which the segment starts
+ */
+int editor_row_wrap_start(erow_t *row, int cols, int seg);
+
+
+/* editor_row_wrap_segment - Find the wrapped segment containing a column
+ * 
+ * Parameters:
+ *  - row: Editor row
+ *  - cols: Number of columns on the screen
+ *  - rx: Column of the rendered row
+ *  - start: Output parameter to return the column at which the
+ *    segment starts
+ * 
+ * Returns: Segment containing rx
+ */
+int editor_row_wrap_segment(erow_t *row, int cols, int rx, int *start);
+
+
+/* editor_row_next_char - Find the start of the next character
+ * 
+ * Characters are as drawn: a byte that isn't part of a valid UTF-8
+ * sequence is a character of its own.
+ * 
+ * Parameters:
+ *  - row: Editor row
+ *  - cx: Cursor position (must be less than row->size)
+ * 
+ * Returns: Position of the character after the one at cx
+ */
+int editor_row_next_char(erow_t *row, int cx);
+
+
+/* editor_row_prev_char - Find the start of the previous character
+ * 
+ * Also used to snap a position that may be in the middle of a
+ * character back to the start of that character.
+ * 
+ * Parameters:
+ *  - row: Editor row
+ *  - cx: Cursor position (must be greater than 0)
+ * 
+ * Returns: Position of the character before cx
+ */
+int editor_row_prev_char(erow_t *row, int cx);
+
+
+/* editor_row_init - Initialize an editor row
+ * 
+ * Copy the given string as the contents of the row,
+ * and render it.
+ * 
+ * Parameters:
+ *  - row: Editor row to initialize
+ *  - s: String contents of the row
+ *  - len: Length of string
+ * 
+ * Returns: 0 on success, -1 if memory could not be allocated (the row
+ *          is then left empty, and can still be freed)
+ */
+int editor_row_init(erow_t *row, const char *s, size_t len);
+
+
+/* editor_row_free - Free a row
+ * 
+ * Parameters:
+ *  - row: Editor row
  * 
  * Returns: nothing
  */
-void editor_row_delete(editor_ctx_t *ctx, int row_idx);
+void editor_row_free(erow_t *row);
 
 
 /* editor_row_insert_char - Inserts a character in a row
@@ -114,9 +311,10 @@ void editor_row_delete(editor_ctx_t *ctx, int row_idx);
  *  - at: Position in the row
  *  - c: Character to insert
  * 
- * Returns: nothing
+ * Returns: 0 on success, -1 if memory could not be allocated (the row
+ *          is left as it was)
  */
-void editor_row_insert_char(erow_t *row, int at, int c);
+int editor_row_insert_char(erow_t *row, int at, int c);
 
 
 /* editor_row_append_string - Append a string at the end of a row
@@ -126,31 +324,52 @@ void editor_row_insert_char(erow_t *row, int at, int c);
  *  - s: String to append
  *  - len: Length of the string to append
  * 
- * Returns: nothing
+ * Returns: 0 on success, -1 if memory could not be allocated (the row
+ *          is left as it was)
  */
-void editor_row_append_string(erow_t *row, char *s, size_t len);
+int editor_row_append_string(erow_t *row, const char *s, size_t len);
 
 
-/* editor_row_delete_char - Deletes a character in a row
+/* editor_row_truncate - Cut a row short
  * 
  * Parameters:
  *  - row: Editor row
- *  - at: Position in the row
+ *  - len: New length of the row (at most row->size)
  * 
  * Returns: nothing
  */
-void editor_row_delete_char(erow_t *row, int at);
+void editor_row_truncate(erow_t *row, int len);
 
 
-/* editor_rows_to_string - Convert the editor rows to a single string
+/* editor_row_splice - Replace several ranges of a row with a string
  *
+ * The row is built again in a single pass, and rendered once, however
+ * many ranges there are (e.g., a key typed with many cursors on the
+ * row, or every match of a search being replaced).
+ * 
  * Parameters:
- *  - ctx: Editor context object
- *  - buflen: Output parameter to return the length of the string
+ *  - row: Editor row
+ *  - edits: Ranges to replace, sorted by position and not overlapping
+ *    (empty ranges just insert the string)
+ *  - n: Number of ranges
+ *  - s: String to put in place of each range
+ *  - len: Length of the string
  * 
- * Returns: Editor rows as a single string
+ * Returns: 0 on success, -1 if memory could not be allocated (the row
+ *          is left as it was)
  */
-char *editor_rows_to_string(editor_ctx_t *ctx, int *buflen);
+int editor_row_splice(erow_t *row, const erow_edit_t *edits, int n, const char *s, int len);
+
+
+/* editor_row_delete_char - Deletes a character in a row
+ * 
+ * Parameters:
+ *  - row: Editor row
+ *  - at: Position in the row
+ * 
+ * Returns: nothing
+ */
+void editor_row_delete_char(erow_t *row, int at);
 
 
 #endif /* ROW_H */
\ No newline at end of file
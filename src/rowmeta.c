@@ -0,0 +1,151 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * rowmeta.c: Metadata of the rows of a buffer, kept in arrays of its own.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rowmeta.h"
+
+
+/* rowmeta_reserve - Make room for the metadata of at least n rows
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int rowmeta_reserve(rowmeta_t *m, int n)
+{
+    if (n <= m->capacity)
+        return 0;
+    int capacity = m->capacity ? m->capacity : 64;
+    while (capacity < n)
+        capacity *= 2;
+    int *sizes = realloc(m->sizes, sizeof(int) * capacity);
+    if (sizes == NULL)
+        return -1;
+    m->sizes = sizes;
+    uint32_t *hashes = realloc(m->hashes, sizeof(uint32_t) * capacity);
+    if (hashes == NULL)
+        return -1;
+    m->hashes = hashes;
+    m->capacity = capacity;
+    return 0;
+}
+
+
+/* rowmeta_fill - Record the metadata of n rows, starting at at */
+static void rowmeta_fill(rowmeta_t *m, int at, const erow_t *rows, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        m->sizes[at + i] = rows[i].size;
+        m->hashes[at + i] = 0;
+    }
+}
+
+
+/* See rowmeta.h */
+void rowmeta_init(rowmeta_t *m)
+{
+    m->sizes = NULL;
+    m->hashes = NULL;
+    m->num_rows = 0;
+    m->capacity = 0;
+}
+
+
+/* See rowmeta.h */
+void rowmeta_free(rowmeta_t *m)
+{
+    free(m->sizes);
+    free(m->hashes);
+    rowmeta_init(m);
+    m->num_rows = -1;
+}
+
+
+/* See rowmeta.h */
+int rowmeta_build(rowmeta_t *m, const erow_t *rows, int n)
+{
+    m->num_rows = -1;
+    if (rowmeta_reserve(m, n) == -1)
+        return -1;
+    rowmeta_fill(m, 0, rows, n);
+    m->num_rows = n;
+    return 0;
+}
+
+
+/* See rowmeta.h */
+int rowmeta_insert(rowmeta_t *m, int at, const erow_t *rows, int n)
+{
+    if (m->num_rows == -1)
+        return -1;
+    if (rowmeta_reserve(m, m->num_rows + n) == -1)
+    {
+        m->num_rows = -1;
+        return -1;
+    }
+    memmove(&m->sizes[at + n], &m->sizes[at], sizeof(int) * (m->num_rows - at));
+    memmove(&m->hashes[at + n], &m->hashes[at], sizeof(uint32_t) * (m->num_rows - at));
+    rowmeta_fill(m, at, rows, n);
+    m->num_rows += n;
+    return 0;
+}
+
+
+/* See rowmeta.h */
+void rowmeta_delete(rowmeta_t *m, int at, int n)
+{
+    if (m->num_rows == -1)
+        return;
+    memmove(&m->sizes[at], &m->sizes[at + n], sizeof(int) * (m->num_rows - at - n));
+    memmove(&m->hashes[at], &m->hashes[at + n], sizeof(uint32_t) * (m->num_rows - at - n));
+    m->num_rows -= n;
+}
+
+
+/* See rowmeta.h */
+void rowmeta_set(rowmeta_t *m, int at, const erow_t *row)
+{
+    if (m->num_rows == -1)
+        return;
+    rowmeta_fill(m, at, row, 1);
+}
+
+
+/* See rowmeta.h */
+long long rowmeta_total(const rowmeta_t *m)
+{
+    long long total = 0;
+    for (int i = 0; i < m->num_rows; i++)
+        total += m->sizes[i];
+    return total;
+}
+
+
+/* See rowmeta.h */
+uint32_t rowmeta_hash_row(const erow_t *row)
+{
+    /* FNV-1a, with 0 kept to mean "not hashed yet" */
+    const char *chars = editor_row_chars(row);
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < row->size; i++)
+    {
+        h ^= (unsigned char)chars[i];
+        h *= 16777619u;
+    }
+    return h ? h : 1;
+}
+
+
+/* See rowmeta.h */
+uint32_t rowmeta_hash(rowmeta_t *m, int at, const erow_t *row)
+{
+    if (m->hashes[at] == 0)
+        m->hashes[at] = rowmeta_hash_row(row);
+    return m->hashes[at];
+}
@@ -0,0 +1,152 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * rowmeta.h: Metadata of the rows of a buffer, kept in arrays of its own.
+ *
+ * Operations that look at every row (adding up the size of the file,
+ * skipping rows too short to hold a search string, comparing rows)
+ * would otherwise walk over the erow_t structs, touching a cache line
+ * per row for a single field. The metadata keeps the size of every row
+ * in one contiguous array (and a hash of its contents in another), so
+ * such scans read memory in order and can be vectorized.
+ *
+ * The buffer keeps its metadata in step with its rows (see buffer.c).
+ * It is only kept for buffers that are entirely in memory: paged and
+ * memory-mapped buffers have rows that come and go, and scanning them
+ * reads the text anyway.
+ */
+
+#ifndef ROWMETA_H
+#define ROWMETA_H
+
+#include <stdint.h>
+#include "row.h"
+
+/* Metadata of the rows of a buffer */
+typedef struct rowmeta
+{
+    /* Size of each row (see erow_t) */
+    int *sizes;
+
+    /* Hash of the contents of each row, or 0 if it hasn't been hashed
+     * since it last changed (see rowmeta_hash) */
+    uint32_t *hashes;
+
+    /* Number of rows, or -1 if the metadata is out of step with the
+     * rows (memory ran out, or the buffer isn't kept in memory) */
+    int num_rows;
+    int capacity;
+} rowmeta_t;
+
+
+/* rowmeta_init - Initialize empty metadata
+ *
+ * Parameters:
+ *  - m: Metadata
+ *
+ * Returns: Nothing
+ */
+void rowmeta_init(rowmeta_t *m);
+
+
+/* rowmeta_free - Free metadata (leaving it out of step)
+ *
+ * Parameters:
+ *  - m: Metadata
+ *
+ * Returns: Nothing
+ */
+void rowmeta_free(rowmeta_t *m);
+
+
+/* rowmeta_build - Record the metadata of every row
+ *
+ * Parameters:
+ *  - m: Metadata
+ *  - rows: Rows
+ *  - n: Number of rows
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (the
+ *          metadata is then out of step)
+ */
+int rowmeta_build(rowmeta_t *m, const erow_t *rows, int n);
+
+
+/* rowmeta_insert - Record inserted rows
+ *
+ * Parameters:
+ *  - m: Metadata
+ *  - at: Index of the first row inserted
+ *  - rows: The rows inserted
+ *  - n: Number of rows inserted
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (the
+ *          metadata is then out of step)
+ */
+int rowmeta_insert(rowmeta_t *m, int at, const erow_t *rows, int n);
+
+
+/* rowmeta_delete - Record deleted rows
+ *
+ * Parameters:
+ *  - m: Metadata
+ *  - at: Index of the first row deleted
+ *  - n: Number of rows deleted
+ *
+ * Returns: Nothing
+ */
+void rowmeta_delete(rowmeta_t *m, int at, int n);
+
+
+/* rowmeta_set - Record that a row changed
+ *
+ * Parameters:
+ *  - m: Metadata
+ *  - at: Row index
+ *  - row: The row
+ *
+ * Returns: Nothing
+ */
+void rowmeta_set(rowmeta_t *m, int at, const erow_t *row);
+
+
+/* rowmeta_total - Add up the sizes of all the rows
+ *
+ * Parameters:
+ *  - m: Metadata (in step with the rows)
+ *
+ * Returns: Total size of the rows
+ */
+long long rowmeta_total(const rowmeta_t *m);
+
+
+/* rowmeta_hash_row - Hash the contents of a row
+ *
+ * Rows with the same contents have the same hash; rows with different
+ * hashes have different contents.
+ *
+ * Parameters:
+ *  - row: The row
+ *
+ * Returns: Hash of the row (never 0)
+ */
+uint32_t rowmeta_hash_row(const erow_t *row);
+
+
+/* rowmeta_hash - Hash the contents of a row, remembering the hash
+ *
+ * The hash (see rowmeta_hash_row) is worked out the first time it is
+ * asked for, and kept until the row changes.
+ *
+ * Parameters:
+ *  - m: Metadata (in step with the rows)
+ *  - at: Row index
+ *  - row: The row
+ *
+ * Returns: Hash of the row (never 0)
+ */
+uint32_t rowmeta_hash(rowmeta_t *m, int at, const erow_t *row);
+
+#endif /* ROWMETA_H */
@@ -0,0 +1,564 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * rowsum.c: Running totals of a measure of each row of a buffer.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rowsum.h"
+
+/* Most rows a block can hold */
+#define ROWSUM_MAX_ROWS (2 * ROWSUM_BLOCK_ROWS)
+
+
+/* rowsum_row - Measure a row of the buffer */
+static int rowsum_row(rowsum_t *s, int row)
+{
+    return s->measure(s, buffer_row(s->buf, row));
+}
+
+
+/* rowsum_block_total - Total of the rows of a block */
+static long long rowsum_block_total(rowsum_block_t *b)
+{
+    return fenwick_prefix(&b->tree, b->num_rows);
+}
+
+
+/* rowsum_free_blocks - Free every block, leaving the sums empty */
+static void rowsum_free_blocks(rowsum_t *s)
+{
+    for (int i = 0; i < s->num_blocks; i++)
+    {
+        free(s->blocks[i].counts);
+        fenwick_free(&s->blocks[i].tree);
+    }
+    s->num_blocks = 0;
+    s->unmeasured = 0;
+    fenwick_truncate(&s->block_rows, 0);
+    fenwick_truncate(&s->block_totals, 0);
+}
+
+
+/* rowsum_lost - Give up on keeping the sums in step with the buffer,
+ *               after memory ran out (rowsum_sync will start over) */
+static void rowsum_lost(rowsum_t *s)
+{
+    rowsum_free_blocks(s);
+    s->num_rows = -1;
+}
+
+
+/* rowsum_add_blocks - Insert empty blocks
+ *
+ * Parameters:
+ *  - s: Row sum
+ *  - at: Index the first new block goes at
+ *  - n: Number of blocks
+ *  - measured: Are the new blocks measured? (see rowsum_block_t)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (nothing
+ *          is added)
+ */
+static int rowsum_add_blocks(rowsum_t *s, int at, int n, int measured)
+{
+    if (s->num_blocks + n > s->capacity)
+    {
+        int capacity = s->capacity ? s->capacity : 16;
+        while (capacity < s->num_blocks + n)
+            capacity *= 2;
+        rowsum_block_t *blocks = realloc(s->blocks, sizeof(rowsum_block_t) * capacity);
+        if (blocks == NULL)
+            return -1;
+        s->blocks = blocks;
+        s->capacity = capacity;
+    }
+
+    memmove(&s->blocks[at + n], &s->blocks[at], sizeof(rowsum_block_t) * (s->num_blocks - at));
+    for (int i = at; i < at + n; i++)
+    {
+        rowsum_block_t *b = &s->blocks[i];
+        b->counts = malloc(sizeof(int) * ROWSUM_MAX_ROWS);
+        if (b->counts == NULL)
+        {
+            for (int j = at; j < i; j++)
+                free(s->blocks[j].counts);
+            memmove(&s->blocks[at], &s->blocks[at + n],
+                    sizeof(rowsum_block_t) * (s->num_blocks - at));
+            return -1;
+        }
+        b->num_rows = 0;
+        fenwick_init(&b->tree);
+        b->measured = measured;
+    }
+    s->num_blocks += n;
+    if (!measured)
+        s->unmeasured += n;
+    return 0;
+}
+
+
+/* rowsum_drop_empty - Remove the blocks that have no rows left */
+static void rowsum_drop_empty(rowsum_t *s)
+{
+    int kept = 0;
+    for (int i = 0; i < s->num_blocks; i++)
+    {
+        rowsum_block_t *b = &s->blocks[i];
+        if (b->num_rows > 0)
+        {
+            s->blocks[kept++] = *b;
+            continue;
+        }
+        if (!b->measured)
+            s->unmeasured--;
+        free(b->counts);
+        fenwick_free(&b->tree);
+    }
+    s->num_blocks = kept;
+}
+
+
+/* rowsum_build_blocks - Rebuild the running totals of the number of
+ *                       rows and the measures of the blocks, in
+ *                       O(n / ROWSUM_BLOCK_ROWS)
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int rowsum_build_blocks(rowsum_t *s)
+{
+    fenwick_truncate(&s->block_rows, 0);
+    fenwick_truncate(&s->block_totals, 0);
+    for (int i = 0; i < s->num_blocks; i++)
+    {
+        rowsum_block_t *b = &s->blocks[i];
+        if (fenwick_append(&s->block_rows, b->num_rows) == -1 ||
+            fenwick_append(&s->block_totals, rowsum_block_total(b)) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+
+/* rowsum_locate - Find the block a row is in
+ *
+ * Parameters:
+ *  - s: Row sum (with at least one block)
+ *  - row: Row index (up to the number of rows, which is found at the
+ *    end of the last block)
+ *  - off: Output parameter to return the index of the row in its block
+ *
+ * Returns: Index of the block
+ */
+static int rowsum_locate(rowsum_t *s, int row, int *off)
+{
+    int i = fenwick_search(&s->block_rows, row);
+    if (i >= s->num_blocks)
+        i = s->num_blocks - 1;
+    *off = row - (int)fenwick_prefix(&s->block_rows, i);
+    return i;
+}
+
+
+/* rowsum_measure_block - Measure the rows of a block, if they haven't
+ *                        been since rowsum_invalidate
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated (the sums
+ *          are then out of step, see rowsum_lost)
+ */
+static int rowsum_measure_block(rowsum_t *s, int i)
+{
+    rowsum_block_t *b = &s->blocks[i];
+    if (b->measured)
+        return 0;
+
+    int first = (int)fenwick_prefix(&s->block_rows, i);
+    long long old = rowsum_block_total(b);
+    for (int j = 0; j < b->num_rows; j++)
+        b->counts[j] = rowsum_row(s, first + j);
+    if (fenwick_build(&b->tree, b->counts, b->num_rows) == -1)
+    {
+        rowsum_lost(s);
+        return -1;
+    }
+    fenwick_add(&s->block_totals, i, rowsum_block_total(b) - old);
+    b->measured = 1;
+    s->unmeasured--;
+    return 0;
+}
+
+
+/* rowsum_layout - Measure every row of the buffer again
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ *          (the sums are left out of step with the buffer)
+ */
+static int rowsum_layout(rowsum_t *s)
+{
+    rowsum_lost(s);
+    int n = s->buf->num_rows;
+    if (rowsum_add_blocks(s, 0, (n + ROWSUM_BLOCK_ROWS - 1) / ROWSUM_BLOCK_ROWS, 1) == -1)
+        return -1;
+    for (int i = 0; i < n; i++)
+    {
+        rowsum_block_t *b = &s->blocks[i / ROWSUM_BLOCK_ROWS];
+        b->counts[b->num_rows++] = rowsum_row(s, i);
+    }
+    for (int i = 0; i < s->num_blocks; i++)
+    {
+        rowsum_block_t *b = &s->blocks[i];
+        if (fenwick_build(&b->tree, b->counts, b->num_rows) == -1)
+        {
+            rowsum_free_blocks(s);
+            return -1;
+        }
+    }
+    if (rowsum_build_blocks(s) == -1)
+    {
+        rowsum_free_blocks(s);
+        return -1;
+    }
+    s->num_rows = n;
+    return 0;
+}
+
+
+/* rowsum_sync - Bring the sums up to date before using them
+ *
+ * Redoes the layout if a change could not be recorded (because memory
+ * ran out).
+ *
+ * Returns: 0 on success, -1 if the sums are out of step (and empty)
+ */
+static int rowsum_sync(rowsum_t *s)
+{
+    if (s->num_rows == s->buf->num_rows)
+        return 0;
+    return rowsum_layout(s);
+}
+
+
+/* rowsum_insert - Measure rows inserted into the buffer
+ *
+ * Rows that fit in the block they go into are added to it. Otherwise
+ * the block and the new rows are spread over as many blocks as they
+ * need, of about ROWSUM_BLOCK_ROWS rows each.
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int rowsum_insert(rowsum_t *s, int at, int n)
+{
+    int i = 0, off = 0;
+    if (s->num_blocks > 0)
+        i = rowsum_locate(s, at, &off);
+
+    if (s->num_blocks > 0 && s->blocks[i].num_rows + n <= ROWSUM_MAX_ROWS)
+    {
+        rowsum_block_t *b = &s->blocks[i];
+        int appended = off == b->num_rows;
+        long long added = 0;
+        memmove(&b->counts[off + n], &b->counts[off], sizeof(int) * (b->num_rows - off));
+        for (int j = 0; j < n; j++)
+        {
+            b->counts[off + j] = rowsum_row(s, at + j);
+            added += b->counts[off + j];
+            /* Rows added at the end of a block go straight into its tree */
+            if (appended && fenwick_append(&b->tree, b->counts[off + j]) == -1)
+                return -1;
+        }
+        b->num_rows += n;
+        if (!appended && fenwick_build(&b->tree, b->counts, b->num_rows) == -1)
+            return -1;
+        fenwick_add(&s->block_rows, i, n);
+        fenwick_add(&s->block_totals, i, added);
+        return 0;
+    }
+
+    /* The rows of the block before and after the new ones */
+    int saved[ROWSUM_MAX_ROWS];
+    int old = 0, measured = 1;
+    if (s->num_blocks > 0)
+    {
+        old = s->blocks[i].num_rows;
+        measured = s->blocks[i].measured;
+        memcpy(saved, s->blocks[i].counts, sizeof(int) * old);
+    }
+
+    /* Block i is reused for the first piece */
+    int total = old + n;
+    int pieces = (total + ROWSUM_BLOCK_ROWS - 1) / ROWSUM_BLOCK_ROWS;
+    int fresh = s->num_blocks > 0 ? pieces - 1 : pieces;
+    if (rowsum_add_blocks(s, s->num_blocks > 0 ? i + 1 : 0, fresh, measured) == -1)
+        return -1;
+
+    int j = 0;
+    for (int k = 0; k < pieces; k++)
+    {
+        rowsum_block_t *b = &s->blocks[i + k];
+        int size = total / pieces + (k < total % pieces);
+        for (b->num_rows = 0; b->num_rows < size; b->num_rows++, j++)
+        {
+            if (j < off)
+                b->counts[b->num_rows] = saved[j];
+            else if (j < off + n)
+                b->counts[b->num_rows] = rowsum_row(s, at + j - off);
+            else
+                b->counts[b->num_rows] = saved[j - n];
+        }
+        if (fenwick_build(&b->tree, b->counts, b->num_rows) == -1)
+            return -1;
+    }
+    return rowsum_build_blocks(s);
+}
+
+
+/* rowsum_delete - Forget rows deleted from the buffer
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+static int rowsum_delete(rowsum_t *s, int at, int n)
+{
+    int off;
+    int i = rowsum_locate(s, at, &off);
+    int emptied = 0;
+    for (; n > 0; i++, off = 0)
+    {
+        rowsum_block_t *b = &s->blocks[i];
+        int m = b->num_rows - off < n ? b->num_rows - off : n;
+        long long removed = fenwick_prefix(&b->tree, off + m) - fenwick_prefix(&b->tree, off);
+        memmove(&b->counts[off], &b->counts[off + m], sizeof(int) * (b->num_rows - off - m));
+        b->num_rows -= m;
+        n -= m;
+        if (b->num_rows == 0)
+        {
+            emptied = 1;
+            continue;
+        }
+
+        if (off == b->num_rows)
+            fenwick_truncate(&b->tree, off);
+        else if (fenwick_build(&b->tree, b->counts, b->num_rows) == -1)
+            return -1;
+        fenwick_add(&s->block_rows, i, -m);
+        fenwick_add(&s->block_totals, i, -removed);
+    }
+
+    if (!emptied)
+        return 0;
+    rowsum_drop_empty(s);
+    return rowsum_build_blocks(s);
+}
+
+
+/* rowsum_changed - Buffer listener callback (see buffer_listener_t) */
+static void rowsum_changed(buffer_listener_t *l, buffer_t *buf,
+                           buffer_change_t change, int at, int n)
+{
+    rowsum_t *s = l->arg;
+    (void)buf;
+
+    /* Out of step since memory ran out; rowsum_sync will start over */
+    if (change != BUFFER_RESET && s->num_rows == -1)
+        return;
+
+    switch (change)
+    {
+    case BUFFER_ROW_CHANGED:
+    {
+        int off;
+        int i = rowsum_locate(s, at, &off);
+        rowsum_block_t *b = &s->blocks[i];
+        int count = rowsum_row(s, at);
+        fenwick_add(&b->tree, off, count - b->counts[off]);
+        fenwick_add(&s->block_totals, i, count - b->counts[off]);
+        b->counts[off] = count;
+        break;
+    }
+
+    case BUFFER_ROWS_INSERTED:
+        if (rowsum_insert(s, at, n) == -1)
+            rowsum_lost(s);
+        else
+            s->num_rows += n;
+        break;
+
+    case BUFFER_ROWS_DELETED:
+        if (rowsum_delete(s, at, n) == -1)
+            rowsum_lost(s);
+        else
+            s->num_rows -= n;
+        break;
+
+    case BUFFER_RESET:
+        rowsum_layout(s);
+        break;
+    }
+}
+
+
+/* See rowsum.h */
+int rowsum_init(rowsum_t *s, buffer_t *buf, rowsum_measure_t measure, void *arg)
+{
+    s->buf = buf;
+    s->measure = measure;
+    s->arg = arg;
+    s->blocks = NULL;
+    s->num_blocks = 0;
+    s->capacity = 0;
+    s->num_rows = 0;
+    fenwick_init(&s->block_rows);
+    fenwick_init(&s->block_totals);
+    s->unmeasured = 0;
+    s->refine_at = 0;
+
+    if (rowsum_layout(s) == -1)
+        return -1;
+
+    s->listener.changed = rowsum_changed;
+    s->listener.arg = s;
+    buffer_add_listener(buf, &s->listener);
+    return 0;
+}
+
+
+/* See rowsum.h */
+void rowsum_free(rowsum_t *s)
+{
+    buffer_remove_listener(s->buf, &s->listener);
+    rowsum_free_blocks(s);
+    free(s->blocks);
+    fenwick_free(&s->block_rows);
+    fenwick_free(&s->block_totals);
+    s->blocks = NULL;
+    s->capacity = 0;
+    s->num_rows = 0;
+}
+
+
+/* See rowsum.h */
+void rowsum_invalidate(rowsum_t *s)
+{
+    for (int i = 0; i < s->num_blocks; i++)
+        s->blocks[i].measured = 0;
+    s->unmeasured = s->num_blocks;
+    s->refine_at = 0;
+}
+
+
+/* See rowsum.h */
+void rowsum_measure_rows(rowsum_t *s, int first, int last)
+{
+    if (rowsum_sync(s) == -1 || s->unmeasured == 0)
+        return;
+    if (first < 0)
+        first = 0;
+    if (last >= s->num_rows)
+        last = s->num_rows - 1;
+    if (first > last)
+        return;
+
+    int off;
+    int i = rowsum_locate(s, first, &off);
+    int end = rowsum_locate(s, last, &off);
+    for (; i <= end; i++)
+        if (rowsum_measure_block(s, i) == -1)
+            return;
+}
+
+
+/* See rowsum.h */
+int rowsum_refine(rowsum_t *s, int max_rows)
+{
+    if (rowsum_sync(s) == -1)
+        return 0;
+    int done = 0;
+    while (s->unmeasured > 0 && done < max_rows)
+    {
+        if (s->refine_at >= s->num_blocks)
+            s->refine_at = 0;
+        rowsum_block_t *b = &s->blocks[s->refine_at];
+        if (!b->measured)
+        {
+            done += b->num_rows;
+            if (rowsum_measure_block(s, s->refine_at) == -1)
+                return 0;
+        }
+        s->refine_at++;
+    }
+    return s->unmeasured > 0;
+}
+
+
+/* See rowsum.h */
+int rowsum_count(rowsum_t *s, int row)
+{
+    if (rowsum_sync(s) == -1 || row < 0 || row >= s->num_rows)
+        return -1;
+    int off;
+    int i = rowsum_locate(s, row, &off);
+    if (rowsum_measure_block(s, i) == -1)
+        return -1;
+    return s->blocks[i].counts[off];
+}
+
+
+/* See rowsum.h */
+long long rowsum_prefix(rowsum_t *s, int row)
+{
+    if (rowsum_sync(s) == -1 || s->num_blocks == 0 || row <= 0)
+        return 0;
+    if (row > s->num_rows)
+        row = s->num_rows;
+    int off;
+    int i = rowsum_locate(s, row, &off);
+    return fenwick_prefix(&s->block_totals, i) + fenwick_prefix(&s->blocks[i].tree, off);
+}
+
+
+/* See rowsum.h */
+int rowsum_find(rowsum_t *s, long long total, long long *rest)
+{
+    if (total < 0)
+        total = 0;
+    for (;;)
+    {
+        if (rowsum_sync(s) == -1 || s->num_blocks == 0)
+        {
+            *rest = total;
+            return 0;
+        }
+
+        int i = fenwick_search(&s->block_totals, total);
+        if (i >= s->num_blocks)
+        {
+            *rest = total - fenwick_prefix(&s->block_totals, s->num_blocks);
+            return s->num_rows;
+        }
+
+        /* Measuring the block may move the total into another one */
+        rowsum_block_t *b = &s->blocks[i];
+        if (!b->measured)
+        {
+            rowsum_measure_block(s, i);
+            continue;
+        }
+
+        long long left = total - fenwick_prefix(&s->block_totals, i);
+        int off = fenwick_search(&b->tree, left);
+        *rest = left - fenwick_prefix(&b->tree, off);
+        return (int)fenwick_prefix(&s->block_rows, i) + off;
+    }
+}
+
+
+/* See rowsum.h */
+long long rowsum_total(rowsum_t *s)
+{
+    if (rowsum_sync(s) == -1)
+        return 0;
+    return fenwick_prefix(&s->block_totals, s->num_blocks);
+}
@@ -0,0 +1,206 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * rowsum.h: Running totals of a measure of each row of a buffer.
+ *
+ * Some questions about a buffer are about totals over the rows above
+ * a point: how many screen lines the rows above a row take up with
+ * soft wrapping (see wrap.h), or how many bytes of the file come before
+ * it (see offsets.h). A row sum caches the measure of every row and
+ * keeps their running totals in a Fenwick tree (see fenwick.h), so
+ * finding the total above a row, or the row a total falls in, takes
+ * O(log n) instead of a walk over the rows.
+ *
+ * The sum listens to its buffer: an edited row is measured again on
+ * its own. The rows are split into blocks of about ROWSUM_BLOCK_ROWS,
+ * each with a Fenwick tree of its own, and two more trees hold the
+ * number of rows and the total of each block. Inserting or deleting
+ * rows anywhere only rebuilds the tree of the block they are in (in
+ * O(ROWSUM_BLOCK_ROWS)), and the block trees when a block is split or
+ * emptied (in O(n / ROWSUM_BLOCK_ROWS)), so an edit in the middle of
+ * a large buffer never rebuilds the whole index.
+ *
+ * When the measure changes (e.g., the screen is resized), the sum can
+ * be invalidated instead of measured again: each block keeps its old
+ * measures as an estimate until it is measured, which happens when one
+ * of its rows is asked for, when a range of rows is (e.g., the rows on
+ * the screen), or bit by bit with rowsum_refine.
+ */
+
+#ifndef ROWSUM_H
+#define ROWSUM_H
+
+#include "buffer.h"
+#include "fenwick.h"
+
+/* Number of rows in a block of a row sum (a block is split in two
+ * when it grows to twice this size) */
+#define ROWSUM_BLOCK_ROWS (1024)
+
+struct rowsum;
+
+/* Measure of a row (at least 0) */
+typedef int (*rowsum_measure_t)(struct rowsum *s, erow_t *row);
+
+/* Consecutive rows of a row sum */
+typedef struct rowsum_block
+{
+    /* Measure of each row (room for 2 * ROWSUM_BLOCK_ROWS), and their
+     * running totals */
+    int *counts;
+    int num_rows;
+    fenwick_t tree;
+
+    /* Have the rows been measured since rowsum_invalidate? (If not,
+     * counts holds their old measures, as an estimate) */
+    int measured;
+} rowsum_block_t;
+
+/* Running totals over a buffer */
+typedef struct rowsum
+{
+    /* Buffer being measured, how to measure a row, and an argument for
+     * the measure's own use */
+    buffer_t *buf;
+    rowsum_measure_t measure;
+    void *arg;
+
+    /* Blocks of rows, in order, and the number of rows (-1 if the sums
+     * are out of step with the buffer, because memory ran out) */
+    rowsum_block_t *blocks;
+    int num_blocks;
+    int capacity;
+    int num_rows;
+
+    /* Running totals of the number of rows, and of the measures, of
+     * each block */
+    fenwick_t block_rows;
+    fenwick_t block_totals;
+
+    /* Number of blocks that haven't been measured since
+     * rowsum_invalidate, and where rowsum_refine looks for one next */
+    int unmeasured;
+    int refine_at;
+
+    /* Registered with the buffer */
+    buffer_listener_t listener;
+} rowsum_t;
+
+
+/* rowsum_init - Start measuring a buffer
+ *
+ * Measures every row of the buffer, and keeps the sums up to date as
+ * the buffer changes, until rowsum_free is called.
+ *
+ * Parameters:
+ *  - s: Row sum
+ *  - buf: Buffer (must stay at the same address until rowsum_free)
+ *  - measure: How to measure a row
+ *  - arg: Passed through to the measure, in s->arg
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+int rowsum_init(rowsum_t *s, buffer_t *buf, rowsum_measure_t measure, void *arg);
+
+
+/* rowsum_free - Stop measuring a buffer
+ *
+ * Parameters:
+ *  - s: Row sum
+ *
+ * Returns: Nothing
+ */
+void rowsum_free(rowsum_t *s);
+
+
+/* rowsum_invalidate - Note that something the measure depends on has
+ *                     changed
+ *
+ * Takes O(n / ROWSUM_BLOCK_ROWS): nothing is measured yet, and the old
+ * measures stand in for the new ones until their blocks are measured.
+ *
+ * Parameters:
+ *  - s: Row sum
+ *
+ * Returns: Nothing
+ */
+void rowsum_invalidate(rowsum_t *s);
+
+
+/* rowsum_measure_rows - Make sure some rows have been measured since
+ *                       rowsum_invalidate
+ *
+ * Parameters:
+ *  - s: Row sum
+ *  - first, last: Range of rows (clamped to the buffer)
+ *
+ * Returns: Nothing
+ */
+void rowsum_measure_rows(rowsum_t *s, int first, int last);
+
+
+/* rowsum_refine - Measure some of the rows that haven't been measured
+ *                 since rowsum_invalidate
+ *
+ * Parameters:
+ *  - s: Row sum
+ *  - max_rows: About how many rows to measure
+ *
+ * Returns: 1 if there are rows left to measure, 0 otherwise
+ */
+int rowsum_refine(rowsum_t *s, int max_rows);
+
+
+/* rowsum_count - Measure of a row (measured first, if it hasn't been
+ *                since rowsum_invalidate)
+ *
+ * Parameters:
+ *  - s: Row sum
+ *  - row: Row index
+ *
+ * Returns: The measure, or -1 if the row is out of range
+ */
+int rowsum_count(rowsum_t *s, int row);
+
+
+/* rowsum_prefix - Total of the rows above a row
+ *
+ * Parameters:
+ *  - s: Row sum
+ *  - row: Row index (up to the number of rows, for the total of the
+ *    whole buffer)
+ *
+ * Returns: Total of the rows [0, row)
+ */
+long long rowsum_prefix(rowsum_t *s, int row);
+
+
+/* rowsum_find - Find the row a running total falls in
+ *
+ * The row found is measured first, if it hasn't been since
+ * rowsum_invalidate.
+ *
+ * Parameters:
+ *  - s: Row sum
+ *  - total: Running total
+ *  - rest: Output parameter to return how far into the row the total
+ *    is (past the end of the buffer, how far past the end it is)
+ *
+ * Returns: Index of the row whose range [prefix, prefix + count)
+ *          contains the total (the number of rows if it's past the end)
+ */
+int rowsum_find(rowsum_t *s, long long total, long long *rest);
+
+
+/* rowsum_total - Total of every row of the buffer
+ *
+ * Parameters:
+ *  - s: Row sum
+ *
+ * Returns: The total
+ */
+long long rowsum_total(rowsum_t *s);
+
+#endif /* ROWSUM_H */
@@ -15,6 +15,9 @@
 
 #include "common.h"
 #include "editor.h"
+#include "highlight.h"
+#include "utf8.h"
+#include "trace.h"
 
 
 /* We define a simple "screen" type that represents the contents of the screen
@@ -25,16 +28,47 @@ typedef struct screen
 {
     char *buf;
     int len;
+    int capacity;
 } screen_t;
 
 
 /* Macro to initialize a dynamic string */
 #define SCREEN_INIT \
     {               \
-        NULL, 0     \
+        NULL, 0, 0  \
     }
 
 
+/* screen_reserve - Make room at the end of the screen
+ *
+ * The caller writes directly into the returned space, and then
+ * adds the number of bytes it wrote to screen->len.
+ *
+ * Parameters:
+ *  - screen: The screen
+ *  - len: Number of bytes to make room for
+ * 
+ * Returns: Pointer to the free space, or NULL if it could not be allocated
+ */
+char *screen_reserve(screen_t *screen, int len)
+{
+    if (screen->len + len > screen->capacity)
+    {
+        /* Grow geometrically, since a frame is built from many small
+         * appends */
+        int capacity = screen->capacity ? screen->capacity : 256;
+        while (capacity < screen->len + len)
+            capacity *= 2;
+        char *new = realloc(screen->buf, capacity);
+        if (new == NULL)
+            return NULL;
+        screen->buf = new;
+        screen->capacity = capacity;
+    }
+    return &screen->buf[screen->len];
+}
+
+
 /* screen_append - Append to the screen
  *
  * Parameters:
@@ -46,11 +80,10 @@ typedef struct screen
  */
 void screen_append(screen_t *screen, const char *s, int len)
 {
-    char *new = realloc(screen->buf, screen->len + len);
-    if (new == NULL)
+    char *dest = screen_reserve(screen, len);
+    if (dest == NULL)
         return;
-    memcpy(&new[screen->len], s, len);
-    screen->buf = new;
+    memcpy(dest, s, len);
     screen->len += len;
 }
 
@@ -68,6 +101,42 @@ void screen_free(screen_t *screen)
 }
 
 
+/* screen_scroll_wrapped - Update the row offsets in soft wrap mode
+ *
+ * Works in screen lines rather than rows, so the cursor is kept in view
+ * even on a row that is taller than the screen.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ * 
+ * Returns: Nothing
+ */
+static void screen_scroll_wrapped(editor_ctx_t *ctx)
+{
+    /* The rows that can end up on the screen are wrapped at this width
+     * first (after a resize, the rest are wrapped later) */
+    wrap_measure_rows(ctx->wrap, ctx->cy - ctx->screen_rows, ctx->cy + ctx->screen_rows);
+    wrap_measure_rows(ctx->wrap, ctx->rowoff, ctx->rowoff + ctx->screen_rows);
+
+    int seg = 0, start = 0;
+    if (ctx->cy < ctx->buf->num_rows)
+        seg = editor_row_wrap_segment(buffer_row(ctx->buf, ctx->cy), ctx->screen_cols,
+                                      ctx->rx, &start);
+
+    long long line = wrap_line(ctx->wrap, ctx->cy) + seg;
+    long long top = wrap_line(ctx->wrap, ctx->rowoff) + ctx->segoff;
+    if (line < top)
+        top = line;
+    if (line >= top + ctx->screen_rows)
+        top = line - ctx->screen_rows + 1;
+
+    ctx->rowoff = wrap_find(ctx->wrap, top, &ctx->segoff);
+    ctx->coloff = 0;
+    ctx->screen_cy = (int)(line - top);
+    ctx->screen_cx = ctx->rx - start;
+}
+
+
 /* screen_scroll - Update the row/column offsets based on the cursor
  *
  * Parameters:
@@ -78,9 +147,15 @@ void screen_free(screen_t *screen)
 void screen_scroll(editor_ctx_t *ctx)
 {
     ctx->rx = 0;
-    if (ctx->cy < ctx->num_rows)
+    if (ctx->cy < ctx->buf->num_rows)
     {
-        ctx->rx = editor_row_cx2rx(&ctx->rows[ctx->cy], ctx->cx);
+        ctx->rx = editor_row_cx2rx(buffer_row(ctx->buf, ctx->cy), ctx->cx);
+    }
+
+    if (ctx->wrap)
+    {
+        screen_scroll_wrapped(ctx);
+        return;
     }
 
     if (ctx->cy < ctx->rowoff)
@@ -99,81 +174,303 @@ void screen_scroll(editor_ctx_t *ctx)
     {
         ctx->coloff = ctx->rx - ctx->screen_cols + 1;
     }
+    ctx->segoff = 0;
+    ctx->screen_cy = ctx->cy - ctx->rowoff;
+    ctx->screen_cx = ctx->rx - ctx->coloff;
+}
+
+
+/* screen_draw_highlighted - Draw part of a highlighted row
+ *
+ * Consecutive characters of the same color are appended together,
+ * with a color escape only where the color changes.
+ *
+ * Parameters:
+ *  - screen: Editor screen
+ *  - row: Editor row (its highlighting must be up to date)
+ *  - at: First byte of render to draw
+ *  - len: Number of bytes to draw
+ * 
+ * Returns: Nothing
+ */
+void screen_draw_highlighted(screen_t *screen, erow_t *row, int at, int len)
+{
+    const char *render = editor_row_rendered(row, NULL);
+    int current_color = -1;
+    int j = 0;
+    while (j < len)
+    {
+        int start = j;
+        unsigned char hl = row->hl[at + j];
+        while (j < len && row->hl[at + j] == hl)
+            j++;
+
+        int color = hl == HL_NORMAL ? -1 : highlight_color(hl);
+        if (color != current_color)
+        {
+            char esc[16];
+            int esclen = color == -1 ? snprintf(esc, sizeof(esc), "\x1b[39m")
+                                     : snprintf(esc, sizeof(esc), "\x1b[%dm", color);
+            screen_append(screen, esc, esclen);
+            current_color = color;
+        }
+        screen_append(screen, &render[at + start], j - start);
+    }
+    if (current_color != -1)
+        screen_append(screen, "\x1b[39m", 5);
 }
 
 
-/* screen_draw_rows - Draws the editor rows
+/* screen_draw_row - Draw one screen line of an editor row
  *
  * Parameters:
  *  - ctx: Editor context object
  *  - screen: Editor screen
+ *  - row: Editor row
+ *  - col: Column of the rendered row to start at
  * 
  * Returns: Nothing
  */
-void screen_draw_rows(editor_ctx_t *ctx, screen_t *screen)
+static void screen_draw_row(editor_ctx_t *ctx, screen_t *screen, erow_t *row, int col)
 {
-    int y;
-    for (y = 0; y < ctx->screen_rows; y++)
+    if (row->flags & (ROW_VIEW | ROW_LONG))
     {
-        int filerow = y + ctx->rowoff;
-        if (filerow >= ctx->num_rows)
+        /* Views and long rows have no render, so expand them straight
+         * into the screen */
+        char *dest = screen_reserve(screen, ctx->screen_cols * UTF8_MAX_BYTES);
+        if (dest)
+            screen->len += editor_row_render_slice(row, col, ctx->screen_cols, dest);
+        return;
+    }
+    int start, end;
+    int pad = editor_row_visible(row, col, ctx->screen_cols, &start, &end);
+    while (pad--)
+        screen_append(screen, " ", 1);
+    if (row->flags & ROW_HL_VALID)
+        screen_draw_highlighted(screen, row, start, end - start);
+    else
+        screen_append(screen, &editor_row_rendered(row, NULL)[start], end - start);
+}
+
+
+/* screen_draw_cursors - Draw the extra cursors of the focused pane
+ *                       that are on a line
+ *
+ * The terminal only shows the main cursor, so the others are drawn
+ * over the text, in reverse video.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - screen: Editor screen
+ *  - row: Editor row shown on the line
+ *  - filerow: Index of the row
+ *  - col, end: Columns of the rendered row shown on the line
+ *
+ * Returns: Nothing
+ */
+static void screen_draw_cursors(editor_ctx_t *ctx, screen_t *screen, erow_t *row,
+                                int filerow, int col, int end)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+
+    /* The cursors are sorted, so find the first one on the row */
+    int lo = 0, hi = pane->num_cursors;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (pane->cursors[mid].cy < filerow)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (int i = lo; i < pane->num_cursors && pane->cursors[i].cy == filerow; i++)
+    {
+        int cx = pane->cursors[i].cx;
+        if (cx > row->size)
+            continue;
+        int rx = editor_row_cx2rx(row, cx);
+        if (rx < col || rx >= end)
+            continue;
+
+        /* A whole wide character, but only the first column of a tab */
+        int width = 1;
+        if (cx < row->size && editor_row_chars(row)[cx] != '\t')
+            width = editor_row_cx2rx(row, editor_row_next_char(row, cx)) - rx;
+        if (width > end - rx)
+            width = end - rx;
+
+        char esc[32];
+        int esclen = snprintf(esc, sizeof(esc), "\x1b[%dG\x1b[7m", pane->left + rx - col + 1);
+        screen_append(screen, esc, esclen);
+        if (cx < row->size)
         {
-            if (ctx->num_rows == 0 && y == ctx->screen_rows / 3)
-            {
-                char welcome[80];
-                int welcomelen = snprintf(welcome, sizeof(welcome),
-                                          "Micro editor -- version %s", MICRO_VERSION);
-                if (welcomelen > ctx->screen_cols)
-                    welcomelen = ctx->screen_cols;
-                int padding = (ctx->screen_cols - welcomelen) / 2;
-                if (padding)
-                {
-                    screen_append(screen, "~", 1);
-                    padding--;
-                }
-                while (padding--)
-                    screen_append(screen, " ", 1);
-                screen_append(screen, welcome, welcomelen);
-            }
-            else
+            char *dest = screen_reserve(screen, width * UTF8_MAX_BYTES);
+            if (dest)
+                screen->len += editor_row_render_slice(row, rx, width, dest);
+        }
+        else
+        {
+            screen_append(screen, " ", 1);
+        }
+        screen_append(screen, "\x1b[m", 3);
+    }
+}
+
+
+/* screen_draw_line - Draw a line of text of the focused pane
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - screen: Editor screen
+ *  - y: Line of the pane
+ *  - filerow, seg: Row (and segment of the row, in soft wrap mode)
+ *    shown on the line, which are moved on to the next line
+ *
+ * Returns: Nothing
+ */
+static void screen_draw_line(editor_ctx_t *ctx, screen_t *screen, int y, int *filerow, int *seg)
+{
+    if (*filerow >= ctx->buf->num_rows)
+    {
+        if (ctx->buf->num_rows == 0 && y == ctx->screen_rows / 3)
+        {
+            char welcome[80];
+            int welcomelen = snprintf(welcome, sizeof(welcome),
+                                      "Micro editor -- version %s", MICRO_VERSION);
+            if (welcomelen > ctx->screen_cols)
+                welcomelen = ctx->screen_cols;
+            int padding = (ctx->screen_cols - welcomelen) / 2;
+            if (padding)
             {
                 screen_append(screen, "~", 1);
+                padding--;
             }
+            while (padding--)
+                screen_append(screen, " ", 1);
+            screen_append(screen, welcome, welcomelen);
         }
         else
         {
-            int len = ctx->rows[filerow].rsize - ctx->coloff;
-            if (len < 0)
-                len = 0;
-            if (len > ctx->screen_cols)
-                len = ctx->screen_cols;
-            screen_append(screen, &ctx->rows[filerow].render[ctx->coloff], len);
+            screen_append(screen, "~", 1);
         }
-        screen_append(screen, "\x1b[K", 3);
-        screen_append(screen, "\r\n", 2);
+    }
+    else if (ctx->wrap)
+    {
+        erow_t *row = buffer_row(ctx->buf, *filerow);
+        int col = editor_row_wrap_start(row, ctx->screen_cols, *seg);
+        screen_draw_row(ctx, screen, row, col);
+        int last = *seg + 1 >= wrap_count(ctx->wrap, *filerow);
+        if (ctx->panes[ctx->pane]->num_cursors > 0)
+        {
+            int end = last ? col + ctx->screen_cols
+                           : editor_row_wrap_start(row, ctx->screen_cols, *seg + 1);
+            screen_draw_cursors(ctx, screen, row, *filerow, col, end);
+        }
+        if (last)
+        {
+            (*filerow)++;
+            *seg = 0;
+        }
+        else
+        {
+            (*seg)++;
+        }
+    }
+    else
+    {
+        erow_t *row = buffer_row(ctx->buf, *filerow);
+        screen_draw_row(ctx, screen, row, ctx->coloff);
+        if (ctx->panes[ctx->pane]->num_cursors > 0)
+            screen_draw_cursors(ctx, screen, row, *filerow, ctx->coloff,
+                                ctx->coloff + ctx->screen_cols);
+        (*filerow)++;
     }
 }
 
 
-/* editor_draw_status_bar - Draw the status bar
+/* screen_status_prepend - Put some text in front of the right-hand side
+ *                         of the status bar, if there's room
+ *
+ * Parameters:
+ *  - rstatus: Right-hand side of the status bar
+ *  - size: Size of rstatus
+ *  - rlen: Length of rstatus (updated)
+ *  - text: Text to put in front
+ *  - room: Number of columns the right-hand side can take up
+ *
+ * Returns: 1 if the text fit, 0 if it didn't (leaving rstatus as it was)
+ */
+static int screen_status_prepend(char *rstatus, size_t size, int *rlen, const char *text, int room)
+{
+    int tlen = strlen(text);
+    if (*rlen + tlen > room || *rlen + tlen >= (int)size)
+        return 0;
+    memmove(rstatus + tlen, rstatus, *rlen + 1);
+    memcpy(rstatus, text, tlen);
+    *rlen += tlen;
+    return 1;
+}
+
+
+/* editor_draw_status_bar - Draw the status bar of the focused pane
  *
  * Parameters:
  *  - ctx: Editor context object
  *  - screen: Editor screen
+ *  - focused: Does the pane actually have the focus? (Panes are drawn
+ *    by giving each of them the focus in turn)
  * 
  * Returns: Nothing
  */
-void screen_draw_status_bar(editor_ctx_t *ctx, screen_t *screen)
+void screen_draw_status_bar(editor_ctx_t *ctx, screen_t *screen, int focused)
 {
-    screen_append(screen, "\x1b[7m", 4);
-    char status[80], rstatus[80];
-    int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
-                       ctx->filename ? ctx->filename : "[No Name]", ctx->num_rows,
-                       ctx->dirty ? "(modified)" : "");
+    /* The panes that don't have the focus are dimmed */
+    if (focused)
+        screen_append(screen, "\x1b[7m", 4);
+    else
+        screen_append(screen, "\x1b[2;7m", 6);
+    char status[80], rstatus[160], bufnum[24] = "", mode[24];
+    if (ctx->num_buffers > 1)
+        snprintf(bufnum, sizeof(bufnum), "[%d/%d] ", ctx->current + 1, ctx->num_buffers);
+    compress_reader_t *reader = ctx->buffers[ctx->current]->reader;
+    if (reader)
+        snprintf(mode, sizeof(mode), "[loading %d%%] ", compress_progress(reader));
+    else
+        snprintf(mode, sizeof(mode), "%s%s", ctx->buf->pager ? "[paged] " : "",
+                 ctx->buf->readonly ? "[read-only] " : "");
+    int len = snprintf(status, sizeof(status), "%s%.20s - %d lines %s%s%s", bufnum,
+                       ctx->buf->filename ? ctx->buf->filename : "[No Name]", ctx->buf->num_rows,
+                       mode, ctx->buf->dirty ? "(modified)" : "",
+                       ctx->recording ? " [recording]" : "");
     int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d",
-                        ctx->cy + 1, ctx->num_rows);
+                        ctx->cy + 1, ctx->buf->num_rows);
     if (len > ctx->screen_cols)
         len = ctx->screen_cols;
+
+    /* The byte offset of the cursor goes first, if there's room, then
+     * the counts of the whole buffer (with its size, if the offset
+     * didn't give it) */
+    int room = ctx->screen_cols - len;
+    char part[96];
+    long long offset, total;
+    int has_offset = editor_cursor_offset(ctx, &offset, &total) == 0;
+    int fits = 1;
+    if (has_offset)
+    {
+        snprintf(part, sizeof(part), "byte %lld of %lld | ", offset, total);
+        fits = screen_status_prepend(rstatus, sizeof(rstatus), &rlen, part, room);
+    }
+    if (fits)
+    {
+        const stats_t *st = &ctx->buf->stats;
+        if (has_offset)
+            snprintf(part, sizeof(part), "%lld words, %lld chars | ", st->words, st->chars);
+        else
+            snprintf(part, sizeof(part), "%lld bytes, %lld words, %lld chars | ",
+                     st->bytes, st->words, st->chars);
+        screen_status_prepend(rstatus, sizeof(rstatus), &rlen, part, room);
+    }
     screen_append(screen, status, len);
     while (len < ctx->screen_cols)
     {
@@ -189,7 +486,6 @@ void screen_draw_status_bar(editor_ctx_t *ctx, screen_t *screen)
         }
     }
     screen_append(screen, "\x1b[m", 3);
-    screen_append(screen, "\r\n", 2);
 }
 
 
@@ -203,37 +499,196 @@ void screen_draw_status_bar(editor_ctx_t *ctx, screen_t *screen)
  */
 void screen_draw_message_bar(editor_ctx_t *ctx, screen_t *screen)
 {
+    char pos[32];
+    snprintf(pos, sizeof(pos), "\x1b[%d;1H", ctx->window_rows);
+    screen_append(screen, pos, strlen(pos));
     screen_append(screen, "\x1b[K", 3);
     int msglen = strlen(ctx->statusmsg);
-    if (msglen > ctx->screen_cols)
-        msglen = ctx->screen_cols;
+    if (msglen > ctx->window_cols)
+        msglen = ctx->window_cols;
     if (msglen && time(NULL) - ctx->statusmsg_time < 5)
         screen_append(screen, ctx->statusmsg, msglen);
 }
 
 
+/* screen_put_line - Put a line of a pane on the screen, unless it's
+ *                   already there
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - screen: Editor screen
+ *  - pane: Pane
+ *  - y: Line of the pane (its number of rows for the status bar)
+ *  - line: What the line should show
+ *
+ * Returns: Nothing
+ */
+static void screen_put_line(editor_ctx_t *ctx, screen_t *screen, pane_t *pane, int y,
+                            const screen_t *line)
+{
+    pane_line_t *drawn = &pane->drawn[y];
+    if (drawn->text && drawn->len == line->len && memcmp(drawn->text, line->buf, line->len) == 0)
+        return;
+
+    /* Erase the old line, without touching the panes to its right (and
+     * before drawing, since the line can move the terminal's cursor
+     * back, see screen_draw_cursors) */
+    char esc[48];
+    int esclen = snprintf(esc, sizeof(esc), "\x1b[%d;%dH", pane->top + y + 1, pane->left + 1);
+    if (pane->left + pane->cols < ctx->window_cols)
+        esclen += snprintf(esc + esclen, sizeof(esc) - esclen, "\x1b[%dX", pane->cols);
+    else
+        esclen += snprintf(esc + esclen, sizeof(esc) - esclen, "\x1b[K");
+    screen_append(screen, esc, esclen);
+    screen_append(screen, line->buf, line->len);
+
+    char *text = realloc(drawn->text, line->len + 1);
+    if (text == NULL)
+    {
+        /* We'll just draw it again next time */
+        free(drawn->text);
+        drawn->text = NULL;
+        return;
+    }
+    memcpy(text, line->buf, line->len);
+    drawn->text = text;
+    drawn->len = line->len;
+}
+
+
+/* screen_draw_pane - Draw the focused pane
+ *
+ * Only the lines that differ from what the pane last drew are put on
+ * the screen. If neither the buffer nor the offsets changed since, the
+ * text isn't even looked at, only the status bar.
+ *
+ * Parameters:
+ *  - ctx: Editor context object
+ *  - screen: Editor screen
+ *  - focused: Does the pane actually have the focus? (see
+ *    screen_draw_status_bar)
+ *
+ * Returns: Nothing
+ */
+static void screen_draw_pane(editor_ctx_t *ctx, screen_t *screen, int focused)
+{
+    pane_t *pane = ctx->panes[ctx->pane];
+    if (pane->drawn == NULL)
+    {
+        pane->drawn = calloc(pane->rows + 1, sizeof(pane_line_t));
+        if (pane->drawn == NULL)
+            return;
+    }
+
+    screen_t line = SCREEN_INIT;
+    if (pane->damaged || pane->drawn_rowoff != ctx->rowoff ||
+        pane->drawn_coloff != ctx->coloff || pane->drawn_segoff != ctx->segoff)
+    {
+        highlight_update(ctx->buf, ctx->rowoff, ctx->rowoff + ctx->screen_rows - 1);
+
+        int filerow = ctx->rowoff;
+        int seg = ctx->segoff;
+        for (int y = 0; y < ctx->screen_rows; y++)
+        {
+            line.len = 0;
+            screen_draw_line(ctx, &line, y, &filerow, &seg);
+            screen_put_line(ctx, screen, pane, y, &line);
+        }
+        pane->drawn_rowoff = ctx->rowoff;
+        pane->drawn_coloff = ctx->coloff;
+        pane->drawn_segoff = ctx->segoff;
+        pane->damaged = 0;
+    }
+
+    line.len = 0;
+    screen_draw_status_bar(ctx, &line, focused);
+    screen_put_line(ctx, screen, pane, ctx->screen_rows, &line);
+    screen_free(&line);
+}
+
+
+/* screen_draw_separators - Draw the columns between side by side panes
+ *
+ * Parameters:
+ *  - layout: Layout (sub)tree
+ *  - screen: Editor screen
+ *
+ * Returns: Nothing
+ */
+static void screen_draw_separators(pane_layout_t *layout, screen_t *screen)
+{
+    if (layout->pane)
+        return;
+    if (layout->side_by_side)
+    {
+        int col = layout->second->left;
+        for (int y = 0; y < layout->rows; y++)
+        {
+            char esc[32];
+            int esclen = snprintf(esc, sizeof(esc), "\x1b[%d;%dH|", layout->top + y + 1, col);
+            screen_append(screen, esc, esclen);
+        }
+    }
+    screen_draw_separators(layout->first, screen);
+    screen_draw_separators(layout->second, screen);
+}
+
+
 /* See screen.h */
 void screen_refresh(editor_ctx_t *ctx)
 {
-    screen_scroll(ctx);
+    /* Each pane is scrolled and drawn while it has the focus, since
+     * that's where the editor keeps the cursor and offsets of the pane */
+    int focus = ctx->pane;
+    int cursor_y = 0, cursor_x = 0;
 
+    TRACE_BEGIN(TRACE_SCROLL);
+    for (int i = 0; i < ctx->num_panes; i++)
+    {
+        editor_focus_pane(ctx, i);
+        screen_scroll(ctx);
+        if (i == focus)
+        {
+            cursor_y = ctx->panes[i]->top + ctx->screen_cy;
+            cursor_x = ctx->panes[i]->left + ctx->screen_cx;
+        }
+    }
+    TRACE_END(TRACE_SCROLL);
+
+    TRACE_BEGIN(TRACE_RENDER);
     screen_t screen = SCREEN_INIT;
 
     screen_append(&screen, "\x1b[?25l", 6);
-    screen_append(&screen, "\x1b[H", 3);
 
-    screen_draw_rows(ctx, &screen);
-    screen_draw_status_bar(ctx, &screen);
+    /* After the layout changes, start from a blank screen */
+    if (ctx->repaint)
+    {
+        screen_append(&screen, "\x1b[2J", 4);
+        for (int i = 0; i < ctx->num_panes; i++)
+            pane_invalidate(ctx->panes[i]);
+        screen_draw_separators(ctx->layout, &screen);
+        ctx->repaint = 0;
+    }
+
+    for (int i = 0; i < ctx->num_panes; i++)
+    {
+        editor_focus_pane(ctx, i);
+        screen_draw_pane(ctx, &screen, i == focus);
+    }
+    editor_focus_pane(ctx, focus);
+
     screen_draw_message_bar(ctx, &screen);
 
     char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (ctx->cy - ctx->rowoff) + 1,
-             (ctx->rx - ctx->coloff) + 1);
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", cursor_y + 1, cursor_x + 1);
     screen_append(&screen, buf, strlen(buf));
 
     screen_append(&screen, "\x1b[?25h", 6);
+    TRACE_END(TRACE_RENDER);
 
+    TRACE_BEGIN(TRACE_WRITE);
     write(STDOUT_FILENO, screen.buf, screen.len);
+    TRACE_END(TRACE_WRITE);
 
     screen_free(&screen);
 }
@@ -0,0 +1,366 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * sort.c: Sorting lines, removing duplicate lines, and reversing their
+ * order.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "parallel.h"
+#include "sort.h"
+
+/* Most runs sorted on threads of their own before they are merged */
+#define SORT_MAX_RUNS (PARALLEL_MAX_THREADS)
+
+/* Ranges this short are sorted by insertion */
+#define SORT_INSERTION_ROWS (16)
+
+/* A row being sorted: its first 8 bytes (as a big-endian number, padded
+ * with zeros), and its index */
+typedef struct sort_item
+{
+    uint64_t prefix;
+    int index;
+} sort_item_t;
+
+/* Work shared by the threads of sort_lines */
+typedef struct sort_job
+{
+    /* The rows being sorted */
+    const erow_t *rows;
+
+    /* Where each run starts (bounds[runs] is the number of rows) */
+    int bounds[SORT_MAX_RUNS + 1];
+    int runs;
+
+    /* The runs, and where the next round of merging puts them */
+    sort_item_t *from;
+    sort_item_t *to;
+} sort_job_t;
+
+/* Work shared by the threads of sort_unique_lines */
+typedef struct sort_hash_job
+{
+    /* Metadata of the buffer's rows, to keep the hashes in (NULL to
+     * just hash the rows) */
+    rowmeta_t *meta;
+    const erow_t *rows;
+    int at;
+    uint32_t *hashes;
+} sort_hash_job_t;
+
+
+/* sort_check - Check that rows of a buffer can be reordered
+ *
+ * Returns: 0 if they can, -1 if they can't (with errno set, as
+ *          buffer_permute_rows would)
+ */
+static int sort_check(buffer_t *buf, int at, int n)
+{
+    if (buf->readonly || buf->pager)
+    {
+        errno = buf->readonly ? EROFS : EINVAL;
+        return -1;
+    }
+    if (at < 0 || n < 0 || at + n > buf->num_rows)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+
+/* sort_prefix - The first 8 bytes of a row, as a number that compares
+ *               as they do */
+static uint64_t sort_prefix(const erow_t *row)
+{
+    const char *chars = editor_row_chars(row);
+    uint64_t prefix = 0;
+    for (int i = 0; i < 8; i++)
+        prefix = prefix << 8 | (i < row->size ? (unsigned char)chars[i] : 0);
+    return prefix;
+}
+
+
+/* sort_compare - Compare two rows being sorted
+ *
+ * Returns: A negative number, 0 or a positive number if the row of a
+ *          comes before, is the same as, or comes after the row of b
+ */
+static int sort_compare(const erow_t *rows, const sort_item_t *a, const sort_item_t *b)
+{
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+    const erow_t *x = &rows[a->index], *y = &rows[b->index];
+    int c = memcmp(editor_row_chars(x), editor_row_chars(y), x->size < y->size ? x->size : y->size);
+    if (c != 0)
+        return c;
+    return (x->size > y->size) - (x->size < y->size);
+}
+
+
+/* sort_merge - Merge two sorted ranges into out (keeping their order
+ *              where rows are the same) */
+static void sort_merge(const erow_t *rows, const sort_item_t *a, int na,
+                       const sort_item_t *b, int nb, sort_item_t *out)
+{
+    int i = 0, j = 0, k = 0;
+    while (i < na && j < nb)
+        out[k++] = sort_compare(rows, &b[j], &a[i]) < 0 ? b[j++] : a[i++];
+    memcpy(&out[k], &a[i], sizeof(sort_item_t) * (na - i));
+    memcpy(&out[k + na - i], &b[j], sizeof(sort_item_t) * (nb - j));
+}
+
+
+/* sort_run - Sort a range of items in place, using tmp (as long as the
+ *            range) as scratch space */
+static void sort_run(const erow_t *rows, sort_item_t *items, sort_item_t *tmp, int n)
+{
+    if (n <= SORT_INSERTION_ROWS)
+    {
+        for (int i = 1; i < n; i++)
+        {
+            sort_item_t item = items[i];
+            int j = i;
+            for (; j > 0 && sort_compare(rows, &item, &items[j - 1]) < 0; j--)
+                items[j] = items[j - 1];
+            items[j] = item;
+        }
+        return;
+    }
+
+    int half = n / 2;
+    sort_run(rows, items, tmp, half);
+    sort_run(rows, items + half, tmp + half, n - half);
+    if (sort_compare(rows, &items[half - 1], &items[half]) <= 0)
+        return;
+    sort_merge(rows, items, half, items + half, n - half, tmp);
+    memcpy(items, tmp, sizeof(sort_item_t) * n);
+}
+
+
+/* sort_runs - Sort the runs [start, end) (see parallel_for) */
+static void sort_runs(void *arg, int start, int end)
+{
+    sort_job_t *job = arg;
+    for (int r = start; r < end; r++)
+    {
+        int first = job->bounds[r], last = job->bounds[r + 1];
+        for (int i = first; i < last; i++)
+        {
+            job->from[i].prefix = sort_prefix(&job->rows[i]);
+            job->from[i].index = i;
+        }
+        sort_run(job->rows, job->from + first, job->to + first, last - first);
+    }
+}
+
+
+/* sort_merge_pairs - Merge the pairs of runs [start, end) (see
+ *                    parallel_for); a run left without a pair is
+ *                    copied as it is */
+static void sort_merge_pairs(void *arg, int start, int end)
+{
+    sort_job_t *job = arg;
+    for (int p = start; p < end; p++)
+    {
+        int first = job->bounds[2 * p], middle = job->bounds[2 * p + 1];
+        if (2 * p + 1 == job->runs)
+        {
+            memcpy(&job->to[first], &job->from[first], sizeof(sort_item_t) * (middle - first));
+            continue;
+        }
+        int last = job->bounds[2 * p + 2];
+        sort_merge(job->rows, &job->from[first], middle - first,
+                   &job->from[middle], last - middle, &job->to[first]);
+    }
+}
+
+
+/* See sort.h */
+int sort_lines(buffer_t *buf, int at, int n)
+{
+    if (sort_check(buf, at, n) == -1)
+        return -1;
+    if (n < 2)
+        return 0;
+
+    sort_item_t *items = malloc(sizeof(sort_item_t) * n);
+    sort_item_t *tmp = malloc(sizeof(sort_item_t) * n);
+    int *order = malloc(sizeof(int) * n);
+    if (items == NULL || tmp == NULL || order == NULL)
+    {
+        free(items);
+        free(tmp);
+        free(order);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    sort_job_t job;
+    job.rows = &buf->rows[at];
+    job.runs = n / SORT_CHUNK_ROWS;
+    if (job.runs > SORT_MAX_RUNS)
+        job.runs = SORT_MAX_RUNS;
+    if (job.runs < 1)
+        job.runs = 1;
+    for (int r = 0; r <= job.runs; r++)
+        job.bounds[r] = (int)((long long)n * r / job.runs);
+    job.from = items;
+    job.to = tmp;
+    parallel_for(job.runs, 1, sort_runs, &job);
+
+    /* Each round of merging halves the number of runs */
+    while (job.runs > 1)
+    {
+        int pairs = (job.runs + 1) / 2;
+        parallel_for(pairs, 1, sort_merge_pairs, &job);
+        for (int p = 0; p < pairs; p++)
+            job.bounds[p] = job.bounds[2 * p];
+        job.bounds[pairs] = n;
+        job.runs = pairs;
+        sort_item_t *swap = job.from;
+        job.from = job.to;
+        job.to = swap;
+    }
+
+    /* Rows that are in order already are left alone */
+    int moved = 0;
+    for (int i = 0; i < n; i++)
+    {
+        order[i] = job.from[i].index;
+        moved |= order[i] != i;
+    }
+    free(items);
+    free(tmp);
+
+    int rc = moved ? buffer_permute_rows(buf, at, n, order) : 0;
+    free(order);
+    return rc;
+}
+
+
+/* sort_hash_rows - Hash the rows [start, end) (see parallel_for) */
+static void sort_hash_rows(void *arg, int start, int end)
+{
+    sort_hash_job_t *job = arg;
+    for (int i = start; i < end; i++)
+    {
+        int at = job->at + i;
+        job->hashes[i] = job->meta ? rowmeta_hash(job->meta, at, &job->rows[at])
+                                   : rowmeta_hash_row(&job->rows[at]);
+    }
+}
+
+
+/* See sort.h */
+int sort_unique_lines(buffer_t *buf, int at, int n)
+{
+    if (sort_check(buf, at, n) == -1)
+        return -1;
+    if (n < 2)
+        return 0;
+
+    /* An open-addressing table of the rows kept so far, at least twice
+     * as large as the number of rows */
+    int bits = 1;
+    while ((1LL << bits) < 2LL * n)
+        bits++;
+    size_t size = (size_t)1 << bits;
+    uint32_t *hashes = malloc(sizeof(uint32_t) * n);
+    int *table = malloc(sizeof(int) * size);
+    int *order = malloc(sizeof(int) * n);
+    if (hashes == NULL || table == NULL || order == NULL)
+    {
+        free(hashes);
+        free(table);
+        free(order);
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(table, -1, sizeof(int) * size);
+
+    /* The first hash brings the buffer's metadata up to date, so the
+     * threads only fill in hashes of their own rows. If it couldn't be
+     * (for lack of memory), they hash the rows without keeping the
+     * hashes, rather than each trying to build it again */
+    buffer_row_hash(buf, at);
+    int have_meta = !buf->line_offsets && buf->meta.num_rows == buf->num_rows;
+    sort_hash_job_t job = {have_meta ? &buf->meta : NULL, buf->rows, at, hashes};
+    parallel_for(n, SORT_CHUNK_ROWS, sort_hash_rows, &job);
+
+    /* The rows kept go first, in order, and the duplicates after them */
+    const erow_t *rows = &buf->rows[at];
+    int kept = 0, dropped = 0;
+    for (int i = 0; i < n; i++)
+    {
+        size_t slot = (uint32_t)(hashes[i] * 2654435761u) >> (32 - bits);
+        int duplicate = 0;
+        for (; table[slot] != -1; slot = (slot + 1) & (size - 1))
+        {
+            int j = table[slot];
+            if (hashes[j] == hashes[i] && rows[j].size == rows[i].size &&
+                memcmp(editor_row_chars(&rows[j]), editor_row_chars(&rows[i]), rows[i].size) == 0)
+            {
+                duplicate = 1;
+                break;
+            }
+        }
+        if (duplicate)
+        {
+            order[n - 1 - dropped++] = i;
+            continue;
+        }
+        table[slot] = i;
+        order[kept++] = i;
+    }
+    free(hashes);
+    free(table);
+
+    /* The duplicates were put at the end backwards */
+    for (int i = 0; i < dropped / 2; i++)
+    {
+        int swap = order[kept + i];
+        order[kept + i] = order[n - 1 - i];
+        order[n - 1 - i] = swap;
+    }
+
+    int rc = 0;
+    if (dropped > 0)
+    {
+        rc = buffer_permute_rows(buf, at, n, order);
+        if (rc == 0)
+            buffer_delete_rows(buf, at + kept, dropped);
+    }
+    free(order);
+    return rc == -1 ? -1 : dropped;
+}
+
+
+/* See sort.h */
+int sort_reverse_lines(buffer_t *buf, int at, int n)
+{
+    if (sort_check(buf, at, n) == -1)
+        return -1;
+    if (n < 2)
+        return 0;
+
+    int *order = malloc(sizeof(int) * n);
+    if (order == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (int i = 0; i < n; i++)
+        order[i] = n - 1 - i;
+    int rc = buffer_permute_rows(buf, at, n, order);
+    free(order);
+    return rc;
+}
@@ -0,0 +1,72 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * sort.h: Sorting lines, removing duplicate lines, and reversing their
+ * order.
+ *
+ * These work out a new order for the rows and hand it to
+ * buffer_permute_rows, which moves the rows themselves (not their
+ * contents) and records the order for undo. Sorting is a merge sort:
+ * runs of rows are sorted on threads of their own, then merged in
+ * pairs, each pair on a thread. Rows are compared by their first 8
+ * bytes (kept next to each row's index, so most comparisons don't touch
+ * the rows at all), then by the rest. Duplicates are found by the hashes
+ * of the rows (see buffer_row_hash), worked out in parallel.
+ *
+ * Only buffers that are entirely in memory can be sorted.
+ */
+
+#ifndef SORT_H
+#define SORT_H
+
+#include "buffer.h"
+
+/* Fewest rows worth sorting (or hashing) on a thread of their own */
+#define SORT_CHUNK_ROWS (16384)
+
+
+/* sort_lines - Sort consecutive rows
+ *
+ * Rows are compared byte by byte (as `LC_ALL=C sort` does), a row that
+ * is the start of another coming first.
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Index of the first row
+ *  - n: Number of rows
+ *
+ * Returns: 0 on success, -1 on error (with errno set, see
+ *          buffer_permute_rows)
+ */
+int sort_lines(buffer_t *buf, int at, int n);
+
+
+/* sort_unique_lines - Remove the rows that are the same as an earlier
+ *                     one (wherever it is), keeping the others in order
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Index of the first row
+ *  - n: Number of rows
+ *
+ * Returns: Number of rows removed, or -1 on error (with errno set, see
+ *          buffer_permute_rows)
+ */
+int sort_unique_lines(buffer_t *buf, int at, int n);
+
+
+/* sort_reverse_lines - Reverse the order of consecutive rows
+ *
+ * Parameters:
+ *  - buf: Buffer
+ *  - at: Index of the first row
+ *  - n: Number of rows
+ *
+ * Returns: 0 on success, -1 on error (with errno set, see
+ *          buffer_permute_rows)
+ */
+int sort_reverse_lines(buffer_t *buf, int at, int n);
+
+#endif /* SORT_H */
@@ -0,0 +1,106 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * stats.c: Counting the bytes, words and characters of text.
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "stats.h"
+
+
+/* stats_is_space - Does a byte separate words? */
+static int stats_is_space(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+
+/* See stats.h */
+void stats_count(stats_t *s, const char *text, size_t len, int *in_word)
+{
+    size_t i = 0;
+    long long words = 0, chars = 0;
+    unsigned prev = *in_word ? 1 : 0;
+
+#ifdef __SSE2__
+    /* 16 bytes at a time: a mask of the bytes that start words, and
+     * one of the bytes that don't start characters, added up in a byte
+     * per lane (and into the totals before the lanes can overflow) */
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(-1);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i below_tab = _mm_set1_epi8('\t' - 1);
+    const __m128i above_cr = _mm_set1_epi8('\r' + 1);
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i cont_end = _mm_set1_epi8((char)0xc0);
+    __m128i last = prev ? ones : zero;
+    __m128i starts = zero, skipped = zero;
+    size_t vectors = 0;
+    int rounds = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                  _mm_and_si128(_mm_cmpgt_epi8(v, below_tab),
+                                                _mm_cmplt_epi8(v, above_cr)));
+
+        /* A word starts at every byte in a word after one that isn't
+         * (the byte before the first one being the last of the
+         * previous 16) */
+        __m128i word = _mm_andnot_si128(ws, ones);
+        __m128i before = _mm_or_si128(_mm_slli_si128(word, 1), _mm_srli_si128(last, 15));
+        starts = _mm_sub_epi8(starts, _mm_andnot_si128(before, word));
+        last = word;
+
+        /* Continuation bytes (0x80-0xbf) are the ones below 0xc0, as
+         * signed bytes */
+        skipped = _mm_sub_epi8(skipped, _mm_or_si128(_mm_cmplt_epi8(v, cont_end),
+                                                     _mm_cmpeq_epi8(v, newline)));
+        vectors++;
+
+        if (++rounds == 255 || i + 32 > len)
+        {
+            __m128i w = _mm_sad_epu8(starts, zero), c = _mm_sad_epu8(skipped, zero);
+            words += _mm_cvtsi128_si32(w) + _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+            chars -= _mm_cvtsi128_si32(c) + _mm_cvtsi128_si32(_mm_srli_si128(c, 8));
+            starts = skipped = zero;
+            rounds = 0;
+        }
+    }
+    chars += 16 * (long long)vectors;
+    prev = _mm_movemask_epi8(last) >> 15;
+#endif
+
+    for (; i < len; i++)
+    {
+        unsigned char c = text[i];
+        unsigned word = !stats_is_space(c);
+        words += word && !prev;
+        prev = word;
+        chars += (c & 0xc0) != 0x80 && c != '\n';
+    }
+
+    s->bytes += len;
+    s->words += words;
+    s->chars += chars;
+    *in_word = prev;
+}
+
+
+/* See stats.h */
+void stats_widen(const char *text, int len, int *from, int *to)
+{
+    if (*from < 0)
+        *from = 0;
+    if (*to > len)
+        *to = len;
+    while (*from > 0 && !stats_is_space(text[*from - 1]))
+        (*from)--;
+    while (*to < len && !stats_is_space(text[*to]))
+        (*to)++;
+}
@@ -0,0 +1,58 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * stats.h: Counting the bytes, words and characters of text.
+ *
+ * A word is a run of bytes other than ASCII whitespace, and a
+ * character is any byte that doesn't continue a UTF-8 sequence, apart
+ * from line breaks. Buffers count their text as it is loaded, and then
+ * only count the part of a row around an edit again (see buffer.h), so
+ * the totals are always up to date.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+
+/* Counts of some text */
+typedef struct stats
+{
+    long long bytes;
+    long long words;
+    long long chars;
+} stats_t;
+
+
+/* stats_count - Count the bytes, words and characters of some text
+ *
+ * Parameters:
+ *  - s: Counts to add the counts of the text to
+ *  - text: Text
+ *  - len: Length of the text
+ *  - in_word: Whether the byte before the text was part of a word (so
+ *    text can be counted in pieces); set to whether its last byte is
+ *
+ * Returns: Nothing
+ */
+void stats_count(stats_t *s, const char *text, size_t len, int *in_word);
+
+
+/* stats_widen - Widen a range of text to the whitespace around it
+ *
+ * Editing the range can only change the words that are in the widened
+ * range, so counting it before and after the edit is enough to keep
+ * the counts of the whole text up to date.
+ *
+ * Parameters:
+ *  - text: Text
+ *  - len: Length of the text
+ *  - from, to: The range (widened in place)
+ *
+ * Returns: Nothing
+ */
+void stats_widen(const char *text, int len, int *from, int *to);
+
+#endif /* STATS_H */
@@ -6,22 +6,35 @@
  * terminal.c: Lower-level terminal operations.
  */
 
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
 #include <termios.h>
 #include <stdlib.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 
 #include "common.h"
 #include "terminal.h"
+#include "trace.h"
 
 /* Used to store the terminal state when the program starts
  * (so we can restore it when it exits). Has to be a global 
  * variable because atexit() doesn't take any parameters */
 static struct termios orig_termios;
 
+/* Set by the SIGWINCH handler, and cleared by terminal_resized() */
+static volatile sig_atomic_t window_resized = 0;
+
+/* Keys read by terminal_take_key() that weren't the one it was looking
+ * for, to be returned by terminal_read_key() (oldest first) */
+static int queued_keys[TERMINAL_QUEUE_KEYS];
+static int queue_first = 0, queue_len = 0;
+
 
 /*
  * terminal_disable_raw_mode - Disables terminal raw mode
@@ -56,18 +69,17 @@ void terminal_enable_raw_mode()
         terminal_die("tcsetattr");
 }
 
-/* See terminal.h */
-int terminal_read_key()
+/* terminal_decode_key - Decode a key from its first byte
+ *
+ * Reads the rest of the escape sequence, if any, from the terminal.
+ *
+ * Parameters:
+ *  - c: First byte of the key
+ *
+ * Returns: Integer value of keypress
+ */
+static int terminal_decode_key(char c)
 {
-    int nread;
-    char c;
-
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
-    {
-        if (nread == -1 && errno != EAGAIN)
-            terminal_die("read");
-    }
-
     /* Arrow key processing */
 
     if (c == '\x1b')
@@ -143,6 +155,116 @@ int terminal_read_key()
 }
 
 
+/* terminal_read_new_key - Read a key from the terminal itself (not the
+ *                         queue) */
+static int terminal_read_new_key()
+{
+    int nread;
+    char c;
+
+    while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
+    {
+        if (nread == -1 && errno != EAGAIN)
+            terminal_die("read");
+    }
+    TRACE_INSTANT(TRACE_READ);
+
+    TRACE_BEGIN(TRACE_DECODE);
+    int key = terminal_decode_key(c);
+    TRACE_END(TRACE_DECODE);
+
+    return key;
+}
+
+
+/* See terminal.h */
+int terminal_read_key()
+{
+    if (queue_len > 0)
+    {
+        int key = queued_keys[queue_first];
+        queue_first = (queue_first + 1) % TERMINAL_QUEUE_KEYS;
+        queue_len--;
+        return key;
+    }
+    return terminal_read_new_key();
+}
+
+
+/* See terminal.h */
+int terminal_take_key(int key)
+{
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    while (queue_len < TERMINAL_QUEUE_KEYS && poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN))
+    {
+        int c = terminal_read_new_key();
+        if (c == key)
+            return 1;
+        queued_keys[(queue_first + queue_len) % TERMINAL_QUEUE_KEYS] = c;
+        queue_len++;
+    }
+    return 0;
+}
+
+
+/* See terminal.h */
+int terminal_wait(const int *fds, int nfds, int timeout_ms)
+{
+    struct pollfd pfds[1 + TERMINAL_WAIT_MAX_FDS];
+    if (queue_len > 0)
+        return 1;
+    if (nfds > TERMINAL_WAIT_MAX_FDS)
+        nfds = TERMINAL_WAIT_MAX_FDS;
+
+    pfds[0].fd = STDIN_FILENO;
+    pfds[0].events = POLLIN;
+    for (int i = 0; i < nfds; i++)
+    {
+        pfds[1 + i].fd = fds[i];
+        pfds[1 + i].events = POLLIN;
+    }
+
+    if (poll(pfds, 1 + nfds, timeout_ms) == -1)
+    {
+        if (errno != EINTR)
+            terminal_die("poll");
+        return 0;
+    }
+    return (pfds[0].revents & POLLIN) != 0;
+}
+
+
+/* terminal_handle_resize - SIGWINCH handler */
+static void terminal_handle_resize(int sig)
+{
+    (void)sig;
+    window_resized = 1;
+}
+
+
+/* See terminal.h */
+void terminal_watch_resize()
+{
+    /* No SA_RESTART, so the signal also wakes up terminal_wait() */
+    struct sigaction sa;
+    sa.sa_handler = terminal_handle_resize;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    if (sigaction(SIGWINCH, &sa, NULL) == -1)
+        terminal_die("sigaction");
+}
+
+
+/* See terminal.h */
+int terminal_resized()
+{
+    if (!window_resized)
+        return 0;
+    window_resized = 0;
+    return 1;
+}
+
+
 /* get_cursor_position - Get current position of cursor
  * 
  * Parameters:
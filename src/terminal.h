@@ -9,6 +9,12 @@
 #ifndef TERMINAL_H
 #define TERMINAL_H
 
+/* Maximum number of file descriptors terminal_wait() can wait on */
+#define TERMINAL_WAIT_MAX_FDS (4)
+
+/* Maximum number of keys terminal_take_key() keeps for later */
+#define TERMINAL_QUEUE_KEYS (256)
+
 /*
  * terminal_enable_raw_mode - Enables terminal raw mode
  * 
@@ -40,6 +46,54 @@ void terminal_enable_raw_mode();
 int terminal_read_key();
 
 
+/* terminal_take_key - Look for a key among those typed so far, without
+ *                     waiting
+ *
+ * The keys typed before it are kept, and returned by terminal_read_key()
+ * as if they had just been typed, so they aren't lost while the editor
+ * is busy (e.g. waiting for a command to finish).
+ *
+ * Parameters:
+ *  - key: Key to look for (as returned by terminal_read_key)
+ *
+ * Returns: 1 if the key was typed (it is then read), 0 otherwise
+ */
+int terminal_take_key(int key);
+
+/* terminal_wait - Wait for a key or for activity on other files
+ *
+ * Parameters:
+ *  - fds: File descriptors to wait on, besides the terminal
+ *  - nfds: Number of file descriptors in fds
+ *  - timeout_ms: Maximum time to wait, in milliseconds (-1 for no limit)
+ *
+ * Returns: 1 if a key is ready to be read, 0 otherwise (one of fds
+ *          became readable, or the timeout expired)
+ */
+int terminal_wait(const int *fds, int nfds, int timeout_ms);
+
+
+/* terminal_watch_resize - Start watching for changes to the size
+ *                         of the terminal
+ *
+ * Parameters: none
+ *
+ * Returns: Nothing
+ */
+void terminal_watch_resize();
+
+
+/* terminal_resized - Has the terminal been resized?
+ *
+ * Interrupts terminal_wait(), so this should be checked after it returns.
+ *
+ * Parameters: none
+ *
+ * Returns: 1 if the terminal was resized since the last call, 0 otherwise
+ */
+int terminal_resized();
+
+
 /* terminal_get_window_size - Returns size of terminal
  * 
  * Parameters:
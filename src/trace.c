@@ -0,0 +1,82 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * trace.c: Lightweight latency tracing of the keypress-to-frame path.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#ifdef MICRO_TRACE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/* A single trace event */
+typedef struct trace_event
+{
+    /* Monotonic timestamp, in nanoseconds */
+    uint64_t ts;
+
+    /* trace_point_t of the event */
+    unsigned char point;
+
+    /* 'B', 'E' or 'i' */
+    char phase;
+} trace_event_t;
+
+/* The ring buffer. Producers claim a slot by atomically incrementing
+ * trace_head, so recording an event never takes a lock. */
+static trace_event_t trace_ring[TRACE_RING_SIZE];
+static atomic_uint_fast64_t trace_head;
+
+/* Names of the trace points, as shown in the exported trace */
+static const char *trace_names[TRACE_NUM_POINTS] = {
+    "read", "decode", "edit", "scroll", "render", "write"};
+
+
+/* See trace.h */
+void trace_record(trace_point_t point, char phase)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint_fast64_t slot = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    trace_event_t *ev = &trace_ring[slot & (TRACE_RING_SIZE - 1)];
+    ev->ts = (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+    ev->point = point;
+    ev->phase = phase;
+}
+
+
+/* See trace.h */
+int trace_export_chrome(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+
+    uint_fast64_t head = atomic_load_explicit(&trace_head, memory_order_acquire);
+    uint_fast64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (uint_fast64_t i = first; i < head; i++)
+    {
+        trace_event_t *ev = &trace_ring[i & (TRACE_RING_SIZE - 1)];
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1%s}\n",
+                i == first ? "" : ",", trace_names[ev->point], ev->phase,
+                ev->ts / 1000.0, ev->phase == 'i' ? ",\"s\":\"t\"" : "");
+    }
+    fprintf(fp, "],\"displayTimeUnit\":\"ns\"}\n");
+
+    if (fclose(fp) == EOF)
+        return -1;
+    return 0;
+}
+
+#endif /* MICRO_TRACE */
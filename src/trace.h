@@ -0,0 +1,71 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * trace.h: Lightweight latency tracing of the keypress-to-frame path.
+ *
+ * Trace points record a monotonic timestamp into a fixed-size ring
+ * buffer, which can be exported in the Chrome trace-event JSON format
+ * (viewable in chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Tracing is only compiled in when MICRO_TRACE is defined (configure
+ * with -DMICRO_TRACE=ON); otherwise the TRACE_* macros expand to nothing.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* The stages of handling a keypress */
+typedef enum
+{
+    TRACE_READ,     /* A key arrived from the terminal */
+    TRACE_DECODE,   /* Decoding escape sequences into a key */
+    TRACE_EDIT,     /* Applying the key to the buffer */
+    TRACE_SCROLL,   /* Updating the row/column offsets */
+    TRACE_RENDER,   /* Drawing the frame into the screen buffer */
+    TRACE_WRITE,    /* Writing the frame to the terminal */
+    TRACE_NUM_POINTS
+} trace_point_t;
+
+/* Number of events kept in the ring buffer (must be a power of two) */
+#define TRACE_RING_SIZE (1 << 16)
+
+#ifdef MICRO_TRACE
+
+/* trace_record - Record a trace event
+ *
+ * Lock-free and safe to call from any thread. Once the ring buffer
+ * is full, the oldest events are overwritten.
+ *
+ * Parameters:
+ *  - point: Stage being traced
+ *  - phase: 'B' (stage begins), 'E' (stage ends) or 'i' (instant)
+ *
+ * Returns: Nothing
+ */
+void trace_record(trace_point_t point, char phase);
+
+
+/* trace_export_chrome - Write the recorded events as Chrome trace JSON
+ *
+ * Parameters:
+ *  - path: File to write
+ *
+ * Returns: 0 on success, -1 on error (with errno set)
+ */
+int trace_export_chrome(const char *path);
+
+#define TRACE_BEGIN(p) trace_record((p), 'B')
+#define TRACE_END(p) trace_record((p), 'E')
+#define TRACE_INSTANT(p) trace_record((p), 'i')
+
+#else
+
+#define TRACE_BEGIN(p) ((void)0)
+#define TRACE_END(p) ((void)0)
+#define TRACE_INSTANT(p) ((void)0)
+
+#endif /* MICRO_TRACE */
+
+#endif /* TRACE_H */
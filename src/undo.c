@@ -0,0 +1,173 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * undo.c: The undo log of a buffer.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "undo.h"
+
+
+/* See undo.h */
+void undo_init(undo_t *u)
+{
+    u->groups = NULL;
+    u->num_groups = 0;
+    u->capacity = 0;
+    u->open = 0;
+    u->failed = 0;
+}
+
+
+/* See undo.h */
+void undo_group_free(undo_group_t *group)
+{
+    for (int i = 0; i < group->num_steps; i++)
+        free(group->steps[i].text);
+    free(group->steps);
+    group->steps = NULL;
+    group->num_steps = 0;
+    group->capacity = 0;
+}
+
+
+/* undo_drop - Drop the oldest groups of the log
+ *
+ * Parameters:
+ *  - u: Undo log
+ *  - n: Number of groups to drop
+ *
+ * Returns: Nothing
+ */
+static void undo_drop(undo_t *u, int n)
+{
+    for (int i = 0; i < n; i++)
+        undo_group_free(&u->groups[i]);
+    memmove(&u->groups[0], &u->groups[n], sizeof(undo_group_t) * (u->num_groups - n));
+    u->num_groups -= n;
+}
+
+
+/* See undo.h */
+void undo_free(undo_t *u)
+{
+    undo_drop(u, u->num_groups);
+    free(u->groups);
+    undo_init(u);
+}
+
+
+/* See undo.h */
+void undo_begin(undo_t *u, int cx, int cy, int typing)
+{
+    u->open = 1;
+    u->failed = 0;
+
+    if (typing && u->num_groups > 0)
+    {
+        undo_group_t *last = &u->groups[u->num_groups - 1];
+        if (last->typing && last->end_cx == cx && last->end_cy == cy)
+            return;
+    }
+
+    if (u->num_groups == UNDO_MAX_GROUPS)
+        undo_drop(u, 1);
+    if (u->num_groups == u->capacity)
+    {
+        int capacity = u->capacity ? u->capacity * 2 : 16;
+        undo_group_t *groups = realloc(u->groups, sizeof(undo_group_t) * capacity);
+        if (groups == NULL)
+        {
+            u->failed = 1;
+            return;
+        }
+        u->groups = groups;
+        u->capacity = capacity;
+    }
+
+    undo_group_t *g = &u->groups[u->num_groups++];
+    g->steps = NULL;
+    g->num_steps = 0;
+    g->capacity = 0;
+    g->cx = g->end_cx = cx;
+    g->cy = g->end_cy = cy;
+    g->typing = typing;
+}
+
+
+/* See undo.h */
+void undo_end(undo_t *u, int cx, int cy)
+{
+    if (!u->open)
+        return;
+    u->open = 0;
+
+    if (u->failed)
+    {
+        undo_drop(u, u->num_groups);
+        return;
+    }
+    undo_group_t *g = &u->groups[u->num_groups - 1];
+    if (g->num_steps == 0)
+    {
+        undo_group_free(g);
+        u->num_groups--;
+        return;
+    }
+    g->end_cx = cx;
+    g->end_cy = cy;
+}
+
+
+/* See undo.h */
+undo_step_t *undo_add_step(undo_t *u)
+{
+    if (!u->open || u->failed)
+        return NULL;
+
+    undo_group_t *g = &u->groups[u->num_groups - 1];
+    if (g->num_steps == g->capacity)
+    {
+        int capacity = g->capacity ? g->capacity * 2 : 4;
+        undo_step_t *steps = realloc(g->steps, sizeof(undo_step_t) * capacity);
+        if (steps == NULL)
+        {
+            u->failed = 1;
+            return NULL;
+        }
+        g->steps = steps;
+        g->capacity = capacity;
+    }
+
+    undo_step_t *step = &g->steps[g->num_steps++];
+    step->kind = UNDO_ROW_CHANGED;
+    step->at = 0;
+    step->n = 1;
+    step->text = NULL;
+    step->len = 0;
+    return step;
+}
+
+
+/* See undo.h */
+undo_step_t *undo_last_step(undo_t *u)
+{
+    if (!u->open || u->failed)
+        return NULL;
+    undo_group_t *g = &u->groups[u->num_groups - 1];
+    return g->num_steps > 0 ? &g->steps[g->num_steps - 1] : NULL;
+}
+
+
+/* See undo.h */
+int undo_pop(undo_t *u, undo_group_t *group)
+{
+    if (u->open || u->num_groups == 0)
+        return 0;
+    *group = u->groups[--u->num_groups];
+    return 1;
+}
@@ -0,0 +1,172 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * undo.h: The undo log of a buffer.
+ *
+ * Changes are recorded a row at a time, as what it takes to put the
+ * row back: the old contents of a row that is changed or deleted, and
+ * the position of rows that are inserted. The steps taken by one
+ * command (a keypress, a replace...) are kept together in a group, and
+ * undone together. Nothing is recorded outside of a group, so changes
+ * that aren't the user's (such as new lines of a followed file) are
+ * not undone.
+ *
+ * The log only stores the steps; buffer_undo() applies them.
+ */
+
+#ifndef UNDO_H
+#define UNDO_H
+
+/* Most groups kept in the log (the oldest are dropped beyond that) */
+#define UNDO_MAX_GROUPS (1000)
+
+/* Kinds of undo steps */
+typedef enum
+{
+    /* Row at changed; text is what it was */
+    UNDO_ROW_CHANGED,
+
+    /* n rows were inserted at at */
+    UNDO_ROWS_INSERTED,
+
+    /* Row at was deleted; text is what it was */
+    UNDO_ROW_DELETED,
+
+    /* The n rows from at were reordered; text holds n ints, the index
+     * (from at) each row came from */
+    UNDO_ROWS_MOVED
+} undo_kind_t;
+
+/* A step */
+typedef struct undo_step
+{
+    undo_kind_t kind;
+    int at;
+    int n;
+    char *text;
+    int len;
+} undo_step_t;
+
+/* A group of steps, undone together */
+typedef struct undo_group
+{
+    undo_step_t *steps;
+    int num_steps;
+    int capacity;
+
+    /* Cursor position before and after the changes */
+    int cx, cy;
+    int end_cx, end_cy;
+
+    /* Was the group started by typing? (Typing on from where it ended
+     * adds to it, rather than starting a new group) */
+    int typing;
+} undo_group_t;
+
+/* An undo log */
+typedef struct undo
+{
+    undo_group_t *groups;
+    int num_groups;
+    int capacity;
+
+    /* Is a group being recorded? And has a step been lost (because
+     * memory ran out), so the group can't be undone? */
+    int open;
+    int failed;
+} undo_t;
+
+
+/* undo_init - Initialize an empty undo log
+ *
+ * Parameters:
+ *  - u: Undo log
+ *
+ * Returns: Nothing
+ */
+void undo_init(undo_t *u);
+
+
+/* undo_free - Empty an undo log, freeing its steps
+ *
+ * Parameters:
+ *  - u: Undo log
+ *
+ * Returns: Nothing
+ */
+void undo_free(undo_t *u);
+
+
+/* undo_begin - Start recording a group of steps
+ *
+ * Parameters:
+ *  - u: Undo log
+ *  - cx, cy: Cursor position before the changes
+ *  - typing: Is the group started by typing? If the last group was
+ *    too, and ended at cx, cy, steps are added to that group instead
+ *
+ * Returns: Nothing
+ */
+void undo_begin(undo_t *u, int cx, int cy, int typing);
+
+
+/* undo_end - Stop recording a group of steps
+ *
+ * A group with no steps is dropped. So is a group that lost a step,
+ * along with every group before it, since they can no longer be
+ * undone in order.
+ *
+ * Parameters:
+ *  - u: Undo log
+ *  - cx, cy: Cursor position after the changes
+ *
+ * Returns: Nothing
+ */
+void undo_end(undo_t *u, int cx, int cy);
+
+
+/* undo_add_step - Add a step to the group being recorded
+ *
+ * Parameters:
+ *  - u: Undo log
+ *
+ * Returns: The step to fill in (its text, if any, then belongs to the
+ *          log), or NULL if no group is being recorded or memory could
+ *          not be allocated
+ */
+undo_step_t *undo_add_step(undo_t *u);
+
+
+/* undo_last_step - The step last added to the group being recorded
+ *
+ * Parameters:
+ *  - u: Undo log
+ *
+ * Returns: The step, or NULL if there isn't one
+ */
+undo_step_t *undo_last_step(undo_t *u);
+
+
+/* undo_pop - Take the last group out of the log
+ *
+ * Parameters:
+ *  - u: Undo log
+ *  - group: Where to put the group (free it with undo_group_free)
+ *
+ * Returns: 1 if there was a group, 0 if the log is empty
+ */
+int undo_pop(undo_t *u, undo_group_t *group);
+
+
+/* undo_group_free - Free the steps of a group
+ *
+ * Parameters:
+ *  - group: Group
+ *
+ * Returns: Nothing
+ */
+void undo_group_free(undo_group_t *group);
+
+#endif /* UNDO_H */
@@ -0,0 +1,176 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * utf8.c: Decoding UTF-8 and finding how many columns characters
+ *         take up on the screen.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utf8.h"
+
+
+/* See utf8.h */
+int utf8_is_ascii(const char *s, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    /* 64 bytes at a time: OR the blocks together, and check the top
+     * bit of every byte at once */
+    for (; i + 64 <= len; i += 64)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(s + i + 48));
+        __m128i acc = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(acc))
+            return 0;
+    }
+    for (; i + 16 <= len; i += 16)
+    {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i))))
+            return 0;
+    }
+#endif
+
+    /* Eight bytes at a time */
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, s + i, 8);
+        if (word & 0x8080808080808080ULL)
+            return 0;
+    }
+
+    for (; i < len; i++)
+        if ((unsigned char)s[i] & 0x80)
+            return 0;
+    return 1;
+}
+
+
+/* See utf8.h */
+int utf8_decode(const char *s, size_t len, int *cp)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    int n, min;
+
+    if (u[0] < 0x80)
+    {
+        *cp = u[0];
+        return 1;
+    }
+    else if ((u[0] & 0xe0) == 0xc0)
+    {
+        n = 2;
+        min = 0x80;
+        *cp = u[0] & 0x1f;
+    }
+    else if ((u[0] & 0xf0) == 0xe0)
+    {
+        n = 3;
+        min = 0x800;
+        *cp = u[0] & 0x0f;
+    }
+    else if ((u[0] & 0xf8) == 0xf0)
+    {
+        n = 4;
+        min = 0x10000;
+        *cp = u[0] & 0x07;
+    }
+    else
+    {
+        *cp = -1;
+        return 1;
+    }
+
+    if ((size_t)n > len)
+    {
+        *cp = -1;
+        return 1;
+    }
+    for (int i = 1; i < n; i++)
+    {
+        if ((u[i] & 0xc0) != 0x80)
+        {
+            *cp = -1;
+            return 1;
+        }
+        *cp = (*cp << 6) | (u[i] & 0x3f);
+    }
+
+    /* Reject overlong encodings, surrogates and out of range values */
+    if (*cp < min || *cp > 0x10ffff || (*cp >= 0xd800 && *cp <= 0xdfff))
+    {
+        *cp = -1;
+        return 1;
+    }
+    return n;
+}
+
+
+/* A range of code points */
+typedef struct
+{
+    int first, last;
+} utf8_range_t;
+
+/* Combining characters (zero width) */
+static const utf8_range_t utf8_combining[] = {
+    {0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x0610, 0x061a},
+    {0x064b, 0x065f}, {0x0e31, 0x0e31}, {0x0e34, 0x0e3a}, {0x1ab0, 0x1aff},
+    {0x1dc0, 0x1dff}, {0x200b, 0x200f}, {0x20d0, 0x20ff}, {0xfe00, 0xfe0f},
+    {0xfe20, 0xfe2f}};
+
+/* East Asian wide characters and emoji (two columns) */
+static const utf8_range_t utf8_wide[] = {
+    {0x1100, 0x115f}, {0x2e80, 0x303e}, {0x3041, 0x33ff}, {0x3400, 0x4dbf},
+    {0x4e00, 0x9fff}, {0xa000, 0xa4cf}, {0xac00, 0xd7a3}, {0xf900, 0xfaff},
+    {0xfe30, 0xfe4f}, {0xff00, 0xff60}, {0xffe0, 0xffe6}, {0x1f300, 0x1f64f},
+    {0x1f900, 0x1f9ff}, {0x20000, 0x2fffd}, {0x30000, 0x3fffd}};
+
+
+/* utf8_in_ranges - Is a code point in one of a sorted list of ranges? */
+static int utf8_in_ranges(int cp, const utf8_range_t *ranges, int n)
+{
+    int lo = 0, hi = n - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cp < ranges[mid].first)
+            hi = mid - 1;
+        else if (cp > ranges[mid].last)
+            lo = mid + 1;
+        else
+            return 1;
+    }
+    return 0;
+}
+
+
+/* See utf8.h */
+int utf8_width(int cp)
+{
+    if (cp < 0x300)
+        return 1;
+    if (utf8_in_ranges(cp, utf8_combining, sizeof(utf8_combining) / sizeof(utf8_combining[0])))
+        return 0;
+    if (utf8_in_ranges(cp, utf8_wide, sizeof(utf8_wide) / sizeof(utf8_wide[0])))
+        return 2;
+    return 1;
+}
+
+
+/* See utf8.h */
+int utf8_is_continuation(char c)
+{
+    return ((unsigned char)c & 0xc0) == 0x80;
+}
@@ -0,0 +1,66 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * utf8.h: Decoding UTF-8 and finding how many columns characters
+ *         take up on the screen.
+ *
+ * Most of what we edit (and practically all of our logs) is plain
+ * ASCII, so there is a fast, vectorized check for that, and the row
+ * layer only decodes rows that fail it.
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+
+/* Maximum number of bytes in a UTF-8 encoded character */
+#define UTF8_MAX_BYTES (4)
+
+/* utf8_is_ascii - Is a string pure ASCII?
+ *
+ * Parameters:
+ *  - s: String
+ *  - len: Length of the string
+ *
+ * Returns: 1 if every byte is below 0x80, 0 otherwise
+ */
+int utf8_is_ascii(const char *s, size_t len);
+
+
+/* utf8_decode - Decode one character
+ *
+ * Parameters:
+ *  - s: String
+ *  - len: Number of bytes available (at least 1)
+ *  - cp: Output parameter to return the code point, or -1 if the
+ *    bytes are not valid UTF-8
+ *
+ * Returns: Number of bytes in the character (1 for an invalid byte)
+ */
+int utf8_decode(const char *s, size_t len, int *cp);
+
+
+/* utf8_width - Number of columns a character takes up on the screen
+ *
+ * Parameters:
+ *  - cp: Code point (or -1 for an invalid byte)
+ *
+ * Returns: 0 for combining characters, 2 for wide (e.g., CJK)
+ *          characters, 1 otherwise
+ */
+int utf8_width(int cp);
+
+
+/* utf8_is_continuation - Is a byte in the middle of a character?
+ *
+ * Parameters:
+ *  - c: Byte
+ *
+ * Returns: 1 if c is a continuation byte (10xxxxxx), 0 otherwise
+ */
+int utf8_is_continuation(char c);
+
+#endif /* UTF8_H */
@@ -0,0 +1,87 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * wrap.c: Layout of a buffer with soft line wrapping.
+ */
+
+#include "wrap.h"
+
+
+/* wrap_measure - Number of screen lines a row takes up (see
+ *                rowsum_measure_t) */
+static int wrap_measure(rowsum_t *s, erow_t *row)
+{
+    wrap_t *w = s->arg;
+    return editor_row_wrap_count(row, w->cols);
+}
+
+
+/* See wrap.h */
+int wrap_init(wrap_t *w, buffer_t *buf, int cols)
+{
+    w->cols = cols > 0 ? cols : 1;
+    return rowsum_init(&w->lines, buf, wrap_measure, w);
+}
+
+
+/* See wrap.h */
+void wrap_free(wrap_t *w)
+{
+    rowsum_free(&w->lines);
+}
+
+
+/* See wrap.h */
+void wrap_set_cols(wrap_t *w, int cols)
+{
+    w->cols = cols > 0 ? cols : 1;
+    rowsum_invalidate(&w->lines);
+}
+
+
+/* See wrap.h */
+void wrap_measure_rows(wrap_t *w, int first, int last)
+{
+    rowsum_measure_rows(&w->lines, first, last);
+}
+
+
+/* See wrap.h */
+int wrap_refine(wrap_t *w)
+{
+    return rowsum_refine(&w->lines, WRAP_REFINE_ROWS);
+}
+
+
+/* See wrap.h */
+int wrap_count(wrap_t *w, int row)
+{
+    int count = rowsum_count(&w->lines, row);
+    return count > 0 ? count : 1;
+}
+
+
+/* See wrap.h */
+long long wrap_line(wrap_t *w, int row)
+{
+    return rowsum_prefix(&w->lines, row);
+}
+
+
+/* See wrap.h */
+int wrap_find(wrap_t *w, long long line, int *seg)
+{
+    long long rest;
+    int row = rowsum_find(&w->lines, line, &rest);
+    *seg = (int)rest;
+    return row;
+}
+
+
+/* See wrap.h */
+long long wrap_total(wrap_t *w)
+{
+    return rowsum_total(&w->lines);
+}
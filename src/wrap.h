@@ -0,0 +1,152 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * wrap.h: Layout of a buffer with soft line wrapping.
+ *
+ * With soft wrapping, each row takes up one or more lines of the
+ * screen. We keep running totals of the number of screen lines of
+ * every row (see rowsum.h), so finding the screen line a row starts
+ * on, or the row a screen line belongs to, takes O(log n) instead of
+ * a walk over the rows above it. An edited row is wrapped again on
+ * its own.
+ *
+ * When the width changes, nothing is wrapped again straight away: the
+ * rows on the screen are wrapped when they are drawn (see
+ * wrap_measure_rows), and the rest a little at a time while the editor
+ * is idle (see wrap_refine). Until then, rows keep their old number of
+ * screen lines.
+ */
+
+#ifndef WRAP_H
+#define WRAP_H
+
+#include "buffer.h"
+#include "rowsum.h"
+
+/* Number of rows wrap_refine wraps again at a time */
+#define WRAP_REFINE_ROWS (1 << 15)
+
+/* Wrap index of a buffer */
+typedef struct wrap
+{
+    /* Number of screen lines of each row, and their running totals */
+    rowsum_t lines;
+
+    /* Width of the screen */
+    int cols;
+} wrap_t;
+
+
+/* wrap_init - Start laying out a buffer
+ *
+ * Wraps every row of the buffer, and keeps the index up to date as
+ * the buffer changes, until wrap_free is called. Not supported for
+ * paged buffers (wrapping every row would load the whole file).
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *  - buf: Buffer (must stay at the same address until wrap_free)
+ *  - cols: Number of columns on the screen
+ *
+ * Returns: 0 on success, -1 if memory could not be allocated
+ */
+int wrap_init(wrap_t *w, buffer_t *buf, int cols);
+
+
+/* wrap_free - Stop laying out a buffer
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *
+ * Returns: Nothing
+ */
+void wrap_free(wrap_t *w);
+
+
+/* wrap_set_cols - Change the width of the screen
+ *
+ * Takes O(n / ROWSUM_BLOCK_ROWS): the rows are wrapped again as they
+ * are needed (see wrap_measure_rows and wrap_refine).
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *  - cols: Number of columns on the screen
+ *
+ * Returns: Nothing
+ */
+void wrap_set_cols(wrap_t *w, int cols);
+
+
+/* wrap_measure_rows - Make sure some rows are wrapped at the current
+ *                     width (e.g., the rows on the screen, before
+ *                     working out which screen line each is on)
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *  - first, last: Range of rows (clamped to the buffer)
+ *
+ * Returns: Nothing
+ */
+void wrap_measure_rows(wrap_t *w, int first, int last);
+
+
+/* wrap_refine - Wrap some of the rows that haven't been since the
+ *               width changed
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *
+ * Returns: 1 if there are rows left to wrap, 0 otherwise
+ */
+int wrap_refine(wrap_t *w);
+
+
+/* wrap_count - Number of screen lines a row takes up
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *  - row: Row index
+ *
+ * Returns: Number of screen lines (at least 1)
+ */
+int wrap_count(wrap_t *w, int row);
+
+
+/* wrap_line - Find the screen line a row starts on
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *  - row: Row index (up to the number of rows, for the line
+ *    just past the end of the buffer)
+ *
+ * Returns: Screen line (counting from the top of the buffer)
+ */
+long long wrap_line(wrap_t *w, int row);
+
+
+/* wrap_find - Find the row a screen line belongs to
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *  - line: Screen line (counting from the top of the buffer)
+ *  - seg: Output parameter to return the segment of the row the
+ *    line shows (see editor_row_wrap_start). For lines past the end
+ *    of the buffer, how far past the end they are.
+ *
+ * Returns: Row index (the number of rows for lines past the end)
+ */
+int wrap_find(wrap_t *w, long long line, int *seg);
+
+
+/* wrap_total - Total number of screen lines in the buffer
+ *
+ * Parameters:
+ *  - w: Wrap index
+ *
+ * Returns: Number of screen lines
+ */
+long long wrap_total(wrap_t *w);
+
+#endif /* WRAP_H */
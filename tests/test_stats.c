@@ -0,0 +1,336 @@
+/*
+ * micro - A minimal text editor
+ *
+ * Based on kilo: https://viewsourcecode.org/snaptoken/kilo/
+ *
+ * test_stats.c: Tests of the counts of bytes, words and characters.
+ *
+ * stats_count is checked against a plain byte-by-byte count on random
+ * text (of every length up to a few vectors, at every alignment, and
+ * long enough for the vector loop to flush its lanes), whole and cut
+ * into pieces. Then a buffer is edited at random, in every way that
+ * changes its text, and its running counts are checked against a count
+ * of the whole text after every edit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "sort.h"
+#include "stats.h"
+
+/* Number of random edits made to the small buffer */
+#define TEST_EDITS (4000)
+
+/* Number of rows of the large buffer (enough for buffer_replace_all to
+ * use several threads) */
+#define TEST_LARGE_ROWS (3 * BUFFER_REPLACE_CHUNK_ROWS)
+
+/* Pieces random text is made of: ASCII words, every kind of ASCII
+ * whitespace, UTF-8 sequences of every length, and bytes around the
+ * ranges the vector loop compares against */
+static const char *const test_pieces[] = {
+    "a", "word", "x1", " ", "  ", "\t", "\v", "\f", "\r", "\x08", "\x0e",
+    "\x1f", "!", "\x7f", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+    "\x80", "\xbf", "\xc0", "\xff",
+};
+#define TEST_NUM_PIECES (int)(sizeof(test_pieces) / sizeof(test_pieces[0]))
+
+/* State of the random number generator (xorshift64) */
+static uint64_t test_seed = 0x2545f4914f6cdd1dULL;
+
+/* Number of failed checks */
+static int test_failures = 0;
+
+
+/* test_random - A random number in [0, n) */
+static int test_random(int n)
+{
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 7;
+    test_seed ^= test_seed << 17;
+    return (int)(test_seed % (uint64_t)n);
+}
+
+
+/* test_text - Fill a string with random text
+ *
+ * Parameters:
+ *  - s: String (at least len + 1 bytes)
+ *  - len: Length of the text
+ *  - newlines: Can the text hold line breaks?
+ *
+ * Returns: Nothing
+ */
+static void test_text(char *s, int len, int newlines)
+{
+    /* Some texts are mostly words, some mostly whitespace */
+    int spaces = test_random(3);
+    int i = 0;
+    while (i < len)
+    {
+        const char *piece = test_pieces[test_random(TEST_NUM_PIECES)];
+        if (spaces == 0 && piece[0] == ' ')
+            piece = "word";
+        else if (spaces == 2 && test_random(2))
+            piece = " ";
+        if (newlines && test_random(40) == 0)
+            piece = "\n";
+        int n = strlen(piece);
+        if (n > len - i)
+            n = len - i;
+        memcpy(s + i, piece, n);
+        i += n;
+    }
+    s[len] = '\0';
+}
+
+
+/* test_reference - Count text one byte at a time, as stats_count does
+ *                  without vectors */
+static void test_reference(stats_t *s, const char *text, size_t len, int *in_word)
+{
+    int prev = *in_word;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = text[i];
+        int word = !(c == ' ' || (c >= '\t' && c <= '\r'));
+        s->words += word && !prev;
+        prev = word;
+        s->chars += (c & 0xc0) != 0x80 && c != '\n';
+    }
+    s->bytes += len;
+    *in_word = prev;
+}
+
+
+/* test_check - Check that two counts (and word states) are the same */
+static void test_check(const char *what, const stats_t *got, int got_in_word,
+                       const stats_t *want, int want_in_word)
+{
+    if (got->bytes == want->bytes && got->words == want->words &&
+        got->chars == want->chars && got_in_word == want_in_word)
+        return;
+    printf("%s: got %lld bytes, %lld words, %lld chars (in word: %d), "
+           "expected %lld, %lld, %lld (%d)\n",
+           what, got->bytes, got->words, got->chars, got_in_word,
+           want->bytes, want->words, want->chars, want_in_word);
+    test_failures++;
+}
+
+
+/* test_count - Check stats_count on some text, whole and in pieces */
+static void test_count(const char *what, const char *text, size_t len)
+{
+    for (int start = 0; start < 2; start++)
+    {
+        stats_t got = {0, 0, 0}, want = {0, 0, 0};
+        int got_in_word = start, want_in_word = start;
+        stats_count(&got, text, len, &got_in_word);
+        test_reference(&want, text, len, &want_in_word);
+        test_check(what, &got, got_in_word, &want, want_in_word);
+
+        /* The same text counted in random pieces */
+        stats_t pieces = {0, 0, 0};
+        int in_word = start;
+        for (size_t i = 0; i < len;)
+        {
+            size_t n = 1 + test_random(len - i < 100 ? (int)(len - i) : 100);
+            stats_count(&pieces, text + i, n, &in_word);
+            i += n;
+        }
+        test_check(what, &pieces, in_word, &want, want_in_word);
+    }
+}
+
+
+/* test_kernel - Check stats_count against the reference count */
+static void test_kernel(void)
+{
+    static char text[70000 + 16];
+
+    /* Every short length, at every alignment */
+    for (int len = 0; len <= 80; len++)
+    {
+        for (int align = 0; align < 16; align++)
+        {
+            test_text(text + align, len, 1);
+            test_count("short text", text + align, len);
+        }
+    }
+
+    /* Long texts, past where the lanes of the vector loop are added
+     * into the totals (every 255 vectors) */
+    for (int k = 0; k < 200; k++)
+    {
+        int len = test_random(k < 20 ? 16 * 255 * 2 + 64 : 70000);
+        int align = test_random(16);
+        test_text(text + align, len, 1);
+        test_count("long text", text + align, len);
+    }
+
+    /* Text that is all whitespace, or has no whitespace at all */
+    memset(text, ' ', 5000);
+    test_count("all spaces", text, 5000);
+    memset(text, 'w', 5000);
+    test_count("one word", text, 5000);
+    memset(text, 0x80, 5000);
+    test_count("continuation bytes", text, 5000);
+}
+
+
+/* test_recount - Check the running counts of a buffer against a count
+ *                of its whole text */
+static void test_recount(const char *what, buffer_t *buf)
+{
+    int len;
+    char *text = buffer_to_string(buf, &len);
+    if (text == NULL)
+    {
+        printf("%s: out of memory\n", what);
+        exit(1);
+    }
+    stats_t want = {0, 0, 0};
+    int in_word = 0;
+    test_reference(&want, text, len, &in_word);
+    free(text);
+    test_check(what, &buf->stats, 0, &want, 0);
+}
+
+
+/* test_edit - Make a random edit to a buffer (undone together) */
+static void test_edit(buffer_t *buf)
+{
+    char text[200];
+    int rows = buf->num_rows;
+    int at = rows ? test_random(rows) : 0;
+    int size = rows ? buffer_row(buf, at)->size : 0;
+    int op = rows ? test_random(12) : 5;
+    int cx, cy;
+
+    if (op == 11)
+    {
+        buffer_undo(buf, &cx, &cy);
+        return;
+    }
+
+    undo_begin(&buf->undo, 0, 0, 0);
+    switch (op)
+    {
+    case 0:
+        test_text(text, 1, 0);
+        buffer_row_insert_char(buf, at, test_random(size + 1), text[0]);
+        break;
+    case 1:
+        if (size > 0)
+            buffer_row_delete_char(buf, at, test_random(size));
+        break;
+    case 2:
+        test_text(text, test_random(20), 0);
+        buffer_row_append_string(buf, at, text, strlen(text));
+        break;
+    case 3:
+        buffer_row_truncate(buf, at, test_random(size + 1));
+        break;
+    case 4:
+    {
+        /* Up to 3 ranges, sorted and apart */
+        erow_edit_t edits[3];
+        int n = 0;
+        for (int from = 0; n < 3 && from <= size; n++)
+        {
+            edits[n].at = from + test_random(size - from + 1);
+            edits[n].len = test_random(size - edits[n].at + 1) / 2;
+            from = edits[n].at + edits[n].len + 1;
+        }
+        test_text(text, test_random(6), 0);
+        buffer_row_splice(buf, at, edits, n, text, strlen(text));
+        break;
+    }
+    case 5:
+        test_text(text, test_random(40), 0);
+        buffer_insert_row(buf, test_random(rows + 1), text, strlen(text));
+        break;
+    case 6:
+        test_text(text, 1 + test_random(150), 1);
+        buffer_insert_lines(buf, test_random(rows + 1), text, strlen(text));
+        break;
+    case 7:
+        buffer_delete_rows(buf, at, 1 + test_random(rows - at < 5 ? rows - at : 5));
+        break;
+    case 8:
+    {
+        static const char *const queries[] = {"a", " ", "word", "\xc3\xa9", "\t"};
+        static const char *const withs[] = {"", " ", "x y", "\xe2\x82\xac", "ab"};
+        buffer_replace_all(buf, queries[test_random(5)], withs[test_random(5)]);
+        break;
+    }
+    case 9:
+        sort_unique_lines(buf, 0, rows);
+        break;
+    case 10:
+        sort_lines(buf, at, test_random(rows - at + 1));
+        break;
+    }
+    undo_end(&buf->undo, 0, 0);
+}
+
+
+/* test_buffer - Check the running counts of buffers through random
+ *               edits */
+static void test_buffer(void)
+{
+    static char text[TEST_LARGE_ROWS * 40];
+    buffer_t buf;
+
+    buffer_init(&buf);
+    test_text(text, 4000, 1);
+    buffer_insert_lines(&buf, 0, text, strlen(text));
+    test_recount("loaded", &buf);
+    for (int k = 0; k < TEST_EDITS && test_failures == 0; k++)
+    {
+        test_edit(&buf);
+        test_recount("edited", &buf);
+    }
+    buffer_free(&buf);
+
+    /* Replacing on several threads, and undoing it */
+    buffer_init(&buf);
+    for (int i = 0; i < TEST_LARGE_ROWS; i++)
+    {
+        test_text(text, test_random(38), 0);
+        buffer_insert_row(&buf, i, text, strlen(text));
+    }
+    test_recount("large", &buf);
+    for (int k = 0; k < 6; k++)
+    {
+        int cx, cy;
+        undo_begin(&buf.undo, 0, 0, 0);
+        buffer_replace_all(&buf, k % 2 ? " " : "a", k % 3 ? "\xc3\xa9 " : "");
+        undo_end(&buf.undo, 0, 0);
+        test_recount("large, replaced", &buf);
+        if (k % 2)
+        {
+            buffer_undo(&buf, &cx, &cy);
+            test_recount("large, undone", &buf);
+        }
+    }
+    buffer_free(&buf);
+}
+
+
+int main(void)
+{
+    test_kernel();
+    test_buffer();
+    if (test_failures > 0)
+    {
+        printf("%d checks failed\n", test_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}